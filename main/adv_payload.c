@@ -0,0 +1,52 @@
+#include "adv_payload.h"
+
+#include <string.h>
+
+#include "host/ble_hs.h"
+
+void adv_payload_init(adv_payload_t* payload) { payload->len = 0; }
+
+int adv_payload_add(adv_payload_t* payload, uint8_t type, const void* value,
+                    size_t value_len) {
+  // Length byte, type byte, value.
+  if (value_len + 2 > (size_t)(ADV_PAYLOAD_MAX_LEN - payload->len)) {
+    return BLE_HS_EMSGSIZE;
+  }
+
+  uint8_t* out = &payload->data[payload->len];
+  out[0] = (uint8_t)(value_len + 1);
+  out[1] = type;
+  memcpy(&out[2], value, value_len);
+  payload->len += (uint8_t)(value_len + 2);
+  return 0;
+}
+
+int adv_payload_add_name(adv_payload_t* payload, const char* name) {
+  size_t room = ADV_PAYLOAD_MAX_LEN - payload->len;
+  if (room <= 2) {
+    return BLE_HS_EMSGSIZE;
+  }
+
+  size_t name_len = strlen(name);
+  uint8_t type = BLE_HS_ADV_TYPE_COMP_NAME;
+  if (name_len > room - 2) {
+    name_len = room - 2;
+    type = BLE_HS_ADV_TYPE_INCOMP_NAME;
+  }
+  return adv_payload_add(payload, type, name, name_len);
+}
+
+uint8_t* adv_payload_find(adv_payload_t* payload, uint8_t type) {
+  size_t pos = 0;
+  while (pos + 1 < payload->len) {
+    uint8_t ad_len = payload->data[pos];
+    if (ad_len == 0 || pos + 1 + ad_len > payload->len) {
+      return NULL;
+    }
+    if (payload->data[pos + 1] == type) {
+      return &payload->data[pos + 2];
+    }
+    pos += 1 + ad_len;
+  }
+  return NULL;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Legacy advertising and scan response PDUs carry at most 31 bytes.
+#define ADV_PAYLOAD_MAX_LEN 31
+
+// Raw AD structures, built once and handed to the controller as is.
+typedef struct adv_payload {
+  uint8_t data[ADV_PAYLOAD_MAX_LEN];
+  uint8_t len;
+} adv_payload_t;
+
+void adv_payload_init(adv_payload_t* payload);
+
+// Appends one AD structure. Returns BLE_HS_EMSGSIZE if it doesn't fit.
+int adv_payload_add(adv_payload_t* payload, uint8_t type, const void* value,
+                    size_t value_len);
+
+// Appends the complete local name, or as much of it as fits as a shortened
+// name.
+int adv_payload_add_name(adv_payload_t* payload, const char* name);
+
+// Value of the first AD structure of `type`, for patching in place, or NULL
+// if there is none.
+uint8_t* adv_payload_find(adv_payload_t* payload, uint8_t type);
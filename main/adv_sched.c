@@ -0,0 +1,32 @@
+#include "adv_sched.h"
+
+static const adv_sched_step_t steps[] = {
+    // High duty cycle directed advertising is capped at 1.28 s by the spec.
+    [ADV_SCHED_DIRECTED] = {.phase = ADV_SCHED_DIRECTED,
+                            .itvl_min = 0,
+                            .itvl_max = 0,
+                            .duration_ms = 1280},
+    // 20 ms for 30 s, the fastest interval hosts scan reliably at.
+    [ADV_SCHED_FAST] = {.phase = ADV_SCHED_FAST,
+                        .itvl_min = 32,
+                        .itvl_max = 32,
+                        .duration_ms = 30000},
+    // 1022.5 ms, one of the intervals Apple recommends for accessories.
+    [ADV_SCHED_SLOW] = {.phase = ADV_SCHED_SLOW,
+                        .itvl_min = 1636,
+                        .itvl_max = 1636,
+                        .duration_ms = ADV_SCHED_FOREVER},
+};
+
+const adv_sched_step_t* adv_sched_begin(adv_sched_t* sched,
+                                        bool has_bonded_peer) {
+  sched->phase = has_bonded_peer ? ADV_SCHED_DIRECTED : ADV_SCHED_FAST;
+  return &steps[sched->phase];
+}
+
+const adv_sched_step_t* adv_sched_advance(adv_sched_t* sched) {
+  if (sched->phase != ADV_SCHED_SLOW) {
+    sched->phase++;
+  }
+  return &steps[sched->phase];
+}
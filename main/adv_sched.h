@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ADV_SCHED_FOREVER INT32_MAX
+
+// Reconnect advertising phases, in the order they run after a link drops.
+typedef enum {
+  ADV_SCHED_DIRECTED,
+  ADV_SCHED_FAST,
+  ADV_SCHED_SLOW,
+} adv_sched_phase_t;
+
+typedef struct adv_sched_step {
+  adv_sched_phase_t phase;
+  // Advertising interval in 0.625 ms units; unused for high duty cycle
+  // directed advertising, which the controller runs at <= 3.75 ms.
+  uint16_t itvl_min;
+  uint16_t itvl_max;
+  int32_t duration_ms;
+} adv_sched_step_t;
+
+typedef struct adv_sched {
+  adv_sched_phase_t phase;
+} adv_sched_t;
+
+// Starts a new schedule. Directed advertising is skipped when there is no
+// bonded peer to target.
+const adv_sched_step_t* adv_sched_begin(adv_sched_t* sched,
+                                        bool has_bonded_peer);
+
+// Moves to the next phase once the current one timed out. The slow phase
+// runs forever, so it is returned again if it ever ends.
+const adv_sched_step_t* adv_sched_advance(adv_sched_t* sched);
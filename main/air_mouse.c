@@ -0,0 +1,126 @@
+#include "air_mouse.h"
+
+#include <string.h>
+
+#include "air_mouse_filter.h"
+#include "ble_hid.h"
+#include "ble_hid_data.h"
+#include "board_i2c.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mpu6886.h"
+
+static const char* TAG = "AIR_MOUSE";
+
+#define AIR_MOUSE_SAMPLE_HZ 500
+// Pointer travel per degree the stick is turned.
+#define AIR_MOUSE_COUNTS_PER_DEG 20
+#define AIR_MOUSE_GAIN_Q16                        \
+  (AIR_MOUSE_COUNTS_PER_DEG * 65536 * 10 /       \
+   (MPU6886_GYRO_LSB_PER_DPS_X10 * AIR_MOUSE_SAMPLE_HZ))
+
+// Held upright with the screen towards the user: turning left/right spins
+// around the long (Y) axis, tilting up/down around X.
+#define AIR_MOUSE_YAW_AXIS MPU6886_AXIS_Y
+#define AIR_MOUSE_PITCH_AXIS MPU6886_AXIS_X
+
+static air_mouse_filter_t filter;  // sampler task only
+static air_mouse_accum_t accum;
+static TaskHandle_t sampler_task;
+static esp_timer_handle_t sample_timer;
+
+static bool air_mouse_peek(uint8_t* data, void* arg) {
+  int8_t delta[AIR_MOUSE_AXIS_COUNT];
+  if (!air_mouse_accum_peek(&accum, delta)) {
+    return false;
+  }
+
+  const ble_mouse_report_t report = {
+      .x = delta[AIR_MOUSE_AXIS_X],
+      .y = delta[AIR_MOUSE_AXIS_Y],
+  };
+  memcpy(data, &report, sizeof(report));
+  return true;
+}
+
+static void air_mouse_commit(const uint8_t* data, void* arg) {
+  ble_mouse_report_t report;
+  memcpy(&report, data, sizeof(report));
+  const int8_t delta[AIR_MOUSE_AXIS_COUNT] = {report.x, report.y};
+  air_mouse_accum_commit(&accum, delta);
+}
+
+static const ble_hid_report_source_t mouse_source = {
+    .peek = air_mouse_peek,
+    .commit = air_mouse_commit,
+};
+
+static int16_t negate16(int16_t value) {
+  return value == INT16_MIN ? INT16_MAX : (int16_t)-value;
+}
+
+// The tick is 10 ms, so an esp_timer paces the samples instead of a delay.
+static void air_mouse_sample_cb(void* arg) { xTaskNotifyGive(sampler_task); }
+
+static void air_mouse_task(void* param) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    int16_t gyro[MPU6886_AXIS_COUNT];
+    if (mpu6886_read_gyro(gyro) != ESP_OK) {
+      continue;
+    }
+
+    // Positive gyro rates turn left and tilt up; HID wants right and down.
+    const int16_t rate[AIR_MOUSE_AXIS_COUNT] = {
+        [AIR_MOUSE_AXIS_X] = negate16(gyro[AIR_MOUSE_YAW_AXIS]),
+        [AIR_MOUSE_AXIS_Y] = negate16(gyro[AIR_MOUSE_PITCH_AXIS]),
+    };
+    int32_t motion_q16[AIR_MOUSE_AXIS_COUNT];
+    air_mouse_filter_step(&filter, rate, motion_q16);
+    if (motion_q16[AIR_MOUSE_AXIS_X] != 0 ||
+        motion_q16[AIR_MOUSE_AXIS_Y] != 0) {
+      air_mouse_accum_add(&accum, motion_q16);
+      ble_hid_report_source_ready();
+    }
+  }
+}
+
+esp_err_t air_mouse_start(void) {
+  esp_err_t err = board_i2c_init();
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  err = mpu6886_init(AIR_MOUSE_SAMPLE_HZ);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "IMU initialization failed, error: %s",
+             esp_err_to_name(err));
+    return err;
+  }
+
+  air_mouse_filter_init(&filter, AIR_MOUSE_GAIN_Q16);
+  air_mouse_accum_init(&accum);
+  if (ble_hid_set_report_source(BLE_HID_MOUSE_REPORT_ID, &mouse_source) !=
+      0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  if (xTaskCreatePinnedToCore(air_mouse_task, "air_mouse", 3072, NULL, 5,
+                              &sampler_task, 1) != pdPASS) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  const esp_timer_create_args_t timer_args = {
+      .callback = air_mouse_sample_cb,
+      .name = "air_mouse",
+  };
+  err = esp_timer_create(&timer_args, &sample_timer);
+  if (err != ESP_OK) {
+    return err;
+  }
+  return esp_timer_start_periodic(sample_timer,
+                                  1000000 / AIR_MOUSE_SAMPLE_HZ);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Samples the IMU and feeds its motion to the HID mouse report. Keep the
+// device still for a moment after start so the gyro bias can settle.
+esp_err_t air_mouse_start(void);
+
+#ifdef __cplusplus
+}
+#endif
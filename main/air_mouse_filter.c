@@ -0,0 +1,122 @@
+#include "air_mouse_filter.h"
+
+#include <string.h>
+
+void air_mouse_filter_init(air_mouse_filter_t* filter, int32_t gain_q16) {
+  memset(filter, 0, sizeof(*filter));
+  filter->gain_q16 = gain_q16;
+}
+
+static int32_t abs32(int32_t value) { return value < 0 ? -value : value; }
+
+// One single-pole step towards `target`, rounded to nearest. A plain shift
+// floors, which parks the state up to a full step below its target and turns
+// into steady drift once multiplied out.
+static int32_t approach(int32_t state, int32_t target, int shift) {
+  return state + ((target - state + (1 << (shift - 1))) >> shift);
+}
+
+void air_mouse_filter_step(air_mouse_filter_t* filter,
+                           const int16_t rate[AIR_MOUSE_AXIS_COUNT],
+                           int32_t motion_q16[AIR_MOUSE_AXIS_COUNT]) {
+  if (!filter->seeded) {
+    for (int axis = 0; axis < AIR_MOUSE_AXIS_COUNT; axis++) {
+      filter->mean_q8[axis] = (int32_t)rate[axis] << 8;
+      filter->bias_q8[axis] = filter->mean_q8[axis];
+    }
+    filter->seeded = true;
+  }
+
+  bool still = true;
+  for (int axis = 0; axis < AIR_MOUSE_AXIS_COUNT; axis++) {
+    int32_t sample_q8 = (int32_t)rate[axis] << 8;
+    filter->mean_q8[axis] = approach(filter->mean_q8[axis], sample_q8,
+                                     AIR_MOUSE_FILTER_MEAN_SHIFT);
+    still = still &&
+            abs32(sample_q8 - filter->mean_q8[axis]) <
+                (AIR_MOUSE_FILTER_STILL_LSB << 8) &&
+            abs32(filter->mean_q8[axis] - filter->bias_q8[axis]) <
+                (AIR_MOUSE_FILTER_BIAS_WINDOW_LSB << 8);
+  }
+
+  if (!still) {
+    filter->still_samples = 0;
+  } else if (filter->still_samples < AIR_MOUSE_FILTER_STILL_SAMPLES) {
+    filter->still_samples++;
+  }
+  bool track_bias = filter->still_samples >= AIR_MOUSE_FILTER_STILL_SAMPLES;
+  if (!filter->locked) {
+    // A single noisy first sample is a poor bias; take the still window's
+    // mean outright and report nothing before it.
+    for (int axis = 0; axis < AIR_MOUSE_AXIS_COUNT; axis++) {
+      motion_q16[axis] = 0;
+      if (track_bias) {
+        filter->bias_q8[axis] = filter->mean_q8[axis];
+      }
+    }
+    filter->locked = track_bias;
+    return;
+  }
+
+  for (int axis = 0; axis < AIR_MOUSE_AXIS_COUNT; axis++) {
+    if (track_bias) {
+      filter->bias_q8[axis] =
+          approach(filter->bias_q8[axis], filter->mean_q8[axis],
+                   AIR_MOUSE_FILTER_BIAS_SHIFT);
+    }
+
+    int32_t corrected_q8 = ((int32_t)rate[axis] << 8) - filter->bias_q8[axis];
+    filter->smooth_q8[axis] = approach(filter->smooth_q8[axis], corrected_q8,
+                                       AIR_MOUSE_FILTER_SMOOTH_SHIFT);
+
+    // The deadzone applies after smoothing: on raw samples, noise reaching
+    // past it leaks any leftover bias error through as slow creep.
+    int32_t rate_q8 = filter->smooth_q8[axis];
+    if (abs32(rate_q8) < (AIR_MOUSE_FILTER_DEADZONE_LSB << 8)) {
+      rate_q8 = 0;
+    }
+
+    // Q8 * Q16 >> 8 = Q16; the product needs 64 bits at full scale.
+    motion_q16[axis] = (int32_t)(((int64_t)rate_q8 * filter->gain_q16) >> 8);
+  }
+}
+
+void air_mouse_accum_init(air_mouse_accum_t* accum) {
+  for (int axis = 0; axis < AIR_MOUSE_AXIS_COUNT; axis++) {
+    atomic_init(&accum->q16[axis], 0);
+  }
+}
+
+void air_mouse_accum_add(air_mouse_accum_t* accum,
+                         const int32_t motion_q16[AIR_MOUSE_AXIS_COUNT]) {
+  for (int axis = 0; axis < AIR_MOUSE_AXIS_COUNT; axis++) {
+    atomic_fetch_add_explicit(&accum->q16[axis], motion_q16[axis],
+                              memory_order_relaxed);
+  }
+}
+
+bool air_mouse_accum_peek(air_mouse_accum_t* accum,
+                          int8_t delta[AIR_MOUSE_AXIS_COUNT]) {
+  bool moved = false;
+  for (int axis = 0; axis < AIR_MOUSE_AXIS_COUNT; axis++) {
+    // Truncate toward zero so the remainder never flips sign.
+    int32_t counts =
+        atomic_load_explicit(&accum->q16[axis], memory_order_relaxed) / 65536;
+    if (counts > INT8_MAX) {
+      counts = INT8_MAX;
+    } else if (counts < -INT8_MAX) {
+      counts = -INT8_MAX;
+    }
+    delta[axis] = (int8_t)counts;
+    moved = moved || counts != 0;
+  }
+  return moved;
+}
+
+void air_mouse_accum_commit(air_mouse_accum_t* accum,
+                            const int8_t delta[AIR_MOUSE_AXIS_COUNT]) {
+  for (int axis = 0; axis < AIR_MOUSE_AXIS_COUNT; axis++) {
+    atomic_fetch_sub_explicit(&accum->q16[axis], (int32_t)delta[axis] * 65536,
+                              memory_order_relaxed);
+  }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Gyro rate (raw LSB) below which the device counts as held still, measured
+// against a short running mean so a large bias doesn't hide stillness.
+#define AIR_MOUSE_FILTER_STILL_LSB 48
+// Largest distance from the current bias a still reading may have. Bias
+// drifts slowly, so anything further is a steady turn, not drift.
+#define AIR_MOUSE_FILTER_BIAS_WINDOW_LSB 40
+// Consecutive still samples before the bias starts following the mean.
+#define AIR_MOUSE_FILTER_STILL_SAMPLES 64
+// Bias-corrected rate ignored as sensor noise.
+#define AIR_MOUSE_FILTER_DEADZONE_LSB 8
+// Single-pole smoothing factors, as right shifts.
+#define AIR_MOUSE_FILTER_MEAN_SHIFT 3
+#define AIR_MOUSE_FILTER_BIAS_SHIFT 8
+#define AIR_MOUSE_FILTER_SMOOTH_SHIFT 2
+
+typedef enum {
+  AIR_MOUSE_AXIS_X,  // yaw
+  AIR_MOUSE_AXIS_Y,  // pitch
+  AIR_MOUSE_AXIS_COUNT,
+} air_mouse_axis_t;
+
+// Turns gyro rates into pointer motion. All state is Q8 raw LSB.
+typedef struct air_mouse_filter {
+  int32_t mean_q8[AIR_MOUSE_AXIS_COUNT];
+  int32_t bias_q8[AIR_MOUSE_AXIS_COUNT];
+  int32_t smooth_q8[AIR_MOUSE_AXIS_COUNT];
+  // Pointer counts per raw LSB per sample, Q16.
+  int32_t gain_q16;
+  uint16_t still_samples;
+  bool seeded;
+  // Set once the bias was first taken from a still window.
+  bool locked;
+} air_mouse_filter_t;
+
+void air_mouse_filter_init(air_mouse_filter_t* filter, int32_t gain_q16);
+
+// Feeds one gyro sample and returns the pointer motion it adds, in Q16
+// counts. Nothing moves until the device has been held still for
+// AIR_MOUSE_FILTER_STILL_SAMPLES and the bias was taken from that window.
+void air_mouse_filter_step(air_mouse_filter_t* filter,
+                           const int16_t rate[AIR_MOUSE_AXIS_COUNT],
+                           int32_t motion_q16[AIR_MOUSE_AXIS_COUNT]);
+
+// Sub-count motion carried between reports. One task adds, another takes,
+// without locks: a take only subtracts what it reported, so samples landing
+// in between are kept for the next report.
+typedef struct air_mouse_accum {
+  _Atomic int32_t q16[AIR_MOUSE_AXIS_COUNT];
+} air_mouse_accum_t;
+
+void air_mouse_accum_init(air_mouse_accum_t* accum);
+void air_mouse_accum_add(air_mouse_accum_t* accum,
+                         const int32_t motion_q16[AIR_MOUSE_AXIS_COUNT]);
+
+// Whole counts ready to report, clamped to one report's range. Returns false
+// while they are all zero.
+bool air_mouse_accum_peek(air_mouse_accum_t* accum,
+                          int8_t delta[AIR_MOUSE_AXIS_COUNT]);
+// Removes a delta returned by air_mouse_accum_peek once it was sent.
+void air_mouse_accum_commit(air_mouse_accum_t* accum,
+                            const int8_t delta[AIR_MOUSE_AXIS_COUNT]);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,42 @@
+#include "axp192.h"
+
+#include "board_i2c.h"
+
+enum {
+  AXP192_REG_BATTERY_VOLTAGE_H = 0x78,  // bits 11..4, then 3..0 in 0x79
+  AXP192_REG_ADC_ENABLE_1 = 0x82,
+};
+
+#define AXP192_ADC_BATTERY_VOLTAGE (1 << 7)
+// Battery voltage ADC step, in µV.
+#define AXP192_BATTERY_UV_PER_LSB 1100
+
+static i2c_master_dev_handle_t dev;
+
+esp_err_t axp192_init(void) {
+  esp_err_t err = board_i2c_add_device(AXP192_I2C_ADDR, &dev);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  uint8_t adc_enable = 0;
+  err = board_i2c_read(dev, AXP192_REG_ADC_ENABLE_1, &adc_enable, 1);
+  if (err != ESP_OK) {
+    return err;
+  }
+  return board_i2c_write(dev, AXP192_REG_ADC_ENABLE_1,
+                         adc_enable | AXP192_ADC_BATTERY_VOLTAGE);
+}
+
+esp_err_t axp192_read_battery_mv(uint16_t* mv) {
+  uint8_t raw[2];
+  esp_err_t err =
+      board_i2c_read(dev, AXP192_REG_BATTERY_VOLTAGE_H, raw, sizeof(raw));
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  uint32_t adc = ((uint32_t)raw[0] << 4) | (raw[1] & 0x0F);
+  *mv = (uint16_t)(adc * AXP192_BATTERY_UV_PER_LSB / 1000);
+  return ESP_OK;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AXP192_I2C_ADDR 0x34
+
+// Enables the battery voltage ADC; leaves the power rails as the bootloader
+// set them. The board I2C bus must already be up.
+esp_err_t axp192_init(void);
+
+esp_err_t axp192_read_battery_mv(uint16_t* mv);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,87 @@
+#include "battery_gauge.h"
+
+#include <string.h>
+
+typedef struct battery_curve_point {
+  uint16_t mv;
+  uint8_t percent;
+} battery_curve_point_t;
+
+// Sorted by descending voltage.
+static const battery_curve_point_t curve[] = {
+    {4150, 100}, {4050, 90}, {3970, 80}, {3900, 70}, {3840, 60}, {3800, 50},
+    {3760, 40},  {3730, 30}, {3690, 20}, {3640, 10}, {3500, 5},  {3300, 0},
+};
+
+#define CURVE_LEN (sizeof(curve) / sizeof(curve[0]))
+
+uint8_t battery_gauge_percent(uint16_t mv) {
+  if (mv >= curve[0].mv) {
+    return curve[0].percent;
+  }
+
+  for (size_t i = 1; i < CURVE_LEN; i++) {
+    if (mv >= curve[i].mv) {
+      const battery_curve_point_t* hi = &curve[i - 1];
+      const battery_curve_point_t* lo = &curve[i];
+      return (uint8_t)(lo->percent + (uint32_t)(mv - lo->mv) *
+                                         (hi->percent - lo->percent) /
+                                         (hi->mv - lo->mv));
+    }
+  }
+  return 0;
+}
+
+void battery_gauge_init(battery_gauge_t* gauge) {
+  memset(gauge, 0, sizeof(*gauge));
+  gauge->level = 100;
+}
+
+static uint16_t battery_gauge_median(const battery_gauge_t* gauge) {
+  uint16_t sorted[BATTERY_GAUGE_MEDIAN_LEN];
+  memcpy(sorted, gauge->window_mv, sizeof(sorted));
+  for (uint8_t i = 1; i < BATTERY_GAUGE_MEDIAN_LEN; i++) {
+    uint16_t value = sorted[i];
+    uint8_t j = i;
+    for (; j > 0 && sorted[j - 1] > value; j--) {
+      sorted[j] = sorted[j - 1];
+    }
+    sorted[j] = value;
+  }
+  return sorted[BATTERY_GAUGE_MEDIAN_LEN / 2];
+}
+
+bool battery_gauge_update(battery_gauge_t* gauge, uint16_t mv) {
+  gauge->window_mv[gauge->window_pos] = mv;
+  gauge->window_pos = (gauge->window_pos + 1) % BATTERY_GAUGE_MEDIAN_LEN;
+  if (gauge->window_len < BATTERY_GAUGE_MEDIAN_LEN) {
+    gauge->window_len++;
+    if (gauge->window_len < BATTERY_GAUGE_MEDIAN_LEN) {
+      return false;
+    }
+  }
+
+  int32_t median_q8 = (int32_t)battery_gauge_median(gauge) << 8;
+  if (!gauge->valid) {
+    gauge->smooth_q8 = median_q8;
+  } else {
+    gauge->smooth_q8 +=
+        (median_q8 - gauge->smooth_q8) >> BATTERY_GAUGE_SMOOTH_SHIFT;
+  }
+
+  uint8_t percent = battery_gauge_percent((uint16_t)(gauge->smooth_q8 >> 8));
+  int diff = (int)percent - (int)gauge->level;
+  if (gauge->valid && diff <= BATTERY_GAUGE_RISE_PCT &&
+      diff >= -BATTERY_GAUGE_THRESHOLD_PCT) {
+    return false;
+  }
+
+  bool changed = !gauge->valid || percent != gauge->level;
+  gauge->level = percent;
+  gauge->valid = true;
+  return changed;
+}
+
+uint8_t battery_gauge_level(const battery_gauge_t* gauge) {
+  return gauge->level;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Readings kept for the median, which drops single-sample dips under load
+// (radio bursts, the LCD backlight).
+#define BATTERY_GAUGE_MEDIAN_LEN 3
+// Single-pole smoothing after the median, as a right shift.
+#define BATTERY_GAUGE_SMOOTH_SHIFT 4
+// The reported level only drops once the estimate is further than this below
+// it, so noise around a boundary doesn't toggle it back and forth.
+#define BATTERY_GAUGE_THRESHOLD_PCT 2
+// Rises need a wider margin: the voltage recovering after a load, and noise
+// on the steep part of the curve, lift the estimate a few percent, but only
+// charging lifts it this far.
+#define BATTERY_GAUGE_RISE_PCT 4
+
+typedef struct battery_gauge {
+  uint16_t window_mv[BATTERY_GAUGE_MEDIAN_LEN];
+  uint8_t window_len;
+  uint8_t window_pos;
+  int32_t smooth_q8;  // mV
+  uint8_t level;      // reported percentage
+  bool valid;
+} battery_gauge_t;
+
+void battery_gauge_init(battery_gauge_t* gauge);
+
+// Feeds one battery voltage reading. Returns true when the reported level
+// changed; the first full median window always does.
+bool battery_gauge_update(battery_gauge_t* gauge, uint16_t mv);
+
+// Reported level in percent; 100 until the median window has filled.
+uint8_t battery_gauge_level(const battery_gauge_t* gauge);
+
+// Single-cell LiPo open-circuit voltage to percent, piecewise linear.
+uint8_t battery_gauge_percent(uint16_t mv);
+
+#ifdef __cplusplus
+}
+#endif
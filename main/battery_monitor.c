@@ -0,0 +1,49 @@
+#include "battery_monitor.h"
+
+#include "axp192.h"
+#include "battery_gauge.h"
+#include "ble_battery.h"
+#include "board_i2c.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char* TAG = "BATTERY";
+
+static battery_gauge_t gauge;  // monitor task only
+
+static void battery_monitor_task(void* param) {
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    uint16_t mv;
+    if (axp192_read_battery_mv(&mv) == ESP_OK &&
+        battery_gauge_update(&gauge, mv)) {
+      ESP_LOGI(TAG, "Battery %u mV, level %u%%", mv,
+               battery_gauge_level(&gauge));
+      ble_battery_set_level(battery_gauge_level(&gauge));
+    }
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(BATTERY_MONITOR_PERIOD_MS));
+  }
+}
+
+esp_err_t battery_monitor_start(void) {
+  esp_err_t err = board_i2c_init();
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  err = axp192_init();
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "AXP192 initialization failed, error: %s",
+             esp_err_to_name(err));
+    return err;
+  }
+
+  battery_gauge_init(&gauge);
+  // Lowest priority: nothing waits on a battery reading.
+  if (xTaskCreatePinnedToCore(battery_monitor_task, "battery", 2560, NULL, 1,
+                              NULL, 1) != pdPASS) {
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Samples the battery through the AXP192 every BATTERY_MONITOR_PERIOD_MS and
+// publishes the filtered level to the Battery Service.
+#define BATTERY_MONITOR_PERIOD_MS 10000
+
+esp_err_t battery_monitor_start(void);
+
+#ifdef __cplusplus
+}
+#endif
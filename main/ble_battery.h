@@ -1,7 +1,30 @@
 #pragma once
 
+#include "ble_gatt_registry.h"
+
 #define BLE_BATTERY_SERVICE_UUID 0x180F
 #define BLE_BATTERY_LEVEL_UUID 0x2A19
 
+struct ble_gap_conn_desc;
+struct ble_gap_event;
+
+extern const ble_gatt_attr_t ble_battery_level_attr;
+extern const ble_gatt_attr_t ble_battery_level_cpf_attr;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Called on the host task before the stack starts.
+void ble_battery_init(void);
+
+// Publishes a new level in percent and notifies subscribers if it changed.
+// Safe to call from any task.
+void ble_battery_set_level(uint8_t level);
+
+#ifdef __cplusplus
+}
+#endif
 
-int ble_battery_init(void);
+void ble_battery_on_subscribe(const struct ble_gap_event* event);
+void ble_battery_on_enc_change(const struct ble_gap_conn_desc* desc);
@@ -2,6 +2,8 @@
 
 #include <stdint.h>
 
+#include "ble_gatt_registry.h"
+
 #define BLE_DEVICE_INFO_SERVICE_UUID 0x180A
 #define BLE_DEVICE_MANUFACTURER_UUID 0x2A29
 #define BLE_DEVICE_PNP_UUID 0x2A50
@@ -13,4 +15,5 @@ typedef struct __pnp_id_data {
   uint16_t ver;
 } __attribute__((packed)) pnp_id_data_t;
 
-int ble_device_info_init(void);
+extern const ble_gatt_attr_t ble_device_info_manufacturer_attr;
+extern const ble_gatt_attr_t ble_device_info_pnp_id_attr;
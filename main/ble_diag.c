@@ -0,0 +1,111 @@
+#include "ble_diag.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include "ble_trace.h"
+#include "host/ble_gatt.h"
+#include "host/ble_hs.h"
+#include "nimble/nimble_port.h"
+
+static const char* TAG = "BLE_DIAG";
+
+#define DIAG_LOG_PERIOD_MS 60000
+
+static int diag_latency_read(uint16_t conn_handle,
+                             struct ble_gatt_access_ctxt* ctxt);
+static int diag_latency_write(uint16_t conn_handle, struct os_mbuf* om);
+static void diag_log_cb(struct ble_npl_event* ev);
+
+static latency_hist_t hists[BLE_DIAG_STAGE_COUNT];
+// Taken by the Read at offset 0 and served to the Read Blobs after it, so
+// one long read returns a single consistent set of summaries.
+static latency_hist_summary_t read_snapshot[BLE_DIAG_STAGE_COUNT];
+static struct ble_npl_callout log_callout;
+static uint32_t logged_count;
+
+static const char* const stage_names[BLE_DIAG_STAGE_COUNT] = {
+    [BLE_DIAG_STAGE_QUEUE] = "queue",
+    [BLE_DIAG_STAGE_STACK] = "stack",
+    [BLE_DIAG_STAGE_TOTAL] = "total",
+};
+
+const ble_gatt_attr_t ble_diag_latency_attr = {
+    .read = diag_latency_read,
+    .write = diag_latency_write,
+};
+
+int ble_diag_init(void) {
+  for (size_t i = 0; i < BLE_DIAG_STAGE_COUNT; i++) {
+    latency_hist_reset(&hists[i]);
+  }
+
+  ble_npl_callout_init(&log_callout, nimble_port_get_dflt_eventq(),
+                       diag_log_cb, NULL);
+  ble_npl_callout_reset(&log_callout,
+                        ble_npl_time_ms_to_ticks32(DIAG_LOG_PERIOD_MS));
+  return 0;
+}
+
+uint32_t ble_diag_now_us(void) {
+  // esp_timer rather than CCOUNT: the cycle counters of the two cores aren't
+  // synchronized and reports are stamped on one core, sent on the other.
+  return (uint32_t)esp_timer_get_time();
+}
+
+void ble_diag_record(ble_diag_stage_t stage, uint32_t elapsed_us) {
+  latency_hist_record(&hists[stage], elapsed_us);
+}
+
+static void diag_log_cb(struct ble_npl_event* ev) {
+  latency_hist_summary_t summary;
+  latency_hist_summarize(&hists[BLE_DIAG_STAGE_TOTAL], &summary);
+  if (summary.count != logged_count) {
+    logged_count = summary.count;
+    for (size_t i = 0; i < BLE_DIAG_STAGE_COUNT; i++) {
+      latency_hist_summarize(&hists[i], &summary);
+      ESP_LOGI(TAG,
+               "%s latency: n=%lu p50=%luus p90=%luus p99=%luus max=%luus",
+               stage_names[i], (unsigned long)summary.count,
+               (unsigned long)summary.p50, (unsigned long)summary.p90,
+               (unsigned long)summary.p99, (unsigned long)summary.max);
+    }
+  }
+
+  ble_npl_callout_reset(&log_callout,
+                        ble_npl_time_ms_to_ticks32(DIAG_LOG_PERIOD_MS));
+}
+
+static int diag_latency_read(uint16_t conn_handle,
+                             struct ble_gatt_access_ctxt* ctxt) {
+  if (ctxt->offset == 0) {
+    for (size_t i = 0; i < BLE_DIAG_STAGE_COUNT; i++) {
+      latency_hist_summarize(&hists[i], &read_snapshot[i]);
+    }
+  }
+  // Longer than the default MTU; hosts fetch the tail with Read Blob.
+  return ble_gatt_span_append(conn_handle, ctxt, read_snapshot,
+                              sizeof(read_snapshot));
+}
+
+static int diag_latency_write(uint16_t conn_handle, struct os_mbuf* om) {
+  uint8_t cmd;
+  if (OS_MBUF_PKTLEN(om) != sizeof(cmd) ||
+      os_mbuf_copydata(om, 0, sizeof(cmd), &cmd) != 0) {
+    return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+  }
+
+  switch (cmd) {
+    case BLE_DIAG_CMD_CLEAR:
+      for (size_t i = 0; i < BLE_DIAG_STAGE_COUNT; i++) {
+        latency_hist_reset(&hists[i]);
+      }
+      logged_count = 0;
+      return 0;
+    case BLE_DIAG_CMD_DUMP_TRACE:
+      ble_trace_dump();
+      return 0;
+    default:
+      return BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+  }
+}
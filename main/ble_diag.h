@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ble_gatt_registry.h"
+#include "host/ble_uuid.h"
+#include "latency_hist.h"
+
+// Vendor diagnostics service, 6b1c0001-5d2e-4f0a-9c41-7a3e1f2d0c00.
+#define BLE_DIAG_SERVICE_UUID                                              \
+  BLE_UUID128_INIT(0x00, 0x0c, 0x2d, 0x1f, 0x3e, 0x7a, 0x41, 0x9c, 0x0a, \
+                   0x4f, 0x2e, 0x5d, 0x01, 0x00, 0x1c, 0x6b)
+// Read: one latency_hist_summary_t per stage, in microseconds.
+// Write: BLE_DIAG_CMD_* as a single byte.
+#define BLE_DIAG_LATENCY_UUID                                              \
+  BLE_UUID128_INIT(0x00, 0x0c, 0x2d, 0x1f, 0x3e, 0x7a, 0x41, 0x9c, 0x0a, \
+                   0x4f, 0x2e, 0x5d, 0x02, 0x00, 0x1c, 0x6b)
+
+typedef enum {
+  BLE_DIAG_CMD_CLEAR = 0x00,       // clear the latency histograms
+  BLE_DIAG_CMD_DUMP_TRACE = 0x01,  // print the trace rings to the console
+} ble_diag_cmd_t;
+
+// Where a report spends its time between ble_hid_send_report and the air.
+typedef enum {
+  BLE_DIAG_STAGE_QUEUE,  // enqueue to mbuf handoff
+  BLE_DIAG_STAGE_STACK,  // mbuf handoff to its release after TX
+  BLE_DIAG_STAGE_TOTAL,  // enqueue to mbuf release
+  BLE_DIAG_STAGE_COUNT,
+} ble_diag_stage_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const ble_gatt_attr_t ble_diag_latency_attr;
+
+int ble_diag_init(void);
+
+// Microsecond timestamp shared by both cores.
+uint32_t ble_diag_now_us(void);
+void ble_diag_record(ble_diag_stage_t stage, uint32_t elapsed_us);
+
+#ifdef __cplusplus
+}
+#endif
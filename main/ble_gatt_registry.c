@@ -0,0 +1,388 @@
+#include "ble_gatt_registry.h"
+
+#include <esp_log.h>
+
+#include "ble_battery.h"
+#include "ble_device_info.h"
+#include "ble_diag.h"
+#include "ble_hid.h"
+#include "ble_hid_report_map.h"
+#include "ble_trace.h"
+#include "ble_unit.h"
+#include "ble_upload.h"
+#include "host/ble_hs.h"
+
+static const char* TAG = "BLE_GATT";
+
+uint16_t ble_gatt_chr_handles[BLE_GATT_CHR_COUNT];
+
+// Every table below is const, so it stays in flash. Compound literals
+// (including BLE_UUID16_DECLARE) would have put a writable copy in RAM.
+
+static int gatt_access(uint16_t conn_handle, uint16_t attr_handle,
+                       struct ble_gatt_access_ctxt* ctxt, void* arg);
+
+static const ble_uuid16_t uuid_dis =
+    BLE_UUID16_INIT(BLE_DEVICE_INFO_SERVICE_UUID);
+static const ble_uuid16_t uuid_manufacturer =
+    BLE_UUID16_INIT(BLE_DEVICE_MANUFACTURER_UUID);
+static const ble_uuid16_t uuid_pnp_id = BLE_UUID16_INIT(BLE_DEVICE_PNP_UUID);
+static const ble_uuid16_t uuid_battery =
+    BLE_UUID16_INIT(BLE_BATTERY_SERVICE_UUID);
+static const ble_uuid16_t uuid_battery_level =
+    BLE_UUID16_INIT(BLE_BATTERY_LEVEL_UUID);
+static const ble_uuid16_t uuid_cpf = BLE_UUID16_INIT(BLE_UNIT_DESCRIPTOR_UUID);
+static const ble_uuid16_t uuid_hid = BLE_UUID16_INIT(BLE_HID_SERVICE_UUID);
+static const ble_uuid16_t uuid_hid_info = BLE_UUID16_INIT(BLE_HID_INFO_UUID);
+static const ble_uuid16_t uuid_report_map =
+    BLE_UUID16_INIT(BLE_HID_REPORT_MAP_UUID);
+static const ble_uuid16_t uuid_control_point =
+    BLE_UUID16_INIT(BLE_HID_CONTROL_POINT_UUID);
+static const ble_uuid16_t uuid_report = BLE_UUID16_INIT(BLE_HID_REPORT_UUID);
+static const ble_uuid16_t uuid_report_ref =
+    BLE_UUID16_INIT(BLE_REPORT_DESCRIPTOR_UUID);
+static const ble_uuid16_t uuid_protocol_mode =
+    BLE_UUID16_INIT(BLE_HID_PROTOCOL_MODE_UUID);
+static const ble_uuid16_t uuid_boot_input =
+    BLE_UUID16_INIT(BLE_HID_BOOT_KEYBOARD_INPUT_UUID);
+static const ble_uuid16_t uuid_boot_output =
+    BLE_UUID16_INIT(BLE_HID_BOOT_KEYBOARD_OUTPUT_UUID);
+static const ble_uuid128_t uuid_diag = BLE_DIAG_SERVICE_UUID;
+static const ble_uuid128_t uuid_diag_latency = BLE_DIAG_LATENCY_UUID;
+static const ble_uuid128_t uuid_upload = BLE_UPLOAD_SERVICE_UUID;
+static const ble_uuid128_t uuid_upload_data = BLE_UPLOAD_DATA_UUID;
+static const ble_uuid128_t uuid_upload_control = BLE_UPLOAD_CONTROL_UUID;
+
+#define GATT_ATTR(attr) .access_cb = gatt_access, .arg = (void*)&(attr)
+
+static const struct ble_gatt_chr_def dis_chrs[] = {
+    {
+        .uuid = &uuid_manufacturer.u,
+        GATT_ATTR(ble_device_info_manufacturer_attr),
+        .flags = BLE_GATT_CHR_F_READ,
+    },
+    {
+        .uuid = &uuid_pnp_id.u,
+        GATT_ATTR(ble_device_info_pnp_id_attr),
+        .flags = BLE_GATT_CHR_F_READ,
+    },
+    {0},
+};
+
+static const struct ble_gatt_dsc_def battery_level_dscs[] = {
+    {
+        .uuid = &uuid_cpf.u,
+        GATT_ATTR(ble_battery_level_cpf_attr),
+        .att_flags = BLE_ATT_F_READ,
+    },
+    {0},
+};
+
+static const struct ble_gatt_chr_def battery_chrs[] = {
+    {
+        .uuid = &uuid_battery_level.u,
+        GATT_ATTR(ble_battery_level_attr),
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+        .val_handle = &ble_gatt_chr_handles[BLE_GATT_CHR_BATTERY_LEVEL],
+        .descriptors = battery_level_dscs,
+    },
+    {0},
+};
+
+static const struct ble_gatt_dsc_def hid_input_dscs[] = {
+    {
+        .uuid = &uuid_report_ref.u,
+        GATT_ATTR(ble_hid_input_ref_attr),
+        .att_flags = BLE_ATT_F_READ,
+    },
+    {0},
+};
+
+static const struct ble_gatt_dsc_def hid_nkro_dscs[] = {
+    {
+        .uuid = &uuid_report_ref.u,
+        GATT_ATTR(ble_hid_nkro_ref_attr),
+        .att_flags = BLE_ATT_F_READ,
+    },
+    {0},
+};
+
+static const struct ble_gatt_dsc_def hid_mouse_dscs[] = {
+    {
+        .uuid = &uuid_report_ref.u,
+        GATT_ATTR(ble_hid_mouse_ref_attr),
+        .att_flags = BLE_ATT_F_READ,
+    },
+    {0},
+};
+
+static const struct ble_gatt_dsc_def hid_consumer_dscs[] = {
+    {
+        .uuid = &uuid_report_ref.u,
+        GATT_ATTR(ble_hid_consumer_ref_attr),
+        .att_flags = BLE_ATT_F_READ,
+    },
+    {0},
+};
+
+static const struct ble_gatt_dsc_def hid_system_dscs[] = {
+    {
+        .uuid = &uuid_report_ref.u,
+        GATT_ATTR(ble_hid_system_ref_attr),
+        .att_flags = BLE_ATT_F_READ,
+    },
+    {0},
+};
+
+static const struct ble_gatt_dsc_def hid_output_dscs[] = {
+    {
+        .uuid = &uuid_report_ref.u,
+        GATT_ATTR(ble_hid_output_ref_attr),
+        .att_flags = BLE_ATT_F_READ,
+    },
+    {0},
+};
+
+static const struct ble_gatt_chr_def hid_chrs[] = {
+    {
+        .uuid = &uuid_hid_info.u,
+        GATT_ATTR(ble_hid_info_attr),
+        .flags = BLE_GATT_CHR_F_READ,
+    },
+    {
+        .uuid = &uuid_report_map.u,
+        GATT_ATTR(ble_hid_report_map_attr),
+        .flags = BLE_GATT_CHR_F_READ,
+    },
+    {
+        .uuid = &uuid_control_point.u,
+        GATT_ATTR(ble_hid_control_point_attr),
+        .flags = BLE_GATT_CHR_F_WRITE_NO_RSP,
+    },
+    {
+        // Keyboard input report
+        .uuid = &uuid_report.u,
+        GATT_ATTR(ble_hid_input_report_attr),
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+        .val_handle = &ble_gatt_chr_handles[BLE_GATT_CHR_HID_INPUT],
+        .descriptors = hid_input_dscs,
+    },
+    {
+        // NKRO input report
+        .uuid = &uuid_report.u,
+        GATT_ATTR(ble_hid_input_report_attr),
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+        .val_handle = &ble_gatt_chr_handles[BLE_GATT_CHR_HID_NKRO],
+        .descriptors = hid_nkro_dscs,
+    },
+    {
+        // Mouse input report
+        .uuid = &uuid_report.u,
+        GATT_ATTR(ble_hid_input_report_attr),
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+        .val_handle = &ble_gatt_chr_handles[BLE_GATT_CHR_HID_MOUSE],
+        .descriptors = hid_mouse_dscs,
+    },
+    {
+        // Consumer control input report
+        .uuid = &uuid_report.u,
+        GATT_ATTR(ble_hid_input_report_attr),
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+        .val_handle = &ble_gatt_chr_handles[BLE_GATT_CHR_HID_CONSUMER],
+        .descriptors = hid_consumer_dscs,
+    },
+    {
+        // System control input report
+        .uuid = &uuid_report.u,
+        GATT_ATTR(ble_hid_input_report_attr),
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+        .val_handle = &ble_gatt_chr_handles[BLE_GATT_CHR_HID_SYSTEM],
+        .descriptors = hid_system_dscs,
+    },
+    {
+        // LED output report
+        .uuid = &uuid_report.u,
+        GATT_ATTR(ble_hid_output_report_attr),
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE |
+                 BLE_GATT_CHR_F_WRITE_NO_RSP,
+        .descriptors = hid_output_dscs,
+    },
+    {
+        .uuid = &uuid_protocol_mode.u,
+        GATT_ATTR(ble_hid_protocol_mode_attr),
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE_NO_RSP,
+    },
+    {
+        .uuid = &uuid_boot_input.u,
+        GATT_ATTR(ble_hid_input_report_attr),
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+        .val_handle = &ble_gatt_chr_handles[BLE_GATT_CHR_HID_BOOT_INPUT],
+    },
+    {
+        .uuid = &uuid_boot_output.u,
+        GATT_ATTR(ble_hid_output_report_attr),
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE |
+                 BLE_GATT_CHR_F_WRITE_NO_RSP,
+    },
+    {0},
+};
+
+static const struct ble_gatt_chr_def diag_chrs[] = {
+    {
+        .uuid = &uuid_diag_latency.u,
+        GATT_ATTR(ble_diag_latency_attr),
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_READ_ENC |
+                 BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_ENC,
+    },
+    {0},
+};
+
+static const struct ble_gatt_chr_def upload_chrs[] = {
+    {
+        .uuid = &uuid_upload_data.u,
+        GATT_ATTR(ble_upload_data_attr),
+        .flags = BLE_GATT_CHR_F_WRITE_NO_RSP | BLE_GATT_CHR_F_WRITE_ENC,
+    },
+    {
+        .uuid = &uuid_upload_control.u,
+        GATT_ATTR(ble_upload_control_attr),
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_READ_ENC |
+                 BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_ENC |
+                 BLE_GATT_CHR_F_NOTIFY,
+        .val_handle = &ble_gatt_chr_handles[BLE_GATT_CHR_UPLOAD_CONTROL],
+    },
+    {0},
+};
+
+static const struct ble_gatt_svc_def gatt_svcs[] = {
+    {
+        .type = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid = &uuid_dis.u,
+        .characteristics = dis_chrs,
+    },
+    {
+        .type = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid = &uuid_battery.u,
+        .characteristics = battery_chrs,
+    },
+    {
+        .type = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid = &uuid_hid.u,
+        .characteristics = hid_chrs,
+    },
+    {
+        .type = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid = &uuid_diag.u,
+        .characteristics = diag_chrs,
+    },
+    {
+        .type = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid = &uuid_upload.u,
+        .characteristics = upload_chrs,
+    },
+    {0},
+};
+
+// Service, characteristic and descriptor tables that used to be writable
+// compound literals in RAM.
+#define GATT_TABLE_BYTES                                                     \
+  (sizeof(gatt_svcs) + sizeof(dis_chrs) + sizeof(battery_chrs) +           \
+   sizeof(battery_level_dscs) + sizeof(hid_chrs) + sizeof(hid_input_dscs) + \
+   sizeof(hid_nkro_dscs) + sizeof(hid_mouse_dscs) +                         \
+   sizeof(hid_consumer_dscs) + sizeof(hid_system_dscs) +                    \
+   sizeof(hid_output_dscs) + sizeof(diag_chrs) + sizeof(upload_chrs))
+
+// The linker keeps those tables in flash only while they are const. One that
+// loses the qualifier fails the build here rather than moving back to RAM.
+#define GATT_ASSERT_IN_FLASH(table)                                   \
+  _Static_assert(_Generic(&(table)[0], const __typeof__((table)[0])*: 1, \
+                          default: 0),                                 \
+                 #table " must stay const to stay in flash")
+GATT_ASSERT_IN_FLASH(gatt_svcs);
+GATT_ASSERT_IN_FLASH(dis_chrs);
+GATT_ASSERT_IN_FLASH(battery_chrs);
+GATT_ASSERT_IN_FLASH(battery_level_dscs);
+GATT_ASSERT_IN_FLASH(hid_chrs);
+GATT_ASSERT_IN_FLASH(hid_input_dscs);
+GATT_ASSERT_IN_FLASH(hid_nkro_dscs);
+GATT_ASSERT_IN_FLASH(hid_mouse_dscs);
+GATT_ASSERT_IN_FLASH(hid_consumer_dscs);
+GATT_ASSERT_IN_FLASH(hid_system_dscs);
+GATT_ASSERT_IN_FLASH(hid_output_dscs);
+GATT_ASSERT_IN_FLASH(diag_chrs);
+GATT_ASSERT_IN_FLASH(upload_chrs);
+
+// Characteristics a bonded host can subscribe to: the notifying ones above
+// plus Service Changed in the GATT service. The store keeps a CCCD entry
+// for each, for every bond.
+#define GATT_CCCDS_PER_BOND 9
+_Static_assert(GATT_CCCDS_PER_BOND * CONFIG_BT_NIMBLE_MAX_BONDS <=
+                   CONFIG_BT_NIMBLE_MAX_CCCDS,
+               "every bond must be able to keep all its subscriptions");
+
+static int gatt_count_cccds(void) {
+  int count = 1;  // Service Changed
+  for (const struct ble_gatt_svc_def* svc = gatt_svcs; svc->type != 0;
+       svc++) {
+    for (const struct ble_gatt_chr_def* chr = svc->characteristics;
+         chr->uuid != NULL; chr++) {
+      if (chr->flags & (BLE_GATT_CHR_F_NOTIFY | BLE_GATT_CHR_F_INDICATE)) {
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+int ble_gatt_registry_init(void) {
+  if (gatt_count_cccds() > GATT_CCCDS_PER_BOND) {
+    ESP_LOGE(TAG, "%d subscribable characteristics, GATT_CCCDS_PER_BOND is %d",
+             gatt_count_cccds(), GATT_CCCDS_PER_BOND);
+    return BLE_HS_EINVAL;
+  }
+
+  int rc = ble_gatts_count_cfg(gatt_svcs);
+  if (rc != 0) {
+    return rc;
+  }
+
+  rc = ble_gatts_add_svcs(gatt_svcs);
+  if (rc != 0) {
+    return rc;
+  }
+
+  ESP_LOGI(TAG, "GATT services registered, %u bytes of tables kept in flash",
+           (unsigned)GATT_TABLE_BYTES);
+  return 0;
+}
+
+static int gatt_access(uint16_t conn_handle, uint16_t attr_handle,
+                       struct ble_gatt_access_ctxt* ctxt, void* arg) {
+  const ble_gatt_attr_t* attr = arg;
+  switch (ctxt->op) {
+    case BLE_GATT_ACCESS_OP_READ_CHR:
+    case BLE_GATT_ACCESS_OP_READ_DSC:
+      if (attr->read != NULL) {
+        return attr->read(conn_handle, ctxt);
+      }
+      if (attr->span.data != NULL) {
+#if MYNEWT_VAL(BLE_GATT_BLOB_TRANSFER)
+        BLE_TRACE3(ATT_STATIC_READ, conn_handle, attr_handle, ctxt->offset);
+#else
+        BLE_TRACE3(ATT_STATIC_READ, conn_handle, attr_handle, 0);
+#endif
+        return ble_gatt_span_append(conn_handle, ctxt, attr->span.data,
+                                    attr->span.len);
+      }
+      break;
+    case BLE_GATT_ACCESS_OP_WRITE_CHR:
+    case BLE_GATT_ACCESS_OP_WRITE_DSC:
+      if (attr->write != NULL) {
+        return attr->write(conn_handle, ctxt->om);
+      }
+      break;
+  }
+
+  BLE_TRACE3(ATT_UNEXPECTED_OP, conn_handle, attr_handle, ctxt->op);
+  return BLE_ATT_ERR_UNLIKELY;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ble_gatt_span.h"
+#include "host/ble_gatt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Appends the attribute value with ble_gatt_span_append.
+typedef int (*ble_gatt_read_fn)(uint16_t conn_handle,
+                                struct ble_gatt_access_ctxt* ctxt);
+// Returns 0 or a BLE_ATT_ERR_* code.
+typedef int (*ble_gatt_write_fn)(uint16_t conn_handle, struct os_mbuf* om);
+
+// How one attribute is served. Constant values only set `span`; `read`
+// takes precedence when both are set. A NULL handler rejects that op.
+typedef struct ble_gatt_attr {
+  ble_gatt_span_t span;
+  ble_gatt_read_fn read;
+  ble_gatt_write_fn write;
+} ble_gatt_attr_t;
+
+// Characteristics other modules notify on or match events against.
+typedef enum {
+  BLE_GATT_CHR_HID_INPUT,
+  BLE_GATT_CHR_HID_NKRO,
+  BLE_GATT_CHR_HID_BOOT_INPUT,
+  BLE_GATT_CHR_HID_MOUSE,
+  BLE_GATT_CHR_HID_CONSUMER,
+  BLE_GATT_CHR_HID_SYSTEM,
+  BLE_GATT_CHR_BATTERY_LEVEL,
+  BLE_GATT_CHR_UPLOAD_CONTROL,
+  BLE_GATT_CHR_COUNT,
+} ble_gatt_chr_id_t;
+
+extern uint16_t ble_gatt_chr_handles[BLE_GATT_CHR_COUNT];
+
+static inline uint16_t ble_gatt_chr_handle(ble_gatt_chr_id_t chr) {
+  return ble_gatt_chr_handles[chr];
+}
+
+// Registers every application service in one pass.
+int ble_gatt_registry_init(void);
+
+#ifdef __cplusplus
+}
+#endif
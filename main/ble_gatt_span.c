@@ -0,0 +1,29 @@
+#include "ble_gatt_span.h"
+
+#include "host/ble_att.h"
+#include "host/ble_hs.h"
+
+int ble_gatt_span_append(uint16_t conn_handle,
+                         struct ble_gatt_access_ctxt* ctxt, const void* data,
+                         size_t len) {
+  size_t offset = 0;
+  size_t chunk = len;
+#if MYNEWT_VAL(BLE_GATT_BLOB_TRANSFER)
+  // The stack leaves slicing to us; without this option it calls back for
+  // the whole value and trims the copy itself, so it must get all of it.
+  offset = ctxt->offset;
+  if (offset > len) {
+    return BLE_ATT_ERR_INVALID_OFFSET;
+  }
+
+  uint16_t mtu = ble_att_mtu(conn_handle);
+  size_t max_chunk = (mtu != 0 ? mtu : BLE_ATT_MTU_DFLT) - 1;
+  chunk = len - offset;
+  if (chunk > max_chunk) {
+    chunk = max_chunk;
+  }
+#endif
+
+  int rc = os_mbuf_append(ctxt->om, (const uint8_t*)data + offset, chunk);
+  return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
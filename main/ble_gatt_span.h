@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "host/ble_gatt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A constant attribute value living in flash.
+typedef struct ble_gatt_span {
+  const void* data;
+  size_t len;
+} ble_gatt_span_t;
+
+// Appends the part of `data` a read at ctxt's offset asks for, at most one
+// ATT_MTU - 1 response worth, so long reads cost O(n) instead of re-copying
+// the whole value for every Read Blob.
+int ble_gatt_span_append(uint16_t conn_handle,
+                         struct ble_gatt_access_ctxt* ctxt, const void* data,
+                         size_t len);
+
+#ifdef __cplusplus
+}
+#endif
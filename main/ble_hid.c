@@ -3,124 +3,73 @@
 #include <esp_log.h>
 #include <string.h>
 
-#include "ble_cccd.h"
+#include "ble_diag.h"
+#include "ble_gatt_registry.h"
+#include "ble_hid_data.h"
+#include "ble_hid_mbuf.h"
+#include "ble_hid_report_queue.h"
+#include "ble_hid_sched.h"
+#include "ble_hid_state.h"
+#include "ble_trace.h"
+#include "conn_params.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "gap.h"
+#include "gap_conn.h"
 #include "host/ble_gap.h"
 #include "host/ble_gatt.h"
+#include "nimble/nimble_port.h"
 
 static const char* TAG = "BLE_HID";
 
-static int hid_info_access(uint16_t conn_handle, uint16_t attr_handle,
-                           struct ble_gatt_access_ctxt* ctxt, void* arg);
-static int hid_report_map_access(uint16_t conn_handle, uint16_t attr_handle,
-                                 struct ble_gatt_access_ctxt* ctxt, void* arg);
-static int hid_control_point_access(uint16_t conn_handle, uint16_t attr_handle,
-                                    struct ble_gatt_access_ctxt* ctxt,
-                                    void* arg);
-static int hid_output_report_access(uint16_t conn_handle, uint16_t attr_handle,
-                                    struct ble_gatt_access_ctxt* ctxt,
-                                    void* arg);
-static int hid_input_report_access(uint16_t conn_handle, uint16_t attr_handle,
-                                   struct ble_gatt_access_ctxt* ctxt,
-                                   void* arg);
-static int hid_input_report_dsc_access(uint16_t conn_handle,
-                                       uint16_t attr_handle,
-                                       struct ble_gatt_access_ctxt* ctxt,
-                                       void* arg);
-static int hid_output_report_dsc_access(uint16_t conn_handle,
-                                        uint16_t attr_handle,
-                                        struct ble_gatt_access_ctxt* ctxt,
-                                        void* arg);
-static int hid_protocol_mode_access(uint16_t conn_handle, uint16_t attr_handle,
-                                    struct ble_gatt_access_ctxt* ctxt,
-                                    void* arg);
-
-static uint16_t input_report_chr_handle;
-
-static const struct ble_gatt_svc_def hid_defs[] = {
-    {
-        .type = BLE_GATT_SVC_TYPE_PRIMARY,
-        .uuid = BLE_UUID16_DECLARE(BLE_HID_SERVICE_UUID),
-        .characteristics =
-            (struct ble_gatt_chr_def[]){
-                {
-                    .uuid = BLE_UUID16_DECLARE(BLE_HID_INFO_UUID),
-                    .access_cb = &hid_info_access,
-                    .flags = BLE_GATT_CHR_F_READ,
-                    .val_handle = NULL,
-                    .arg = NULL,
-                },
-                {
-                    .uuid = BLE_UUID16_DECLARE(BLE_HID_REPORT_MAP_UUID),
-                    .access_cb = &hid_report_map_access,
-                    .flags = BLE_GATT_CHR_F_READ,
-                    .val_handle = NULL,
-                    .arg = NULL,
-                },
-                {
-                    .uuid = BLE_UUID16_DECLARE(BLE_HID_CONTROL_POINT_UUID),
-                    .access_cb = &hid_control_point_access,
-                    .flags = BLE_GATT_CHR_F_WRITE_NO_RSP,
-                    .val_handle = NULL,
-                    .arg = NULL,
-                },
-                {
-                    .uuid = BLE_UUID16_DECLARE(
-                        BLE_HID_REPORT_UUID),  // input report
-                    .access_cb = &hid_input_report_access,
-                    .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
-                    .val_handle = &input_report_chr_handle,
-                    .arg = NULL,
-                    .descriptors =
-                        (struct ble_gatt_dsc_def[]){
-                            {
-                                .uuid = BLE_UUID16_DECLARE(
-                                    BLE_REPORT_DESCRIPTOR_UUID),
-                                .access_cb = &hid_input_report_dsc_access,
-                                .att_flags = BLE_ATT_F_READ,
-                                .arg = NULL,
-                            },
-                            {
-                                .uuid = BLE_UUID16_DECLARE(
-                                    BLE_CCCD_DESCRIPTOR_UUID),
-                                .access_cb = &hid_input_report_dsc_access,
-                                .att_flags = BLE_ATT_F_READ | BLE_ATT_F_WRITE,
-                                .arg = &input_report_chr_handle,
-                            },
-                            {0},
-                        },
-                },
-                {
-                    .uuid = BLE_UUID16_DECLARE(
-                        BLE_HID_REPORT_UUID),  // output report
-                    .access_cb = &hid_output_report_access,
-                    .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE |
-                             BLE_GATT_CHR_F_WRITE_NO_RSP,
-                    .val_handle = NULL,
-                    .arg = NULL,
-                    .descriptors =
-                        (struct ble_gatt_dsc_def[]){
-                            {
-                                .uuid = BLE_UUID16_DECLARE(
-                                    BLE_REPORT_DESCRIPTOR_UUID),
-                                .access_cb = &hid_output_report_dsc_access,
-                                .att_flags = BLE_ATT_F_READ,
-                                .arg = NULL,
-                            },
-                            {0},
-                        },
-                },
-                {
-                    .uuid = BLE_UUID16_DECLARE(BLE_HID_PROTOCOL_MODE_UUID),
-                    .access_cb = &hid_protocol_mode_access,
-                    .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE_NO_RSP,
-                    .val_handle = NULL,
-                    .arg = NULL,
-                },
-                {0},
-            },
-    },
-    {0},
-};
+static int hid_control_point_write(uint16_t conn_handle, struct os_mbuf* om);
+static int hid_input_report_read(uint16_t conn_handle,
+                                 struct ble_gatt_access_ctxt* ctxt);
+static int hid_output_report_write(uint16_t conn_handle, struct os_mbuf* om);
+static int hid_protocol_mode_read(uint16_t conn_handle,
+                                  struct ble_gatt_access_ctxt* ctxt);
+static int hid_protocol_mode_write(uint16_t conn_handle, struct os_mbuf* om);
+
+static void hid_drain(void);
+static void hid_drain_event_cb(struct ble_npl_event* ev);
+static void hid_schedule_drain(void);
+static void hid_on_mbuf_free(const ble_hid_mbuf_stamp_t* stamp);
+static void hid_update_nkro(void);
+static void hid_interval_event_cb(struct ble_npl_event* ev);
+static void hid_interval_timer_cb(void* arg);
+static void hid_arm_interval(void);
+static int hid_notify_sink(const ble_hid_queued_report_t* report, void* arg);
+static int hid_queue_sink(const ble_hid_queued_report_t* report, void* arg);
+
+static atomic_bool nkro_subscribed;
+// Producer blocked in ble_hid_wait_for_space, if any.
+static TaskHandle_t _Atomic space_waiter;
+
+static ble_hid_report_queue_t report_queue;
+static struct ble_npl_event drain_event;
+static atomic_bool drain_pending;
+// Only touched on the host task.
+static bool draining;
+
+// What the host holds and this interval's share. Only touched on the host
+// task.
+static ble_hid_sched_t sched;
+
+// Pull-based reports, polled once per connection interval.
+static const ble_hid_report_source_t* _Atomic report_sources
+    [BLE_HID_REPORT_ID_COUNT];
+
+// Interval clock. While a source has data or the budget ran out with reports
+// still queued, a one-shot timer re-armed from the host task ticks once per
+// connection interval; the NimBLE callouts only tick every 10 ms, too coarse
+// for a 7.5 ms interval.
+static struct ble_npl_event interval_event;
+static atomic_bool interval_armed;
+static esp_timer_handle_t interval_timer;
+
+// Fallback tick period, in connection interval units, with no ready link.
+#define HID_DEFAULT_ITVL 6
 
 static const ble_hid_info_data_t hid_info = {
     .hid_version = {0x11, 0x01},  // HID version 1.1
@@ -128,258 +77,628 @@ static const ble_hid_info_data_t hid_info = {
     .flags = 0x02,                // Remote wakeup and NDO supported
 };
 
-static const ble_hid_protocol_mode_t hid_protocol_mode =
-    BLE_HID_PROTOCOL_MODE_REPORT;
-
-static const uint8_t report_map[] = {
-    // Interface
-    0x05, 0x01,  // Usage Page (Generic Desktop)
-    0x09, 0x06,  // Usage (Keyboard)
-    0xA1, 0x01,  // Collection (Application)
-
-    // Report ID (if multiple reports)
-    0x85, BLE_HID_DEFAULT_REPORT_ID,  // Report ID (1)
-
-    // Modifier Keys (Shift, Ctrl, Alt, GUI)
-    0x05, 0x07,  // Usage Page (Key Codes)
-    0x19, 0xE0,  // Usage Minimum (224 = Left Control)
-    0x29, 0xE7,  // Usage Maximum (231 = Right GUI)
-    0x15, 0x00,  // Logical Minimum (0)
-    0x25, 0x01,  // Logical Maximum (1)
-    0x75, 0x01,  // Report Size (1 bit)
-    0x95, 0x08,  // Report Count (8 bits)
-    0x81, 0x02,  // Input (Data, Variable, Absolute)
-
-    // Reserved Byte
-    0x95, 0x01,  // Report Count (1)
-    0x75, 0x08,  // Report Size (8)
-    0x81, 0x01,  // Input (Constant)
-
-    // LED Status (Num Lock, Caps Lock, etc)
-    0x95, 0x05,  // Report Count (5)
-    0x75, 0x01,  // Report Size (1)
-    0x05, 0x08,  // Usage Page (LEDs)
-    0x19, 0x01,  // Usage Minimum (1)
-    0x29, 0x05,  // Usage Maximum (5)
-    0x91, 0x02,  // Output (Data, Variable, Absolute)
-
-    // LED Padding
-    0x95, 0x01,  // Report Count (1)
-    0x75, 0x03,  // Report Size (3)
-    0x91, 0x01,  // Output (Constant)
-
-    // Regular Keys
-    0x95, 0x06,  // Report Count (6)
-    0x75, 0x08,  // Report Size (8)
-    0x15, 0x00,  // Logical Minimum (0)
-    0x25, 0x65,  // Logical Maximum (101)
-    0x05, 0x07,  // Usage Page (Key Codes)
-    0x19, 0x00,  // Usage Minimum (0)
-    0x29, 0x65,  // Usage Maximum (101)
-    0x81, 0x00,  // Input (Data, Array)
-
-    0xC0  // End Collection
+static const ble_hid_report_descriptor_t input_descriptor = {
+    .report_id = BLE_HID_DEFAULT_REPORT_ID,
+    .report_type = BLE_HID_REPORT_TYPE_INPUT,
+};
+
+static const ble_hid_report_descriptor_t nkro_descriptor = {
+    .report_id = BLE_HID_NKRO_REPORT_ID,
+    .report_type = BLE_HID_REPORT_TYPE_INPUT,
+};
+
+static const ble_hid_report_descriptor_t mouse_descriptor = {
+    .report_id = BLE_HID_MOUSE_REPORT_ID,
+    .report_type = BLE_HID_REPORT_TYPE_INPUT,
+};
+
+static const ble_hid_report_descriptor_t consumer_descriptor = {
+    .report_id = BLE_HID_CONSUMER_REPORT_ID,
+    .report_type = BLE_HID_REPORT_TYPE_INPUT,
 };
 
-static ble_hid_report_descriptor_t input_descriptor = {
-    .report_id = 0x01,
+static const ble_hid_report_descriptor_t system_descriptor = {
+    .report_id = BLE_HID_SYSTEM_REPORT_ID,
     .report_type = BLE_HID_REPORT_TYPE_INPUT,
 };
 
-static ble_hid_report_descriptor_t output_descriptor = {
-    .report_id = 0x01,
+static const ble_hid_report_descriptor_t output_descriptor = {
+    .report_id = BLE_HID_DEFAULT_REPORT_ID,
     .report_type = BLE_HID_REPORT_TYPE_OUTPUT,
 };
 
-static ble_cccd_data_t input_report_cccd = {
-    .ind_enabled = 0,
-    .notif_enabled = 0,
-    .reserved2 = 0,
-    .reserved = 0,
+const ble_gatt_attr_t ble_hid_info_attr = {
+    .span = {&hid_info, sizeof(hid_info)},
+};
+const ble_gatt_attr_t ble_hid_input_ref_attr = {
+    .span = {&input_descriptor, sizeof(input_descriptor)},
+};
+const ble_gatt_attr_t ble_hid_nkro_ref_attr = {
+    .span = {&nkro_descriptor, sizeof(nkro_descriptor)},
+};
+const ble_gatt_attr_t ble_hid_mouse_ref_attr = {
+    .span = {&mouse_descriptor, sizeof(mouse_descriptor)},
+};
+const ble_gatt_attr_t ble_hid_consumer_ref_attr = {
+    .span = {&consumer_descriptor, sizeof(consumer_descriptor)},
+};
+const ble_gatt_attr_t ble_hid_system_ref_attr = {
+    .span = {&system_descriptor, sizeof(system_descriptor)},
+};
+const ble_gatt_attr_t ble_hid_output_ref_attr = {
+    .span = {&output_descriptor, sizeof(output_descriptor)},
+};
+const ble_gatt_attr_t ble_hid_control_point_attr = {
+    .write = hid_control_point_write,
+};
+// Shared by the report-mode and boot input reports.
+const ble_gatt_attr_t ble_hid_input_report_attr = {
+    .read = hid_input_report_read,
+};
+// Shared by the report-mode and boot output reports.
+const ble_gatt_attr_t ble_hid_output_report_attr = {
+    .write = hid_output_report_write,
+};
+const ble_gatt_attr_t ble_hid_protocol_mode_attr = {
+    .read = hid_protocol_mode_read,
+    .write = hid_protocol_mode_write,
+};
+
+// Report-mode input reports indexed by report ID. Unused IDs have length 0.
+typedef struct hid_input_route {
+  ble_gatt_chr_id_t chr;
+  gap_conn_sub_t sub;
+  uint8_t length;
+  uint8_t flags;  // ble_hid_sched_flags_t
+} hid_input_route_t;
+
+static const hid_input_route_t input_routes[BLE_HID_REPORT_ID_COUNT] = {
+    [BLE_HID_DEFAULT_REPORT_ID] = {BLE_GATT_CHR_HID_INPUT,
+                                   GAP_CONN_SUB_HID_INPUT,
+                                   sizeof(ble_keyboard_report_t),
+                                   BLE_HID_SCHED_STATE | BLE_HID_SCHED_KEYS},
+    [BLE_HID_NKRO_REPORT_ID] = {BLE_GATT_CHR_HID_NKRO, GAP_CONN_SUB_HID_NKRO,
+                                sizeof(ble_keyboard_nkro_report_t),
+                                BLE_HID_SCHED_STATE | BLE_HID_SCHED_KEYS},
+    [BLE_HID_MOUSE_REPORT_ID] = {BLE_GATT_CHR_HID_MOUSE,
+                                 GAP_CONN_SUB_HID_MOUSE,
+                                 sizeof(ble_mouse_report_t), 0},
+    [BLE_HID_CONSUMER_REPORT_ID] = {BLE_GATT_CHR_HID_CONSUMER,
+                                    GAP_CONN_SUB_HID_CONSUMER,
+                                    sizeof(ble_consumer_report_t),
+                                    BLE_HID_SCHED_STATE},
+    [BLE_HID_SYSTEM_REPORT_ID] = {BLE_GATT_CHR_HID_SYSTEM,
+                                  GAP_CONN_SUB_HID_SYSTEM,
+                                  sizeof(ble_system_report_t),
+                                  BLE_HID_SCHED_STATE},
 };
 
+// Every input characteristic, including the boot keyboard report that has no
+// report ID of its own.
+#define HID_INPUT_SUBS                                               \
+  (GAP_CONN_SUB_HID_INPUT | GAP_CONN_SUB_HID_NKRO |                  \
+   GAP_CONN_SUB_HID_BOOT_INPUT | GAP_CONN_SUB_HID_MOUSE |            \
+   GAP_CONN_SUB_HID_CONSUMER | GAP_CONN_SUB_HID_SYSTEM)
+
+static const hid_input_route_t* hid_input_route(uint8_t report_id) {
+  if (report_id >= BLE_HID_REPORT_ID_COUNT ||
+      input_routes[report_id].length == 0) {
+    return NULL;
+  }
+  return &input_routes[report_id];
+}
+
+// Maps an input characteristic's value handle to its subscription bit.
+static bool hid_input_sub(uint16_t attr_handle, gap_conn_sub_t* sub) {
+  if (attr_handle == ble_gatt_chr_handle(BLE_GATT_CHR_HID_BOOT_INPUT)) {
+    *sub = GAP_CONN_SUB_HID_BOOT_INPUT;
+    return true;
+  }
+
+  for (uint8_t id = 0; id < BLE_HID_REPORT_ID_COUNT; id++) {
+    const hid_input_route_t* route = hid_input_route(id);
+    if (route != NULL && attr_handle == ble_gatt_chr_handle(route->chr)) {
+      *sub = route->sub;
+      return true;
+    }
+  }
+  return false;
+}
+
 int ble_hid_init(void) {
   int rc;
-  rc = ble_gatts_count_cfg(hid_defs);
-  if (rc != 0) {
-    return rc;
+  ble_hid_report_queue_init(&report_queue);
+  atomic_init(&drain_pending, false);
+  atomic_init(&nkro_subscribed, false);
+  ble_npl_event_init(&drain_event, hid_drain_event_cb, NULL);
+  ble_npl_event_init(&interval_event, hid_interval_event_cb, NULL);
+  atomic_init(&interval_armed, false);
+  ble_hid_sched_init(&sched);
+
+  const esp_timer_create_args_t timer_args = {
+      .callback = hid_interval_timer_cb,
+      .name = "hid_interval",
+  };
+  rc = esp_timer_create(&timer_args, &interval_timer);
+  if (rc != ESP_OK) {
+    return BLE_HS_ENOMEM;
   }
 
-  rc = ble_gatts_add_svcs(hid_defs);
+  rc = ble_hid_mbuf_init(hid_on_mbuf_free);
   if (rc != 0) {
     return rc;
   }
 
-  ESP_LOGI(TAG, "Battery service initialized");
   return 0;
 }
 
-static int hid_info_access(uint16_t conn_handle, uint16_t attr_handle,
-                           struct ble_gatt_access_ctxt* ctxt, void* arg) {
-  if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
-    ESP_LOGI(TAG, "Accessing HID info (op=%d)", ctxt->op);
-    int rc = os_mbuf_append(ctxt->om, &hid_info, sizeof(hid_info));
-    if (rc != 0) {
-      ESP_LOGE(TAG, "Failed to append HID info, error code: %d", rc);
-      return rc;
+// Called from the typing task (core 1). Only one task may produce reports;
+// the NimBLE host task (core 0) is the only consumer.
+int ble_hid_send_report(uint8_t report_id, const uint8_t* data, size_t length) {
+  const hid_input_route_t* route = hid_input_route(report_id);
+  if (route == NULL || length != route->length) {
+    return BLE_HS_EINVAL;
+  }
+
+  if (!ble_hid_report_queue_push(&report_queue, report_id, data, length,
+                                 ble_diag_now_us())) {
+    // Backpressure: the caller keeps the keystroke and retries.
+    return BLE_HS_EAGAIN;
+  }
+
+  conn_params_activity();
+  hid_schedule_drain();
+  return 0;
+}
+
+int ble_hid_set_report_source(uint8_t report_id,
+                              const ble_hid_report_source_t* source) {
+  if (hid_input_route(report_id) == NULL) {
+    return BLE_HS_EINVAL;
+  }
+  atomic_store(&report_sources[report_id], source);
+  return 0;
+}
+
+void ble_hid_report_source_ready(void) {
+  if (!atomic_exchange(&interval_armed, true)) {
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &interval_event);
+  }
+}
+
+static void hid_schedule_drain(void) {
+  // Only wake the host task if a drain isn't already scheduled.
+  if (!atomic_exchange(&drain_pending, true)) {
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &drain_event);
+  }
+}
+
+// A pool block came back: the controller took the notification (or the stack
+// dropped it), so the STACK stage ends here rather than at the synchronous
+// NOTIFY_TX. The freed block may unblock a stalled drain.
+static void hid_on_mbuf_free(const ble_hid_mbuf_stamp_t* stamp) {
+  uint32_t now = ble_diag_now_us();
+  ble_diag_record(BLE_DIAG_STAGE_STACK, now - stamp->handoff_us);
+  ble_diag_record(BLE_DIAG_STAGE_TOTAL, now - stamp->enqueued_us);
+  hid_schedule_drain();
+}
+
+static void hid_drain_event_cb(struct ble_npl_event* ev) {
+  // Clear before draining so a report pushed mid-drain schedules another run.
+  atomic_store(&drain_pending, false);
+  hid_drain();
+}
+
+static void hid_drain(void) {
+  // NimBLE raises GAP events from inside ble_gatts_notify_custom, so the
+  // sink may find its way back here.
+  if (draining) {
+    return;
+  }
+
+  draining = true;
+  size_t drained = ble_hid_report_queue_drain(
+      &report_queue, BLE_HID_REPORT_QUEUE_LEN, hid_queue_sink, NULL);
+  draining = false;
+
+  TaskHandle_t waiter = atomic_exchange(&space_waiter, NULL);
+  if (waiter != NULL && drained > 0) {
+    xTaskNotifyGive(waiter);
+  } else if (waiter != NULL) {
+    atomic_store(&space_waiter, waiter);
+  }
+}
+
+void ble_hid_wait_for_space(void) {
+  atomic_store(&space_waiter, xTaskGetCurrentTaskHandle());
+  // Re-check after publishing, or a drain in between would go unnoticed.
+  if (ble_hid_report_queue_count(&report_queue) < BLE_HID_REPORT_QUEUE_LEN) {
+    atomic_store(&space_waiter, NULL);
+    return;
+  }
+  // The timeout only covers a link dropping with the queue still full.
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+  atomic_store(&space_waiter, NULL);
+}
+
+bool ble_hid_nkro_enabled(void) { return atomic_load(&nkro_subscribed); }
+
+void ble_hid_on_connect(uint16_t conn_handle) {
+  // Protocol Mode is per connection and starts out as Report Protocol.
+  gap_conn_t* conn = gap_conn_find(conn_handle);
+  if (conn != NULL) {
+    conn->protocol_mode = BLE_HID_PROTOCOL_MODE_REPORT;
+  }
+}
+
+// LEDs and suspend state follow the host getting input; with none, nothing
+// is lit and nothing is suspended.
+static void hid_update_host_state(void) {
+  const gap_conn_t* conn = gap_conn_find(gap_output_conn());
+  uint32_t state = 0;
+  if (conn != NULL) {
+    state = conn->leds | (conn->suspended ? BLE_HID_STATE_SUSPENDED : 0);
+  }
+  ble_hid_state_update(BLE_HID_STATE_LEDS | BLE_HID_STATE_SUSPENDED, state);
+}
+
+void ble_hid_on_disconnect(uint16_t conn_handle) {
+  hid_update_nkro();
+  hid_update_host_state();
+}
+
+void ble_hid_on_enc_change(const struct ble_gap_conn_desc* desc) {
+  gap_conn_t* conn = gap_conn_find(desc->conn_handle);
+  if (conn == NULL) {
+    return;
+  }
+
+  // NimBLE only replays the stored CCCDs after this event; seed them now so
+  // reports queued while reconnecting go out straight away.
+  if (desc->sec_state.bonded) {
+    for (uint8_t id = 0; id < BLE_HID_REPORT_ID_COUNT; id++) {
+      const hid_input_route_t* route = hid_input_route(id);
+      if (route != NULL) {
+        gap_conn_restore_cccd(conn, &desc->peer_id_addr,
+                              ble_gatt_chr_handle(route->chr), route->sub);
+      }
     }
-    ESP_LOGI(TAG, "HID info read successfully");
+    gap_conn_restore_cccd(conn, &desc->peer_id_addr,
+                          ble_gatt_chr_handle(BLE_GATT_CHR_HID_BOOT_INPUT),
+                          GAP_CONN_SUB_HID_BOOT_INPUT);
+  }
+
+  // The host getting input starts with nothing pressed on a new link.
+  if (desc->conn_handle == gap_output_conn()) {
+    ble_hid_sched_forget(&sched);
+  }
+  hid_update_nkro();
+  hid_update_host_state();
+  hid_schedule_drain();
+}
+
+// A link that is up but not yet ready may still become a target once
+// encryption is restored, so reports are held for it rather than dropped.
+static bool hid_conn_pending(const gap_conn_t* conn) {
+  return !conn->encrypted;
+}
+
+// Drops reports the host wouldn't notice missing, then sends the rest.
+static int hid_queue_sink(const ble_hid_queued_report_t* report, void* arg) {
+  if (ble_hid_sched_redundant(&sched, &report_queue, report,
+                              input_routes[report->report_id].flags)) {
+    BLE_TRACE1(HID_REPORT_COLLAPSED, report->report_id);
     return 0;
   }
+  return hid_notify_sink(report, arg);
+}
+
+static bool hid_conn_ready(const gap_conn_t* conn) {
+  return conn->encrypted && (conn->subscriptions & HID_INPUT_SUBS) != 0;
+}
 
-  ESP_LOGE(TAG, "Invalid operation for HID info (op=%d)", ctxt->op);
-  return BLE_ATT_ERR_UNLIKELY;
+// Reports are only sent to the host getting input, so its link alone picks
+// the keyboard format.
+static void hid_update_nkro(void) {
+  const gap_conn_t* conn = gap_conn_find(gap_output_conn());
+  atomic_store(&nkro_subscribed,
+               conn != NULL && hid_conn_ready(conn) &&
+                   gap_conn_subscribed(conn, GAP_CONN_SUB_HID_NKRO) &&
+                   conn->protocol_mode == BLE_HID_PROTOCOL_MODE_REPORT);
 }
-static int hid_report_map_access(uint16_t conn_handle, uint16_t attr_handle,
-                                 struct ble_gatt_access_ctxt* ctxt, void* arg) {
-  if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
-    ESP_LOGI(TAG, "Accessing HID report map (op=%d)", ctxt->op);
-    int rc = os_mbuf_append(ctxt->om, report_map, sizeof(report_map));
-    if (rc != 0) {
-      ESP_LOGE(TAG, "Failed to append HID report map, error code: %d", rc);
-      return rc;
+
+// Resolves where `report_id` goes on `conn`. Returns false for reports the
+// connection's protocol mode can't carry.
+static bool hid_report_target(const gap_conn_t* conn, uint8_t report_id,
+                              uint16_t* chr_handle, gap_conn_sub_t* sub) {
+  if (conn->protocol_mode == BLE_HID_PROTOCOL_MODE_BOOT) {
+    // Boot Protocol only carries the keyboard, in the same 8-byte layout.
+    *chr_handle = ble_gatt_chr_handle(BLE_GATT_CHR_HID_BOOT_INPUT);
+    *sub = GAP_CONN_SUB_HID_BOOT_INPUT;
+    return report_id == BLE_HID_DEFAULT_REPORT_ID;
+  }
+
+  const hid_input_route_t* route = hid_input_route(report_id);
+  if (route == NULL) {
+    return false;
+  }
+  *chr_handle = ble_gatt_chr_handle(route->chr);
+  *sub = route->sub;
+  return true;
+}
+
+void ble_hid_on_subscribe(const struct ble_gap_event* event) {
+  gap_conn_t* conn = gap_conn_find(event->subscribe.conn_handle);
+  if (conn == NULL) {
+    return;
+  }
+
+  gap_conn_sub_t sub;
+  if (!hid_input_sub(event->subscribe.attr_handle, &sub)) {
+    return;
+  }
+
+  gap_conn_set_subscribed(conn, sub, event->subscribe.cur_notify);
+  hid_update_nkro();
+}
+
+// Connection interval of the host getting input, in microseconds.
+static uint64_t hid_interval_us(void) {
+  const gap_conn_t* conn = gap_conn_find(gap_output_conn());
+  uint16_t itvl = HID_DEFAULT_ITVL;
+  if (conn != NULL && hid_conn_ready(conn) && conn->itvl != 0) {
+    itvl = conn->itvl;
+  }
+  return (uint64_t)itvl * 1250;
+}
+
+// Sends at most one report per source. Returns true while any source still
+// had data, so the caller keeps polling.
+static bool hid_poll_sources(void) {
+  bool active = false;
+  for (uint8_t id = 0; id < BLE_HID_REPORT_ID_COUNT; id++) {
+    const ble_hid_report_source_t* source = atomic_load(&report_sources[id]);
+    if (source == NULL) {
+      continue;
     }
-    ESP_LOGI(TAG, "HID report map read successfully");
 
-    return 0;
+    ble_hid_queued_report_t report = {
+        .report_id = id,
+        .length = input_routes[id].length,
+        .enqueued_us = ble_diag_now_us(),
+    };
+    if (!source->peek(report.data, source->arg)) {
+      continue;
+    }
+
+    active = true;
+    if (hid_notify_sink(&report, NULL) == 0) {
+      source->commit(report.data, source->arg);
+    }
   }
-  ESP_LOGE(TAG, "Invalid operation for HID report map (op=%d)", ctxt->op);
-  return BLE_ATT_ERR_UNLIKELY;
+  return active;
 }
 
-static int hid_control_point_access(uint16_t conn_handle, uint16_t attr_handle,
-                                    struct ble_gatt_access_ctxt* ctxt,
-                                    void* arg) {
-  if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
-    ESP_LOGI(TAG, "Accessing HID control point (op=%d)", ctxt->op);
-    ESP_LOGI(TAG, "Writing HID control point (op=%d) %d bytes", ctxt->op,
-             (int)ctxt->om->om_len);
-    ESP_LOG_BUFFER_HEX(TAG, ctxt->om->om_data, ctxt->om->om_len);
-    return 0;
+// One connection interval has passed: refill the budget, send queued reports
+// first, then whatever the sources have accumulated.
+static void hid_interval_event_cb(struct ble_npl_event* ev) {
+  ble_hid_sched_refill(&sched);
+  hid_drain();
+  bool active = hid_poll_sources();
+  if (active || (ble_hid_sched_exhausted(&sched) &&
+                 ble_hid_report_queue_count(&report_queue) > 0)) {
+    esp_timer_start_once(interval_timer, hid_interval_us());
+    return;
   }
-  return 0;
+
+  // Producers call ble_hid_report_source_ready after every update, so data
+  // landing after the poll waits at most one update.
+  ble_hid_sched_refill(&sched);
+  atomic_store(&interval_armed, false);
 }
-static int hid_input_report_access(uint16_t conn_handle, uint16_t attr_handle,
-                                   struct ble_gatt_access_ctxt* ctxt,
-                                   void* arg) {
-  return 0;
+
+static void hid_interval_timer_cb(void* arg) {
+  ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &interval_event);
 }
 
-static int hid_input_report_dsc_access(uint16_t conn_handle,
-                                       uint16_t attr_handle,
-                                       struct ble_gatt_access_ctxt* ctxt,
-                                       void* arg) {
-  const ble_uuid16_t* uuid = (const ble_uuid16_t*)ctxt->dsc->uuid;
-  ESP_LOGI(TAG, "Accessing input report descriptor (op=%d)", ctxt->op);
-
-  if (uuid->value == BLE_REPORT_DESCRIPTOR_UUID) {
-    if (ctxt->op == BLE_GATT_ACCESS_OP_READ_DSC) {
-      ESP_LOGI(TAG, "Reading input report descriptor (op=%d)", ctxt->op);
-      int rc =
-          os_mbuf_append(ctxt->om, &input_descriptor, sizeof(input_descriptor));
-      if (rc != 0) {
-        ESP_LOGE(TAG,
-                 "Failed to append input report descriptor, error code: %d",
-                 rc);
-        return rc;
-      }
-      ESP_LOGI(TAG, "Input report descriptor read successfully");
-      return 0;
+// Host task: starts the clock when the budget runs out.
+static void hid_arm_interval(void) {
+  if (!atomic_exchange(&interval_armed, true)) {
+    esp_timer_start_once(interval_timer, hid_interval_us());
+  }
+}
+
+// Whether any link is still securing: it may turn out to be the host that
+// gets input.
+static bool hid_output_pending(void) {
+  for (size_t slot = 0; slot < GAP_CONN_TABLE_SIZE; slot++) {
+    gap_conn_t* conn = gap_conn_at(slot);
+    if (conn != NULL && hid_conn_pending(conn)) {
+      return true;
     }
   }
+  return false;
+}
 
-  if (uuid->value == BLE_CCCD_DESCRIPTOR_UUID) {
-    if (ctxt->op == BLE_GATT_ACCESS_OP_READ_DSC) {
-      ESP_LOGI(TAG, "Reading input report cccd descriptor (op=%d)", ctxt->op);
-      int rc = os_mbuf_append(ctxt->om, &input_report_cccd,
-                              sizeof(input_report_cccd));
-      if (rc != 0) {
-        ESP_LOGE(
-            TAG,
-            "Failed to append input report cccd descriptor, error code: %d",
-            rc);
-        return rc;
-      }
-      ESP_LOGI(TAG, "Input report descriptor read successfully");
-      return 0;
+// Hands one notification to the stack. `om` goes back to the pool once the
+// controller has taken it, which restarts a drain stalled on an empty pool.
+static void hid_notify(uint16_t conn_handle, uint16_t chr_handle,
+                       struct os_mbuf* om) {
+  int rc = ble_gatts_notify_custom(conn_handle, chr_handle, om);
+  if (rc != 0) {
+    ESP_LOGE(TAG, "Failed to notify input report, error code: %d", rc);
+  }
+}
+
+// Sends a report to the host getting input, if it subscribed to it.
+static int hid_notify_sink(const ble_hid_queued_report_t* report, void* arg) {
+  gap_conn_t* conn = gap_conn_find(gap_output_conn());
+  uint16_t chr_handle;
+  gap_conn_sub_t sub;
+  if (conn == NULL || !conn->encrypted) {
+    // Hold reports while a link is still securing; drop them when no host
+    // is there to take them. ble_hid_on_enc_change kicks the drain again.
+    return hid_output_pending() ? BLE_HS_EAGAIN : 0;
+  }
+  if (!hid_report_target(conn, report->report_id, &chr_handle, &sub) ||
+      !gap_conn_subscribed(conn, sub)) {
+    return 0;
+  }
+
+  // This interval's share is used up; the interval clock resumes draining.
+  if (ble_hid_sched_exhausted(&sched)) {
+    hid_arm_interval();
+    return BLE_HS_EAGAIN;
+  }
+
+  // Every pool block is still with the stack: keep the report queued until
+  // one is released.
+  ble_hid_mbuf_stamp_t stamp = {report->enqueued_us, ble_diag_now_us()};
+  struct os_mbuf* om =
+      ble_hid_mbuf_get(report->data, report->length, &stamp);
+  if (om == NULL) {
+    return BLE_HS_ENOMEM;
+  }
+
+  ble_hid_sched_sent(&sched, report, input_routes[report->report_id].flags);
+
+  ble_diag_record(BLE_DIAG_STAGE_QUEUE, stamp.handoff_us - stamp.enqueued_us);
+  hid_notify(conn->conn_handle, chr_handle, om);
+  return 0;
+}
+
+// Sends an all-released report for every state the host on `conn_handle`
+// last saw non-zero, so nothing stays held there once input moves away.
+// These go out ahead of the interval budget: the switch shouldn't wait.
+static void hid_release_all(uint16_t conn_handle) {
+  static const uint8_t released[BLE_HID_REPORT_MAX_LEN];
+  gap_conn_t* conn = gap_conn_find(conn_handle);
+  if (conn == NULL || !conn->encrypted) {
+    return;
+  }
+
+  for (uint8_t id = 0; id < BLE_HID_REPORT_ID_COUNT; id++) {
+    const hid_input_route_t* route = hid_input_route(id);
+    uint16_t chr_handle;
+    gap_conn_sub_t sub;
+    if (route == NULL || (route->flags & BLE_HID_SCHED_STATE) == 0 ||
+        ble_hid_sched_released(&sched, id, route->length) ||
+        !hid_report_target(conn, id, &chr_handle, &sub) ||
+        !gap_conn_subscribed(conn, sub)) {
+      continue;
     }
 
-    if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_DSC) {
-      ESP_LOGI(TAG, "Writing input report descriptor (op=%d)", ctxt->op);
-      struct os_mbuf* om = ctxt->om;
-      int rc = os_mbuf_copydata(om, 0, sizeof(input_report_cccd),
-                                &input_report_cccd);
-      if (rc != 0) {
-        ESP_LOGE(TAG, "Failed to copy data from om, error code: %d", rc);
-        return rc;
-      }
-      ESP_LOGI(TAG, "Input report descriptor written successfully");
-      return 0;
+    uint32_t now = ble_diag_now_us();
+    ble_hid_mbuf_stamp_t stamp = {now, now};
+    struct os_mbuf* om = ble_hid_mbuf_get(released, route->length, &stamp);
+    if (om == NULL) {
+      ESP_LOGW(TAG, "No buffer to release report %u on handle %d", id,
+               conn_handle);
+      continue;
     }
+    hid_notify(conn_handle, chr_handle, om);
+    ble_hid_sched_set_state(&sched, id, released, route->length);
   }
+}
 
-  ESP_LOGE(TAG,
-           "Invalid operation for input report descriptor (op=%d, uuid=%04x)",
-           ctxt->op, uuid->value);
-  return BLE_ATT_ERR_UNLIKELY;
+void ble_hid_on_output_change(uint16_t old_conn_handle) {
+  // GAP events raised from inside the notifies must not start a drain: it
+  // would send to the new host against the old host's state.
+  bool was_draining = draining;
+  draining = true;
+  hid_release_all(old_conn_handle);
+  draining = was_draining;
+  // The new host hasn't seen anything from us yet, as on a fresh link.
+  ble_hid_sched_forget(&sched);
+  hid_update_nkro();
+  hid_update_host_state();
+  hid_schedule_drain();
 }
 
-static int hid_output_report_access(uint16_t conn_handle, uint16_t attr_handle,
-                                    struct ble_gatt_access_ctxt* ctxt,
-                                    void* arg) {
-  ESP_LOGI(TAG, "Accessing output report (op=%d)", ctxt->op);
-  if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
-    ESP_LOGI(TAG, "Writing output report (op=%d) %d bytes", ctxt->op,
-             (int)ctxt->om->om_len);
-    ESP_LOG_BUFFER_HEX(TAG, ctxt->om->om_data, ctxt->om->om_len);
-    return 0;
+static int hid_control_point_write(uint16_t conn_handle, struct os_mbuf* om) {
+  uint8_t command = 0;
+  if (OS_MBUF_PKTLEN(om) != sizeof(command) ||
+      os_mbuf_copydata(om, 0, sizeof(command), &command) != 0) {
+    return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
   }
 
-  ESP_LOGE(TAG, "Invalid operation for output report (op=%d)", ctxt->op);
-  return BLE_ATT_ERR_UNLIKELY;
-}
-
-static int hid_output_report_dsc_access(uint16_t conn_handle,
-                                        uint16_t attr_handle,
-                                        struct ble_gatt_access_ctxt* ctxt,
-                                        void* arg) {
-  if (ctxt->op == BLE_GATT_ACCESS_OP_READ_DSC) {
-    ESP_LOGI(TAG, "Accessing output report descriptor (op=%d)", ctxt->op);
-    const ble_uuid16_t* uuid = (const ble_uuid16_t*)ctxt->dsc->uuid;
-    if (uuid->value == BLE_REPORT_DESCRIPTOR_UUID) {
-      ESP_LOGI(TAG, "Reading output report descriptor (op=%d)", ctxt->op);
-      int rc = os_mbuf_append(ctxt->om, &output_descriptor,
-                              sizeof(output_descriptor));
-      if (rc != 0) {
-        ESP_LOGE(TAG,
-                 "Failed to append output report descriptor, error code: %d",
-                 rc);
-        return rc;
-      }
-      ESP_LOGI(TAG, "Output report descriptor read successfully");
+  BLE_TRACE3(HID_CONTROL_POINT_WRITE, conn_handle, sizeof(command), command);
+  gap_conn_t* conn = gap_conn_find(conn_handle);
+  if (conn == NULL) {
+    return BLE_ATT_ERR_UNLIKELY;
+  }
+
+  // Write Without Response, so unknown commands are ignored rather than
+  // answered with an error nobody sees.
+  bool suspended;
+  switch (command) {
+    case BLE_HID_CONTROL_POINT_SUSPEND:
+      suspended = true;
+      break;
+    case BLE_HID_CONTROL_POINT_EXIT_SUSPEND:
+      suspended = false;
+      break;
+    default:
       return 0;
-    }
   }
 
-  ESP_LOGE(TAG, "Invalid operation for output report descriptor (op=%d)",
-           ctxt->op);
-  return BLE_ATT_ERR_UNLIKELY;
-}
-static int hid_protocol_mode_access(uint16_t conn_handle, uint16_t attr_handle,
-                                    struct ble_gatt_access_ctxt* ctxt,
-                                    void* arg) {
-  if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
-    ESP_LOGI(TAG, "Accessing HID protocol mode (op=%d)", ctxt->op);
-    int rc =
-        os_mbuf_append(ctxt->om, &hid_protocol_mode, sizeof(hid_protocol_mode));
-    if (rc != 0) {
-      ESP_LOGE(TAG, "Failed to append HID protocol mode, error code: %d", rc);
-      return rc;
-    }
-    ESP_LOGI(TAG, "HID protocol mode read successfully");
-    return 0;
+  if (conn->suspended != suspended) {
+    conn->suspended = suspended;
+    conn_params_on_suspend(conn);
+    hid_update_host_state();
+  }
+  return 0;
+}
+
+static int hid_input_report_read(uint16_t conn_handle,
+                                 struct ble_gatt_access_ctxt* ctxt) {
+  return 0;
+}
+
+// Report-mode and boot LED reports share this layout: one bit per LED.
+static int hid_output_report_write(uint16_t conn_handle, struct os_mbuf* om) {
+  uint8_t leds = 0;
+  if (OS_MBUF_PKTLEN(om) != sizeof(leds) ||
+      os_mbuf_copydata(om, 0, sizeof(leds), &leds) != 0) {
+    return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+  }
+
+  BLE_TRACE3(HID_OUTPUT_REPORT_WRITE, conn_handle, sizeof(leds), leds);
+  gap_conn_t* conn = gap_conn_find(conn_handle);
+  if (conn == NULL) {
+    return BLE_ATT_ERR_UNLIKELY;
   }
 
-  ESP_LOGE(TAG, "Invalid operation for HID protocol mode (op=%d)", ctxt->op);
-  return BLE_ATT_ERR_UNLIKELY;
+  // Every host keeps its own lock state; only the one typed into shows.
+  conn->leds = leds;
+  hid_update_host_state();
+  return 0;
+}
+
+static int hid_protocol_mode_read(uint16_t conn_handle,
+                                  struct ble_gatt_access_ctxt* ctxt) {
+  gap_conn_t* conn = gap_conn_find(conn_handle);
+  uint8_t mode =
+      conn != NULL ? conn->protocol_mode : BLE_HID_PROTOCOL_MODE_REPORT;
+  BLE_TRACE2(HID_PROTOCOL_MODE_READ, conn_handle, mode);
+  return ble_gatt_span_append(conn_handle, ctxt, &mode, sizeof(mode));
+}
+
+static int hid_protocol_mode_write(uint16_t conn_handle, struct os_mbuf* om) {
+  uint8_t mode = 0;
+  if (OS_MBUF_PKTLEN(om) != sizeof(mode) ||
+      os_mbuf_copydata(om, 0, sizeof(mode), &mode) != 0) {
+    return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+  }
+
+  gap_conn_t* conn = gap_conn_find(conn_handle);
+  if (conn == NULL || (mode != BLE_HID_PROTOCOL_MODE_BOOT &&
+                       mode != BLE_HID_PROTOCOL_MODE_REPORT)) {
+    return BLE_ATT_ERR_UNLIKELY;
+  }
+
+  conn->protocol_mode = mode;
+  hid_update_nkro();
+  BLE_TRACE2(HID_PROTOCOL_MODE_WRITE, conn_handle, mode);
+  return 0;
 }
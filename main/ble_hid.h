@@ -1,9 +1,18 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+#include "ble_gatt_registry.h"
+
 #define BLE_HID_DEFAULT_REPORT_ID 0x01
+#define BLE_HID_NKRO_REPORT_ID 0x02
+#define BLE_HID_MOUSE_REPORT_ID 0x03
+#define BLE_HID_CONSUMER_REPORT_ID 0x04
+#define BLE_HID_SYSTEM_REPORT_ID 0x05
+// One past the highest report ID, for ID-indexed tables.
+#define BLE_HID_REPORT_ID_COUNT 0x06
 
 #define BLE_HID_SERVICE_UUID 0x1812
 #define BLE_HID_INFO_UUID 0x2A4A
@@ -11,6 +20,8 @@
 #define BLE_HID_CONTROL_POINT_UUID 0x2A4C
 #define BLE_HID_REPORT_UUID 0x2A4D
 #define BLE_HID_PROTOCOL_MODE_UUID 0x2A4E
+#define BLE_HID_BOOT_KEYBOARD_INPUT_UUID 0x2A22
+#define BLE_HID_BOOT_KEYBOARD_OUTPUT_UUID 0x2A32
 
 #define BLE_REPORT_DESCRIPTOR_UUID 0x2908
 
@@ -36,14 +47,74 @@ typedef enum {
   BLE_HID_PROTOCOL_MODE_REPORT = 0x01,
 } ble_hid_protocol_mode_t;
 
+typedef enum {
+  BLE_HID_CONTROL_POINT_SUSPEND = 0x00,
+  BLE_HID_CONTROL_POINT_EXIT_SUSPEND = 0x01,
+} ble_hid_control_point_t;
+
+struct ble_gap_conn_desc;
+struct ble_gap_event;
+
+extern const ble_gatt_attr_t ble_hid_info_attr;
+extern const ble_gatt_attr_t ble_hid_input_ref_attr;
+extern const ble_gatt_attr_t ble_hid_nkro_ref_attr;
+extern const ble_gatt_attr_t ble_hid_mouse_ref_attr;
+extern const ble_gatt_attr_t ble_hid_consumer_ref_attr;
+extern const ble_gatt_attr_t ble_hid_system_ref_attr;
+extern const ble_gatt_attr_t ble_hid_output_ref_attr;
+extern const ble_gatt_attr_t ble_hid_control_point_attr;
+extern const ble_gatt_attr_t ble_hid_input_report_attr;
+extern const ble_gatt_attr_t ble_hid_output_report_attr;
+extern const ble_gatt_attr_t ble_hid_protocol_mode_attr;
+
 int ble_hid_init(void);
+void ble_hid_on_subscribe(const struct ble_gap_event* event);
+void ble_hid_on_connect(uint16_t conn_handle);
+void ble_hid_on_disconnect(uint16_t conn_handle);
+void ble_hid_on_enc_change(const struct ble_gap_conn_desc* desc);
+// Input moved away from `old_conn_handle` (BLE_HS_CONN_HANDLE_NONE if no
+// host had it): releases whatever that host still sees pressed and takes
+// the LEDs and suspend state from the new one.
+void ble_hid_on_output_change(uint16_t old_conn_handle);
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Queues one input report; `length` must match the report's struct in
+// ble_hid_data.h. Returns 0 when queued, BLE_HS_EAGAIN when the queue is full
+// (retry later, nothing was dropped) or BLE_HS_EINVAL for an unknown report.
 int ble_hid_send_report(uint8_t report_id, const uint8_t* data, size_t length);
 
+// Blocks the producer task until the host task has taken reports off a full
+// queue, so senders pace themselves by transmit completions after
+// ble_hid_send_report returns BLE_HS_EAGAIN.
+void ble_hid_wait_for_space(void);
+
+// An input report the host task pulls whenever it may send, rather than one
+// queued per change. Suits state that accumulates, like pointer motion, so a
+// burst of updates collapses into one report per connection interval.
+typedef struct ble_hid_report_source {
+  // Fills the report payload; returns false when there's nothing to send.
+  bool (*peek)(uint8_t* data, void* arg);
+  // The payload from the last peek was sent, or dropped for lack of hosts.
+  void (*commit)(const uint8_t* data, void* arg);
+  void* arg;
+} ble_hid_report_source_t;
+
+// Attaches `source` (static storage) to an input report. Queued reports with
+// the same ID still go out through ble_hid_send_report.
+int ble_hid_set_report_source(uint8_t report_id,
+                              const ble_hid_report_source_t* source);
+
+// Tells the host task a source has data. Safe to call from any task after
+// every update; only the first call after an idle period wakes the host.
+void ble_hid_report_source_ready(void);
+
+// True while the host getting input is subscribed to the NKRO bitmap report
+// and hasn't switched to Boot Protocol.
+bool ble_hid_nkro_enabled(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,6 +12,47 @@ typedef struct ble_keyboard_report {
   uint8_t keycode[6];
 } __attribute__((packed)) ble_keyboard_report_t;
 
+#define BLE_KEYBOARD_NKRO_KEYS 128
+
+typedef struct ble_keyboard_nkro_report {
+  uint8_t modifier;
+  uint8_t keys[BLE_KEYBOARD_NKRO_KEYS / 8];
+} __attribute__((packed)) ble_keyboard_nkro_report_t;
+
+#define BLE_MOUSE_BUTTON_LEFT (1 << 0)
+#define BLE_MOUSE_BUTTON_RIGHT (1 << 1)
+#define BLE_MOUSE_BUTTON_MIDDLE (1 << 2)
+#define BLE_MOUSE_BUTTON_BACK (1 << 3)
+#define BLE_MOUSE_BUTTON_FORWARD (1 << 4)
+
+typedef struct ble_mouse_report {
+  uint8_t buttons;
+  int8_t x;
+  int8_t y;
+  int8_t wheel;
+} __attribute__((packed)) ble_mouse_report_t;
+
+// Consumer page usages; 0 releases the key.
+#define BLE_CONSUMER_PLAY_PAUSE 0x00CD
+#define BLE_CONSUMER_SCAN_NEXT 0x00B5
+#define BLE_CONSUMER_SCAN_PREVIOUS 0x00B6
+#define BLE_CONSUMER_MUTE 0x00E2
+#define BLE_CONSUMER_VOLUME_UP 0x00E9
+#define BLE_CONSUMER_VOLUME_DOWN 0x00EA
+
+typedef struct ble_consumer_report {
+  uint16_t usage;
+} __attribute__((packed)) ble_consumer_report_t;
+
+// System control selectors; 0 releases the key.
+#define BLE_SYSTEM_POWER_DOWN 1
+#define BLE_SYSTEM_SLEEP 2
+#define BLE_SYSTEM_WAKE_UP 3
+
+typedef struct ble_system_report {
+  uint8_t control;
+} __attribute__((packed)) ble_system_report_t;
+
 #ifdef __cplusplus
 }
 #endif
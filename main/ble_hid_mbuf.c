@@ -0,0 +1,74 @@
+#include "ble_hid_mbuf.h"
+
+#include <string.h>
+
+#include "ble_hid_report_queue.h"
+#include "os/os_mempool.h"
+
+#define HID_MBUF_BLOCK_SIZE                                         \
+  OS_ALIGN(sizeof(struct os_mbuf) + sizeof(struct os_mbuf_pkthdr) + \
+               BLE_HID_REPORT_MAX_LEN,                              \
+           OS_ALIGNMENT)
+
+static os_membuf_t hid_mbuf_mem[OS_MEMPOOL_SIZE(BLE_HID_MBUF_COUNT,
+                                                HID_MBUF_BLOCK_SIZE)];
+static struct os_mempool_ext hid_mempool;
+static struct os_mbuf_pool hid_mbuf_pool;
+static ble_hid_mbuf_free_fn free_cb;
+// One stamp per block, kept outside the mbuf: the stack chains each report
+// behind its ATT header with os_mbuf_concat, which clears the report's
+// packet header, so a stamp in the user header would be gone by the free.
+static ble_hid_mbuf_stamp_t stamps[BLE_HID_MBUF_COUNT];
+
+static size_t hid_mbuf_index(const void* block) {
+  return (size_t)((const uint8_t*)block - (const uint8_t*)hid_mbuf_mem) /
+         OS_MEM_TRUE_BLOCK_SIZE(HID_MBUF_BLOCK_SIZE);
+}
+
+static os_error_t hid_mbuf_put(struct os_mempool_ext* mpe, void* data,
+                               void* arg) {
+  // Copy the stamp out before the block can be handed out again.
+  ble_hid_mbuf_stamp_t stamp = stamps[hid_mbuf_index(data)];
+
+  os_error_t rc = os_memblock_put_from_cb(&mpe->mpe_mp, data);
+  if (rc == OS_OK && free_cb != NULL) {
+    free_cb(&stamp);
+  }
+  return rc;
+}
+
+int ble_hid_mbuf_init(ble_hid_mbuf_free_fn on_free) {
+  int rc = os_mempool_ext_init(&hid_mempool, BLE_HID_MBUF_COUNT,
+                               HID_MBUF_BLOCK_SIZE, hid_mbuf_mem, "hid_rpt");
+  if (rc != 0) {
+    return rc;
+  }
+
+  free_cb = on_free;
+  hid_mempool.mpe_put_cb = hid_mbuf_put;
+  hid_mempool.mpe_put_arg = NULL;
+
+  return os_mbuf_pool_init(&hid_mbuf_pool, &hid_mempool.mpe_mp,
+                           HID_MBUF_BLOCK_SIZE, BLE_HID_MBUF_COUNT);
+}
+
+struct os_mbuf* ble_hid_mbuf_get(const uint8_t* data, size_t length,
+                                 const ble_hid_mbuf_stamp_t* stamp) {
+  if (length > BLE_HID_REPORT_MAX_LEN) {
+    return NULL;
+  }
+
+  struct os_mbuf* om = os_mbuf_get_pkthdr(&hid_mbuf_pool, 0);
+  if (om == NULL) {
+    return NULL;
+  }
+  stamps[hid_mbuf_index(om)] = *stamp;
+
+  // No headroom: ble_att_clt_tx_notify always puts the ATT header in a new
+  // msys mbuf and chains this one behind it, so each notification still
+  // costs one msys block on top of this one.
+  memcpy(om->om_data, data, length);
+  om->om_len = length;
+  OS_MBUF_PKTHDR(om)->omp_len = length;
+  return om;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "os/os_mbuf.h"
+
+// Blocks in the dedicated input-report pool. This also bounds the number of
+// notifications queued in the host waiting for controller buffers.
+#define BLE_HID_MBUF_COUNT 8
+
+// Kept for each block while the stack holds it, and handed back when the
+// block is released.
+typedef struct ble_hid_mbuf_stamp {
+  uint32_t enqueued_us;
+  uint32_t handoff_us;
+} ble_hid_mbuf_stamp_t;
+
+// `on_free` runs whenever a block returns to the pool, from whichever context
+// released it: once the stack has handed the packet to the controller, or
+// dropped it.
+typedef void (*ble_hid_mbuf_free_fn)(const ble_hid_mbuf_stamp_t* stamp);
+
+int ble_hid_mbuf_init(ble_hid_mbuf_free_fn on_free);
+
+// Returns a single-block packet holding a copy of `data`, or NULL when the
+// pool is empty. This copy out of the report queue is the only one on the
+// send path; the stack prepends its headers in an msys block of its own.
+struct os_mbuf* ble_hid_mbuf_get(const uint8_t* data, size_t length,
+                                 const ble_hid_mbuf_stamp_t* stamp);
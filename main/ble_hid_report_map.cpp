@@ -0,0 +1,180 @@
+#include "ble_hid_report_map.h"
+
+#include "ble_hid.h"
+#include "ble_hid_data.h"
+#include "hid_report_map.hpp"
+
+namespace {
+
+using hid::ReportType;
+
+constexpr auto build_report_map() {
+  hid::ReportMap<256> map;
+
+  // Keyboard
+  map.usage_page(0x01)  // Generic Desktop
+      .usage(0x06)      // Keyboard
+      .collection(hid::kApplication)
+      .report_id(BLE_HID_DEFAULT_REPORT_ID);
+
+  // Modifier keys (Left Control .. Right GUI)
+  map.usage_page(0x07)
+      .usage_min(0xE0)
+      .usage_max(0xE7)
+      .logical_min(0)
+      .logical_max(1)
+      .report_size(1)
+      .report_count(8)
+      .input(hid::kData | hid::kVariable | hid::kAbsolute);
+
+  // Reserved byte
+  map.report_count(1).report_size(8).input(hid::kConstant);
+
+  // LED status (Num Lock .. Kana) and padding
+  map.report_count(5)
+      .report_size(1)
+      .usage_page(0x08)
+      .usage_min(0x01)
+      .usage_max(0x05)
+      .output(hid::kData | hid::kVariable | hid::kAbsolute);
+  map.report_count(1).report_size(3).output(hid::kConstant);
+
+  // Regular keys
+  map.report_count(6)
+      .report_size(8)
+      .logical_min(0)
+      .logical_max(101)
+      .usage_page(0x07)
+      .usage_min(0x00)
+      .usage_max(101)
+      .input(hid::kData | hid::kArray | hid::kAbsolute);
+
+  map.end_collection();
+
+  // NKRO keyboard: one bit per key, used when the host subscribes to it
+  map.usage_page(0x01)
+      .usage(0x06)
+      .collection(hid::kApplication)
+      .report_id(BLE_HID_NKRO_REPORT_ID);
+
+  map.usage_page(0x07)
+      .usage_min(0xE0)
+      .usage_max(0xE7)
+      .logical_min(0)
+      .logical_max(1)
+      .report_size(1)
+      .report_count(8)
+      .input(hid::kData | hid::kVariable | hid::kAbsolute);
+
+  map.usage_min(0x00)
+      .usage_max(BLE_KEYBOARD_NKRO_KEYS - 1)
+      .report_count(BLE_KEYBOARD_NKRO_KEYS)
+      .input(hid::kData | hid::kVariable | hid::kAbsolute);
+
+  map.end_collection();
+
+  // Relative mouse: five buttons, X/Y and wheel
+  map.usage_page(0x01)  // Generic Desktop
+      .usage(0x02)      // Mouse
+      .collection(hid::kApplication)
+      .report_id(BLE_HID_MOUSE_REPORT_ID)
+      .usage(0x01)  // Pointer
+      .collection(hid::kPhysical);
+
+  map.usage_page(0x09)  // Buttons
+      .usage_min(1)
+      .usage_max(5)
+      .logical_min(0)
+      .logical_max(1)
+      .report_size(1)
+      .report_count(5)
+      .input(hid::kData | hid::kVariable | hid::kAbsolute);
+  map.report_count(1).report_size(3).input(hid::kConstant);
+
+  map.usage_page(0x01)
+      .usage(0x30)  // X
+      .usage(0x31)  // Y
+      .usage(0x38)  // Wheel
+      .logical_min(-127)
+      .logical_max(127)
+      .report_size(8)
+      .report_count(3)
+      .input(hid::kData | hid::kVariable | hid::kRelative);
+
+  map.end_collection().end_collection();
+
+  // Consumer control: one 16-bit usage at a time (media, volume, ...)
+  map.usage_page(0x0C)  // Consumer
+      .usage(0x01)      // Consumer Control
+      .collection(hid::kApplication)
+      .report_id(BLE_HID_CONSUMER_REPORT_ID)
+      .usage_min(0x000)
+      .usage_max(0x3FF)
+      .logical_min(0x000)
+      .logical_max(0x3FF)
+      .report_size(16)
+      .report_count(1)
+      .input(hid::kData | hid::kArray | hid::kAbsolute);
+  map.end_collection();
+
+  // System control: Power Down, Sleep, Wake Up
+  map.usage_page(0x01)  // Generic Desktop
+      .usage(0x80)      // System Control
+      .collection(hid::kApplication)
+      .report_id(BLE_HID_SYSTEM_REPORT_ID)
+      .usage_min(0x81)
+      .usage_max(0x83)
+      .logical_min(1)
+      .logical_max(3)
+      .report_size(2)
+      .report_count(1)
+      .input(hid::kData | hid::kArray | hid::kAbsolute | hid::kNullState);
+  map.report_count(1).report_size(6).input(hid::kConstant);
+  map.end_collection();
+
+  return map;
+}
+
+constexpr auto kBuilder = build_report_map();
+
+static_assert(kBuilder.balanced(), "unterminated collection in report map");
+
+static_assert(kBuilder.report_bytes(BLE_HID_DEFAULT_REPORT_ID,
+                                    ReportType::Input) ==
+                  sizeof(ble_keyboard_report_t),
+              "keyboard input report does not match ble_keyboard_report_t");
+static_assert(kBuilder.report_bytes(BLE_HID_DEFAULT_REPORT_ID,
+                                    ReportType::Output) == 1,
+              "keyboard output report must be a single LED byte");
+static_assert(kBuilder.report_bytes(BLE_HID_NKRO_REPORT_ID,
+                                    ReportType::Input) ==
+                  sizeof(ble_keyboard_nkro_report_t),
+              "NKRO input report does not match ble_keyboard_nkro_report_t");
+
+static_assert(kBuilder.report_bytes(BLE_HID_MOUSE_REPORT_ID,
+                                    ReportType::Input) ==
+                  sizeof(ble_mouse_report_t),
+              "mouse input report does not match ble_mouse_report_t");
+static_assert(kBuilder.report_bytes(BLE_HID_CONSUMER_REPORT_ID,
+                                    ReportType::Input) ==
+                  sizeof(ble_consumer_report_t),
+              "consumer input report does not match ble_consumer_report_t");
+static_assert(kBuilder.report_bytes(BLE_HID_SYSTEM_REPORT_ID,
+                                    ReportType::Input) ==
+                  sizeof(ble_system_report_t),
+              "system input report does not match ble_system_report_t");
+
+// The boot keyboard input report is the report-mode keyboard report without
+// its ID, so both must stay 8 bytes.
+static_assert(sizeof(ble_keyboard_report_t) == 8,
+              "boot keyboard report must be 8 bytes");
+
+constexpr auto kReportMap = hid::to_array<kBuilder.size()>(kBuilder);
+
+}  // namespace
+
+extern "C" {
+constinit const ble_gatt_attr_t ble_hid_report_map_attr = {
+    .span = {kReportMap.data(), kReportMap.size()},
+};
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "ble_gatt_registry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Generated at compile time in ble_hid_report_map.cpp.
+extern const ble_gatt_attr_t ble_hid_report_map_attr;
+
+#ifdef __cplusplus
+}
+#endif
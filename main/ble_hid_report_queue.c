@@ -0,0 +1,90 @@
+#include "ble_hid_report_queue.h"
+
+#include <string.h>
+
+#define QUEUE_MASK (BLE_HID_REPORT_QUEUE_LEN - 1)
+
+_Static_assert((BLE_HID_REPORT_QUEUE_LEN & QUEUE_MASK) == 0,
+               "BLE_HID_REPORT_QUEUE_LEN must be a power of two");
+
+void ble_hid_report_queue_init(ble_hid_report_queue_t* queue) {
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+}
+
+bool ble_hid_report_queue_push(ble_hid_report_queue_t* queue,
+                               uint8_t report_id, const uint8_t* data,
+                               size_t length, uint32_t enqueued_us) {
+  if (length > BLE_HID_REPORT_MAX_LEN) {
+    return false;
+  }
+
+  uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+  if (head - tail == BLE_HID_REPORT_QUEUE_LEN) {
+    return false;
+  }
+
+  ble_hid_queued_report_t* entry = &queue->entries[head & QUEUE_MASK];
+  entry->report_id = report_id;
+  entry->length = (uint8_t)length;
+  memcpy(entry->data, data, length);
+  entry->enqueued_us = enqueued_us;
+
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+  return true;
+}
+
+const ble_hid_queued_report_t* ble_hid_report_queue_peek(
+    ble_hid_report_queue_t* queue) {
+  uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+  if (head == tail) {
+    return NULL;
+  }
+
+  return &queue->entries[tail & QUEUE_MASK];
+}
+
+const ble_hid_queued_report_t* ble_hid_report_queue_peek_next(
+    ble_hid_report_queue_t* queue) {
+  uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+  if (head - tail < 2) {
+    return NULL;
+  }
+
+  return &queue->entries[(tail + 1) & QUEUE_MASK];
+}
+
+void ble_hid_report_queue_pop(ble_hid_report_queue_t* queue) {
+  uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+}
+
+size_t ble_hid_report_queue_drain(ble_hid_report_queue_t* queue,
+                                  size_t budget, ble_hid_report_sink_fn sink,
+                                  void* arg) {
+  size_t drained = 0;
+  while (drained < budget) {
+    const ble_hid_queued_report_t* report = ble_hid_report_queue_peek(queue);
+    if (report == NULL) {
+      break;
+    }
+
+    if (sink(report, arg) != 0) {
+      break;
+    }
+
+    ble_hid_report_queue_pop(queue);
+    drained++;
+  }
+
+  return drained;
+}
+
+size_t ble_hid_report_queue_count(ble_hid_report_queue_t* queue) {
+  uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+  uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+  return head - tail;
+}
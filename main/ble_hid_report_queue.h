@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest report payload that fits a notification at the default ATT MTU.
+#define BLE_HID_REPORT_MAX_LEN 20
+
+// Must be a power of two.
+#define BLE_HID_REPORT_QUEUE_LEN 64
+
+typedef struct ble_hid_queued_report {
+  uint8_t report_id;
+  uint8_t length;
+  uint8_t data[BLE_HID_REPORT_MAX_LEN];
+  uint32_t enqueued_us;
+} ble_hid_queued_report_t;
+
+// Single-producer/single-consumer ring. The producer only writes `head`, the
+// consumer only writes `tail`, so neither side takes a lock.
+typedef struct ble_hid_report_queue {
+  _Atomic uint32_t head;
+  _Atomic uint32_t tail;
+  ble_hid_queued_report_t entries[BLE_HID_REPORT_QUEUE_LEN];
+} ble_hid_report_queue_t;
+
+// Returns 0 when the report was consumed, non-zero to stop draining and keep
+// the report at the front of the queue.
+typedef int (*ble_hid_report_sink_fn)(const ble_hid_queued_report_t* report,
+                                      void* arg);
+
+void ble_hid_report_queue_init(ble_hid_report_queue_t* queue);
+
+// Producer side.
+bool ble_hid_report_queue_push(ble_hid_report_queue_t* queue,
+                               uint8_t report_id, const uint8_t* data,
+                               size_t length, uint32_t enqueued_us);
+
+// Consumer side.
+const ble_hid_queued_report_t* ble_hid_report_queue_peek(
+    ble_hid_report_queue_t* queue);
+// The entry behind the front one, or NULL if the producer hasn't pushed it
+// yet.
+const ble_hid_queued_report_t* ble_hid_report_queue_peek_next(
+    ble_hid_report_queue_t* queue);
+void ble_hid_report_queue_pop(ble_hid_report_queue_t* queue);
+size_t ble_hid_report_queue_drain(ble_hid_report_queue_t* queue,
+                                  size_t budget, ble_hid_report_sink_fn sink,
+                                  void* arg);
+
+size_t ble_hid_report_queue_count(ble_hid_report_queue_t* queue);
@@ -0,0 +1,114 @@
+#include "ble_hid_sched.h"
+
+#include <string.h>
+
+#include "ble_hid_data.h"
+
+// Both keyboard formats as one bitmap: usages 0..127, then the modifiers.
+#define HID_KEY_WORDS (BLE_KEYBOARD_NKRO_KEYS / 32 + 1)
+#define HID_KEY_MOD_WORD (HID_KEY_WORDS - 1)
+
+_Static_assert(sizeof(ble_keyboard_nkro_report_t) <= BLE_HID_REPORT_MAX_LEN,
+               "largest input report does not fit a queue entry");
+
+void ble_hid_sched_init(ble_hid_sched_t* sched) {
+  memset(sched, 0, sizeof(*sched));
+  sched->tx_budget = BLE_HID_SCHED_TX_PER_EVENT;
+}
+
+void ble_hid_sched_refill(ble_hid_sched_t* sched) {
+  sched->tx_budget = BLE_HID_SCHED_TX_PER_EVENT;
+}
+
+bool ble_hid_sched_exhausted(const ble_hid_sched_t* sched) {
+  return sched->tx_budget == 0;
+}
+
+static void hid_key_bits(uint8_t report_id, const uint8_t* data,
+                         uint32_t bits[HID_KEY_WORDS]) {
+  memset(bits, 0, HID_KEY_WORDS * sizeof(bits[0]));
+  if (report_id == BLE_HID_NKRO_REPORT_ID) {
+    const ble_keyboard_nkro_report_t* report = (const void*)data;
+    memcpy(bits, report->keys, sizeof(report->keys));
+    bits[HID_KEY_MOD_WORD] = report->modifier;
+    return;
+  }
+
+  const ble_keyboard_report_t* report = (const void*)data;
+  for (size_t i = 0; i < sizeof(report->keycode); i++) {
+    uint8_t key = report->keycode[i];
+    if (key != 0 && key < BLE_KEYBOARD_NKRO_KEYS) {
+      bits[key / 32] |= 1u << (key % 32);
+    }
+  }
+  bits[HID_KEY_MOD_WORD] = report->modifier;
+}
+
+// Whether the host sees the same key-down and key-up edges going last ->
+// next directly as through `mid`: no key may change in `mid` and change
+// back in `next`, and `mid` may not press a new non-modifier key, whose
+// order against the keys `next` presses would be lost. Modifiers only
+// matter as edges, since hosts apply them before the keys in a report.
+static bool hid_keys_collapsible(uint8_t report_id, const uint8_t* last,
+                                 const uint8_t* mid, const uint8_t* next) {
+  uint32_t last_bits[HID_KEY_WORDS];
+  uint32_t mid_bits[HID_KEY_WORDS];
+  uint32_t next_bits[HID_KEY_WORDS];
+  hid_key_bits(report_id, last, last_bits);
+  hid_key_bits(report_id, mid, mid_bits);
+  hid_key_bits(report_id, next, next_bits);
+
+  for (size_t i = 0; i < HID_KEY_WORDS; i++) {
+    if (~(last_bits[i] ^ next_bits[i]) & (mid_bits[i] ^ last_bits[i])) {
+      return false;
+    }
+    if (i != HID_KEY_MOD_WORD && (mid_bits[i] & ~last_bits[i]) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ble_hid_sched_redundant(const ble_hid_sched_t* sched,
+                             ble_hid_report_queue_t* queue,
+                             const ble_hid_queued_report_t* report,
+                             uint8_t flags) {
+  if ((flags & BLE_HID_SCHED_STATE) == 0) {
+    return false;
+  }
+
+  const uint8_t* last = sched->last_sent[report->report_id];
+  if (memcmp(report->data, last, report->length) == 0) {
+    return true;
+  }
+
+  const ble_hid_queued_report_t* next = ble_hid_report_queue_peek_next(queue);
+  return (flags & BLE_HID_SCHED_KEYS) != 0 && next != NULL &&
+         next->report_id == report->report_id &&
+         hid_keys_collapsible(report->report_id, last, report->data,
+                              next->data);
+}
+
+void ble_hid_sched_sent(ble_hid_sched_t* sched,
+                        const ble_hid_queued_report_t* report, uint8_t flags) {
+  sched->tx_budget--;
+  if (flags & BLE_HID_SCHED_STATE) {
+    ble_hid_sched_set_state(sched, report->report_id, report->data,
+                            report->length);
+  }
+}
+
+void ble_hid_sched_set_state(ble_hid_sched_t* sched, uint8_t report_id,
+                             const uint8_t* data, uint8_t length) {
+  memcpy(sched->last_sent[report_id], data, length);
+}
+
+bool ble_hid_sched_released(const ble_hid_sched_t* sched, uint8_t report_id,
+                            uint8_t length) {
+  static const uint8_t released[BLE_HID_REPORT_MAX_LEN];
+  return memcmp(sched->last_sent[report_id], released, length) == 0;
+}
+
+void ble_hid_sched_forget(ble_hid_sched_t* sched) {
+  memset(sched->last_sent, 0, sizeof(sched->last_sent));
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ble_hid.h"
+#include "ble_hid_report_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reports handed to the stack per connection interval. A few fit in one
+// connection event; holding the rest back keeps them in our queue, where
+// superseded states can still be dropped, instead of deep in the stack.
+#define BLE_HID_SCHED_TX_PER_EVENT 4
+
+// How queued reports of one ID may be collapsed before they are sent.
+typedef enum {
+  // Each report carries absolute state, so one equal to the last sent is a
+  // no-op.
+  BLE_HID_SCHED_STATE = 1 << 0,
+  // Keyboard layout: intermediate states can be dropped when the host would
+  // see the same key edges without them.
+  BLE_HID_SCHED_KEYS = 1 << 1,
+} ble_hid_sched_flags_t;
+
+// Send-side bookkeeping of the input path, apart from the radio so it runs
+// on the host as well. Host task only.
+typedef struct ble_hid_sched {
+  // Last payload handed to the stack for each BLE_HID_SCHED_STATE report;
+  // all released until then.
+  uint8_t last_sent[BLE_HID_REPORT_ID_COUNT][BLE_HID_REPORT_MAX_LEN];
+  // What's left of this interval's share. Full whenever the clock is
+  // stopped.
+  int tx_budget;
+} ble_hid_sched_t;
+
+void ble_hid_sched_init(ble_hid_sched_t* sched);
+
+// One connection interval has passed: the full share is available again.
+void ble_hid_sched_refill(ble_hid_sched_t* sched);
+bool ble_hid_sched_exhausted(const ble_hid_sched_t* sched);
+
+// Whether `report`, at the front of `queue`, can be dropped unsent: it
+// repeats what the host already has, or the report behind it makes the same
+// key edges without it.
+bool ble_hid_sched_redundant(const ble_hid_sched_t* sched,
+                             ble_hid_report_queue_t* queue,
+                             const ble_hid_queued_report_t* report,
+                             uint8_t flags);
+
+// `report` went to the stack: takes one share and remembers the state.
+void ble_hid_sched_sent(ble_hid_sched_t* sched,
+                        const ble_hid_queued_report_t* report, uint8_t flags);
+
+// Records what the host holds for `report_id` without taking a share, for
+// reports sent outside the schedule.
+void ble_hid_sched_set_state(ble_hid_sched_t* sched, uint8_t report_id,
+                             const uint8_t* data, uint8_t length);
+
+// Whether the host holds nothing for `report_id`.
+bool ble_hid_sched_released(const ble_hid_sched_t* sched, uint8_t report_id,
+                            uint8_t length);
+
+// The host getting input changed; the new one hasn't seen anything yet.
+void ble_hid_sched_forget(ble_hid_sched_t* sched);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,61 @@
+#include "ble_hid_state.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "host/ble_hs.h"
+
+typedef struct hid_state_subscriber {
+  ble_hid_state_cb cb;
+  void* arg;
+} hid_state_subscriber_t;
+
+static _Atomic uint32_t state_word;
+
+// Entries are written before `subscriber_count` is bumped, so the host task
+// only ever sees complete ones.
+static hid_state_subscriber_t subscribers[BLE_HID_STATE_MAX_SUBSCRIBERS];
+static _Atomic size_t subscriber_count;
+static portMUX_TYPE subscribe_lock = portMUX_INITIALIZER_UNLOCKED;
+
+uint32_t ble_hid_state_get(void) {
+  return atomic_load_explicit(&state_word, memory_order_acquire);
+}
+
+int ble_hid_state_subscribe(ble_hid_state_cb cb, void* arg) {
+  int rc = BLE_HS_ENOMEM;
+  taskENTER_CRITICAL(&subscribe_lock);
+  size_t count = atomic_load_explicit(&subscriber_count, memory_order_relaxed);
+  if (count < BLE_HID_STATE_MAX_SUBSCRIBERS) {
+    subscribers[count] = (hid_state_subscriber_t){cb, arg};
+    atomic_store_explicit(&subscriber_count, count + 1, memory_order_release);
+    rc = 0;
+  }
+  taskEXIT_CRITICAL(&subscribe_lock);
+  return rc;
+}
+
+static void hid_state_notify_task_cb(uint32_t state, uint32_t changed,
+                                     void* arg) {
+  xTaskNotify((TaskHandle_t)arg, state, eSetValueWithOverwrite);
+}
+
+int ble_hid_state_notify_task(TaskHandle_t task) {
+  return ble_hid_state_subscribe(hid_state_notify_task_cb, task);
+}
+
+void ble_hid_state_update(uint32_t mask, uint32_t value) {
+  // Only the host task writes, so a plain load/store pair can't lose bits.
+  uint32_t old = atomic_load_explicit(&state_word, memory_order_relaxed);
+  uint32_t state = (old & ~mask) | (value & mask);
+  uint32_t changed = old ^ state;
+  if (changed == 0) {
+    return;
+  }
+
+  atomic_store_explicit(&state_word, state, memory_order_release);
+  size_t count = atomic_load_explicit(&subscriber_count, memory_order_acquire);
+  for (size_t i = 0; i < count; i++) {
+    subscribers[i].cb(state, changed, subscribers[i].arg);
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Host-driven keyboard state, published as one word. The low byte is the LED
+// output report exactly as the host wrote it.
+#define BLE_HID_STATE_NUM_LOCK (1u << 0)
+#define BLE_HID_STATE_CAPS_LOCK (1u << 1)
+#define BLE_HID_STATE_SCROLL_LOCK (1u << 2)
+#define BLE_HID_STATE_COMPOSE (1u << 3)
+#define BLE_HID_STATE_KANA (1u << 4)
+#define BLE_HID_STATE_LEDS 0xFFu
+// Every connected host has written Suspend to the HID Control Point.
+#define BLE_HID_STATE_SUSPENDED (1u << 8)
+
+#define BLE_HID_STATE_MAX_SUBSCRIBERS 4
+
+// Runs on the NimBLE host task after the word changed; must not block.
+typedef void (*ble_hid_state_cb)(uint32_t state, uint32_t changed, void* arg);
+
+// Safe to call from any task.
+uint32_t ble_hid_state_get(void);
+
+// Returns 0, or BLE_HS_ENOMEM once BLE_HID_STATE_MAX_SUBSCRIBERS are taken.
+// Subscribers can't be removed.
+int ble_hid_state_subscribe(ble_hid_state_cb cb, void* arg);
+
+// Subscribes `task` so it can block in xTaskNotifyWait: each change
+// overwrites its notification value with the new state word.
+int ble_hid_state_notify_task(TaskHandle_t task);
+
+// Host task only. Replaces the bits in `mask` with `value`.
+void ble_hid_state_update(uint32_t mask, uint32_t value);
+
+#ifdef __cplusplus
+}
+#endif
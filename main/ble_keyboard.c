@@ -0,0 +1,728 @@
+#include "ble_keyboard.h"
+
+#include <string.h>
+
+#include "ble_hid.h"
+#include "ble_hid_state.h"
+#include "host/ble_hs.h"
+
+#define K(code) {.keycode = (code), .modifier = 0}
+#define S(code) {.keycode = (code), .modifier = BLE_KEYBOARD_MOD_LSHIFT}
+#define G(code) {.keycode = (code), .modifier = BLE_KEYBOARD_MOD_RALT}
+
+typedef struct keyboard_ext_key {
+  uint16_t codepoint;
+  ble_keyboard_key_t key;
+} keyboard_ext_key_t;
+
+typedef struct keyboard_layout {
+  const ble_keyboard_key_t* ascii;
+  const keyboard_ext_key_t* ext;
+  size_t ext_count;
+} keyboard_layout_t;
+
+// Indexed by ASCII code; zero entries are not typeable. Keycodes are HID
+// usages of the physical key, so e.g. 'z' on QWERTZ is the US 'y' key.
+static const ble_keyboard_key_t ascii_us[128] = {
+    ['\t'] = K(0x2B),
+    ['\n'] = K(0x28),
+    [' '] = K(0x2C),
+    ['!'] = S(0x1E),
+    ['"'] = S(0x34),
+    ['#'] = S(0x20),
+    ['$'] = S(0x21),
+    ['%'] = S(0x22),
+    ['&'] = S(0x24),
+    ['\''] = K(0x34),
+    ['('] = S(0x26),
+    [')'] = S(0x27),
+    ['*'] = S(0x25),
+    ['+'] = S(0x2E),
+    [','] = K(0x36),
+    ['-'] = K(0x2D),
+    ['.'] = K(0x37),
+    ['/'] = K(0x38),
+    ['0'] = K(0x27),
+    ['1'] = K(0x1E),
+    ['2'] = K(0x1F),
+    ['3'] = K(0x20),
+    ['4'] = K(0x21),
+    ['5'] = K(0x22),
+    ['6'] = K(0x23),
+    ['7'] = K(0x24),
+    ['8'] = K(0x25),
+    ['9'] = K(0x26),
+    [':'] = S(0x33),
+    [';'] = K(0x33),
+    ['<'] = S(0x36),
+    ['='] = K(0x2E),
+    ['>'] = S(0x37),
+    ['?'] = S(0x38),
+    ['@'] = S(0x1F),
+    ['A'] = S(0x04),
+    ['B'] = S(0x05),
+    ['C'] = S(0x06),
+    ['D'] = S(0x07),
+    ['E'] = S(0x08),
+    ['F'] = S(0x09),
+    ['G'] = S(0x0A),
+    ['H'] = S(0x0B),
+    ['I'] = S(0x0C),
+    ['J'] = S(0x0D),
+    ['K'] = S(0x0E),
+    ['L'] = S(0x0F),
+    ['M'] = S(0x10),
+    ['N'] = S(0x11),
+    ['O'] = S(0x12),
+    ['P'] = S(0x13),
+    ['Q'] = S(0x14),
+    ['R'] = S(0x15),
+    ['S'] = S(0x16),
+    ['T'] = S(0x17),
+    ['U'] = S(0x18),
+    ['V'] = S(0x19),
+    ['W'] = S(0x1A),
+    ['X'] = S(0x1B),
+    ['Y'] = S(0x1C),
+    ['Z'] = S(0x1D),
+    ['['] = K(0x2F),
+    ['\\'] = K(0x31),
+    [']'] = K(0x30),
+    ['^'] = S(0x23),
+    ['_'] = S(0x2D),
+    ['`'] = K(0x35),
+    ['a'] = K(0x04),
+    ['b'] = K(0x05),
+    ['c'] = K(0x06),
+    ['d'] = K(0x07),
+    ['e'] = K(0x08),
+    ['f'] = K(0x09),
+    ['g'] = K(0x0A),
+    ['h'] = K(0x0B),
+    ['i'] = K(0x0C),
+    ['j'] = K(0x0D),
+    ['k'] = K(0x0E),
+    ['l'] = K(0x0F),
+    ['m'] = K(0x10),
+    ['n'] = K(0x11),
+    ['o'] = K(0x12),
+    ['p'] = K(0x13),
+    ['q'] = K(0x14),
+    ['r'] = K(0x15),
+    ['s'] = K(0x16),
+    ['t'] = K(0x17),
+    ['u'] = K(0x18),
+    ['v'] = K(0x19),
+    ['w'] = K(0x1A),
+    ['x'] = K(0x1B),
+    ['y'] = K(0x1C),
+    ['z'] = K(0x1D),
+    ['{'] = S(0x2F),
+    ['|'] = S(0x31),
+    ['}'] = S(0x30),
+    ['~'] = S(0x35),
+};
+
+static const ble_keyboard_key_t ascii_uk[128] = {
+    ['\t'] = K(0x2B),
+    ['\n'] = K(0x28),
+    [' '] = K(0x2C),
+    ['!'] = S(0x1E),
+    ['"'] = S(0x1F),
+    ['#'] = K(0x32),
+    ['$'] = S(0x21),
+    ['%'] = S(0x22),
+    ['&'] = S(0x24),
+    ['\''] = K(0x34),
+    ['('] = S(0x26),
+    [')'] = S(0x27),
+    ['*'] = S(0x25),
+    ['+'] = S(0x2E),
+    [','] = K(0x36),
+    ['-'] = K(0x2D),
+    ['.'] = K(0x37),
+    ['/'] = K(0x38),
+    ['0'] = K(0x27),
+    ['1'] = K(0x1E),
+    ['2'] = K(0x1F),
+    ['3'] = K(0x20),
+    ['4'] = K(0x21),
+    ['5'] = K(0x22),
+    ['6'] = K(0x23),
+    ['7'] = K(0x24),
+    ['8'] = K(0x25),
+    ['9'] = K(0x26),
+    [':'] = S(0x33),
+    [';'] = K(0x33),
+    ['<'] = S(0x36),
+    ['='] = K(0x2E),
+    ['>'] = S(0x37),
+    ['?'] = S(0x38),
+    ['@'] = S(0x34),
+    ['A'] = S(0x04),
+    ['B'] = S(0x05),
+    ['C'] = S(0x06),
+    ['D'] = S(0x07),
+    ['E'] = S(0x08),
+    ['F'] = S(0x09),
+    ['G'] = S(0x0A),
+    ['H'] = S(0x0B),
+    ['I'] = S(0x0C),
+    ['J'] = S(0x0D),
+    ['K'] = S(0x0E),
+    ['L'] = S(0x0F),
+    ['M'] = S(0x10),
+    ['N'] = S(0x11),
+    ['O'] = S(0x12),
+    ['P'] = S(0x13),
+    ['Q'] = S(0x14),
+    ['R'] = S(0x15),
+    ['S'] = S(0x16),
+    ['T'] = S(0x17),
+    ['U'] = S(0x18),
+    ['V'] = S(0x19),
+    ['W'] = S(0x1A),
+    ['X'] = S(0x1B),
+    ['Y'] = S(0x1C),
+    ['Z'] = S(0x1D),
+    ['['] = K(0x2F),
+    ['\\'] = K(0x64),
+    [']'] = K(0x30),
+    ['^'] = S(0x23),
+    ['_'] = S(0x2D),
+    ['`'] = K(0x35),
+    ['a'] = K(0x04),
+    ['b'] = K(0x05),
+    ['c'] = K(0x06),
+    ['d'] = K(0x07),
+    ['e'] = K(0x08),
+    ['f'] = K(0x09),
+    ['g'] = K(0x0A),
+    ['h'] = K(0x0B),
+    ['i'] = K(0x0C),
+    ['j'] = K(0x0D),
+    ['k'] = K(0x0E),
+    ['l'] = K(0x0F),
+    ['m'] = K(0x10),
+    ['n'] = K(0x11),
+    ['o'] = K(0x12),
+    ['p'] = K(0x13),
+    ['q'] = K(0x14),
+    ['r'] = K(0x15),
+    ['s'] = K(0x16),
+    ['t'] = K(0x17),
+    ['u'] = K(0x18),
+    ['v'] = K(0x19),
+    ['w'] = K(0x1A),
+    ['x'] = K(0x1B),
+    ['y'] = K(0x1C),
+    ['z'] = K(0x1D),
+    ['{'] = S(0x2F),
+    ['|'] = S(0x64),
+    ['}'] = S(0x30),
+    ['~'] = S(0x32),
+};
+
+static const ble_keyboard_key_t ascii_de[128] = {
+    ['\t'] = K(0x2B),
+    ['\n'] = K(0x28),
+    [' '] = K(0x2C),
+    ['!'] = S(0x1E),
+    ['"'] = S(0x1F),
+    ['#'] = K(0x32),
+    ['$'] = S(0x21),
+    ['%'] = S(0x22),
+    ['&'] = S(0x23),
+    ['\''] = S(0x32),
+    ['('] = S(0x25),
+    [')'] = S(0x26),
+    ['*'] = S(0x30),
+    ['+'] = K(0x30),
+    [','] = K(0x36),
+    ['-'] = K(0x38),
+    ['.'] = K(0x37),
+    ['/'] = S(0x24),
+    ['0'] = K(0x27),
+    ['1'] = K(0x1E),
+    ['2'] = K(0x1F),
+    ['3'] = K(0x20),
+    ['4'] = K(0x21),
+    ['5'] = K(0x22),
+    ['6'] = K(0x23),
+    ['7'] = K(0x24),
+    ['8'] = K(0x25),
+    ['9'] = K(0x26),
+    [':'] = S(0x37),
+    [';'] = S(0x36),
+    ['<'] = K(0x64),
+    ['='] = S(0x27),
+    ['>'] = S(0x64),
+    ['?'] = S(0x2D),
+    ['@'] = G(0x14),
+    ['A'] = S(0x04),
+    ['B'] = S(0x05),
+    ['C'] = S(0x06),
+    ['D'] = S(0x07),
+    ['E'] = S(0x08),
+    ['F'] = S(0x09),
+    ['G'] = S(0x0A),
+    ['H'] = S(0x0B),
+    ['I'] = S(0x0C),
+    ['J'] = S(0x0D),
+    ['K'] = S(0x0E),
+    ['L'] = S(0x0F),
+    ['M'] = S(0x10),
+    ['N'] = S(0x11),
+    ['O'] = S(0x12),
+    ['P'] = S(0x13),
+    ['Q'] = S(0x14),
+    ['R'] = S(0x15),
+    ['S'] = S(0x16),
+    ['T'] = S(0x17),
+    ['U'] = S(0x18),
+    ['V'] = S(0x19),
+    ['W'] = S(0x1A),
+    ['X'] = S(0x1B),
+    ['Y'] = S(0x1D),
+    ['Z'] = S(0x1C),
+    ['['] = G(0x25),
+    ['\\'] = G(0x2D),
+    [']'] = G(0x26),
+    ['_'] = S(0x38),
+    ['a'] = K(0x04),
+    ['b'] = K(0x05),
+    ['c'] = K(0x06),
+    ['d'] = K(0x07),
+    ['e'] = K(0x08),
+    ['f'] = K(0x09),
+    ['g'] = K(0x0A),
+    ['h'] = K(0x0B),
+    ['i'] = K(0x0C),
+    ['j'] = K(0x0D),
+    ['k'] = K(0x0E),
+    ['l'] = K(0x0F),
+    ['m'] = K(0x10),
+    ['n'] = K(0x11),
+    ['o'] = K(0x12),
+    ['p'] = K(0x13),
+    ['q'] = K(0x14),
+    ['r'] = K(0x15),
+    ['s'] = K(0x16),
+    ['t'] = K(0x17),
+    ['u'] = K(0x18),
+    ['v'] = K(0x19),
+    ['w'] = K(0x1A),
+    ['x'] = K(0x1B),
+    ['y'] = K(0x1D),
+    ['z'] = K(0x1C),
+    ['{'] = G(0x24),
+    ['|'] = G(0x64),
+    ['}'] = G(0x27),
+    ['~'] = G(0x30),
+};
+
+static const ble_keyboard_key_t ascii_fr[128] = {
+    ['\t'] = K(0x2B),
+    ['\n'] = K(0x28),
+    [' '] = K(0x2C),
+    ['!'] = K(0x38),
+    ['"'] = K(0x20),
+    ['#'] = G(0x20),
+    ['$'] = K(0x30),
+    ['%'] = S(0x34),
+    ['&'] = K(0x1E),
+    ['\''] = K(0x21),
+    ['('] = K(0x22),
+    [')'] = K(0x2D),
+    ['*'] = K(0x32),
+    ['+'] = S(0x2E),
+    [','] = K(0x10),
+    ['-'] = K(0x23),
+    ['.'] = S(0x36),
+    ['/'] = S(0x37),
+    ['0'] = S(0x27),
+    ['1'] = S(0x1E),
+    ['2'] = S(0x1F),
+    ['3'] = S(0x20),
+    ['4'] = S(0x21),
+    ['5'] = S(0x22),
+    ['6'] = S(0x23),
+    ['7'] = S(0x24),
+    ['8'] = S(0x25),
+    ['9'] = S(0x26),
+    [':'] = K(0x37),
+    [';'] = K(0x36),
+    ['<'] = K(0x64),
+    ['='] = K(0x2E),
+    ['>'] = S(0x64),
+    ['?'] = S(0x10),
+    ['@'] = G(0x27),
+    ['A'] = S(0x14),
+    ['B'] = S(0x05),
+    ['C'] = S(0x06),
+    ['D'] = S(0x07),
+    ['E'] = S(0x08),
+    ['F'] = S(0x09),
+    ['G'] = S(0x0A),
+    ['H'] = S(0x0B),
+    ['I'] = S(0x0C),
+    ['J'] = S(0x0D),
+    ['K'] = S(0x0E),
+    ['L'] = S(0x0F),
+    ['M'] = S(0x33),
+    ['N'] = S(0x11),
+    ['O'] = S(0x12),
+    ['P'] = S(0x13),
+    ['Q'] = S(0x04),
+    ['R'] = S(0x15),
+    ['S'] = S(0x16),
+    ['T'] = S(0x17),
+    ['U'] = S(0x18),
+    ['V'] = S(0x19),
+    ['W'] = S(0x1D),
+    ['X'] = S(0x1B),
+    ['Y'] = S(0x1C),
+    ['Z'] = S(0x1A),
+    ['['] = G(0x22),
+    ['\\'] = G(0x25),
+    [']'] = G(0x2D),
+    ['^'] = G(0x26),
+    ['_'] = K(0x25),
+    ['a'] = K(0x14),
+    ['b'] = K(0x05),
+    ['c'] = K(0x06),
+    ['d'] = K(0x07),
+    ['e'] = K(0x08),
+    ['f'] = K(0x09),
+    ['g'] = K(0x0A),
+    ['h'] = K(0x0B),
+    ['i'] = K(0x0C),
+    ['j'] = K(0x0D),
+    ['k'] = K(0x0E),
+    ['l'] = K(0x0F),
+    ['m'] = K(0x33),
+    ['n'] = K(0x11),
+    ['o'] = K(0x12),
+    ['p'] = K(0x13),
+    ['q'] = K(0x04),
+    ['r'] = K(0x15),
+    ['s'] = K(0x16),
+    ['t'] = K(0x17),
+    ['u'] = K(0x18),
+    ['v'] = K(0x19),
+    ['w'] = K(0x1D),
+    ['x'] = K(0x1B),
+    ['y'] = K(0x1C),
+    ['z'] = K(0x1A),
+    ['{'] = G(0x21),
+    ['|'] = G(0x23),
+    ['}'] = G(0x2E),
+};
+
+// Non-ASCII characters, sorted by codepoint.
+static const keyboard_ext_key_t ext_uk[] = {
+    {0x00A3, S(0x20)},  // £
+    {0x00AC, S(0x35)},  // ¬
+    {0x20AC, G(0x21)},  // €
+};
+
+static const keyboard_ext_key_t ext_de[] = {
+    {0x00A7, S(0x20)},  // §
+    {0x00B0, S(0x35)},  // °
+    {0x00B2, G(0x1F)},  // ²
+    {0x00B3, G(0x20)},  // ³
+    {0x00B5, G(0x10)},  // µ
+    {0x00C4, S(0x34)},  // Ä
+    {0x00D6, S(0x33)},  // Ö
+    {0x00DC, S(0x2F)},  // Ü
+    {0x00DF, K(0x2D)},  // ß
+    {0x00E4, K(0x34)},  // ä
+    {0x00F6, K(0x33)},  // ö
+    {0x00FC, K(0x2F)},  // ü
+    {0x20AC, G(0x08)},  // €
+};
+
+static const keyboard_ext_key_t ext_fr[] = {
+    {0x00A3, S(0x30)},  // £
+    {0x00A4, G(0x30)},  // ¤
+    {0x00A7, S(0x38)},  // §
+    {0x00B0, S(0x2D)},  // °
+    {0x00B2, K(0x35)},  // ²
+    {0x00B5, S(0x32)},  // µ
+    {0x00E0, K(0x27)},  // à
+    {0x00E7, K(0x26)},  // ç
+    {0x00E8, K(0x24)},  // è
+    {0x00E9, K(0x1F)},  // é
+    {0x00F9, K(0x34)},  // ù
+    {0x20AC, G(0x08)},  // €
+};
+
+#define LAYOUT(name)                                         \
+  {                                                          \
+      .ascii = ascii_##name,                                 \
+      .ext = ext_##name,                                     \
+      .ext_count = sizeof(ext_##name) / sizeof(ext_##name[0]), \
+  }
+
+static const keyboard_layout_t layouts[BLE_KEYBOARD_LAYOUT_COUNT] = {
+    [BLE_KEYBOARD_LAYOUT_US] = {.ascii = ascii_us, .ext = NULL, .ext_count = 0},
+    [BLE_KEYBOARD_LAYOUT_UK] = LAYOUT(uk),
+    [BLE_KEYBOARD_LAYOUT_DE] = LAYOUT(de),
+    [BLE_KEYBOARD_LAYOUT_FR] = LAYOUT(fr),
+};
+
+// Decodes one UTF-8 sequence starting at `pos`. Malformed input yields
+// U+FFFD, which no layout maps, and advances by one byte.
+static uint32_t utf8_next(const uint8_t* text, size_t length, size_t* pos) {
+  uint8_t lead = text[*pos];
+  size_t extra;
+  uint32_t codepoint;
+
+  if (lead < 0x80) {
+    *pos += 1;
+    return lead;
+  } else if ((lead & 0xE0) == 0xC0) {
+    extra = 1;
+    codepoint = lead & 0x1F;
+  } else if ((lead & 0xF0) == 0xE0) {
+    extra = 2;
+    codepoint = lead & 0x0F;
+  } else if ((lead & 0xF8) == 0xF0) {
+    extra = 3;
+    codepoint = lead & 0x07;
+  } else {
+    *pos += 1;
+    return 0xFFFD;
+  }
+
+  if (extra >= length - *pos) {
+    *pos += 1;
+    return 0xFFFD;
+  }
+
+  for (size_t i = 1; i <= extra; i++) {
+    uint8_t cont = text[*pos + i];
+    if ((cont & 0xC0) != 0x80) {
+      *pos += 1;
+      return 0xFFFD;
+    }
+    codepoint = (codepoint << 6) | (cont & 0x3F);
+  }
+
+  *pos += extra + 1;
+  return codepoint;
+}
+
+bool ble_keyboard_lookup(ble_keyboard_layout_t layout, uint32_t codepoint,
+                         ble_keyboard_key_t* key) {
+  if (layout >= BLE_KEYBOARD_LAYOUT_COUNT) {
+    return false;
+  }
+
+  const keyboard_layout_t* table = &layouts[layout];
+  if (codepoint < 0x80) {
+    *key = table->ascii[codepoint];
+    return key->keycode != 0;
+  }
+
+  size_t lo = 0;
+  size_t hi = table->ext_count;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (table->ext[mid].codepoint < codepoint) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo < table->ext_count && table->ext[lo].codepoint == codepoint) {
+    *key = table->ext[lo].key;
+    return true;
+  }
+  return false;
+}
+
+void ble_keyboard_typer_init(ble_keyboard_typer_t* typer,
+                             ble_keyboard_layout_t layout, const char* text,
+                             size_t length) {
+  memset(typer, 0, sizeof(*typer));
+  typer->layout = layout;
+  typer->text = (const uint8_t*)text;
+  typer->length = length;
+}
+
+void ble_keyboard_typer_set_caps_lock(ble_keyboard_typer_t* typer,
+                                      bool caps_lock) {
+  typer->caps_lock = caps_lock;
+}
+
+// Caps Lock only inverts Shift on keys whose unshifted and shifted characters
+// are the two cases of one letter, which the layout table itself tells us.
+static bool keyboard_caps_affects(ble_keyboard_layout_t layout,
+                                  uint32_t codepoint, ble_keyboard_key_t key) {
+  uint32_t partner;
+  if ((codepoint >= 'a' && codepoint <= 'z') ||
+      (codepoint >= 0xE0 && codepoint <= 0xFE && codepoint != 0xF7)) {
+    partner = codepoint - 0x20;
+  } else if ((codepoint >= 'A' && codepoint <= 'Z') ||
+             (codepoint >= 0xC0 && codepoint <= 0xDE && codepoint != 0xD7)) {
+    partner = codepoint + 0x20;
+  } else {
+    return false;
+  }
+
+  ble_keyboard_key_t other;
+  return ble_keyboard_lookup(layout, partner, &other) &&
+         other.keycode == key.keycode &&
+         (other.modifier ^ key.modifier) == BLE_KEYBOARD_MOD_LSHIFT;
+}
+
+static void typer_press(ble_keyboard_typer_t* typer, ble_keyboard_key_t key,
+                        ble_keyboard_report_t* report) {
+  memset(report, 0, sizeof(*report));
+  report->modifier = key.modifier;
+  report->keycode[0] = key.keycode;
+  typer->held = key;
+}
+
+bool ble_keyboard_typer_next(ble_keyboard_typer_t* typer,
+                             ble_keyboard_report_t* report) {
+  if (typer->pending.keycode != 0) {
+    typer_press(typer, typer->pending, report);
+    typer->pending.keycode = 0;
+    return true;
+  }
+
+  ble_keyboard_key_t key = {0};
+  bool found = false;
+  while (!found && typer->pos < typer->length) {
+    uint32_t codepoint = utf8_next(typer->text, typer->length, &typer->pos);
+    found = ble_keyboard_lookup(typer->layout, codepoint, &key);
+    if (!found) {
+      typer->skipped++;
+    } else if (typer->caps_lock &&
+               keyboard_caps_affects(typer->layout, codepoint, key)) {
+      key.modifier ^= BLE_KEYBOARD_MOD_LSHIFT;
+    }
+  }
+
+  if (found) {
+    bool needs_release =
+        typer->held.keycode != 0 && (key.keycode == typer->held.keycode ||
+                                     key.modifier != typer->held.modifier);
+    if (!needs_release) {
+      typer_press(typer, key, report);
+      return true;
+    }
+    typer->pending = key;
+  } else if (typer->held.keycode == 0) {
+    return false;
+  }
+
+  memset(report, 0, sizeof(*report));
+  typer->held.keycode = 0;
+  typer->held.modifier = 0;
+  return true;
+}
+
+void ble_keyboard_state_clear(ble_keyboard_state_t* state) {
+  memset(state, 0, sizeof(*state));
+}
+
+void ble_keyboard_state_press(ble_keyboard_state_t* state, uint8_t keycode) {
+  if (keycode >= BLE_KEYBOARD_KEY_LEFT_CTRL &&
+      keycode <= BLE_KEYBOARD_KEY_RIGHT_GUI) {
+    state->modifier |= 1u << (keycode - BLE_KEYBOARD_KEY_LEFT_CTRL);
+  } else if (keycode < BLE_KEYBOARD_NKRO_KEYS) {
+    state->keys[keycode / 32] |= 1u << (keycode % 32);
+  }
+}
+
+void ble_keyboard_state_release(ble_keyboard_state_t* state,
+                                uint8_t keycode) {
+  if (keycode >= BLE_KEYBOARD_KEY_LEFT_CTRL &&
+      keycode <= BLE_KEYBOARD_KEY_RIGHT_GUI) {
+    state->modifier &= ~(1u << (keycode - BLE_KEYBOARD_KEY_LEFT_CTRL));
+  } else if (keycode < BLE_KEYBOARD_NKRO_KEYS) {
+    state->keys[keycode / 32] &= ~(1u << (keycode % 32));
+  }
+}
+
+bool ble_keyboard_state_equal(const ble_keyboard_state_t* a,
+                              const ble_keyboard_state_t* b) {
+  uint32_t diff = a->modifier ^ b->modifier;
+  for (size_t i = 0; i < BLE_KEYBOARD_STATE_WORDS; i++) {
+    diff |= a->keys[i] ^ b->keys[i];
+  }
+  return diff == 0;
+}
+
+void ble_keyboard_state_to_nkro(const ble_keyboard_state_t* state,
+                                ble_keyboard_nkro_report_t* report) {
+  // Bit k of the report is byte k / 8, bit k % 8, which is exactly the
+  // little-endian layout of the state words.
+  report->modifier = state->modifier;
+  memcpy(report->keys, state->keys, sizeof(report->keys));
+}
+
+void ble_keyboard_state_to_report(const ble_keyboard_state_t* state,
+                                  ble_keyboard_report_t* report) {
+  memset(report, 0, sizeof(*report));
+  report->modifier = state->modifier;
+
+  size_t count = 0;
+  for (size_t i = 0; i < BLE_KEYBOARD_STATE_WORDS; i++) {
+    uint32_t word = state->keys[i];
+    while (word != 0) {
+      if (count == sizeof(report->keycode)) {
+        memset(report->keycode, BLE_KEYBOARD_KEY_ERROR_ROLLOVER,
+               sizeof(report->keycode));
+        return;
+      }
+      report->keycode[count++] = (uint8_t)(i * 32 + __builtin_ctz(word));
+      word &= word - 1;
+    }
+  }
+}
+
+int ble_keyboard_send_state(const ble_keyboard_state_t* state) {
+  if (ble_hid_nkro_enabled()) {
+    ble_keyboard_nkro_report_t report;
+    ble_keyboard_state_to_nkro(state, &report);
+    return ble_hid_send_report(BLE_HID_NKRO_REPORT_ID, (const uint8_t*)&report,
+                               sizeof(report));
+  }
+
+  ble_keyboard_report_t report;
+  ble_keyboard_state_to_report(state, &report);
+  return ble_hid_send_report(BLE_HID_DEFAULT_REPORT_ID,
+                             (const uint8_t*)&report, sizeof(report));
+}
+
+int ble_keyboard_type(ble_keyboard_layout_t layout, const char* text) {
+  ble_keyboard_typer_t typer;
+  ble_keyboard_report_t report;
+  ble_keyboard_state_t state;
+
+  ble_keyboard_typer_init(&typer, layout, text, strlen(text));
+  for (;;) {
+    // Follow the host if it toggles Caps Lock mid-text.
+    ble_keyboard_typer_set_caps_lock(
+        &typer, (ble_hid_state_get() & BLE_HID_STATE_CAPS_LOCK) != 0);
+    if (!ble_keyboard_typer_next(&typer, &report)) {
+      break;
+    }
+
+    ble_keyboard_state_clear(&state);
+    state.modifier = report.modifier;
+    if (report.keycode[0] != 0) {
+      ble_keyboard_state_press(&state, report.keycode[0]);
+    }
+    while (ble_keyboard_send_state(&state) == BLE_HS_EAGAIN) {
+      ble_hid_wait_for_space();
+    }
+  }
+
+  return (int)typer.skipped;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ble_hid_data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLE_KEYBOARD_MOD_LCTRL 0x01
+#define BLE_KEYBOARD_MOD_LSHIFT 0x02
+#define BLE_KEYBOARD_MOD_LALT 0x04
+#define BLE_KEYBOARD_MOD_LGUI 0x08
+#define BLE_KEYBOARD_MOD_RCTRL 0x10
+#define BLE_KEYBOARD_MOD_RSHIFT 0x20
+#define BLE_KEYBOARD_MOD_RALT 0x40  // AltGr
+#define BLE_KEYBOARD_MOD_RGUI 0x80
+
+typedef enum {
+  BLE_KEYBOARD_LAYOUT_US,
+  BLE_KEYBOARD_LAYOUT_UK,
+  BLE_KEYBOARD_LAYOUT_DE,
+  BLE_KEYBOARD_LAYOUT_FR,
+  BLE_KEYBOARD_LAYOUT_COUNT,
+} ble_keyboard_layout_t;
+
+#define BLE_KEYBOARD_KEY_ERROR_ROLLOVER 0x01
+#define BLE_KEYBOARD_KEY_LEFT_CTRL 0xE0
+#define BLE_KEYBOARD_KEY_RIGHT_GUI 0xE7
+
+#define BLE_KEYBOARD_STATE_WORDS (BLE_KEYBOARD_NKRO_KEYS / 32)
+
+// Set of currently pressed keys, one bit per usage, with the modifier keys
+// folded into a separate byte as in both report formats.
+typedef struct ble_keyboard_state {
+  uint32_t keys[BLE_KEYBOARD_STATE_WORDS];
+  uint8_t modifier;
+} ble_keyboard_state_t;
+
+typedef struct ble_keyboard_key {
+  uint8_t keycode;
+  uint8_t modifier;
+} ble_keyboard_key_t;
+
+// Turns UTF-8 text into press/release reports. A release is only emitted
+// when the next character reuses the held key or needs other modifiers;
+// otherwise the next press replaces the held key directly.
+typedef struct ble_keyboard_typer {
+  ble_keyboard_layout_t layout;
+  bool caps_lock;
+  const uint8_t* text;
+  size_t length;
+  size_t pos;
+  ble_keyboard_key_t held;
+  ble_keyboard_key_t pending;
+  size_t skipped;
+} ble_keyboard_typer_t;
+
+// Returns false when `codepoint` can't be typed with a single chord on
+// `layout` (dead-key sequences are not supported).
+bool ble_keyboard_lookup(ble_keyboard_layout_t layout, uint32_t codepoint,
+                         ble_keyboard_key_t* key);
+
+void ble_keyboard_typer_init(ble_keyboard_typer_t* typer,
+                             ble_keyboard_layout_t layout, const char* text,
+                             size_t length);
+
+// Tells the typer whether the host has Caps Lock on. Letters then take the
+// opposite Shift state, so uppercase runs mixed with digits and punctuation
+// need no modifier changes and hence no extra release reports.
+void ble_keyboard_typer_set_caps_lock(ble_keyboard_typer_t* typer,
+                                      bool caps_lock);
+
+// Fills `report` with the next report and returns true, or returns false once
+// the text is exhausted and all keys are released.
+bool ble_keyboard_typer_next(ble_keyboard_typer_t* typer,
+                             ble_keyboard_report_t* report);
+
+void ble_keyboard_state_clear(ble_keyboard_state_t* state);
+void ble_keyboard_state_press(ble_keyboard_state_t* state, uint8_t keycode);
+void ble_keyboard_state_release(ble_keyboard_state_t* state, uint8_t keycode);
+bool ble_keyboard_state_equal(const ble_keyboard_state_t* a,
+                              const ble_keyboard_state_t* b);
+
+void ble_keyboard_state_to_nkro(const ble_keyboard_state_t* state,
+                                ble_keyboard_nkro_report_t* report);
+// Reports ErrorRollOver in every slot when more than six keys are held.
+void ble_keyboard_state_to_report(const ble_keyboard_state_t* state,
+                                  ble_keyboard_report_t* report);
+
+// Sends `state` as an NKRO report if the host subscribed to it, otherwise as
+// a 6KRO report.
+int ble_keyboard_send_state(const ble_keyboard_state_t* state);
+
+// Types `text` through ble_hid_send_report, blocking while the send queue is
+// full. Returns the number of characters that could not be typed.
+int ble_keyboard_type(ble_keyboard_layout_t layout, const char* text);
+
+#ifdef __cplusplus
+}
+#endif
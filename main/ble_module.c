@@ -1,5 +1,6 @@
 #include "ble_module.h"
 
+#include "esp_ota_ops.h"
 #include "gap.h"
 #include "host/ble_gap.h"
 #include "host/ble_uuid.h"
@@ -13,6 +14,7 @@ static const char* DEVICE_NAME = "M5STICK-C";
 void ble_store_config_init(void);
 static void ble_host_task(void* param);
 static void ble_on_stack_sync(void);
+static void ble_confirm_image(void);
 static void ble_on_stack_reset(int reason);
 
 void ble_module_init(void) {
@@ -25,7 +27,7 @@ void ble_module_init(void) {
 
   ble_hs_cfg.reset_cb = ble_on_stack_reset;
   ble_hs_cfg.sync_cb = ble_on_stack_sync;
-  ble_hs_cfg.store_status_cb = ble_store_util_status_rr;
+  ble_hs_cfg.store_status_cb = gap_store_status_cb;
 
   ble_hs_cfg.sm_bonding = 1;
   ble_hs_cfg.sm_io_cap = BLE_HS_IO_NO_INPUT_OUTPUT;
@@ -36,15 +38,40 @@ void ble_module_init(void) {
       BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
 
   ble_store_config_init();
+  gap_slots_init();
 
   nimble_port_freertos_init(ble_host_task);
 }
 
 static void ble_on_stack_sync(void) {
   ESP_LOGI(TAG, "nimble stack synced");
+  ble_confirm_image();
   adv_init();
 }
 
+// An updated image keeps its slot once the controller and host are up and
+// talking; one that resets before that is rolled back by the bootloader.
+static void ble_confirm_image(void) {
+  static bool confirmed;
+  if (confirmed) {
+    return;
+  }
+
+  esp_ota_img_states_t state;
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  if (esp_ota_get_state_partition(running, &state) == ESP_OK &&
+      state == ESP_OTA_IMG_PENDING_VERIFY) {
+    esp_err_t err = esp_ota_mark_app_valid_cancel_rollback();
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to confirm the image, error: %s",
+               esp_err_to_name(err));
+      return;
+    }
+    ESP_LOGI(TAG, "Image confirmed, rollback cancelled");
+  }
+  confirmed = true;
+}
+
 static void ble_on_stack_reset(int reason) {
   ESP_LOGI(TAG, "nimble stack reset, reset reason: %d", reason);
 }
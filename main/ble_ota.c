@@ -0,0 +1,234 @@
+#include "ble_ota.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host/ble_hs.h"
+#include "ota_pipeline.h"
+
+static const char* TAG = "BLE_OTA";
+
+#define OTA_PROGRESS_STEP (64 * 1024)
+#define OTA_RESTART_DELAY_MS 1000
+
+// Flow control must be able to open a window once the writer catches up.
+_Static_assert(UPLOAD_RX_WINDOW * BLE_UPLOAD_CHUNK_MAX <=
+                   (OTA_PIPELINE_BLOCKS - 1) * OTA_PIPELINE_BLOCK_SIZE,
+               "an upload window must fit in the free pipeline blocks");
+
+static int ota_begin(uint32_t length, const uint8_t* params,
+                     size_t params_len);
+static int ota_verify_image(const uint8_t digest[32]);
+
+const ble_upload_target_t ble_ota_target = {
+    .begin = ota_begin,
+    .sink = {.write = ble_ota_stream_write,
+             .window_ready = ble_ota_stream_window_ready},
+    .finish = ble_ota_stream_finish,
+    .abort = ble_ota_stream_abort,
+};
+
+static const ble_ota_stream_t firmware_stream = {
+    .verify = ota_verify_image,
+    .restart = true,
+};
+
+// One stream at a time, whichever target started it.
+static ota_pipeline_t pipeline;
+static const esp_partition_t* partition;
+static const ble_ota_stream_t* stream;
+static uint32_t image_length;
+static uint8_t expected_sha256[32];
+static TaskHandle_t writer_task;
+// Set by the host task once the last block is handed over; the writer then
+// checks the image and publishes the outcome in `result`.
+static atomic_bool finishing;
+static atomic_bool aborted;
+static _Atomic int result = BLE_UPLOAD_PENDING;
+
+static int ota_flash_erase(void* ctx, uint32_t offset, size_t len) {
+  esp_err_t err = esp_partition_erase_range(ctx, offset, len);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to erase at 0x%x, error: %s", (unsigned)offset,
+             esp_err_to_name(err));
+    return -1;
+  }
+  return 0;
+}
+
+static int ota_flash_write(void* ctx, uint32_t offset, const void* data,
+                           size_t len) {
+  esp_err_t err = esp_partition_write(ctx, offset, data, len);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to write at 0x%x, error: %s", (unsigned)offset,
+             esp_err_to_name(err));
+    return -1;
+  }
+  return 0;
+}
+
+static const ota_flash_ops_t flash_ops = {
+    .erase = ota_flash_erase,
+    .write = ota_flash_write,
+};
+
+int ble_ota_stream_begin(const esp_partition_t* target, uint32_t length,
+                         const ble_ota_stream_t* kind) {
+  // The writer may still be flushing or checking an abandoned image.
+  if (ota_pipeline_pending(&pipeline) ||
+      (atomic_load(&finishing) &&
+       atomic_load(&result) == BLE_UPLOAD_PENDING)) {
+    return BLE_ATT_ERR_INSUFFICIENT_RES;
+  }
+  if (target == NULL || length > target->size) {
+    return BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+  }
+
+  partition = target;
+  stream = kind;
+  image_length = length;
+  ota_pipeline_init(&pipeline, &flash_ops, (void*)partition);
+  atomic_store(&finishing, false);
+  atomic_store(&aborted, false);
+  atomic_store(&result, BLE_UPLOAD_PENDING);
+  ESP_LOGI(TAG, "Receiving %u bytes into %s", (unsigned)length,
+           partition->label);
+  return 0;
+}
+
+static int ota_begin(uint32_t length, const uint8_t* params,
+                     size_t params_len) {
+  if (params_len != sizeof(expected_sha256)) {
+    return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+  }
+
+  int rc = ble_ota_stream_begin(esp_ota_get_next_update_partition(NULL),
+                                length, &firmware_stream);
+  if (rc == 0) {
+    memcpy(expected_sha256, params, sizeof(expected_sha256));
+  }
+  return rc;
+}
+
+int ble_ota_stream_write(uint32_t offset, const uint8_t* data, size_t len,
+                         void* arg) {
+  if (offset != pipeline.pushed) {
+    return -1;
+  }
+
+  int handed_over = ota_pipeline_write(&pipeline, data, len);
+  if (handed_over < 0) {
+    return -1;
+  }
+  if (handed_over > 0) {
+    xTaskNotifyGive(writer_task);
+  }
+  return 0;
+}
+
+bool ble_ota_stream_window_ready(void* arg) {
+  return ota_pipeline_room(&pipeline) >=
+         UPLOAD_RX_WINDOW * BLE_UPLOAD_CHUNK_MAX;
+}
+
+int ble_ota_stream_finish(void) {
+  if (!atomic_load(&finishing)) {
+    // With both blocks in flight the tail has to wait; the writer wakes
+    // us again when one is done.
+    if (ota_pipeline_flush(&pipeline) < 0) {
+      return BLE_UPLOAD_PENDING;
+    }
+    atomic_store(&finishing, true);
+    xTaskNotifyGive(writer_task);
+    return BLE_UPLOAD_PENDING;
+  }
+  return atomic_load(&result);
+}
+
+void ble_ota_stream_abort(void) { atomic_store(&aborted, true); }
+
+static int ota_verify_image(const uint8_t digest[32]) {
+  if (memcmp(digest, expected_sha256, sizeof(expected_sha256)) != 0) {
+    ESP_LOGE(TAG, "Image SHA-256 mismatch");
+    return UPLOAD_STATUS_VERIFY_FAILED;
+  }
+
+  // Also checks the image header and the hash appended at build time.
+  esp_err_t err = esp_ota_set_boot_partition(partition);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Image rejected, error: %s", esp_err_to_name(err));
+    return UPLOAD_STATUS_VERIFY_FAILED;
+  }
+
+  ESP_LOGI(TAG, "Image verified, %s boots next", partition->label);
+  return UPLOAD_STATUS_DONE;
+}
+
+static int ota_verify(void) {
+  uint8_t digest[32];
+  ota_pipeline_finish(&pipeline, digest);
+  if (ota_pipeline_failed(&pipeline)) {
+    return UPLOAD_STATUS_WRITE_FAILED;
+  }
+  if (atomic_load(&aborted)) {
+    return UPLOAD_STATUS_ABORTED;
+  }
+  return stream->verify(digest);
+}
+
+// Drains the pipeline on core 1. Hashing and the erase and write calls run
+// here rather than on the host task, but esp_partition_erase_range and
+// esp_partition_write disable the flash cache on both cores while they run:
+// the NimBLE host on core 0 still stalls for each ~4 KB sector erase, and
+// only gets to run between sectors.
+static void ota_writer_task(void* param) {
+  uint32_t logged = 0;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    bool progressed = false;
+    while (ota_pipeline_pending(&pipeline)) {
+      ota_pipeline_process(&pipeline);
+      progressed = true;
+    }
+
+    uint32_t written = ota_pipeline_written(&pipeline);
+    if (written / OTA_PROGRESS_STEP > logged / OTA_PROGRESS_STEP) {
+      ESP_LOGI(TAG, "%u of %u bytes written", (unsigned)written,
+               (unsigned)image_length);
+    }
+    logged = written;
+
+    // `finishing` is published after the last block, so re-checking
+    // pending after it can't miss the tail.
+    if (atomic_load(&finishing) && !ota_pipeline_pending(&pipeline) &&
+        atomic_load(&result) == BLE_UPLOAD_PENDING) {
+      int status = ota_verify();
+      atomic_store(&result, status);
+      ble_upload_wake();
+      if (status == UPLOAD_STATUS_DONE && stream->restart) {
+        // Long enough for the final reply to go out.
+        vTaskDelay(pdMS_TO_TICKS(OTA_RESTART_DELAY_MS));
+        esp_restart();
+      }
+    } else if (progressed) {
+      // Freed a block: a held ACK or the tail flush can go ahead.
+      ble_upload_wake();
+    }
+  }
+}
+
+int ble_ota_init(void) {
+  // Below the air mouse sampler, which has a deadline; the writer only has
+  // to keep up with the link on average.
+  if (xTaskCreatePinnedToCore(ota_writer_task, "ota_writer", 4096, NULL, 3,
+                              &writer_task, 1) != pdPASS) {
+    return BLE_HS_ENOMEM;
+  }
+  return 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ble_upload.h"
+#include "esp_partition.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Firmware target of the upload service. The image streams into the next
+// OTA app partition through ota_pipeline, erased and written on a task of
+// its own; the host task keeps receiving between sectors, though it stalls
+// during each erase while the flash cache is off. BEGIN carries the image's
+// SHA-256; on a match the partition becomes the boot partition and the
+// device restarts into it.
+extern const ble_upload_target_t ble_ota_target;
+
+// The writer also serves other targets that fill a partition: their begin
+// calls ble_ota_stream_begin, and the rest of the target is the stream's.
+typedef struct ble_ota_stream {
+  // Runs on the writer task once every byte is in flash, with the SHA-256
+  // of all of them. Returns an upload_status_t.
+  int (*verify)(const uint8_t digest[32]);
+  // Restart after a DONE reply, into the new image.
+  bool restart;
+} ble_ota_stream_t;
+
+// Erases and writes `partition` a sector ahead of the data, off the host
+// task. Returns 0 or a BLE_ATT_ERR_* code, as ble_upload_target_t.begin.
+int ble_ota_stream_begin(const esp_partition_t* partition, uint32_t length,
+                         const ble_ota_stream_t* stream);
+int ble_ota_stream_write(uint32_t offset, const uint8_t* data, size_t len,
+                         void* arg);
+bool ble_ota_stream_window_ready(void* arg);
+int ble_ota_stream_finish(void);
+void ble_ota_stream_abort(void);
+
+// Starts the flash writer task.
+int ble_ota_init(void);
+
+#ifdef __cplusplus
+}
+#endif
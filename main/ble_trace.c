@@ -0,0 +1,58 @@
+#include "ble_trace.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#define TRACE_RING_MASK (BLE_TRACE_RING_LEN - 1)
+
+_Static_assert((BLE_TRACE_RING_LEN & TRACE_RING_MASK) == 0,
+               "BLE_TRACE_RING_LEN must be a power of two");
+
+// One ring per core so writers never contend across cores. Tasks on the
+// same core claim slots with an atomic increment, which is cheap locally.
+typedef struct trace_ring {
+  _Atomic uint32_t head;
+  ble_trace_record_t records[BLE_TRACE_RING_LEN];
+} trace_ring_t;
+
+static trace_ring_t rings[portNUM_PROCESSORS];
+
+void ble_trace_record(ble_trace_event_t event, uint32_t a0, uint32_t a1,
+                      uint32_t a2) {
+  trace_ring_t* ring = &rings[esp_cpu_get_core_id()];
+  uint32_t seq =
+      atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+
+  ble_trace_record_t* record = &ring->records[seq & TRACE_RING_MASK];
+  record->timestamp_us = (uint32_t)esp_timer_get_time();
+  record->event = (uint16_t)event;
+  record->seq = (uint16_t)seq;
+  record->args[0] = a0;
+  record->args[1] = a1;
+  record->args[2] = a2;
+}
+
+void ble_trace_dump(void) {
+  for (int core = 0; core < portNUM_PROCESSORS; core++) {
+    trace_ring_t* ring = &rings[core];
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t start = head > BLE_TRACE_RING_LEN ? head - BLE_TRACE_RING_LEN : 0;
+
+    printf("BLE_TRACE BEGIN core=%d count=%lu\n", core,
+           (unsigned long)(head - start));
+    for (uint32_t seq = start; seq != head; seq++) {
+      const uint8_t* bytes =
+          (const uint8_t*)&ring->records[seq & TRACE_RING_MASK];
+      printf("BLE_TRACE %d ", core);
+      for (size_t i = 0; i < sizeof(ble_trace_record_t); i++) {
+        printf("%02x", bytes[i]);
+      }
+      printf("\n");
+    }
+    printf("BLE_TRACE END core=%d\n", core);
+  }
+}
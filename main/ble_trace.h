@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+
+// Set to 0 to compile every BLE_TRACE* call out.
+#ifndef BLE_TRACE_ENABLED
+#define BLE_TRACE_ENABLED 1
+#endif
+
+// Records per core. Must be a power of two.
+#define BLE_TRACE_RING_LEN 256
+
+typedef enum {
+#define BLE_TRACE_EVENT(name, format) BLE_TRACE_##name,
+#include "ble_trace_events.h"
+#undef BLE_TRACE_EVENT
+  BLE_TRACE_EVENT_COUNT,
+} ble_trace_event_t;
+
+// Wire layout read by tools/ble_trace_decode.py; keep the two in sync.
+typedef struct ble_trace_record {
+  uint32_t timestamp_us;
+  uint16_t event;
+  uint16_t seq;
+  uint32_t args[3];
+} __attribute__((packed)) ble_trace_record_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Cheap enough for the host task hot paths: no formatting, no locks.
+void ble_trace_record(ble_trace_event_t event, uint32_t a0, uint32_t a1,
+                      uint32_t a2);
+
+// Prints both rings to the console as hex lines for the decoder.
+void ble_trace_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if BLE_TRACE_ENABLED
+#define BLE_TRACE3(event, a0, a1, a2)                                    \
+  ble_trace_record(BLE_TRACE_##event, (uint32_t)(a0), (uint32_t)(a1), \
+                   (uint32_t)(a2))
+#else
+#define BLE_TRACE3(event, a0, a1, a2) \
+  do {                                \
+  } while (0)
+#endif
+
+#define BLE_TRACE0(event) BLE_TRACE3(event, 0, 0, 0)
+#define BLE_TRACE1(event, a0) BLE_TRACE3(event, a0, 0, 0)
+#define BLE_TRACE2(event, a0, a1) BLE_TRACE3(event, a0, a1, 0)
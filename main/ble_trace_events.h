@@ -0,0 +1,29 @@
+// Trace event table. Each entry is (name, format); the format is only used by
+// tools/ble_trace_decode.py, which parses this file, so it never reaches
+// flash. Arguments are printed as 32-bit integers. Append new events at the
+// end so older dumps still decode.
+//
+// No include guard: expanded with different definitions of BLE_TRACE_EVENT.
+
+BLE_TRACE_EVENT(ATT_UNEXPECTED_OP, "conn=%u attr=%u op=%u")
+BLE_TRACE_EVENT(HID_INFO_READ, "conn=%u")
+BLE_TRACE_EVENT(HID_REPORT_MAP_READ, "conn=%u offset=%u")
+BLE_TRACE_EVENT(HID_CONTROL_POINT_WRITE, "conn=%u len=%u value=%u")
+BLE_TRACE_EVENT(HID_REPORT_REF_READ, "conn=%u attr=%u")
+BLE_TRACE_EVENT(HID_OUTPUT_REPORT_WRITE, "conn=%u len=%u value=0x%02x")
+BLE_TRACE_EVENT(HID_PROTOCOL_MODE_READ, "conn=%u mode=%u")
+BLE_TRACE_EVENT(HID_PROTOCOL_MODE_WRITE, "conn=%u mode=%u")
+BLE_TRACE_EVENT(BATTERY_LEVEL_READ, "conn=%u level=%u")
+BLE_TRACE_EVENT(BATTERY_CPF_READ, "conn=%u")
+BLE_TRACE_EVENT(DIS_MANUFACTURER_READ, "conn=%u")
+BLE_TRACE_EVENT(DIS_PNP_ID_READ, "conn=%u")
+BLE_TRACE_EVENT(GAP_MTU, "conn=%u mtu=%u")
+BLE_TRACE_EVENT(GAP_CONN_UPDATE, "conn=%u itvl=%u latency=%u")
+BLE_TRACE_EVENT(GAP_CONN_UPDATE_REQ, "conn=%u itvl_min=%u itvl_max=%u")
+BLE_TRACE_EVENT(GAP_SUBSCRIBE, "conn=%u attr=%u notify=%u")
+BLE_TRACE_EVENT(GAP_EVENT, "type=%u")
+BLE_TRACE_EVENT(ATT_STATIC_READ, "conn=%u attr=%u offset=%u")
+BLE_TRACE_EVENT(BATTERY_LEVEL_NOTIFY, "level=%u")
+BLE_TRACE_EVENT(HID_REPORT_COLLAPSED, "report_id=%u")
+BLE_TRACE_EVENT(UPLOAD_BEGIN, "conn=%u length=%u")
+BLE_TRACE_EVENT(UPLOAD_REPLY, "status=%u next_seq=%u received=%u")
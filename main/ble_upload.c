@@ -0,0 +1,327 @@
+#include "ble_upload.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <string.h>
+
+#include "ble_ota.h"
+#include "ble_trace.h"
+#include "conn_params.h"
+#include "gap_conn.h"
+#include "host/ble_gatt.h"
+#include "host/ble_hs.h"
+#include "macro_store.h"
+#include "nimble/nimble_port.h"
+
+static const char* TAG = "BLE_UPLOAD";
+
+// Client Characteristic Configuration Descriptor Improperly Configured.
+#define UPLOAD_ATT_ERR_NOT_SUBSCRIBED 0xFD
+
+typedef struct upload_session {
+  upload_rx_t rx;
+  const ble_upload_target_t* target;
+  uint8_t target_id;
+  bool finishing;  // all bytes in, waiting for the target's verdict
+  uint16_t conn_handle;
+  int64_t started_us;
+  int64_t ended_us;
+} upload_session_t;
+
+static int upload_data_write(uint16_t conn_handle, struct os_mbuf* om);
+static int upload_control_read(uint16_t conn_handle,
+                               struct ble_gatt_access_ctxt* ctxt);
+static int upload_control_write(uint16_t conn_handle, struct os_mbuf* om);
+static void upload_wake_cb(struct ble_npl_event* ev);
+
+static int macros_begin(uint32_t length, const uint8_t* params,
+                        size_t params_len);
+static int macros_verify(const uint8_t digest[32]);
+
+// Flash goes through the OTA writer task, as the firmware target's does.
+static const ble_upload_target_t macros_target = {
+    .begin = macros_begin,
+    .sink = {.write = ble_ota_stream_write,
+             .window_ready = ble_ota_stream_window_ready},
+    .finish = ble_ota_stream_finish,
+    .abort = ble_ota_stream_abort,
+};
+
+static const ble_ota_stream_t macros_stream = {.verify = macros_verify};
+
+static const ble_upload_target_t* const targets[BLE_UPLOAD_TARGET_COUNT] = {
+    [BLE_UPLOAD_TARGET_MACROS] = &macros_target,
+    [BLE_UPLOAD_TARGET_FIRMWARE] = &ble_ota_target,
+};
+
+// One session at a time, only touched on the NimBLE host task.
+static upload_session_t session = {.conn_handle = GAP_CONN_HANDLE_NONE};
+// A single chunk; the upload itself goes straight to its target.
+static uint8_t chunk_buf[sizeof(ble_upload_chunk_t) + BLE_UPLOAD_CHUNK_MAX];
+static struct ble_npl_event wake_event;
+
+const ble_gatt_attr_t ble_upload_data_attr = {.write = upload_data_write};
+const ble_gatt_attr_t ble_upload_control_attr = {
+    .read = upload_control_read,
+    .write = upload_control_write,
+};
+
+void ble_upload_init(void) {
+  ble_npl_event_init(&wake_event, upload_wake_cb, NULL);
+}
+
+void ble_upload_wake(void) {
+  ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &wake_event);
+}
+
+static int macros_begin(uint32_t length, const uint8_t* params,
+                        size_t params_len) {
+  if (params_len != 0) {
+    return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+  }
+  // A macro playing from the mapping meanwhile reads a half-written table
+  // at worst; macro_play releases the keys on a corrupt stream.
+  return ble_ota_stream_begin(macro_store_partition(), length,
+                              &macros_stream);
+}
+
+// The CRC already matched; the table is checked when a macro plays.
+static int macros_verify(const uint8_t digest[32]) {
+  return UPLOAD_STATUS_DONE;
+}
+
+static uint32_t upload_rate(void) {
+  int64_t end = session.conn_handle != GAP_CONN_HANDLE_NONE
+                    ? esp_timer_get_time()
+                    : session.ended_us;
+  int64_t elapsed_us = end - session.started_us;
+  if (elapsed_us <= 0) {
+    return 0;
+  }
+  return (uint32_t)(session.rx.received * 1000000LL / elapsed_us);
+}
+
+static void upload_end(const upload_reply_t* reply) {
+  session.ended_us = esp_timer_get_time();
+  session.conn_handle = GAP_CONN_HANDLE_NONE;
+  session.finishing = false;
+  if (reply->status == UPLOAD_STATUS_DONE) {
+    ESP_LOGI(TAG, "Upload done, %u bytes in %u ms (%u B/s)",
+             (unsigned)reply->received,
+             (unsigned)((session.ended_us - session.started_us) / 1000),
+             (unsigned)upload_rate());
+  } else {
+    ESP_LOGW(TAG, "Upload ended, status=%u received=%u", reply->status,
+             (unsigned)reply->received);
+  }
+}
+
+static void upload_send_reply(const upload_reply_t* reply) {
+  uint16_t conn_handle = session.conn_handle;
+  BLE_TRACE3(UPLOAD_REPLY, reply->status, reply->next_seq, reply->received);
+  if (!session.rx.active) {
+    upload_end(reply);
+  }
+
+  // A lost reply isn't fatal: the sender times out, resends from its last
+  // ACK and the duplicate gets answered.
+  struct os_mbuf* om = ble_hs_mbuf_from_flat(reply, sizeof(*reply));
+  if (om == NULL) {
+    ESP_LOGW(TAG, "No buffer for upload reply");
+    return;
+  }
+
+  int rc = ble_gatts_notify_custom(
+      conn_handle, ble_gatt_chr_handle(BLE_GATT_CHR_UPLOAD_CONTROL), om);
+  if (rc != 0) {
+    ESP_LOGW(TAG, "Failed to notify upload reply, error code: %d", rc);
+  }
+}
+
+static void upload_poll_finish(void) {
+  int status = session.target->finish();
+  if (status == BLE_UPLOAD_PENDING) {
+    return;
+  }
+
+  upload_reply_t reply = {
+      .status = (uint8_t)status,
+      .next_seq = session.rx.next_seq,
+      .received = session.rx.received,
+  };
+  upload_send_reply(&reply);
+}
+
+static void upload_handle_reply(const upload_reply_t* reply) {
+  if (reply->status == UPLOAD_STATUS_DONE) {
+    // The bytes are intact; whether they are usable is up to the target.
+    session.finishing = true;
+    upload_poll_finish();
+    return;
+  }
+
+  if (!session.rx.active && session.target->abort != NULL) {
+    session.target->abort();
+  }
+  upload_send_reply(reply);
+}
+
+static void upload_wake_cb(struct ble_npl_event* ev) {
+  if (session.conn_handle == GAP_CONN_HANDLE_NONE) {
+    return;
+  }
+
+  if (session.finishing) {
+    upload_poll_finish();
+    return;
+  }
+
+  upload_reply_t reply;
+  if (upload_rx_poll(&session.rx, &session.target->sink, &reply)) {
+    upload_send_reply(&reply);
+  }
+}
+
+static int upload_begin(uint16_t conn_handle, struct os_mbuf* om) {
+  struct {
+    ble_upload_begin_t begin;
+    uint8_t params[BLE_UPLOAD_PARAMS_MAX];
+  } __attribute__((packed)) cmd;
+  uint16_t len = OS_MBUF_PKTLEN(om);
+  if (len < sizeof(cmd.begin) || len > sizeof(cmd) ||
+      os_mbuf_copydata(om, 0, len, &cmd) != 0) {
+    return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+  }
+
+  if (session.finishing ||
+      (session.rx.active && session.conn_handle != conn_handle)) {
+    return BLE_ATT_ERR_INSUFFICIENT_RES;
+  }
+
+  gap_conn_t* conn = gap_conn_find(conn_handle);
+  if (conn == NULL ||
+      !gap_conn_subscribed(conn, GAP_CONN_SUB_UPLOAD_CONTROL)) {
+    return UPLOAD_ATT_ERR_NOT_SUBSCRIBED;
+  }
+
+  if (cmd.begin.target >= BLE_UPLOAD_TARGET_COUNT ||
+      cmd.begin.length == 0) {
+    return BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+  }
+
+  // BEGIN during a session restarts it.
+  if (session.rx.active && session.target->abort != NULL) {
+    session.target->abort();
+  }
+  session.rx.active = false;
+
+  const ble_upload_target_t* target = targets[cmd.begin.target];
+  int rc = target->begin(cmd.begin.length, cmd.params,
+                         len - sizeof(cmd.begin));
+  if (rc != 0) {
+    session.conn_handle = GAP_CONN_HANDLE_NONE;
+    return rc;
+  }
+
+  session.target = target;
+  session.target_id = cmd.begin.target;
+  session.conn_handle = conn_handle;
+  session.started_us = esp_timer_get_time();
+  upload_rx_begin(&session.rx, cmd.begin.length, cmd.begin.crc32);
+  BLE_TRACE2(UPLOAD_BEGIN, conn_handle, cmd.begin.length);
+  ESP_LOGI(TAG, "Upload started, %u bytes to target %u",
+           (unsigned)cmd.begin.length, cmd.begin.target);
+
+  // Ask for full-size link-layer packets so a chunk isn't fragmented; the
+  // request carries our receive limits too.
+  rc = ble_gap_set_data_len(conn_handle, BLE_HCI_SET_DATALEN_TX_OCTETS_MAX,
+                            BLE_HCI_SET_DATALEN_TX_TIME_MAX);
+  if (rc != 0) {
+    ESP_LOGW(TAG, "Failed to request data length, error code: %d", rc);
+  }
+  conn_params_activity();
+  return 0;
+}
+
+static int upload_control_read(uint16_t conn_handle,
+                               struct ble_gatt_access_ctxt* ctxt) {
+  ble_upload_progress_t progress = {
+      .active = session.conn_handle != GAP_CONN_HANDLE_NONE,
+      .target = session.target_id,
+      .length = session.rx.length,
+      .received = session.rx.received,
+      .bytes_per_s = upload_rate(),
+  };
+  return ble_gatt_span_append(conn_handle, ctxt, &progress,
+                              sizeof(progress));
+}
+
+static int upload_control_write(uint16_t conn_handle, struct os_mbuf* om) {
+  uint8_t cmd;
+  if (os_mbuf_copydata(om, 0, sizeof(cmd), &cmd) != 0) {
+    return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+  }
+
+  upload_reply_t reply;
+  switch (cmd) {
+    case BLE_UPLOAD_CMD_BEGIN:
+      return upload_begin(conn_handle, om);
+    case BLE_UPLOAD_CMD_ABORT:
+      if (conn_handle == session.conn_handle &&
+          upload_rx_abort(&session.rx, &reply)) {
+        upload_handle_reply(&reply);
+      }
+      return 0;
+    default:
+      return BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+  }
+}
+
+static int upload_data_write(uint16_t conn_handle, struct os_mbuf* om) {
+  if (conn_handle != session.conn_handle) {
+    return BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+  }
+
+  uint16_t len = OS_MBUF_PKTLEN(om);
+  if (len < sizeof(ble_upload_chunk_t) || len > sizeof(chunk_buf) ||
+      os_mbuf_copydata(om, 0, len, chunk_buf) != 0) {
+    return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+  }
+
+  // Keeps the link on the short interval for as long as data flows.
+  conn_params_activity();
+
+  const ble_upload_chunk_t* chunk = (const ble_upload_chunk_t*)chunk_buf;
+  upload_reply_t reply;
+  if (upload_rx_chunk(&session.rx, chunk->seq, chunk->data,
+                      len - sizeof(*chunk), &session.target->sink, &reply)) {
+    upload_handle_reply(&reply);
+  }
+  return 0;
+}
+
+void ble_upload_on_subscribe(const struct ble_gap_event* event) {
+  gap_conn_t* conn = gap_conn_find(event->subscribe.conn_handle);
+  if (conn != NULL && event->subscribe.attr_handle ==
+                          ble_gatt_chr_handle(BLE_GATT_CHR_UPLOAD_CONTROL)) {
+    gap_conn_set_subscribed(conn, GAP_CONN_SUB_UPLOAD_CONTROL,
+                            event->subscribe.cur_notify);
+  }
+}
+
+void ble_upload_on_disconnect(uint16_t conn_handle) {
+  if (conn_handle != session.conn_handle) {
+    return;
+  }
+
+  upload_reply_t reply = {
+      .status = UPLOAD_STATUS_ABORTED,
+      .next_seq = session.rx.next_seq,
+      .received = session.rx.received,
+  };
+  session.rx.active = false;
+  if (session.target->abort != NULL) {
+    session.target->abort();
+  }
+  upload_end(&reply);
+}
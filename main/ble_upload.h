@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ble_gatt_registry.h"
+#include "host/ble_gap.h"
+#include "host/ble_uuid.h"
+#include "sdkconfig.h"
+#include "upload_rx.h"
+
+// Vendor bulk upload service, 6b1c0003-5d2e-4f0a-9c41-7a3e1f2d0c00.
+#define BLE_UPLOAD_SERVICE_UUID                                            \
+  BLE_UUID128_INIT(0x00, 0x0c, 0x2d, 0x1f, 0x3e, 0x7a, 0x41, 0x9c, 0x0a, \
+                   0x4f, 0x2e, 0x5d, 0x03, 0x00, 0x1c, 0x6b)
+// Write Without Response: ble_upload_chunk_t.
+#define BLE_UPLOAD_DATA_UUID                                               \
+  BLE_UUID128_INIT(0x00, 0x0c, 0x2d, 0x1f, 0x3e, 0x7a, 0x41, 0x9c, 0x0a, \
+                   0x4f, 0x2e, 0x5d, 0x04, 0x00, 0x1c, 0x6b)
+// Write: BLE_UPLOAD_CMD_*. Notify: upload_reply_t.
+// Read: ble_upload_progress_t.
+#define BLE_UPLOAD_CONTROL_UUID                                            \
+  BLE_UUID128_INIT(0x00, 0x0c, 0x2d, 0x1f, 0x3e, 0x7a, 0x41, 0x9c, 0x0a, \
+                   0x4f, 0x2e, 0x5d, 0x05, 0x00, 0x1c, 0x6b)
+
+// Largest chunk payload: a Write Command at the preferred MTU, less the
+// ATT opcode and handle and the sequence number.
+#define BLE_UPLOAD_CHUNK_MAX (CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU - 3 - 2)
+
+typedef enum {
+  BLE_UPLOAD_CMD_BEGIN = 0x01,  // ble_upload_begin_t
+  BLE_UPLOAD_CMD_ABORT = 0x02,  // opcode only
+} ble_upload_cmd_t;
+
+typedef enum {
+  BLE_UPLOAD_TARGET_MACROS = 0x00,  // the macro partition, macro_format.h
+  // An app image for the next OTA slot, see ble_ota.h. BEGIN carries its
+  // SHA-256 after the CRC.
+  BLE_UPLOAD_TARGET_FIRMWARE = 0x01,
+  BLE_UPLOAD_TARGET_COUNT,
+} ble_upload_target_id_t;
+
+// Followed by up to BLE_UPLOAD_PARAMS_MAX bytes the target defines.
+typedef struct ble_upload_begin {
+  uint8_t cmd;
+  uint8_t target;
+  uint32_t length;
+  uint32_t crc32;  // zlib CRC-32 of all `length` bytes
+} __attribute__((packed)) ble_upload_begin_t;
+
+#define BLE_UPLOAD_PARAMS_MAX 32
+
+typedef struct ble_upload_progress {
+  uint8_t active;  // receiving or verifying
+  uint8_t target;
+  uint32_t length;
+  uint32_t received;
+  uint32_t bytes_per_s;  // since BEGIN, frozen when the session ends
+} __attribute__((packed)) ble_upload_progress_t;
+
+typedef struct ble_upload_chunk {
+  uint16_t seq;  // 0 for the first chunk after BEGIN, wraps
+  uint8_t data[];
+} __attribute__((packed)) ble_upload_chunk_t;
+
+// Returned by finish while the target is still busy.
+#define BLE_UPLOAD_PENDING (-1)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A destination for uploads. Callbacks run on the NimBLE host task.
+typedef struct ble_upload_target {
+  // Checks the BEGIN parameters and gets ready for `length` bytes. Returns
+  // 0 or a BLE_ATT_ERR_* code.
+  int (*begin)(uint32_t length, const uint8_t* params, size_t params_len);
+  upload_sink_t sink;
+  // Runs once every byte is in and the CRC matched, then again after each
+  // ble_upload_wake until it returns an upload_status_t.
+  int (*finish)(void);
+  // The session ended before finish returned; may be NULL.
+  void (*abort)(void);
+} ble_upload_target_t;
+
+extern const ble_gatt_attr_t ble_upload_data_attr;
+extern const ble_gatt_attr_t ble_upload_control_attr;
+
+void ble_upload_init(void);
+
+// Safe from any task. Has the host task retry a reply held for sink room
+// or a pending finish.
+void ble_upload_wake(void);
+
+void ble_upload_on_subscribe(const struct ble_gap_event* event);
+void ble_upload_on_disconnect(uint16_t conn_handle);
+
+#ifdef __cplusplus
+}
+#endif
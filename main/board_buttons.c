@@ -0,0 +1,114 @@
+#include "board_buttons.h"
+
+#include <stdbool.h>
+
+#include "ble_keyboard.h"
+#include "driver/gpio.h"
+#include "esp_app_desc.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "gap.h"
+#include "host_slots.h"
+#include "macro_store.h"
+
+static const char* TAG = "BUTTONS";
+
+typedef enum {
+  BUTTON_NONE,
+  BUTTON_SHORT,  // released before BOARD_BUTTONS_LONG_MS
+  BUTTON_LONG,   // reached BOARD_BUTTONS_LONG_MS, reported once while held
+} button_press_t;
+
+typedef struct button {
+  gpio_num_t gpio;
+  bool down;         // debounced level
+  uint8_t settle;    // polls the raw level has differed from `down`
+  uint16_t held_ms;  // since the debounced press
+} button_t;
+
+// Button task only.
+static button_t button_a = {.gpio = BOARD_BUTTON_A_GPIO};
+static button_t button_b = {.gpio = BOARD_BUTTON_B_GPIO};
+
+static button_press_t button_poll(button_t* button) {
+  bool raw = gpio_get_level(button->gpio) == 0;
+  if (raw == button->down) {
+    button->settle = 0;
+  } else if (++button->settle * BOARD_BUTTONS_PERIOD_MS >=
+             BOARD_BUTTONS_DEBOUNCE_MS) {
+    button->settle = 0;
+    button->down = raw;
+    uint16_t held_ms = button->held_ms;
+    button->held_ms = 0;
+    if (!raw && held_ms < BOARD_BUTTONS_LONG_MS) {
+      return BUTTON_SHORT;
+    }
+    return BUTTON_NONE;
+  }
+
+  if (button->down && button->held_ms < BOARD_BUTTONS_LONG_MS) {
+    button->held_ms += BOARD_BUTTONS_PERIOD_MS;
+    if (button->held_ms >= BOARD_BUTTONS_LONG_MS) {
+      return BUTTON_LONG;
+    }
+  }
+  return BUTTON_NONE;
+}
+
+// Typing blocks this task until the last report is queued; presses made
+// meanwhile are not seen.
+static void buttons_on_a(button_press_t press) {
+  if (press == BUTTON_SHORT) {
+    esp_err_t err = macro_play(0);
+    if (err != ESP_OK) {
+      ESP_LOGW(TAG, "Macro 0 not played: %s", esp_err_to_name(err));
+    }
+  } else if (press == BUTTON_LONG) {
+    int skipped = ble_keyboard_type(BLE_KEYBOARD_LAYOUT_US,
+                                    esp_app_get_description()->version);
+    if (skipped != 0) {
+      ESP_LOGW(TAG, "%d characters of the version could not be typed",
+               skipped);
+    }
+  }
+}
+
+static void buttons_on_b(button_press_t press) {
+  if (press == BUTTON_SHORT) {
+    uint8_t slot = (uint8_t)((gap_selected_host() + 1) % HOST_SLOT_COUNT);
+    ESP_LOGI(TAG, "Selecting host slot %u", slot);
+    gap_select_host(slot);
+  }
+}
+
+static void board_buttons_task(void* param) {
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    buttons_on_a(button_poll(&button_a));
+    buttons_on_b(button_poll(&button_b));
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(BOARD_BUTTONS_PERIOD_MS));
+  }
+}
+
+esp_err_t board_buttons_start(void) {
+  const gpio_config_t config = {
+      .pin_bit_mask =
+          1ULL << BOARD_BUTTON_A_GPIO | 1ULL << BOARD_BUTTON_B_GPIO,
+      .mode = GPIO_MODE_INPUT,
+      // GPIO 37 and 39 have no internal pulls; the board provides them.
+      .pull_up_en = GPIO_PULLUP_DISABLE,
+      .pull_down_en = GPIO_PULLDOWN_DISABLE,
+      .intr_type = GPIO_INTR_DISABLE,
+  };
+  esp_err_t err = gpio_config(&config);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  if (xTaskCreatePinnedToCore(board_buttons_task, "buttons", 3072, NULL, 4,
+                              NULL, 1) != pdPASS) {
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// M5StickC buttons, both active low with external pull-ups.
+#define BOARD_BUTTON_A_GPIO 37  // front
+#define BOARD_BUTTON_B_GPIO 39  // side
+
+// Polled every BOARD_BUTTONS_PERIOD_MS; a level must hold for
+// BOARD_BUTTONS_DEBOUNCE_MS to count, and a press held for
+// BOARD_BUTTONS_LONG_MS is a long press.
+#define BOARD_BUTTONS_PERIOD_MS 10
+#define BOARD_BUTTONS_DEBOUNCE_MS 30
+#define BOARD_BUTTONS_LONG_MS 800
+
+// Starts the button task, the keyboard's only report producer:
+//   A       plays macro 0
+//   A held  types the running firmware version
+//   B       selects the next host slot
+// Needs the BLE module and the macro store initialized.
+esp_err_t board_buttons_start(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,48 @@
+#include "board_i2c.h"
+
+#include "esp_log.h"
+
+static const char* TAG = "BOARD_I2C";
+
+static i2c_master_bus_handle_t bus;
+
+esp_err_t board_i2c_init(void) {
+  if (bus != NULL) {
+    return ESP_OK;
+  }
+
+  const i2c_master_bus_config_t config = {
+      .i2c_port = BOARD_I2C_PORT,
+      .sda_io_num = BOARD_I2C_SDA_GPIO,
+      .scl_io_num = BOARD_I2C_SCL_GPIO,
+      .clk_source = I2C_CLK_SRC_DEFAULT,
+      .glitch_ignore_cnt = 7,
+      .flags.enable_internal_pullup = true,
+  };
+  esp_err_t err = i2c_new_master_bus(&config, &bus);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create I2C bus, error: %s", esp_err_to_name(err));
+  }
+  return err;
+}
+
+esp_err_t board_i2c_add_device(uint16_t addr, i2c_master_dev_handle_t* dev) {
+  const i2c_device_config_t config = {
+      .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+      .device_address = addr,
+      .scl_speed_hz = BOARD_I2C_FREQ_HZ,
+  };
+  return i2c_master_bus_add_device(bus, &config, dev);
+}
+
+esp_err_t board_i2c_read(i2c_master_dev_handle_t dev, uint8_t reg,
+                         uint8_t* data, size_t length) {
+  return i2c_master_transmit_receive(dev, &reg, sizeof(reg), data, length,
+                                     BOARD_I2C_TIMEOUT_MS);
+}
+
+esp_err_t board_i2c_write(i2c_master_dev_handle_t dev, uint8_t reg,
+                          uint8_t value) {
+  const uint8_t buf[] = {reg, value};
+  return i2c_master_transmit(dev, buf, sizeof(buf), BOARD_I2C_TIMEOUT_MS);
+}
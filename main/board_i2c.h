@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// M5StickC internal bus: MPU6886 IMU and AXP192 power management.
+#define BOARD_I2C_PORT I2C_NUM_0
+#define BOARD_I2C_SDA_GPIO 21
+#define BOARD_I2C_SCL_GPIO 22
+#define BOARD_I2C_FREQ_HZ 400000
+#define BOARD_I2C_TIMEOUT_MS 10
+
+// Creates the bus on first use. Call from app_main only.
+esp_err_t board_i2c_init(void);
+
+esp_err_t board_i2c_add_device(uint16_t addr, i2c_master_dev_handle_t* dev);
+
+// Register-addressed transfers, as used by both chips on the bus.
+esp_err_t board_i2c_read(i2c_master_dev_handle_t dev, uint8_t reg,
+                         uint8_t* data, size_t length);
+esp_err_t board_i2c_write(i2c_master_dev_handle_t dev, uint8_t reg,
+                          uint8_t value);
+
+#ifdef __cplusplus
+}
+#endif
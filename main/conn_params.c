@@ -0,0 +1,137 @@
+#include "conn_params.h"
+
+#include <stdatomic.h>
+
+#include "conn_policy.h"
+#include "esp_log.h"
+#include "nimble/nimble_port.h"
+
+static const char* TAG = "CONN_PARAMS";
+
+#define CONN_PARAMS_TICK_MS 1000
+
+// 7.5-15 ms, no peripheral latency: one report per interval while typing.
+static const struct ble_gap_upd_params active_params = {
+    .itvl_min = 6,
+    .itvl_max = 12,
+    .latency = 0,
+    .supervision_timeout = 400,
+};
+
+// 30-45 ms with 30 skipped events; the keyboard can still transmit at any
+// event, so only the host-to-device direction gets slower.
+static const struct ble_gap_upd_params idle_params = {
+    .itvl_min = 24,
+    .itvl_max = 36,
+    .latency = 30,
+    .supervision_timeout = 600,
+};
+
+static struct ble_npl_callout tick;
+static struct ble_npl_event wake_event;
+static _Atomic uint32_t last_activity_ms;
+// Set by the host task while some link isn't in active mode, so only the
+// first report after idle wakes the controller.
+static atomic_bool wake_armed;
+
+static void conn_params_tick_cb(struct ble_npl_event* ev);
+static void conn_params_evaluate(void);
+
+static uint32_t conn_params_now_ms(void) {
+  return ble_npl_time_ticks_to_ms32(ble_npl_time_get());
+}
+
+void conn_params_init(void) {
+  ble_npl_callout_init(&tick, nimble_port_get_dflt_eventq(),
+                       conn_params_tick_cb, NULL);
+  ble_npl_event_init(&wake_event, conn_params_tick_cb, NULL);
+  atomic_store(&last_activity_ms, conn_params_now_ms());
+}
+
+void conn_params_on_connect(gap_conn_t* conn) {
+  conn_policy_init(&conn->policy, conn_params_now_ms());
+  if (!ble_npl_callout_is_active(&tick)) {
+    ble_npl_callout_reset(&tick,
+                          ble_npl_time_ms_to_ticks32(CONN_PARAMS_TICK_MS));
+  }
+}
+
+void conn_params_on_enc_change(void) { conn_params_evaluate(); }
+
+void conn_params_on_update(gap_conn_t* conn, int status) {
+  uint32_t now = conn_params_now_ms();
+  if (conn->policy.requested != CONN_POLICY_MODE_NONE) {
+    if (status != 0) {
+      ESP_LOGW(TAG, "Parameter update rejected, handle=%d status=%d",
+               conn->conn_handle, status);
+    }
+    conn_policy_on_result(&conn->policy, now, status == 0);
+  } else if (status == 0) {
+    conn_policy_on_peer_update(&conn->policy, now);
+  }
+}
+
+void conn_params_on_update_req(gap_conn_t* conn,
+                               struct ble_gap_upd_params* self_params) {
+  // Accept what the host asks for, but don't let it add latency while the
+  // keyboard is in use.
+  if (conn->policy.mode == CONN_POLICY_MODE_ACTIVE) {
+    self_params->latency = 0;
+  }
+}
+
+void conn_params_on_suspend(gap_conn_t* conn) { conn_params_evaluate(); }
+
+void conn_params_activity(void) {
+  atomic_store_explicit(&last_activity_ms, conn_params_now_ms(),
+                        memory_order_relaxed);
+  if (atomic_exchange(&wake_armed, false)) {
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &wake_event);
+  }
+}
+
+static void conn_params_tick_cb(struct ble_npl_event* ev) {
+  conn_params_evaluate();
+  if (gap_conn_count() > 0) {
+    ble_npl_callout_reset(&tick,
+                          ble_npl_time_ms_to_ticks32(CONN_PARAMS_TICK_MS));
+  }
+}
+
+static void conn_params_evaluate(void) {
+  uint32_t now = conn_params_now_ms();
+  uint32_t activity =
+      atomic_load_explicit(&last_activity_ms, memory_order_relaxed);
+  bool armed = false;
+
+  for (size_t slot = 0; slot < GAP_CONN_TABLE_SIZE; slot++) {
+    gap_conn_t* conn = gap_conn_at(slot);
+    // Leave pairing alone; hosts often renegotiate right after it.
+    if (conn == NULL || !conn->encrypted) {
+      continue;
+    }
+
+    // A suspended host isn't listening for keys, so its link goes idle
+    // straight away. Reports still go out at the next event if typed.
+    uint32_t link_activity =
+        conn->suspended ? now - CONN_POLICY_IDLE_MS : activity;
+    conn_policy_mode_t mode =
+        conn_policy_evaluate(&conn->policy, now, link_activity);
+    if (mode != CONN_POLICY_MODE_NONE) {
+      const struct ble_gap_upd_params* params =
+          mode == CONN_POLICY_MODE_ACTIVE ? &active_params : &idle_params;
+      int rc = ble_gap_update_params(conn->conn_handle, params);
+      if (rc != 0) {
+        ESP_LOGW(TAG, "Failed to request parameters, handle=%d rc=%d",
+                 conn->conn_handle, rc);
+        conn_policy_on_result(&conn->policy, now, false);
+      }
+    }
+
+    if (conn->policy.mode != CONN_POLICY_MODE_ACTIVE) {
+      armed = true;
+    }
+  }
+
+  atomic_store(&wake_armed, armed);
+}
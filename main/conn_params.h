@@ -0,0 +1,25 @@
+#pragma once
+
+#include "gap_conn.h"
+#include "host/ble_gap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Called on the host task.
+void conn_params_init(void);
+void conn_params_on_connect(gap_conn_t* conn);
+void conn_params_on_enc_change(void);
+void conn_params_on_update(gap_conn_t* conn, int status);
+void conn_params_on_update_req(gap_conn_t* conn,
+                               struct ble_gap_upd_params* self_params);
+// Re-evaluates after `conn->suspended` changed.
+void conn_params_on_suspend(gap_conn_t* conn);
+
+// Marks the HID send path as busy. Safe to call from any task.
+void conn_params_activity(void);
+
+#ifdef __cplusplus
+}
+#endif
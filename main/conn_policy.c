@@ -0,0 +1,52 @@
+#include "conn_policy.h"
+
+// Timestamps wrap, so compare through the signed difference.
+static bool time_before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+void conn_policy_init(conn_policy_t* policy, uint32_t now_ms) {
+  policy->mode = CONN_POLICY_MODE_NONE;
+  policy->requested = CONN_POLICY_MODE_NONE;
+  // Give the host time to finish pairing and discovery before the first
+  // request.
+  policy->changed_ms = now_ms;
+  policy->retry_ms = now_ms;
+}
+
+conn_policy_mode_t conn_policy_evaluate(conn_policy_t* policy, uint32_t now_ms,
+                                        uint32_t last_activity_ms) {
+  if (policy->requested != CONN_POLICY_MODE_NONE ||
+      time_before(now_ms, policy->retry_ms) ||
+      time_before(now_ms, policy->changed_ms + CONN_POLICY_DWELL_MS)) {
+    return CONN_POLICY_MODE_NONE;
+  }
+
+  conn_policy_mode_t want = now_ms - last_activity_ms < CONN_POLICY_IDLE_MS
+                                ? CONN_POLICY_MODE_ACTIVE
+                                : CONN_POLICY_MODE_IDLE;
+  if (want == policy->mode) {
+    return CONN_POLICY_MODE_NONE;
+  }
+
+  policy->requested = want;
+  return want;
+}
+
+void conn_policy_on_result(conn_policy_t* policy, uint32_t now_ms,
+                           bool accepted) {
+  if (policy->requested == CONN_POLICY_MODE_NONE) {
+    return;
+  }
+
+  if (accepted) {
+    policy->mode = policy->requested;
+    policy->changed_ms = now_ms;
+  } else {
+    policy->retry_ms = now_ms + CONN_POLICY_BACKOFF_MS;
+  }
+  policy->requested = CONN_POLICY_MODE_NONE;
+}
+
+void conn_policy_on_peer_update(conn_policy_t* policy, uint32_t now_ms) {
+  policy->mode = CONN_POLICY_MODE_NONE;
+  policy->retry_ms = now_ms + CONN_POLICY_BACKOFF_MS;
+}
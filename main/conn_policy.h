@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Idle time before a link drops to the low-power parameters.
+#define CONN_POLICY_IDLE_MS 5000
+// Minimum time between two requested parameter changes on one link.
+#define CONN_POLICY_DWELL_MS 1000
+// Wait after the host rejects a request before asking again.
+#define CONN_POLICY_BACKOFF_MS 30000
+
+typedef enum {
+  CONN_POLICY_MODE_NONE,  // host-chosen parameters, nothing requested yet
+  CONN_POLICY_MODE_ACTIVE,
+  CONN_POLICY_MODE_IDLE,
+} conn_policy_mode_t;
+
+typedef struct conn_policy {
+  uint8_t mode;
+  uint8_t requested;  // mode awaiting the host's answer, or NONE
+  uint32_t changed_ms;
+  uint32_t retry_ms;
+} conn_policy_t;
+
+void conn_policy_init(conn_policy_t* policy, uint32_t now_ms);
+
+// Returns the mode to request given the last send activity, or
+// CONN_POLICY_MODE_NONE to leave the link alone. A returned mode stays
+// outstanding until conn_policy_on_result().
+conn_policy_mode_t conn_policy_evaluate(conn_policy_t* policy, uint32_t now_ms,
+                                        uint32_t last_activity_ms);
+
+void conn_policy_on_result(conn_policy_t* policy, uint32_t now_ms,
+                           bool accepted);
+
+// The host changed the parameters on its own; respect them for a while.
+void conn_policy_on_peer_update(conn_policy_t* policy, uint32_t now_ms);
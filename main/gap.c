@@ -1,20 +1,102 @@
 #include "gap.h"
 
+#include <stdatomic.h>
 #include <string.h>
 
+#include "adv_payload.h"
+#include "adv_sched.h"
 #include "ble_battery.h"
-#include "ble_device_info.h"
+#include "ble_diag.h"
+#include "ble_gatt_registry.h"
 #include "ble_hid.h"
+#include "ble_ota.h"
+#include "ble_trace.h"
+#include "ble_upload.h"
+#include "conn_params.h"
+#include "esp_bt.h"
+#include "gap_conn.h"
 #include "host/ble_gap.h"
 #include "host/util/util.h"
+#include "host_slots.h"
+#include "nimble/nimble_port.h"
+#include "nvs.h"
 #include "services/gap/ble_svc_gap.h"
 #include "services/gatt/ble_svc_gatt.h"
 
 static const char* TAG = "GAP";
 
-static uint16_t conn_handle = BLE_HS_CONN_HANDLE_NONE;
+#define GAP_APPEARANCE_KEYBOARD 0x03C1
+
+// Advertising data in the order ble_hs_adv_set_fields emits it, built once.
+// Only the TX power level changes between starts; it's patched in place.
+static adv_payload_t adv_data;
+static uint8_t* adv_tx_pwr;
+
+// Scan response with the device name, built when the name is set.
+static adv_payload_t rsp_data;
+
+static adv_sched_t adv_sched;
+// Identity address of the last bonded host that dropped, if any.
+static ble_addr_t last_peer;
+static bool last_peer_valid;
+
+// One slot per bond, persisted as a record in NVS.
+#define GAP_SLOTS_NVS_NAMESPACE "gap"
+#define GAP_SLOTS_NVS_KEY "host_slots"
+
+_Static_assert(HOST_SLOT_COUNT == CONFIG_BT_NIMBLE_MAX_BONDS,
+               "one host slot per bond");
+_Static_assert(sizeof(host_addr_t) == sizeof(ble_addr_t),
+               "host slots store ble_addr_t");
+_Static_assert(HOST_SLOT_CONN_NONE == BLE_HS_CONN_HANDLE_NONE,
+               "host slots use NimBLE's empty handle");
+
+typedef struct gap_slots_record {
+  uint8_t active;
+  uint8_t bonded[HOST_SLOT_COUNT];
+  host_addr_t addrs[HOST_SLOT_COUNT];
+} __attribute__((packed)) gap_slots_record_t;
+
+// Host task only.
+static host_slots_t host_slots;
+static gap_slots_record_t slots_saved;
+// Written by gap_select_host from any task, taken by the host task. Starts
+// out as the slot restored at boot.
+static _Atomic uint8_t select_request;
+static struct ble_npl_event select_event;
 
 int gap_event_handler(struct ble_gap_event* event, void* arg);
+static void gap_conn_update_desc(gap_conn_t* conn,
+                                 const struct ble_gap_conn_desc* desc);
+
+static int build_adv_data(void) {
+  static const uint8_t flags = BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP;
+  static const uint8_t uuids16[] = {BLE_HID_SERVICE_UUID & 0xFF,
+                                    BLE_HID_SERVICE_UUID >> 8};
+  static const uint8_t tx_pwr = 0;
+  static const uint8_t appearance[] = {GAP_APPEARANCE_KEYBOARD & 0xFF,
+                                       GAP_APPEARANCE_KEYBOARD >> 8};
+
+  adv_payload_init(&adv_data);
+  int rc = adv_payload_add(&adv_data, BLE_HS_ADV_TYPE_FLAGS, &flags, 1);
+  if (rc == 0) {
+    rc = adv_payload_add(&adv_data, BLE_HS_ADV_TYPE_COMP_UUIDS16, uuids16,
+                         sizeof(uuids16));
+  }
+  if (rc == 0) {
+    rc = adv_payload_add(&adv_data, BLE_HS_ADV_TYPE_TX_PWR_LVL, &tx_pwr, 1);
+  }
+  if (rc == 0) {
+    rc = adv_payload_add(&adv_data, BLE_HS_ADV_TYPE_APPEARANCE, appearance,
+                         sizeof(appearance));
+  }
+  if (rc != 0) {
+    return rc;
+  }
+
+  adv_tx_pwr = adv_payload_find(&adv_data, BLE_HS_ADV_TYPE_TX_PWR_LVL);
+  return 0;
+}
 
 int gap_init(const char* device_name) {
   ble_svc_gap_init();
@@ -25,89 +107,159 @@ int gap_init(const char* device_name) {
     return rc;
   }
 
-  ble_svc_gatt_init();
-
-  rc = ble_device_info_init();
+  rc = build_adv_data();
   if (rc != 0) {
-    ESP_LOGE(TAG, "Failed to initialize device info, error code: %d", rc);
+    ESP_LOGE(TAG, "Failed to build advertising data, error code: %d", rc);
     return rc;
   }
 
-  rc = ble_battery_init();
+  adv_payload_init(&rsp_data);
+  rc = adv_payload_add_name(&rsp_data, device_name);
   if (rc != 0) {
-    ESP_LOGE(TAG, "Failed to initialize battery service, error code: %d", rc);
+    ESP_LOGE(TAG, "Failed to build scan response, error code: %d", rc);
     return rc;
   }
 
+  ble_svc_gatt_init();
+
   rc = ble_hid_init();
   if (rc != 0) {
     ESP_LOGE(TAG, "Failed to initialize HID service, error code: %d", rc);
     return rc;
   }
 
+  rc = ble_diag_init();
+  if (rc != 0) {
+    ESP_LOGE(TAG, "Failed to initialize diagnostics service, error code: %d",
+             rc);
+    return rc;
+  }
+
+  rc = ble_ota_init();
+  if (rc != 0) {
+    ESP_LOGE(TAG, "Failed to initialize OTA writer, error code: %d", rc);
+    return rc;
+  }
+
+  rc = ble_gatt_registry_init();
+  if (rc != 0) {
+    ESP_LOGE(TAG, "Failed to register GATT services, error code: %d", rc);
+    return rc;
+  }
+
+  ble_battery_init();
+  ble_upload_init();
+  conn_params_init();
+
   return 0;
 }
 
-static void start_advertising(void) {
-  // First set up advertising data fields
-  struct ble_hs_adv_fields fields = {0};
-  fields.flags = BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP;
-  fields.tx_pwr_lvl_is_present = 1;
-  fields.tx_pwr_lvl = BLE_HS_ADV_TX_PWR_LVL_AUTO;
-
-  // Set up appearance
-  fields.appearance = 0x03C1;
-  fields.appearance_is_present = 1;
-
-  ble_uuid16_t services[] = {
-      {
-          .u =
-              {
-                  .type = BLE_UUID_TYPE_16,
-              },
-          .value = BLE_HID_SERVICE_UUID,
-      },
-  };
+static int8_t adv_tx_power_dbm(void) {
+  // ESP32 power levels are 3 dB apart, starting at -12 dBm.
+  return (int8_t)(-12 + 3 * esp_ble_tx_power_get(ESP_BLE_PWR_TYPE_ADV));
+}
 
-  fields.uuids16 = services;
-  fields.num_uuids16 = sizeof(services) / sizeof(services[0]);
-  fields.uuids16_is_complete = 1;
+static bool peer_connected(const ble_addr_t* addr) {
+  for (size_t slot = 0; slot < GAP_CONN_TABLE_SIZE; slot++) {
+    gap_conn_t* conn = gap_conn_at(slot);
+    if (conn != NULL && conn->peer_addr_type == addr->type &&
+        memcmp(conn->peer_addr, addr->val, sizeof(addr->val)) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
 
-  // Configure advertising data
-  int rc = ble_gap_adv_set_fields(&fields);
-  if (rc != 0) {
-    ESP_LOGE(TAG, "Error setting advertisement data; rc=%d", rc);
-    return;
+// Picks the bonded host to reconnect to: the selected slot's, else the one
+// that dropped last, else the newest bond that isn't already connected. An
+// empty selected slot keeps advertising undirected so a new host can pair.
+static bool reconnect_peer_find(ble_addr_t* peer) {
+  host_addr_t selected;
+  if (host_slots_reconnect_target(&host_slots, &selected)) {
+    memcpy(peer, &selected, sizeof(*peer));
+    return true;
+  }
+  if (host_slots_pairing(&host_slots)) {
+    return false;
   }
 
-  // Set up scan response fields with the device name
-  struct ble_hs_adv_fields rsp_fields = {0};
-  rsp_fields.name = (uint8_t*)ble_svc_gap_device_name();
-  rsp_fields.name_len = strlen(ble_svc_gap_device_name());
-  rsp_fields.name_is_complete = 1;
+  if (last_peer_valid && !peer_connected(&last_peer)) {
+    *peer = last_peer;
+    return true;
+  }
 
-  // Set scan response data
-  rc = ble_gap_adv_rsp_set_fields(&rsp_fields);
-  if (rc != 0) {
-    ESP_LOGE(TAG, "Error setting scan response data; rc=%d", rc);
-    return;
+  ble_addr_t bonds[CONFIG_BT_NIMBLE_MAX_BONDS];
+  int num_bonds = 0;
+  if (ble_store_util_bonded_peers(bonds, &num_bonds,
+                                  CONFIG_BT_NIMBLE_MAX_BONDS) != 0) {
+    return false;
   }
 
-  // Start advertising
+  for (int i = num_bonds - 1; i >= 0; i--) {
+    if (!peer_connected(&bonds[i])) {
+      *peer = bonds[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+static void start_advertising_step(const adv_sched_step_t* step,
+                                   const ble_addr_t* peer) {
   struct ble_gap_adv_params adv_params = {
       .conn_mode = BLE_GAP_CONN_MODE_UND,
       .disc_mode = BLE_GAP_DISC_MODE_GEN,
+      .itvl_min = step->itvl_min,
+      .itvl_max = step->itvl_max,
   };
+  uint8_t own_addr_type = BLE_OWN_ADDR_PUBLIC;
 
-  rc = ble_gap_adv_start(BLE_ADDR_PUBLIC, NULL, BLE_HS_FOREVER, &adv_params,
-                         gap_event_handler, NULL);
+  if (step->phase == ADV_SCHED_DIRECTED) {
+    adv_params.conn_mode = BLE_GAP_CONN_MODE_DIR;
+    adv_params.disc_mode = BLE_GAP_DISC_MODE_NON;
+    adv_params.high_duty_cycle = 1;
+    // Lets the controller target the host's current RPA through the
+    // resolving list, falling back to the public address without an entry.
+    own_addr_type = BLE_OWN_ADDR_RPA_PUBLIC_DEFAULT;
+  } else {
+    peer = NULL;
+  }
+
+  int32_t duration_ms =
+      step->duration_ms == ADV_SCHED_FOREVER ? BLE_HS_FOREVER
+                                             : step->duration_ms;
+  int rc = ble_gap_adv_start(own_addr_type, peer, duration_ms, &adv_params,
+                             gap_event_handler, NULL);
   if (rc != 0) {
     ESP_LOGE(TAG, "Failed to start advertising; rc=%d", rc);
   } else {
-    ESP_LOGI(TAG, "Advertising started");
+    ESP_LOGI(TAG, "Advertising started, phase=%d", step->phase);
   }
 }
 
+static void start_advertising(void) {
+  // The controller keeps the payloads, but a stack reset clears them, so
+  // push the prebuilt bytes on every start.
+  *adv_tx_pwr = (uint8_t)adv_tx_power_dbm();
+  int rc = ble_gap_adv_set_data(adv_data.data, adv_data.len);
+  if (rc != 0) {
+    ESP_LOGE(TAG, "Error setting advertisement data; rc=%d", rc);
+    return;
+  }
+
+  rc = ble_gap_adv_rsp_set_data(rsp_data.data, rsp_data.len);
+  if (rc != 0) {
+    ESP_LOGE(TAG, "Error setting scan response data; rc=%d", rc);
+    return;
+  }
+
+  // Start the reconnect schedule
+  ble_addr_t peer;
+  bool has_peer = reconnect_peer_find(&peer);
+  start_advertising_step(adv_sched_begin(&adv_sched, has_peer),
+                         has_peer ? &peer : NULL);
+}
+
 void adv_init() {
   int rc = 0;
 
@@ -120,36 +272,350 @@ void adv_init() {
   start_advertising();
 }
 
+static void gap_slots_record(gap_slots_record_t* record) {
+  memset(record, 0, sizeof(*record));
+  record->active = host_slots.active;
+  for (uint8_t i = 0; i < HOST_SLOT_COUNT; i++) {
+    record->bonded[i] = host_slots.slots[i].bonded;
+    record->addrs[i] = host_slots.slots[i].addr;
+  }
+}
+
+// Writes the slots out when their hosts or the selection changed; links
+// coming and going don't touch flash.
+static void gap_slots_save(void) {
+  gap_slots_record_t record;
+  gap_slots_record(&record);
+  if (memcmp(&record, &slots_saved, sizeof(record)) == 0) {
+    return;
+  }
+
+  nvs_handle_t nvs;
+  esp_err_t err = nvs_open(GAP_SLOTS_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+  if (err == ESP_OK) {
+    err = nvs_set_blob(nvs, GAP_SLOTS_NVS_KEY, &record, sizeof(record));
+    if (err == ESP_OK) {
+      err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to save host slots, error: %s",
+             esp_err_to_name(err));
+    return;
+  }
+  slots_saved = record;
+}
+
+static bool gap_bond_exists(const ble_addr_t* bonds, int num_bonds,
+                            const host_addr_t* addr) {
+  for (int i = 0; i < num_bonds; i++) {
+    if (memcmp(&bonds[i], addr, sizeof(*addr)) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void gap_select_event_cb(struct ble_npl_event* ev) {
+  uint16_t old_output = host_slots_output(&host_slots);
+  host_slots_switch_t result =
+      host_slots_select(&host_slots, atomic_load(&select_request));
+  if (result == HOST_SLOTS_STAY) {
+    return;
+  }
+
+  // Input moves before anything slower, such as the flash write below.
+  ble_hid_on_output_change(old_output);
+  ESP_LOGI(TAG, "Host slot %u selected, switch=%d", host_slots.active,
+           result);
+
+  if (result != HOST_SLOTS_SWITCHED) {
+    // Restart the schedule aimed at the selected host, or open for pairing.
+    if (ble_gap_adv_active()) {
+      ble_gap_adv_stop();
+    }
+    if (gap_conn_count() < CONFIG_BT_NIMBLE_MAX_CONNECTIONS) {
+      adv_init();
+    }
+  }
+  gap_slots_save();
+}
+
+void gap_slots_init(void) {
+  ble_npl_event_init(&select_event, gap_select_event_cb, NULL);
+  host_slots_init(&host_slots);
+
+  ble_addr_t bonds[CONFIG_BT_NIMBLE_MAX_BONDS];
+  int num_bonds = 0;
+  if (ble_store_util_bonded_peers(bonds, &num_bonds,
+                                  CONFIG_BT_NIMBLE_MAX_BONDS) != 0) {
+    num_bonds = 0;
+  }
+
+  gap_slots_record_t record;
+  size_t len = sizeof(record);
+  nvs_handle_t nvs;
+  esp_err_t err = nvs_open(GAP_SLOTS_NVS_NAMESPACE, NVS_READONLY, &nvs);
+  if (err == ESP_OK) {
+    err = nvs_get_blob(nvs, GAP_SLOTS_NVS_KEY, &record, &len);
+    nvs_close(nvs);
+  }
+
+  if (err == ESP_OK && len == sizeof(record) &&
+      record.active < HOST_SLOT_COUNT) {
+    slots_saved = record;
+    host_slots.active = record.active;
+    for (uint8_t i = 0; i < HOST_SLOT_COUNT; i++) {
+      // A bond deleted since (re-pairing, a full store) empties its slot.
+      if (record.bonded[i] &&
+          gap_bond_exists(bonds, num_bonds, &record.addrs[i])) {
+        host_slots.slots[i].bonded = 1;
+        host_slots.slots[i].addr = record.addrs[i];
+      }
+    }
+  } else {
+    // Bonds made before slots existed fill them in store order.
+    for (int i = 0; i < num_bonds && i < HOST_SLOT_COUNT; i++) {
+      host_slots.slots[i].bonded = 1;
+      memcpy(&host_slots.slots[i].addr, &bonds[i], sizeof(bonds[i]));
+    }
+  }
+  atomic_store(&select_request, host_slots.active);
+  gap_slots_save();
+}
+
+void gap_select_host(uint8_t slot) {
+  atomic_store(&select_request, slot);
+  ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &select_event);
+}
+
+uint8_t gap_selected_host(void) { return atomic_load(&select_request); }
+
+uint16_t gap_output_conn(void) { return host_slots_output(&host_slots); }
+
+// Binds a newly encrypted link to its host's slot. A new host that takes
+// over an occupied slot replaces that slot's bond; one that finds no slot
+// is disconnected.
+static void gap_slots_on_enc_change(const struct ble_gap_conn_desc* desc) {
+  if (!desc->sec_state.bonded) {
+    ESP_LOGW(TAG, "Unbonded host on handle %d gets no slot",
+             desc->conn_handle);
+    return;
+  }
+
+  uint16_t old_output = host_slots_output(&host_slots);
+  host_addr_t addr;
+  memcpy(&addr, &desc->peer_id_addr, sizeof(addr));
+  host_slot_t evicted;
+  uint8_t slot =
+      host_slots_on_encrypted(&host_slots, &addr, desc->conn_handle, &evicted);
+  if (slot == HOST_SLOT_NONE) {
+    // Every slot's host is connected: turn the newcomer away rather than cut
+    // one of them off, and drop the bond the stack just stored for it.
+    ESP_LOGW(TAG, "No free slot for the host on handle %d", desc->conn_handle);
+    ble_gap_terminate(desc->conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+    ble_addr_t peer;
+    memcpy(&peer, &desc->peer_id_addr, sizeof(peer));
+    ble_store_util_delete_peer(&peer);
+    return;
+  }
+  ESP_LOGI(TAG, "Host on handle %d is in slot %u", desc->conn_handle, slot);
+
+  if (old_output != BLE_HS_CONN_HANDLE_NONE &&
+      old_output != host_slots_output(&host_slots)) {
+    ble_hid_on_output_change(old_output);
+  }
+  if (evicted.bonded) {
+    if (evicted.conn_handle != HOST_SLOT_CONN_NONE) {
+      ble_gap_terminate(evicted.conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+    }
+    ble_addr_t peer;
+    memcpy(&peer, &evicted.addr, sizeof(peer));
+    ble_store_util_delete_peer(&peer);
+    ESP_LOGI(TAG, "Slot %u re-paired, previous host forgotten", slot);
+  }
+  gap_slots_save();
+}
+
+static bool gap_bond_in_slot(const ble_addr_t* bond) {
+  for (uint8_t i = 0; i < HOST_SLOT_COUNT; i++) {
+    const host_slot_t* entry = &host_slots.slots[i];
+    if (entry->bonded &&
+        memcmp(bond, &entry->addr, sizeof(entry->addr)) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Deletes a bond that no slot refers to.
+static int gap_delete_stray_bond(void) {
+  ble_addr_t bonds[CONFIG_BT_NIMBLE_MAX_BONDS];
+  int num_bonds = 0;
+  int rc = ble_store_util_bonded_peers(bonds, &num_bonds,
+                                       CONFIG_BT_NIMBLE_MAX_BONDS);
+  if (rc != 0) {
+    return rc;
+  }
+  for (int i = 0; i < num_bonds; i++) {
+    if (!gap_bond_in_slot(&bonds[i])) {
+      return ble_store_util_delete_peer(&bonds[i]);
+    }
+  }
+  return BLE_HS_ESTORE_CAP;
+}
+
+int gap_store_status_cb(struct ble_store_status_event* event, void* arg) {
+  // The bond store only fills up when a new host pairs with every slot
+  // taken. Drop the bond of the slot the host will get and empty that slot,
+  // so no slot is left pointing at a deleted bond; with every slot's host
+  // connected there is none, and failing here fails the pairing. A full
+  // CCCD table or an overflow is the stack's business.
+  bool bonds_full = event->event_code == BLE_STORE_EVENT_FULL &&
+                    (event->full.obj_type == BLE_STORE_OBJ_TYPE_OUR_SEC ||
+                     event->full.obj_type == BLE_STORE_OBJ_TYPE_PEER_SEC);
+  if (!bonds_full) {
+    return ble_store_util_status_rr(event, arg);
+  }
+
+  uint8_t slot = host_slots_for_new_host(&host_slots);
+  if (slot == HOST_SLOT_NONE) {
+    ESP_LOGW(TAG, "No free slot, refusing to bond handle %d",
+             event->full.conn_handle);
+    return BLE_HS_ESTORE_CAP;
+  }
+  host_slot_t* entry = &host_slots.slots[slot];
+  if (!entry->bonded) {
+    return gap_delete_stray_bond();
+  }
+
+  ble_addr_t peer;
+  memcpy(&peer, &entry->addr, sizeof(peer));
+  int rc = ble_store_util_delete_peer(&peer);
+  if (rc == 0) {
+    entry->bonded = 0;
+    gap_slots_save();
+    ESP_LOGI(TAG, "Slot %u freed for a new host", slot);
+  }
+  return rc;
+}
+
 int gap_event_handler(struct ble_gap_event* event, void* arg) {
   int rc = 0;
   struct ble_gap_conn_desc desc;
+  gap_conn_t* conn;
   switch (event->type) {
     case BLE_GAP_EVENT_CONNECT:
       ESP_LOGI(TAG, "Connection established, status=%d", event->connect.status);
-      if (event->connect.status == 0) {
-        conn_handle = event->connect.conn_handle;
+      if (event->connect.status != 0) {
+        adv_init();
+        break;
       }
 
-      rc = ble_gap_security_initiate(conn_handle);
+      conn = gap_conn_add(event->connect.conn_handle);
+      if (conn == NULL) {
+        ESP_LOGE(TAG, "Connection table full, dropping handle %d",
+                 event->connect.conn_handle);
+        ble_gap_terminate(event->connect.conn_handle,
+                          BLE_ERR_REM_USER_CONN_TERM);
+        break;
+      }
+
+      conn->mtu = BLE_ATT_MTU_DFLT;
+      if (ble_gap_conn_find(event->connect.conn_handle, &desc) == 0) {
+        gap_conn_update_desc(conn, &desc);
+      }
+      conn_params_on_connect(conn);
+      ble_hid_on_connect(event->connect.conn_handle);
+
+      rc = ble_gap_security_initiate(event->connect.conn_handle);
       if (rc != 0) {
         ESP_LOGE(TAG, "Failed to initiate security, error code: %d", rc);
       } else {
         ESP_LOGI(TAG, "Security initiated");
       }
+
+      // Keep accepting other hosts while there are free slots.
+      if (gap_conn_count() < CONFIG_BT_NIMBLE_MAX_CONNECTIONS) {
+        adv_init();
+      }
       break;
     case BLE_GAP_EVENT_DISCONNECT:
       ESP_LOGI(TAG, "Disconnected, reason=%d", event->disconnect.reason);
-      conn_handle = BLE_HS_CONN_HANDLE_NONE;
-      adv_init();
+      if (event->disconnect.conn.sec_state.bonded) {
+        last_peer = event->disconnect.conn.peer_id_addr;
+        last_peer_valid = true;
+      }
+      gap_conn_remove(event->disconnect.conn.conn_handle);
+      host_slots_on_disconnect(&host_slots,
+                               event->disconnect.conn.conn_handle);
+      ble_hid_on_disconnect(event->disconnect.conn.conn_handle);
+      ble_upload_on_disconnect(event->disconnect.conn.conn_handle);
+      // The undirected advertising restarted on CONNECT may still be on, by
+      // now in its slow phase: restart the schedule so a bonded host that
+      // dropped gets directed advertising first.
+      if (event->disconnect.conn.sec_state.bonded && ble_gap_adv_active()) {
+        ble_gap_adv_stop();
+      }
+      if (!ble_gap_adv_active()) {
+        adv_init();
+      }
       break;
     case BLE_GAP_EVENT_MTU:
-      ESP_LOGI(TAG, "MTU exchange complete, MTU=%d", event->mtu.value);
+      BLE_TRACE2(GAP_MTU, event->mtu.conn_handle, event->mtu.value);
+      conn = gap_conn_find(event->mtu.conn_handle);
+      if (conn != NULL) {
+        conn->mtu = event->mtu.value;
+      }
       break;
     case BLE_GAP_EVENT_ENC_CHANGE:
-      if (event->enc_change.status == 0) {
-        ESP_LOGI(TAG, "Encryption established");
-      } else {
+      if (event->enc_change.status != 0) {
         ESP_LOGE(TAG, "Encryption failed, status=%d", event->enc_change.status);
+        break;
+      }
+
+      ESP_LOGI(TAG, "Encryption established");
+      conn = gap_conn_find(event->enc_change.conn_handle);
+      if (conn != NULL &&
+          ble_gap_conn_find(event->enc_change.conn_handle, &desc) == 0) {
+        gap_conn_update_desc(conn, &desc);
+        gap_slots_on_enc_change(&desc);
+        ble_hid_on_enc_change(&desc);
+        ble_battery_on_enc_change(&desc);
+        conn_params_on_enc_change();
+      }
+      break;
+    case BLE_GAP_EVENT_CONN_UPDATE:
+      conn = gap_conn_find(event->conn_update.conn_handle);
+      if (conn == NULL) {
+        break;
+      }
+
+      if (event->conn_update.status == 0 &&
+          ble_gap_conn_find(event->conn_update.conn_handle, &desc) == 0) {
+        gap_conn_update_desc(conn, &desc);
+        BLE_TRACE3(GAP_CONN_UPDATE, conn->conn_handle, conn->itvl,
+                   conn->latency);
+      }
+      conn_params_on_update(conn, event->conn_update.status);
+      break;
+    case BLE_GAP_EVENT_CONN_UPDATE_REQ:
+      BLE_TRACE3(GAP_CONN_UPDATE_REQ, event->conn_update_req.conn_handle,
+                 event->conn_update_req.peer_params->itvl_min,
+                 event->conn_update_req.peer_params->itvl_max);
+      conn = gap_conn_find(event->conn_update_req.conn_handle);
+      if (conn != NULL) {
+        conn_params_on_update_req(conn, event->conn_update_req.self_params);
+      }
+      break;
+    case BLE_GAP_EVENT_ADV_COMPLETE:
+      // Phase timed out without a connection: step down to the next one.
+      if (event->adv_complete.reason == BLE_HS_ETIMEOUT) {
+        ble_addr_t peer;
+        bool has_peer = reconnect_peer_find(&peer);
+        start_advertising_step(adv_sched_advance(&adv_sched),
+                               has_peer ? &peer : NULL);
       }
       break;
     case BLE_GAP_EVENT_REPEAT_PAIRING:
@@ -163,19 +629,43 @@ int gap_event_handler(struct ble_gap_event* event, void* arg) {
       ESP_LOGI(TAG, "Re-pairing...");
       return BLE_GAP_REPEAT_PAIRING_RETRY;
     case BLE_GAP_EVENT_SUBSCRIBE:
-      rc = ble_gap_conn_find(event->subscribe.conn_handle, &desc);
-      if (rc != 0) {
-        ESP_LOGE(TAG, "Failed to find connection, error code: %d", rc);
-        return rc;
-      }
-
-      if (!desc.sec_state.encrypted) {
-        ESP_LOGI(TAG, "Not encrypted, ignoring subscribe event");
-      }
+      // Recorded even before encryption; reports only go to the selected
+      // host once its link is encrypted and subscribed.
+      BLE_TRACE3(GAP_SUBSCRIBE, event->subscribe.conn_handle,
+                 event->subscribe.attr_handle, event->subscribe.cur_notify);
+      ble_hid_on_subscribe(event);
+      ble_battery_on_subscribe(event);
+      ble_upload_on_subscribe(event);
       break;
     default:
-      ESP_LOGI(TAG, "Caught event: %d", event->type);
+      BLE_TRACE1(GAP_EVENT, event->type);
       break;
   }
   return 0;
 }
+
+static void gap_conn_update_desc(gap_conn_t* conn,
+                                 const struct ble_gap_conn_desc* desc) {
+  conn->itvl = desc->conn_itvl;
+  conn->latency = desc->conn_latency;
+  conn->supervision_timeout = desc->supervision_timeout;
+  conn->encrypted = desc->sec_state.encrypted;
+  conn->bonded = desc->sec_state.bonded;
+  conn->peer_addr_type = desc->peer_id_addr.type;
+  memcpy(conn->peer_addr, desc->peer_id_addr.val, sizeof(conn->peer_addr));
+}
+
+void gap_conn_restore_cccd(gap_conn_t* conn, const ble_addr_t* peer_id_addr,
+                           uint16_t chr_val_handle, gap_conn_sub_t sub) {
+  struct ble_store_key_cccd key = {
+      .peer_addr = *peer_id_addr,
+      .chr_val_handle = chr_val_handle,
+      .idx = 0,
+  };
+  struct ble_store_value_cccd value;
+
+  if (ble_store_read_cccd(&key, &value) == 0) {
+    gap_conn_set_subscribed(conn, sub,
+                            (value.flags & BLE_GATTS_CLT_CFG_F_NOTIFY) != 0);
+  }
+}
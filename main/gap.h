@@ -1,5 +1,32 @@
 #pragma once
 
+#include "gap_conn.h"
+#include "host/ble_hs.h"
+
 void adv_init(void);
 
 int gap_init(const char* device_name);
+
+// Loads the host slots; needs the bond store loaded.
+void gap_slots_init(void);
+
+// Selects host slot 0..HOST_SLOT_COUNT-1, from any task. A connected host
+// gets input from the next report on; otherwise advertising turns to that
+// host, or opens for pairing if the slot is empty.
+void gap_select_host(uint8_t slot);
+
+// The slot last passed to gap_select_host, or the one restored at boot.
+// Safe from any task.
+uint8_t gap_selected_host(void);
+
+// Link of the selected host, or BLE_HS_CONN_HANDLE_NONE while it is away.
+// Host task only.
+uint16_t gap_output_conn(void);
+
+// store_status_cb: frees the selected slot's bond when a new host pairs
+// into a full bond store; anything else goes to ble_store_util_status_rr.
+int gap_store_status_cb(struct ble_store_status_event* event, void* arg);
+
+// Seeds `sub` on `conn` from the CCCD the stack persisted for a bonded peer.
+void gap_conn_restore_cccd(gap_conn_t* conn, const ble_addr_t* peer_id_addr,
+                           uint16_t chr_val_handle, gap_conn_sub_t sub);
@@ -0,0 +1,103 @@
+#include "gap_conn.h"
+
+#include <string.h>
+
+#define TABLE_MASK (GAP_CONN_TABLE_SIZE - 1)
+#define HOME_SLOT(handle) ((size_t)(handle) & TABLE_MASK)
+
+_Static_assert((GAP_CONN_TABLE_SIZE & TABLE_MASK) == 0,
+               "GAP_CONN_TABLE_SIZE must be a power of two");
+
+// Open addressing with linear probing. Controllers hand out small sequential
+// handles, so lookups almost always hit the home slot.
+static gap_conn_t conn_table[GAP_CONN_TABLE_SIZE] = {
+    [0 ... GAP_CONN_TABLE_SIZE - 1] = {.conn_handle = GAP_CONN_HANDLE_NONE},
+};
+static size_t conn_count;
+
+static gap_conn_t* probe(uint16_t conn_handle, bool for_insert) {
+  size_t slot = HOME_SLOT(conn_handle);
+  for (size_t i = 0; i < GAP_CONN_TABLE_SIZE; i++) {
+    gap_conn_t* conn = &conn_table[slot];
+    if (conn->conn_handle == conn_handle) {
+      return conn;
+    }
+    if (conn->conn_handle == GAP_CONN_HANDLE_NONE) {
+      return for_insert ? conn : NULL;
+    }
+    slot = (slot + 1) & TABLE_MASK;
+  }
+  return NULL;
+}
+
+gap_conn_t* gap_conn_add(uint16_t conn_handle) {
+  gap_conn_t* conn = probe(conn_handle, true);
+  if (conn == NULL) {
+    return NULL;
+  }
+
+  if (conn->conn_handle == GAP_CONN_HANDLE_NONE) {
+    memset(conn, 0, sizeof(*conn));
+    conn->conn_handle = conn_handle;
+    conn_count++;
+  }
+  return conn;
+}
+
+gap_conn_t* gap_conn_find(uint16_t conn_handle) {
+  if (conn_handle == GAP_CONN_HANDLE_NONE) {
+    return NULL;
+  }
+  return probe(conn_handle, false);
+}
+
+void gap_conn_remove(uint16_t conn_handle) {
+  gap_conn_t* conn = gap_conn_find(conn_handle);
+  if (conn == NULL) {
+    return;
+  }
+
+  size_t hole = (size_t)(conn - conn_table);
+  conn_table[hole].conn_handle = GAP_CONN_HANDLE_NONE;
+  conn_count--;
+
+  // Backward-shift deletion keeps every remaining entry reachable from its
+  // home slot without tombstones.
+  size_t slot = hole;
+  for (;;) {
+    slot = (slot + 1) & TABLE_MASK;
+    if (conn_table[slot].conn_handle == GAP_CONN_HANDLE_NONE) {
+      break;
+    }
+
+    size_t home = HOME_SLOT(conn_table[slot].conn_handle);
+    bool reachable = hole <= slot ? (hole < home && home <= slot)
+                                  : (hole < home || home <= slot);
+    if (reachable) {
+      continue;
+    }
+
+    conn_table[hole] = conn_table[slot];
+    conn_table[slot].conn_handle = GAP_CONN_HANDLE_NONE;
+    hole = slot;
+  }
+}
+
+size_t gap_conn_count(void) { return conn_count; }
+
+gap_conn_t* gap_conn_at(size_t slot) {
+  if (slot >= GAP_CONN_TABLE_SIZE ||
+      conn_table[slot].conn_handle == GAP_CONN_HANDLE_NONE) {
+    return NULL;
+  }
+  return &conn_table[slot];
+}
+
+void gap_conn_set_subscribed(gap_conn_t* conn, gap_conn_sub_t sub,
+                             bool subscribed) {
+  if (subscribed) {
+    conn->subscriptions |= sub;
+  } else {
+    conn->subscriptions &= ~(uint32_t)sub;
+  }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "conn_policy.h"
+#include "sdkconfig.h"
+
+// Power of two at least CONFIG_BT_NIMBLE_MAX_CONNECTIONS, so a handle maps to
+// its home slot with a mask.
+#define GAP_CONN_TABLE_SIZE 4
+#define GAP_CONN_HANDLE_NONE 0xFFFF
+
+_Static_assert(GAP_CONN_TABLE_SIZE >= CONFIG_BT_NIMBLE_MAX_CONNECTIONS,
+               "connection table smaller than the NimBLE connection limit");
+
+// Characteristics a peer can subscribe to, one bit each.
+typedef enum {
+  GAP_CONN_SUB_HID_INPUT = 1 << 0,
+  GAP_CONN_SUB_HID_NKRO = 1 << 1,
+  GAP_CONN_SUB_HID_BOOT_INPUT = 1 << 2,
+  GAP_CONN_SUB_BATTERY_LEVEL = 1 << 3,
+  GAP_CONN_SUB_HID_MOUSE = 1 << 4,
+  GAP_CONN_SUB_HID_CONSUMER = 1 << 5,
+  GAP_CONN_SUB_HID_SYSTEM = 1 << 6,
+  GAP_CONN_SUB_UPLOAD_CONTROL = 1 << 7,
+} gap_conn_sub_t;
+
+typedef struct gap_conn {
+  uint16_t conn_handle;
+  uint16_t mtu;
+  uint16_t itvl;
+  uint16_t latency;
+  uint16_t supervision_timeout;
+  uint8_t encrypted : 1;
+  uint8_t bonded : 1;
+  uint8_t suspended : 1;  // HID Control Point
+  uint8_t protocol_mode;
+  uint8_t leds;  // last HID Output Report
+  uint8_t peer_addr_type;
+  uint8_t peer_addr[6];  // identity address
+  uint32_t subscriptions;
+  conn_policy_t policy;
+} gap_conn_t;
+
+// Only touched on the NimBLE host task.
+gap_conn_t* gap_conn_add(uint16_t conn_handle);
+gap_conn_t* gap_conn_find(uint16_t conn_handle);
+void gap_conn_remove(uint16_t conn_handle);
+size_t gap_conn_count(void);
+
+// Iterates occupied slots: returns NULL for empty ones.
+gap_conn_t* gap_conn_at(size_t slot);
+
+static inline bool gap_conn_subscribed(const gap_conn_t* conn,
+                                       gap_conn_sub_t sub) {
+  return (conn->subscriptions & sub) != 0;
+}
+
+void gap_conn_set_subscribed(gap_conn_t* conn, gap_conn_sub_t sub,
+                             bool subscribed);
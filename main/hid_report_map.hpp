@@ -0,0 +1,189 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Compile-time HID report descriptor builder. Every item is emitted with the
+// smallest data size that holds its value, and the bit length of each
+// (report ID, report type) pair is tracked as main items are added so the
+// packed report structs can be checked with static_assert.
+namespace hid {
+
+enum class ReportType : uint8_t {
+  Input = 0x01,
+  Output = 0x02,
+  Feature = 0x03,
+};
+
+// Main item data flags.
+inline constexpr uint8_t kData = 0x00;
+inline constexpr uint8_t kConstant = 0x01;
+inline constexpr uint8_t kArray = 0x00;
+inline constexpr uint8_t kVariable = 0x02;
+inline constexpr uint8_t kAbsolute = 0x00;
+inline constexpr uint8_t kRelative = 0x04;
+inline constexpr uint8_t kNullState = 0x40;
+
+// Collection kinds.
+inline constexpr uint8_t kPhysical = 0x00;
+inline constexpr uint8_t kApplication = 0x01;
+
+// Never defined: reaching one of these during constant evaluation turns a
+// malformed descriptor into a compile error.
+void report_map_overflow();
+void report_map_unbalanced_collection();
+void report_map_too_many_reports();
+
+template <std::size_t Capacity>
+class ReportMap {
+ public:
+  static constexpr std::size_t kMaxReports = 16;
+
+  constexpr ReportMap& usage_page(uint16_t page) {
+    return unsigned_item(0x04, page);
+  }
+  constexpr ReportMap& usage(uint16_t usage) {
+    return unsigned_item(0x08, usage);
+  }
+  constexpr ReportMap& usage_min(uint16_t usage) {
+    return unsigned_item(0x18, usage);
+  }
+  constexpr ReportMap& usage_max(uint16_t usage) {
+    return unsigned_item(0x28, usage);
+  }
+  constexpr ReportMap& logical_min(int32_t value) {
+    return signed_item(0x14, value);
+  }
+  constexpr ReportMap& logical_max(int32_t value) {
+    return signed_item(0x24, value);
+  }
+  constexpr ReportMap& report_size(uint32_t bits) {
+    report_size_ = bits;
+    return unsigned_item(0x74, bits);
+  }
+  constexpr ReportMap& report_count(uint32_t count) {
+    report_count_ = count;
+    return unsigned_item(0x94, count);
+  }
+  constexpr ReportMap& report_id(uint8_t id) {
+    report_id_ = id;
+    return unsigned_item(0x84, id);
+  }
+
+  constexpr ReportMap& collection(uint8_t kind) {
+    depth_++;
+    return unsigned_item(0xA0, kind);
+  }
+  constexpr ReportMap& end_collection() {
+    if (depth_ == 0) {
+      report_map_unbalanced_collection();
+    }
+    depth_--;
+    emit(0xC0);
+    return *this;
+  }
+
+  constexpr ReportMap& input(uint8_t flags) {
+    return main_item(0x80, flags, ReportType::Input);
+  }
+  constexpr ReportMap& output(uint8_t flags) {
+    return main_item(0x90, flags, ReportType::Output);
+  }
+  constexpr ReportMap& feature(uint8_t flags) {
+    return main_item(0xB0, flags, ReportType::Feature);
+  }
+
+  constexpr std::size_t size() const { return size_; }
+  constexpr uint8_t operator[](std::size_t i) const { return bytes_[i]; }
+  constexpr bool balanced() const { return depth_ == 0; }
+
+  // Payload bits of one report, excluding the report ID byte.
+  constexpr std::size_t report_bits(uint8_t id, ReportType type) const {
+    for (std::size_t i = 0; i < num_reports_; i++) {
+      if (reports_[i].id == id && reports_[i].type == type) {
+        return reports_[i].bits;
+      }
+    }
+    return 0;
+  }
+
+  constexpr std::size_t report_bytes(uint8_t id, ReportType type) const {
+    return (report_bits(id, type) + 7) / 8;
+  }
+
+ private:
+  struct Report {
+    uint8_t id;
+    ReportType type;
+    std::size_t bits;
+  };
+
+  constexpr void emit(uint8_t byte) {
+    if (size_ == Capacity) {
+      report_map_overflow();
+    }
+    bytes_[size_++] = byte;
+  }
+
+  constexpr ReportMap& item(uint8_t prefix, uint32_t data, uint8_t length) {
+    // Short item size codes: 0, 1, 2 and 4 bytes are 0, 1, 2 and 3.
+    emit(prefix | (length == 4 ? 3 : length));
+    for (uint8_t i = 0; i < length; i++) {
+      emit(static_cast<uint8_t>(data >> (8 * i)));
+    }
+    return *this;
+  }
+
+  constexpr ReportMap& unsigned_item(uint8_t prefix, uint32_t value) {
+    uint8_t length = value <= 0xFF ? 1 : value <= 0xFFFF ? 2 : 4;
+    return item(prefix, value, length);
+  }
+
+  constexpr ReportMap& signed_item(uint8_t prefix, int32_t value) {
+    uint8_t length = (value >= -128 && value <= 127)        ? 1
+                     : (value >= -32768 && value <= 32767) ? 2
+                                                           : 4;
+    return item(prefix, static_cast<uint32_t>(value), length);
+  }
+
+  constexpr ReportMap& main_item(uint8_t prefix, uint8_t flags,
+                                 ReportType type) {
+    add_bits(type, report_size_ * report_count_);
+    return unsigned_item(prefix, flags);
+  }
+
+  constexpr void add_bits(ReportType type, std::size_t bits) {
+    for (std::size_t i = 0; i < num_reports_; i++) {
+      if (reports_[i].id == report_id_ && reports_[i].type == type) {
+        reports_[i].bits += bits;
+        return;
+      }
+    }
+    if (num_reports_ == kMaxReports) {
+      report_map_too_many_reports();
+    }
+    reports_[num_reports_++] = Report{report_id_, type, bits};
+  }
+
+  uint8_t bytes_[Capacity]{};
+  std::size_t size_ = 0;
+  uint32_t report_size_ = 0;
+  uint32_t report_count_ = 0;
+  uint8_t report_id_ = 0;
+  std::size_t depth_ = 0;
+  Report reports_[kMaxReports]{};
+  std::size_t num_reports_ = 0;
+};
+
+// Copies a finished builder into an array of exactly its size.
+template <std::size_t N, std::size_t Capacity>
+constexpr std::array<uint8_t, N> to_array(const ReportMap<Capacity>& map) {
+  std::array<uint8_t, N> bytes{};
+  for (std::size_t i = 0; i < N; i++) {
+    bytes[i] = map[i];
+  }
+  return bytes;
+}
+
+}  // namespace hid
@@ -0,0 +1,109 @@
+#include "host_slots.h"
+
+#include <string.h>
+
+static const host_slot_t empty_slot = {.conn_handle = HOST_SLOT_CONN_NONE};
+
+void host_slots_init(host_slots_t* slots) {
+  for (uint8_t i = 0; i < HOST_SLOT_COUNT; i++) {
+    slots->slots[i] = empty_slot;
+  }
+  slots->active = 0;
+}
+
+host_slots_switch_t host_slots_select(host_slots_t* slots, uint8_t slot) {
+  if (slot >= HOST_SLOT_COUNT || slot == slots->active) {
+    return HOST_SLOTS_STAY;
+  }
+
+  slots->active = slot;
+  const host_slot_t* selected = &slots->slots[slot];
+  if (!selected->bonded) {
+    return HOST_SLOTS_PAIR;
+  }
+  return selected->conn_handle != HOST_SLOT_CONN_NONE ? HOST_SLOTS_SWITCHED
+                                                      : HOST_SLOTS_RECONNECT;
+}
+
+static bool host_addr_equal(const host_addr_t* a, const host_addr_t* b) {
+  return a->type == b->type && memcmp(a->val, b->val, sizeof(a->val)) == 0;
+}
+
+static uint8_t host_slots_place(const host_slots_t* slots,
+                                const host_addr_t* addr) {
+  for (uint8_t i = 0; i < HOST_SLOT_COUNT; i++) {
+    const host_slot_t* entry = &slots->slots[i];
+    if (entry->bonded && host_addr_equal(&entry->addr, addr)) {
+      return i;
+    }
+  }
+
+  return host_slots_for_new_host(slots);
+}
+
+uint8_t host_slots_for_new_host(const host_slots_t* slots) {
+  if (!slots->slots[slots->active].bonded) {
+    return slots->active;
+  }
+  for (uint8_t i = 0; i < HOST_SLOT_COUNT; i++) {
+    if (!slots->slots[i].bonded) {
+      return i;
+    }
+  }
+
+  // Every slot taken: never cut off a host that is connected.
+  if (slots->slots[slots->active].conn_handle == HOST_SLOT_CONN_NONE) {
+    return slots->active;
+  }
+  for (uint8_t i = 0; i < HOST_SLOT_COUNT; i++) {
+    if (slots->slots[i].conn_handle == HOST_SLOT_CONN_NONE) {
+      return i;
+    }
+  }
+  return HOST_SLOT_NONE;
+}
+
+uint8_t host_slots_on_encrypted(host_slots_t* slots, const host_addr_t* addr,
+                                uint16_t conn_handle, host_slot_t* evicted) {
+  uint8_t slot = host_slots_place(slots, addr);
+  *evicted = empty_slot;
+  if (slot == HOST_SLOT_NONE) {
+    return slot;
+  }
+
+  host_slot_t* entry = &slots->slots[slot];
+  if (entry->bonded && !host_addr_equal(&entry->addr, addr)) {
+    *evicted = *entry;
+  }
+
+  entry->addr = *addr;
+  entry->bonded = 1;
+  entry->conn_handle = conn_handle;
+  return slot;
+}
+
+void host_slots_on_disconnect(host_slots_t* slots, uint16_t conn_handle) {
+  for (uint8_t i = 0; i < HOST_SLOT_COUNT; i++) {
+    if (slots->slots[i].conn_handle == conn_handle) {
+      slots->slots[i].conn_handle = HOST_SLOT_CONN_NONE;
+    }
+  }
+}
+
+uint16_t host_slots_output(const host_slots_t* slots) {
+  return slots->slots[slots->active].conn_handle;
+}
+
+bool host_slots_reconnect_target(const host_slots_t* slots,
+                                 host_addr_t* addr) {
+  const host_slot_t* selected = &slots->slots[slots->active];
+  if (!selected->bonded || selected->conn_handle != HOST_SLOT_CONN_NONE) {
+    return false;
+  }
+  *addr = selected->addr;
+  return true;
+}
+
+bool host_slots_pairing(const host_slots_t* slots) {
+  return !slots->slots[slots->active].bonded;
+}
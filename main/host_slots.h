@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Easy-Switch style host selection: each slot remembers one host by its
+// identity address, and only the selected slot's host gets input. Pure
+// bookkeeping; the caller advertises, releases keys and persists.
+
+#define HOST_SLOT_COUNT 3
+#define HOST_SLOT_CONN_NONE 0xFFFF
+#define HOST_SLOT_NONE 0xFF
+
+// Same layout as ble_addr_t.
+typedef struct host_addr {
+  uint8_t type;
+  uint8_t val[6];
+} host_addr_t;
+
+typedef struct host_slot {
+  host_addr_t addr;
+  uint8_t bonded;        // `addr` is valid
+  uint16_t conn_handle;  // encrypted link to the host, or HOST_SLOT_CONN_NONE
+} host_slot_t;
+
+typedef struct host_slots {
+  host_slot_t slots[HOST_SLOT_COUNT];
+  uint8_t active;
+} host_slots_t;
+
+typedef enum {
+  HOST_SLOTS_STAY,       // already selected
+  HOST_SLOTS_SWITCHED,   // the host is connected and gets input right away
+  HOST_SLOTS_RECONNECT,  // bonded but away: advertise directed at it
+  HOST_SLOTS_PAIR,       // empty: advertise for a new host
+} host_slots_switch_t;
+
+// Every slot empty, slot 0 selected.
+void host_slots_init(host_slots_t* slots);
+
+// Selects `slot`. Out-of-range slots are ignored.
+host_slots_switch_t host_slots_select(host_slots_t* slots, uint8_t slot);
+
+// Binds an encrypted link to the host's own slot; a new host takes the
+// selected slot if empty, else the first empty one, else the selected one if
+// its host is away, else the first slot whose host is away. `evicted`
+// receives the host it replaced (bonded == 0 if none). Returns the slot, or
+// HOST_SLOT_NONE with nothing changed when every slot's host is connected.
+uint8_t host_slots_on_encrypted(host_slots_t* slots, const host_addr_t* addr,
+                                uint16_t conn_handle, host_slot_t* evicted);
+
+// The slot host_slots_on_encrypted would give a host it doesn't know yet,
+// or HOST_SLOT_NONE.
+uint8_t host_slots_for_new_host(const host_slots_t* slots);
+
+void host_slots_on_disconnect(host_slots_t* slots, uint16_t conn_handle);
+
+// Link that gets input, or HOST_SLOT_CONN_NONE.
+uint16_t host_slots_output(const host_slots_t* slots);
+
+// The selected slot's host when it is bonded but not connected: the one to
+// reconnect to.
+bool host_slots_reconnect_target(const host_slots_t* slots,
+                                 host_addr_t* addr);
+
+// Whether the selected slot is waiting for a new host.
+bool host_slots_pairing(const host_slots_t* slots);
+
+#ifdef __cplusplus
+}
+#endif
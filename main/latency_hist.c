@@ -0,0 +1,90 @@
+#include "latency_hist.h"
+
+#define SUB_COUNT (1u << LATENCY_HIST_SUB_BITS)
+#define SUB_MASK (SUB_COUNT - 1)
+
+void latency_hist_reset(latency_hist_t* hist) {
+  for (size_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+    atomic_store_explicit(&hist->buckets[i], 0, memory_order_relaxed);
+  }
+  atomic_store_explicit(&hist->count, 0, memory_order_relaxed);
+  atomic_store_explicit(&hist->max, 0, memory_order_relaxed);
+}
+
+size_t latency_hist_bucket(uint32_t value) {
+  if (value < SUB_COUNT) {
+    return value;
+  }
+  if (value >= (1u << LATENCY_HIST_MAX_BITS)) {
+    return LATENCY_HIST_BUCKETS - 1;
+  }
+
+  uint32_t msb = 31 - __builtin_clz(value);
+  uint32_t shift = msb - LATENCY_HIST_SUB_BITS;
+  return ((shift + 1) << LATENCY_HIST_SUB_BITS) | ((value >> shift) & SUB_MASK);
+}
+
+uint32_t latency_hist_bucket_upper(size_t bucket) {
+  if (bucket < SUB_COUNT) {
+    return bucket;
+  }
+  if (bucket >= LATENCY_HIST_BUCKETS - 1) {
+    return UINT32_MAX;
+  }
+
+  uint32_t shift = (bucket >> LATENCY_HIST_SUB_BITS) - 1;
+  uint32_t lower = (SUB_COUNT | (bucket & SUB_MASK)) << shift;
+  return lower + (1u << shift) - 1;
+}
+
+void latency_hist_record(latency_hist_t* hist, uint32_t value) {
+  atomic_fetch_add_explicit(&hist->buckets[latency_hist_bucket(value)], 1,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&hist->count, 1, memory_order_relaxed);
+
+  uint32_t max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+  while (value > max &&
+         !atomic_compare_exchange_weak_explicit(&hist->max, &max, value,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+  }
+}
+
+uint32_t latency_hist_percentile(latency_hist_t* hist, uint32_t permille) {
+  // Sum the buckets rather than trusting `count`, which a concurrent
+  // recorder may have bumped before its bucket.
+  uint32_t counts[LATENCY_HIST_BUCKETS];
+  uint64_t total = 0;
+  for (size_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+    counts[i] = atomic_load_explicit(&hist->buckets[i], memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  uint64_t rank = (total * permille + 999) / 1000;
+  if (rank == 0) {
+    rank = 1;
+  }
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      uint32_t upper = latency_hist_bucket_upper(i);
+      uint32_t max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+      return upper < max ? upper : max;
+    }
+  }
+  return 0;
+}
+
+void latency_hist_summarize(latency_hist_t* hist,
+                            latency_hist_summary_t* summary) {
+  summary->count = atomic_load_explicit(&hist->count, memory_order_relaxed);
+  summary->p50 = latency_hist_percentile(hist, 500);
+  summary->p90 = latency_hist_percentile(hist, 900);
+  summary->p99 = latency_hist_percentile(hist, 990);
+  summary->max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+}
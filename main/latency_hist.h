@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Log-linear buckets: values below 2^SUB_BITS get one bucket each, every
+// power of two above that is split into 2^SUB_BITS equal buckets, so any
+// bucket is at most 1/8 wide relative to its value.
+#define LATENCY_HIST_SUB_BITS 3
+// Values at or above 2^MAX_BITS land in an overflow bucket of their own, the
+// last one.
+#define LATENCY_HIST_MAX_BITS 24
+#define LATENCY_HIST_BUCKETS                                                \
+  (((LATENCY_HIST_MAX_BITS - LATENCY_HIST_SUB_BITS + 1)                     \
+    << LATENCY_HIST_SUB_BITS) +                                             \
+   1)
+
+// Fixed size and lock-free: any task may record while another reads.
+typedef struct latency_hist {
+  _Atomic uint32_t buckets[LATENCY_HIST_BUCKETS];
+  _Atomic uint32_t count;
+  _Atomic uint32_t max;
+} latency_hist_t;
+
+typedef struct latency_hist_summary {
+  uint32_t count;
+  uint32_t p50;
+  uint32_t p90;
+  uint32_t p99;
+  uint32_t max;
+} __attribute__((packed)) latency_hist_summary_t;
+
+void latency_hist_reset(latency_hist_t* hist);
+void latency_hist_record(latency_hist_t* hist, uint32_t value);
+
+// Upper bound of the bucket holding the `permille`th value, 0 when empty.
+uint32_t latency_hist_percentile(latency_hist_t* hist, uint32_t permille);
+void latency_hist_summarize(latency_hist_t* hist,
+                            latency_hist_summary_t* summary);
+
+size_t latency_hist_bucket(uint32_t value);
+uint32_t latency_hist_bucket_upper(size_t bucket);
+
+#ifdef __cplusplus
+}
+#endif
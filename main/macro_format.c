@@ -0,0 +1,162 @@
+#include "macro_format.h"
+
+#include <string.h>
+
+void macro_encoder_init(macro_encoder_t* enc, uint8_t* buf, size_t size) {
+  enc->buf = buf;
+  enc->size = size;
+  enc->len = 0;
+  enc->overflow = false;
+}
+
+static bool macro_emit(macro_encoder_t* enc, const uint8_t* bytes,
+                       size_t count) {
+  if (enc->overflow || count > enc->size - enc->len) {
+    enc->overflow = true;
+    return false;
+  }
+  memcpy(enc->buf + enc->len, bytes, count);
+  enc->len += count;
+  return true;
+}
+
+bool macro_encode_toggle(macro_encoder_t* enc, uint8_t usage) {
+  if (usage == 0 || usage > MACRO_OP_TOGGLE_MAX) {
+    return false;
+  }
+  return macro_emit(enc, &usage, 1);
+}
+
+bool macro_encode_chord(macro_encoder_t* enc, const uint8_t* usages,
+                        size_t count) {
+  if (count == 0 || count > MACRO_OP_CHORD_MAX_KEYS) {
+    return false;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (usages[i] == 0 || usages[i] > MACRO_OP_TOGGLE_MAX) {
+      return false;
+    }
+  }
+
+  uint8_t op = (uint8_t)(MACRO_OP_CHORD | (count - 1));
+  return macro_emit(enc, &op, 1) && macro_emit(enc, usages, count);
+}
+
+bool macro_encode_mods(macro_encoder_t* enc, uint8_t modifier, bool send) {
+  const uint8_t op[] = {send ? MACRO_OP_MODS_SEND : MACRO_OP_MODS, modifier};
+  return macro_emit(enc, op, sizeof(op));
+}
+
+bool macro_encode_delay(macro_encoder_t* enc, uint32_t ms) {
+  while (ms > 0) {
+    uint32_t units = ms / MACRO_SHORT_DELAY_MS;
+    if (ms % MACRO_SHORT_DELAY_MS == 0 && units <= 0x1F) {
+      uint8_t op = (uint8_t)(MACRO_OP_SHORT_DELAY | units);
+      return macro_emit(enc, &op, 1);
+    }
+
+    uint16_t chunk = ms > UINT16_MAX ? UINT16_MAX : (uint16_t)ms;
+    const uint8_t op[] = {MACRO_OP_DELAY, (uint8_t)chunk,
+                          (uint8_t)(chunk >> 8)};
+    if (!macro_emit(enc, op, sizeof(op))) {
+      return false;
+    }
+    ms -= chunk;
+  }
+  return true;
+}
+
+bool macro_encode_end(macro_encoder_t* enc) {
+  const uint8_t op = MACRO_OP_END;
+  return macro_emit(enc, &op, 1);
+}
+
+bool macro_table_get(const uint8_t* image, size_t size, uint16_t index,
+                     const uint8_t** macro, size_t* length) {
+  macro_table_header_t header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, image, sizeof(header));
+  if (header.magic != MACRO_TABLE_MAGIC ||
+      header.version != MACRO_TABLE_VERSION || index >= header.count ||
+      (size - sizeof(header)) / sizeof(macro_table_entry_t) < header.count) {
+    return false;
+  }
+
+  macro_table_entry_t entry;
+  memcpy(&entry, image + sizeof(header) + index * sizeof(entry),
+         sizeof(entry));
+  if (entry.offset > size || entry.length > size - entry.offset) {
+    return false;
+  }
+
+  *macro = image + entry.offset;
+  *length = entry.length;
+  return true;
+}
+
+void macro_player_init(macro_player_t* player, const uint8_t* macro,
+                       size_t length) {
+  player->pos = macro;
+  player->end = macro + length;
+  ble_keyboard_state_clear(&player->state);
+  player->delay_ms = 0;
+}
+
+static void macro_toggle(ble_keyboard_state_t* state, uint8_t usage) {
+  state->keys[usage / 32] ^= 1u << (usage % 32);
+}
+
+macro_step_t macro_player_next(macro_player_t* player) {
+  for (;;) {
+    if (player->pos == player->end) {
+      return MACRO_STEP_ERROR;
+    }
+
+    uint8_t op = *player->pos++;
+    size_t left = (size_t)(player->end - player->pos);
+    if (op == MACRO_OP_END) {
+      return MACRO_STEP_END;
+    } else if (op == 0) {
+      return MACRO_STEP_ERROR;
+    } else if (op <= MACRO_OP_TOGGLE_MAX) {
+      macro_toggle(&player->state, op);
+      return MACRO_STEP_REPORT;
+    } else if (op < MACRO_OP_MODS) {
+      size_t count = (size_t)(op & 0x1F) + 1;
+      if (left < count) {
+        return MACRO_STEP_ERROR;
+      }
+      for (size_t i = 0; i < count; i++) {
+        uint8_t usage = player->pos[i];
+        if (usage == 0 || usage > MACRO_OP_TOGGLE_MAX) {
+          return MACRO_STEP_ERROR;
+        }
+        macro_toggle(&player->state, usage);
+      }
+      player->pos += count;
+      return MACRO_STEP_REPORT;
+    } else if (op == MACRO_OP_MODS || op == MACRO_OP_MODS_SEND) {
+      if (left < 1) {
+        return MACRO_STEP_ERROR;
+      }
+      player->state.modifier = *player->pos++;
+      if (op == MACRO_OP_MODS_SEND) {
+        return MACRO_STEP_REPORT;
+      }
+    } else if (op > MACRO_OP_SHORT_DELAY && op < MACRO_OP_DELAY) {
+      player->delay_ms = (uint32_t)(op & 0x1F) * MACRO_SHORT_DELAY_MS;
+      return MACRO_STEP_DELAY;
+    } else if (op == MACRO_OP_DELAY) {
+      if (left < 2) {
+        return MACRO_STEP_ERROR;
+      }
+      player->delay_ms = player->pos[0] | (uint32_t)player->pos[1] << 8;
+      player->pos += 2;
+      return MACRO_STEP_DELAY;
+    } else {
+      return MACRO_STEP_ERROR;
+    }
+  }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ble_keyboard.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A macro partition starts with a table header and `count` entries, each
+// locating one macro stream relative to the start of the partition.
+#define MACRO_TABLE_MAGIC 0x5243414D  // "MACR"
+#define MACRO_TABLE_VERSION 1
+
+typedef struct macro_table_header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t count;
+} __attribute__((packed)) macro_table_header_t;
+
+typedef struct macro_table_entry {
+  uint32_t offset;
+  uint32_t length;
+} __attribute__((packed)) macro_table_entry_t;
+
+// Macro stream opcodes. Keys are delta-encoded: an opcode names the usages
+// that change state, and the player sends the resulting key state. Typing
+// one unmodified character costs two bytes.
+enum {
+  // 0x01..0x7F: toggle that usage, then send.
+  MACRO_OP_TOGGLE_MAX = 0x7F,
+  // 0x80 | (n - 1), n = 1..32, followed by n usages: toggle all, send once.
+  MACRO_OP_CHORD = 0x80,
+  MACRO_OP_CHORD_MAX_KEYS = 32,
+  // Followed by the new modifier byte; MODS_SEND also sends.
+  MACRO_OP_MODS = 0xA0,
+  MACRO_OP_MODS_SEND = 0xA1,
+  // 0xC0 | n, n = 1..31: wait n * MACRO_SHORT_DELAY_MS.
+  MACRO_OP_SHORT_DELAY = 0xC0,
+  // Followed by a little-endian uint16 in milliseconds.
+  MACRO_OP_DELAY = 0xE0,
+  MACRO_OP_END = 0xFF,
+};
+
+#define MACRO_SHORT_DELAY_MS 10
+
+// Writes a macro stream into a caller-owned buffer. Every call returns false
+// once the buffer is full and leaves the encoder in that state.
+typedef struct macro_encoder {
+  uint8_t* buf;
+  size_t size;
+  size_t len;
+  bool overflow;
+} macro_encoder_t;
+
+void macro_encoder_init(macro_encoder_t* enc, uint8_t* buf, size_t size);
+bool macro_encode_toggle(macro_encoder_t* enc, uint8_t usage);
+bool macro_encode_chord(macro_encoder_t* enc, const uint8_t* usages,
+                        size_t count);
+bool macro_encode_mods(macro_encoder_t* enc, uint8_t modifier, bool send);
+bool macro_encode_delay(macro_encoder_t* enc, uint32_t ms);
+bool macro_encode_end(macro_encoder_t* enc);
+
+// Locates macro `index` in a table image. Returns false if the image is not
+// a valid table or the entry points outside it.
+bool macro_table_get(const uint8_t* image, size_t size, uint16_t index,
+                     const uint8_t** macro, size_t* length);
+
+typedef enum {
+  MACRO_STEP_REPORT,  // send `state`
+  MACRO_STEP_DELAY,   // wait `delay_ms`
+  MACRO_STEP_END,
+  MACRO_STEP_ERROR,  // truncated stream or bad opcode
+} macro_step_t;
+
+// Walks a stream in place; nothing is copied out of it.
+typedef struct macro_player {
+  const uint8_t* pos;
+  const uint8_t* end;
+  ble_keyboard_state_t state;
+  uint32_t delay_ms;
+} macro_player_t;
+
+void macro_player_init(macro_player_t* player, const uint8_t* macro,
+                       size_t length);
+macro_step_t macro_player_next(macro_player_t* player);
+
+#ifdef __cplusplus
+}
+#endif
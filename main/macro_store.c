@@ -0,0 +1,74 @@
+#include "macro_store.h"
+
+#include "ble_hid.h"
+#include "ble_keyboard.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host/ble_hs.h"
+#include "macro_format.h"
+
+static const char* TAG = "MACRO";
+
+static const esp_partition_t* partition;
+static const uint8_t* image;
+static esp_partition_mmap_handle_t mmap_handle;
+
+esp_err_t macro_store_init(void) {
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                       MACRO_PARTITION_SUBTYPE,
+                                       MACRO_PARTITION_LABEL);
+  if (partition == NULL) {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  const void* base;
+  esp_err_t err = esp_partition_mmap(partition, 0, partition->size,
+                                     ESP_PARTITION_MMAP_DATA, &base,
+                                     &mmap_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to map macro partition, error: %s",
+             esp_err_to_name(err));
+    return err;
+  }
+
+  image = base;
+  return ESP_OK;
+}
+
+const esp_partition_t* macro_store_partition(void) { return partition; }
+
+esp_err_t macro_play(uint16_t index) {
+  const uint8_t* macro;
+  size_t length;
+  if (image == NULL ||
+      !macro_table_get(image, partition->size, index, &macro, &length)) {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  macro_player_t player;
+  macro_player_init(&player, macro, length);
+  for (;;) {
+    switch (macro_player_next(&player)) {
+      case MACRO_STEP_REPORT:
+        while (ble_keyboard_send_state(&player.state) == BLE_HS_EAGAIN) {
+          ble_hid_wait_for_space();
+        }
+        break;
+      case MACRO_STEP_DELAY:
+        vTaskDelay(pdMS_TO_TICKS(player.delay_ms));
+        break;
+      case MACRO_STEP_END:
+        return ESP_OK;
+      case MACRO_STEP_ERROR:
+        ESP_LOGE(TAG, "Macro %u is corrupt at byte %u", index,
+                 (unsigned)(player.pos - macro));
+        // Don't leave keys held on the host.
+        ble_keyboard_state_clear(&player.state);
+        while (ble_keyboard_send_state(&player.state) == BLE_HS_EAGAIN) {
+          ble_hid_wait_for_space();
+        }
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+  }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Data partition holding a macro table (see macro_format.h).
+#define MACRO_PARTITION_LABEL "macros"
+#define MACRO_PARTITION_SUBTYPE 0x40
+
+// Maps the macro partition for reading. The mapping stays for the lifetime
+// of the program.
+esp_err_t macro_store_init(void);
+
+const esp_partition_t* macro_store_partition(void);
+
+// Types macro `index` straight from the mapping. Runs on the calling task,
+// which must be the only HID report producer, and blocks until the last
+// report is queued. Returns ESP_ERR_NOT_FOUND for a missing entry and
+// ESP_ERR_INVALID_RESPONSE for a corrupt stream.
+esp_err_t macro_play(uint16_t index);
+
+#ifdef __cplusplus
+}
+#endif
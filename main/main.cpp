@@ -1,14 +1,20 @@
 
 #include <functional>
 
+#include "air_mouse.h"
+#include "battery_monitor.h"
+#include "board_buttons.h"
 #include "ble_module.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
+#include "macro_store.h"
 #include "nvs_flash.h"
 
+static const char* TAG = "MAIN";
+
 extern "C" void app_main() {
   esp_err_t err = nvs_flash_init();
   if (err == ESP_ERR_NVS_NEW_VERSION_FOUND ||
@@ -19,4 +25,25 @@ extern "C" void app_main() {
 
   ESP_ERROR_CHECK(err);
   ble_module_init();
+
+  // The keyboard works without the IMU, so a missing sensor isn't fatal.
+  err = air_mouse_start();
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Air mouse disabled: %s", esp_err_to_name(err));
+  }
+
+  err = macro_store_init();
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Macros unavailable: %s", esp_err_to_name(err));
+  }
+
+  err = board_buttons_start();
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Buttons disabled: %s", esp_err_to_name(err));
+  }
+
+  err = battery_monitor_start();
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Battery monitor disabled: %s", esp_err_to_name(err));
+  }
 }
@@ -0,0 +1,87 @@
+#include "mpu6886.h"
+
+#include "board_i2c.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char* TAG = "MPU6886";
+
+#define MPU6886_WHO_AM_I_VALUE 0x19
+// Gyro output rate with the digital low-pass filter enabled.
+#define MPU6886_INTERNAL_RATE_HZ 1000
+
+enum {
+  MPU6886_REG_SMPLRT_DIV = 0x19,
+  MPU6886_REG_CONFIG = 0x1A,
+  MPU6886_REG_GYRO_CONFIG = 0x1B,
+  MPU6886_REG_ACCEL_CONFIG = 0x1C,
+  MPU6886_REG_ACCEL_CONFIG2 = 0x1D,
+  MPU6886_REG_FIFO_EN = 0x23,
+  MPU6886_REG_INT_PIN_CFG = 0x37,
+  MPU6886_REG_INT_ENABLE = 0x38,
+  MPU6886_REG_GYRO_XOUT_H = 0x43,
+  MPU6886_REG_USER_CTRL = 0x6A,
+  MPU6886_REG_PWR_MGMT_1 = 0x6B,
+  MPU6886_REG_WHO_AM_I = 0x75,
+};
+
+static i2c_master_dev_handle_t dev;
+
+esp_err_t mpu6886_init(uint32_t sample_hz) {
+  esp_err_t err = board_i2c_add_device(MPU6886_I2C_ADDR, &dev);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  uint8_t who_am_i = 0;
+  err = board_i2c_read(dev, MPU6886_REG_WHO_AM_I, &who_am_i, 1);
+  if (err != ESP_OK) {
+    return err;
+  }
+  if (who_am_i != MPU6886_WHO_AM_I_VALUE) {
+    ESP_LOGE(TAG, "Unexpected WHO_AM_I 0x%02x", who_am_i);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  err = board_i2c_write(dev, MPU6886_REG_PWR_MGMT_1, 0x80);  // reset
+  if (err != ESP_OK) {
+    return err;
+  }
+  vTaskDelay(pdMS_TO_TICKS(20));
+
+  const uint8_t config[][2] = {
+      {MPU6886_REG_PWR_MGMT_1, 0x01},    // PLL clock
+      {MPU6886_REG_GYRO_CONFIG, 0x18},   // ±2000 °/s
+      {MPU6886_REG_ACCEL_CONFIG, 0x10},  // ±8 g
+      {MPU6886_REG_ACCEL_CONFIG2, 0x00},
+      {MPU6886_REG_CONFIG, 0x01},  // 176 Hz low-pass, 1 kHz internal rate
+      {MPU6886_REG_SMPLRT_DIV,
+       (uint8_t)(MPU6886_INTERNAL_RATE_HZ / sample_hz - 1)},
+      {MPU6886_REG_USER_CTRL, 0x00},
+      {MPU6886_REG_FIFO_EN, 0x00},
+      {MPU6886_REG_INT_PIN_CFG, 0x22},
+      {MPU6886_REG_INT_ENABLE, 0x00},
+  };
+  for (size_t i = 0; i < sizeof(config) / sizeof(config[0]); i++) {
+    err = board_i2c_write(dev, config[i][0], config[i][1]);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+  return ESP_OK;
+}
+
+esp_err_t mpu6886_read_gyro(int16_t gyro[MPU6886_AXIS_COUNT]) {
+  uint8_t raw[MPU6886_AXIS_COUNT * 2];
+  esp_err_t err =
+      board_i2c_read(dev, MPU6886_REG_GYRO_XOUT_H, raw, sizeof(raw));
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  for (int axis = 0; axis < MPU6886_AXIS_COUNT; axis++) {
+    gyro[axis] = (int16_t)((raw[axis * 2] << 8) | raw[axis * 2 + 1]);
+  }
+  return ESP_OK;
+}
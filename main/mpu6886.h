@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MPU6886_I2C_ADDR 0x68
+// Gyro sensitivity at the ±2000 °/s range mpu6886_init selects, 16.4
+// LSB per °/s.
+#define MPU6886_GYRO_LSB_PER_DPS_X10 164
+
+typedef enum {
+  MPU6886_AXIS_X,
+  MPU6886_AXIS_Y,
+  MPU6886_AXIS_Z,
+  MPU6886_AXIS_COUNT,
+} mpu6886_axis_t;
+
+// Resets the IMU and configures the gyro for `sample_hz` (4..1000) on the
+// board I2C bus, which must already be up.
+esp_err_t mpu6886_init(uint32_t sample_hz);
+
+esp_err_t mpu6886_read_gyro(int16_t gyro[MPU6886_AXIS_COUNT]);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,130 @@
+#include "ota_pipeline.h"
+
+#include <string.h>
+
+void ota_pipeline_init(ota_pipeline_t* pipeline, const ota_flash_ops_t* ops,
+                       void* ctx) {
+  pipeline->ops = ops;
+  pipeline->ctx = ctx;
+  pipeline->fill = 0;
+  pipeline->pushed = 0;
+  atomic_init(&pipeline->submitted, 0);
+  atomic_init(&pipeline->completed, 0);
+  atomic_init(&pipeline->written, 0);
+  atomic_init(&pipeline->failed, false);
+  // Releases the hash of an image abandoned halfway; a no-op otherwise.
+  mbedtls_sha256_free(&pipeline->sha);
+  mbedtls_sha256_init(&pipeline->sha);
+  mbedtls_sha256_starts(&pipeline->sha, 0);
+}
+
+static uint32_t ota_pipeline_in_flight(ota_pipeline_t* pipeline) {
+  uint32_t submitted =
+      atomic_load_explicit(&pipeline->submitted, memory_order_relaxed);
+  uint32_t completed =
+      atomic_load_explicit(&pipeline->completed, memory_order_acquire);
+  return submitted - completed;
+}
+
+size_t ota_pipeline_room(ota_pipeline_t* pipeline) {
+  // Blocks past the one being filled are free once the consumer is done.
+  uint32_t free_blocks =
+      OTA_PIPELINE_BLOCKS - ota_pipeline_in_flight(pipeline);
+  if (free_blocks == 0) {
+    return 0;
+  }
+  return (free_blocks - 1) * OTA_PIPELINE_BLOCK_SIZE +
+         (OTA_PIPELINE_BLOCK_SIZE - pipeline->fill);
+}
+
+static void ota_pipeline_submit(ota_pipeline_t* pipeline) {
+  uint32_t submitted =
+      atomic_load_explicit(&pipeline->submitted, memory_order_relaxed);
+  pipeline->blocks[submitted % OTA_PIPELINE_BLOCKS].len = pipeline->fill;
+  pipeline->fill = 0;
+  atomic_store_explicit(&pipeline->submitted, submitted + 1,
+                        memory_order_release);
+}
+
+int ota_pipeline_write(ota_pipeline_t* pipeline, const uint8_t* data,
+                       size_t len) {
+  if (ota_pipeline_failed(pipeline) || len > ota_pipeline_room(pipeline)) {
+    return -1;
+  }
+
+  int handed_over = 0;
+  while (len > 0) {
+    uint32_t submitted =
+        atomic_load_explicit(&pipeline->submitted, memory_order_relaxed);
+    ota_block_t* block = &pipeline->blocks[submitted % OTA_PIPELINE_BLOCKS];
+    size_t n = OTA_PIPELINE_BLOCK_SIZE - pipeline->fill;
+    if (n > len) {
+      n = len;
+    }
+
+    memcpy(&block->data[pipeline->fill], data, n);
+    pipeline->fill += n;
+    pipeline->pushed += n;
+    data += n;
+    len -= n;
+
+    if (pipeline->fill == OTA_PIPELINE_BLOCK_SIZE) {
+      ota_pipeline_submit(pipeline);
+      handed_over++;
+    }
+  }
+  return handed_over;
+}
+
+int ota_pipeline_flush(ota_pipeline_t* pipeline) {
+  if (pipeline->fill == 0) {
+    return 0;
+  }
+  if (ota_pipeline_in_flight(pipeline) == OTA_PIPELINE_BLOCKS) {
+    return -1;
+  }
+
+  ota_pipeline_submit(pipeline);
+  return 1;
+}
+
+bool ota_pipeline_pending(ota_pipeline_t* pipeline) {
+  uint32_t completed =
+      atomic_load_explicit(&pipeline->completed, memory_order_relaxed);
+  uint32_t submitted =
+      atomic_load_explicit(&pipeline->submitted, memory_order_acquire);
+  return submitted != completed;
+}
+
+int ota_pipeline_process(ota_pipeline_t* pipeline) {
+  uint32_t completed =
+      atomic_load_explicit(&pipeline->completed, memory_order_relaxed);
+  const ota_block_t* block =
+      &pipeline->blocks[completed % OTA_PIPELINE_BLOCKS];
+  uint32_t offset = completed * OTA_PIPELINE_BLOCK_SIZE;
+
+  int rc = -1;
+  if (!ota_pipeline_failed(pipeline) &&
+      pipeline->ops->erase(pipeline->ctx, offset, OTA_PIPELINE_BLOCK_SIZE) ==
+          0 &&
+      pipeline->ops->write(pipeline->ctx, offset, block->data, block->len) ==
+          0) {
+    // Hashed from RAM after the write, so the digest covers exactly the
+    // bytes that went to flash.
+    mbedtls_sha256_update(&pipeline->sha, block->data, block->len);
+    atomic_fetch_add_explicit(&pipeline->written, block->len,
+                              memory_order_relaxed);
+    rc = 0;
+  } else {
+    atomic_store(&pipeline->failed, true);
+  }
+
+  atomic_store_explicit(&pipeline->completed, completed + 1,
+                        memory_order_release);
+  return rc;
+}
+
+void ota_pipeline_finish(ota_pipeline_t* pipeline, uint8_t digest[32]) {
+  mbedtls_sha256_finish(&pipeline->sha, digest);
+  mbedtls_sha256_free(&pipeline->sha);
+}
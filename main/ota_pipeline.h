@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mbedtls/sha256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Double-buffered path from a byte stream into flash. One producer fills a
+// sector-sized block while one consumer erases, writes and hashes the other,
+// so the producer never makes a flash call itself. Flash is reached through
+// ota_flash_ops_t only, which lets the pipeline run on the host against a
+// file.
+
+#define OTA_PIPELINE_BLOCK_SIZE 4096  // one flash sector
+#define OTA_PIPELINE_BLOCKS 2
+
+typedef struct ota_flash_ops {
+  // Erases [offset, offset + len), both sector aligned. Returns 0 on success.
+  int (*erase)(void* ctx, uint32_t offset, size_t len);
+  // Writes erased flash. Returns 0 on success.
+  int (*write)(void* ctx, uint32_t offset, const void* data, size_t len);
+} ota_flash_ops_t;
+
+typedef struct ota_block {
+  uint32_t len;
+  uint8_t data[OTA_PIPELINE_BLOCK_SIZE];
+} ota_block_t;
+
+typedef struct ota_pipeline {
+  const ota_flash_ops_t* ops;
+  void* ctx;
+  ota_block_t blocks[OTA_PIPELINE_BLOCKS];
+  uint32_t fill;               // producer: bytes in the block being filled
+  uint32_t pushed;             // producer: bytes accepted
+  _Atomic uint32_t submitted;  // blocks handed to the consumer
+  _Atomic uint32_t completed;  // blocks the consumer is done with
+  _Atomic uint32_t written;    // bytes in flash
+  atomic_bool failed;
+  mbedtls_sha256_context sha;  // consumer
+} ota_pipeline_t;
+
+// Starts a new image at offset 0. No block may still be in flight.
+void ota_pipeline_init(ota_pipeline_t* pipeline, const ota_flash_ops_t* ops,
+                       void* ctx);
+
+// Producer side.
+
+// Bytes ota_pipeline_write can take right now.
+size_t ota_pipeline_room(ota_pipeline_t* pipeline);
+
+// Copies `len` bytes, at most ota_pipeline_room, and hands every block that
+// fills up to the consumer. Returns the number of blocks handed over, or -1
+// if the data doesn't fit or flash has failed.
+int ota_pipeline_write(ota_pipeline_t* pipeline, const uint8_t* data,
+                       size_t len);
+
+// Hands over the last, partial block. Returns the number of blocks handed
+// over, or -1 if there is no buffer free for it yet.
+int ota_pipeline_flush(ota_pipeline_t* pipeline);
+
+// Consumer side.
+
+// Whether a block is waiting for ota_pipeline_process.
+bool ota_pipeline_pending(ota_pipeline_t* pipeline);
+
+// Erases, writes and hashes the oldest block handed over. Returns 0, or -1
+// once flash has failed; later blocks are then dropped unwritten.
+int ota_pipeline_process(ota_pipeline_t* pipeline);
+
+// SHA-256 of everything written. Call once, with nothing pending.
+void ota_pipeline_finish(ota_pipeline_t* pipeline, uint8_t digest[32]);
+
+static inline uint32_t ota_pipeline_written(ota_pipeline_t* pipeline) {
+  return atomic_load_explicit(&pipeline->written, memory_order_relaxed);
+}
+
+static inline bool ota_pipeline_failed(ota_pipeline_t* pipeline) {
+  return atomic_load(&pipeline->failed);
+}
+
+#ifdef __cplusplus
+}
+#endif
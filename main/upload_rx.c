@@ -0,0 +1,127 @@
+#include "upload_rx.h"
+
+// Reflected polynomial 0xEDB88320, four bits at a time: 64 bytes of table
+// instead of 1 KiB, and still well ahead of the link.
+static const uint32_t crc32_nibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+    0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t upload_crc32(uint32_t crc, const uint8_t* data, size_t len) {
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+    crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+static void upload_rx_reply(const upload_rx_t* rx, upload_status_t status,
+                            upload_reply_t* reply) {
+  reply->status = status;
+  reply->next_seq = rx->next_seq;
+  reply->received = rx->received;
+}
+
+static bool upload_rx_end(upload_rx_t* rx, upload_status_t status,
+                          upload_reply_t* reply) {
+  rx->active = false;
+  upload_rx_reply(rx, status, reply);
+  return true;
+}
+
+static bool upload_rx_open_window(upload_rx_t* rx, upload_status_t status,
+                                  const upload_sink_t* sink,
+                                  upload_reply_t* reply) {
+  if (sink->window_ready != NULL && !sink->window_ready(sink->arg)) {
+    rx->held = true;
+    rx->held_status = status;
+    return false;
+  }
+
+  rx->held = false;
+  upload_rx_reply(rx, status, reply);
+  return true;
+}
+
+void upload_rx_begin(upload_rx_t* rx, uint32_t length, uint32_t crc) {
+  *rx = (upload_rx_t){
+      .length = length,
+      .expected_crc = crc,
+      .active = true,
+  };
+}
+
+bool upload_rx_abort(upload_rx_t* rx, upload_reply_t* reply) {
+  if (!rx->active) {
+    return false;
+  }
+  return upload_rx_end(rx, UPLOAD_STATUS_ABORTED, reply);
+}
+
+bool upload_rx_chunk(upload_rx_t* rx, uint16_t seq, const uint8_t* data,
+                     size_t len, const upload_sink_t* sink,
+                     upload_reply_t* reply) {
+  if (!rx->active) {
+    return false;
+  }
+
+  int16_t ahead = (int16_t)(seq - rx->next_seq);
+  // Lost chunks only make the sequence skip ahead; going back means the
+  // sender timed out and started over from its last ACK. Skipping from
+  // duplicates straight past next_seq means the ACK they drew arrived and
+  // the chunk after it didn't.
+  bool restarted = (int16_t)(seq - rx->last_seq) <= 0;
+  bool new_gap = ahead > 0 && (int16_t)(rx->last_seq - rx->next_seq) < 0;
+  rx->last_seq = seq;
+  if (ahead != 0) {
+    // A gap asks for a resend; duplicates mean our ACK got lost or the
+    // sender timed out, so tell it where we are. Only once per run, or a
+    // whole window in flight would turn into as many replies, but again
+    // for a restarted sender in case that reply was lost too.
+    if (rx->resync_sent && !restarted && !new_gap) {
+      return false;
+    }
+    rx->resync_sent = true;
+    rx->unacked = 0;
+    return upload_rx_open_window(
+        rx, ahead > 0 ? UPLOAD_STATUS_NACK : UPLOAD_STATUS_ACK, sink, reply);
+  }
+
+  if (len == 0 || len > rx->length - rx->received) {
+    return upload_rx_end(rx, UPLOAD_STATUS_LENGTH_MISMATCH, reply);
+  }
+
+  if (sink->write(rx->received, data, len, sink->arg) != 0) {
+    return upload_rx_end(rx, UPLOAD_STATUS_WRITE_FAILED, reply);
+  }
+
+  rx->crc = upload_crc32(rx->crc, data, len);
+  rx->received += len;
+  rx->next_seq++;
+  rx->resync_sent = false;
+
+  if (rx->received == rx->length) {
+    return upload_rx_end(rx,
+                         rx->crc == rx->expected_crc
+                             ? UPLOAD_STATUS_DONE
+                             : UPLOAD_STATUS_CRC_MISMATCH,
+                         reply);
+  }
+
+  if (++rx->unacked < UPLOAD_RX_WINDOW) {
+    return false;
+  }
+  rx->unacked = 0;
+  return upload_rx_open_window(rx, UPLOAD_STATUS_ACK, sink, reply);
+}
+
+bool upload_rx_poll(upload_rx_t* rx, const upload_sink_t* sink,
+                    upload_reply_t* reply) {
+  if (!rx->active || !rx->held) {
+    return false;
+  }
+  return upload_rx_open_window(rx, rx->held_status, sink, reply);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Receiver side of the bulk upload protocol: in-order chunks with 16-bit
+// sequence numbers, a cumulative acknowledgement every UPLOAD_RX_WINDOW
+// chunks and go-back-N on a gap. Knows nothing about BLE or flash, so it
+// builds and runs on the host.
+
+// Chunks the sender may have in flight before it must wait for an ACK.
+#define UPLOAD_RX_WINDOW 16
+
+typedef enum {
+  UPLOAD_STATUS_ACK = 0x00,   // everything before next_seq is stored
+  UPLOAD_STATUS_NACK = 0x01,  // chunk missing, resend from next_seq
+  UPLOAD_STATUS_DONE = 0x02,  // all bytes stored and the CRC matches
+  UPLOAD_STATUS_CRC_MISMATCH = 0x03,
+  UPLOAD_STATUS_WRITE_FAILED = 0x04,
+  UPLOAD_STATUS_LENGTH_MISMATCH = 0x05,  // chunk runs past the length
+  UPLOAD_STATUS_ABORTED = 0x06,
+  UPLOAD_STATUS_VERIFY_FAILED = 0x07,  // the target rejected the contents
+} upload_status_t;
+
+// Notified to the sender.
+typedef struct upload_reply {
+  uint8_t status;  // upload_status_t
+  uint16_t next_seq;
+  uint32_t received;
+} __attribute__((packed)) upload_reply_t;
+
+typedef struct upload_rx {
+  uint32_t length;
+  uint32_t expected_crc;
+  uint32_t received;
+  uint32_t crc;
+  uint16_t next_seq;
+  uint16_t last_seq;  // of the last chunk received, in order or not
+  uint8_t unacked;
+  bool resync_sent;  // answered the current gap or duplicate run already
+  bool held;         // a reply is waiting for the sink to make room
+  uint8_t held_status;
+  bool active;
+} upload_rx_t;
+
+// Where the data goes.
+typedef struct upload_sink {
+  // Stores `len` bytes at `offset`. Returns 0 on success.
+  int (*write)(uint32_t offset, const uint8_t* data, size_t len, void* arg);
+  // Whether a full window of chunks would fit; NULL if it always does.
+  // Every ACK or NACK lets the sender send another window, so holding them
+  // back is the sender's only flow control.
+  bool (*window_ready)(void* arg);
+  void* arg;
+} upload_sink_t;
+
+// CRC-32 as in zlib: start with 0 and feed the previous result back in.
+uint32_t upload_crc32(uint32_t crc, const uint8_t* data, size_t len);
+
+void upload_rx_begin(upload_rx_t* rx, uint32_t length, uint32_t crc);
+
+// Ends the session; returns false if none was running.
+bool upload_rx_abort(upload_rx_t* rx, upload_reply_t* reply);
+
+// Handles one data chunk and writes it to `sink` if it is the next one
+// expected. Returns true when `reply` should be sent to the sender. A reply
+// with a status other than ACK or NACK ends the session.
+bool upload_rx_chunk(upload_rx_t* rx, uint16_t seq, const uint8_t* data,
+                     size_t len, const upload_sink_t* sink,
+                     upload_reply_t* reply);
+
+// Releases a reply held back by window_ready once the sink has room.
+bool upload_rx_poll(upload_rx_t* rx, const upload_sink_t* sink,
+                    upload_reply_t* reply);
+
+#ifdef __cplusplus
+}
+#endif
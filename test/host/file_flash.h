@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ota_pipeline.h"
+#include "test_util.h"
+
+// ota_flash_ops_t over a temporary file that behaves like NOR flash: erase
+// sets whole sectors to 0xFF and writes can only clear bits. Every write
+// must land on erased bytes, and every erase and write must land in offset
+// order, as the pipeline promises. Failures can be injected per offset.
+
+#define FILE_FLASH_SECTOR OTA_PIPELINE_BLOCK_SIZE
+
+typedef struct file_flash {
+  FILE* file;
+  uint32_t size;
+  uint32_t erased_end;   // first byte past the last erased sector
+  uint32_t written_end;  // first byte past the last write
+  uint32_t erases;
+  uint32_t writes;
+  uint32_t fail_erase_at;  // UINT32_MAX for none
+  uint32_t fail_write_at;
+} file_flash_t;
+
+static inline void file_flash_open(file_flash_t* flash, uint32_t size) {
+  memset(flash, 0, sizeof(*flash));
+  flash->file = tmpfile();
+  CHECK(flash->file != NULL);
+  flash->size = size;
+  flash->fail_erase_at = UINT32_MAX;
+  flash->fail_write_at = UINT32_MAX;
+
+  // Fresh from the factory: garbage, not erased.
+  uint8_t sector[FILE_FLASH_SECTOR];
+  memset(sector, 0x5A, sizeof(sector));
+  for (uint32_t offset = 0; offset < size; offset += sizeof(sector)) {
+    CHECK_EQ(fwrite(sector, 1, sizeof(sector), flash->file), sizeof(sector));
+  }
+}
+
+static inline void file_flash_close(file_flash_t* flash) {
+  fclose(flash->file);
+  flash->file = NULL;
+}
+
+// The pipeline starts a new image at offset 0.
+static inline void file_flash_restart(file_flash_t* flash) {
+  flash->erased_end = 0;
+  flash->written_end = 0;
+}
+
+static inline void file_flash_read(file_flash_t* flash, uint32_t offset,
+                                   void* data, size_t len) {
+  CHECK(offset + len <= flash->size);
+  CHECK_EQ(fseek(flash->file, offset, SEEK_SET), 0);
+  CHECK_EQ(fread(data, 1, len, flash->file), len);
+}
+
+static inline int file_flash_erase(void* ctx, uint32_t offset, size_t len) {
+  file_flash_t* flash = ctx;
+  CHECK_EQ(offset % FILE_FLASH_SECTOR, 0);
+  CHECK_EQ(len % FILE_FLASH_SECTOR, 0);
+  CHECK(offset + len <= flash->size);
+  CHECK_EQ(offset, flash->erased_end);
+  if (offset == flash->fail_erase_at) {
+    return -1;
+  }
+
+  uint8_t sector[FILE_FLASH_SECTOR];
+  memset(sector, 0xFF, sizeof(sector));
+  CHECK_EQ(fseek(flash->file, offset, SEEK_SET), 0);
+  for (size_t done = 0; done < len; done += sizeof(sector)) {
+    CHECK_EQ(fwrite(sector, 1, sizeof(sector), flash->file), sizeof(sector));
+  }
+  flash->erased_end = offset + (uint32_t)len;
+  flash->erases++;
+  return 0;
+}
+
+static inline int file_flash_write(void* ctx, uint32_t offset,
+                                   const void* data, size_t len) {
+  file_flash_t* flash = ctx;
+  CHECK_EQ(offset, flash->written_end);
+  CHECK(offset + len <= flash->erased_end);
+  if (offset == flash->fail_write_at) {
+    return -1;
+  }
+
+  uint8_t old[FILE_FLASH_SECTOR];
+  CHECK(len <= sizeof(old));
+  file_flash_read(flash, offset, old, len);
+  for (size_t i = 0; i < len; i++) {
+    CHECK_EQ(old[i], 0xFF);
+  }
+  CHECK_EQ(fseek(flash->file, offset, SEEK_SET), 0);
+  CHECK_EQ(fwrite(data, 1, len, flash->file), len);
+  flash->written_end = offset + (uint32_t)len;
+  flash->writes++;
+  return 0;
+}
+
+static const ota_flash_ops_t file_flash_ops = {
+    .erase = file_flash_erase,
+    .write = file_flash_write,
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+typedef enum {
+  ESP_BLE_PWR_TYPE_ADV = 9,
+} esp_ble_power_type_t;
+
+// Levels are 3 dB apart from ESP_PWR_LVL_N12 (-12 dBm).
+typedef enum {
+  ESP_PWR_LVL_N12 = 0,
+  ESP_PWR_LVL_P3 = 5,
+  ESP_PWR_LVL_P9 = 7,
+} esp_power_level_t;
+
+esp_power_level_t esp_ble_tx_power_get(esp_ble_power_type_t power_type);
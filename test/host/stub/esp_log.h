@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdio.h>
+
+// Compiled in but never printed, so format strings are still checked.
+#define ESP_LOG_DISCARD(tag, format, ...) \
+  do {                                    \
+    (void)(tag);                          \
+    if (0) {                              \
+      printf(format, ##__VA_ARGS__);      \
+    }                                     \
+  } while (0)
+
+#define ESP_LOGE ESP_LOG_DISCARD
+#define ESP_LOGW ESP_LOG_DISCARD
+#define ESP_LOGI ESP_LOG_DISCARD
+#define ESP_LOGD ESP_LOG_DISCARD
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct esp_partition {
+  uint32_t address;
+  uint32_t size;
+  uint32_t erase_size;
+  char label[17];
+} esp_partition_t;
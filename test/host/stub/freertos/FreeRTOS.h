@@ -0,0 +1,6 @@
+#pragma once
+
+// Host-test stand-in: only the types firmware headers mention.
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+
+#define BLE_ATT_MTU_DFLT 23
+
+#define BLE_ATT_ERR_INVALID_OFFSET 0x07
+#define BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN 0x0d
+#define BLE_ATT_ERR_UNLIKELY 0x0e
+#define BLE_ATT_ERR_INSUFFICIENT_RES 0x11
+
+// Provided by the test.
+uint16_t ble_att_mtu(uint16_t conn_handle);
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "nimble/ble.h"
+
+#define BLE_GAP_EVENT_CONNECT 0
+#define BLE_GAP_EVENT_DISCONNECT 1
+#define BLE_GAP_EVENT_CONN_UPDATE 3
+#define BLE_GAP_EVENT_CONN_UPDATE_REQ 4
+#define BLE_GAP_EVENT_ADV_COMPLETE 9
+#define BLE_GAP_EVENT_ENC_CHANGE 10
+#define BLE_GAP_EVENT_NOTIFY_TX 13
+#define BLE_GAP_EVENT_SUBSCRIBE 14
+#define BLE_GAP_EVENT_MTU 15
+#define BLE_GAP_EVENT_REPEAT_PAIRING 17
+
+#define BLE_GAP_CONN_MODE_NON 0
+#define BLE_GAP_CONN_MODE_DIR 1
+#define BLE_GAP_CONN_MODE_UND 2
+#define BLE_GAP_DISC_MODE_NON 0
+#define BLE_GAP_DISC_MODE_LTD 1
+#define BLE_GAP_DISC_MODE_GEN 2
+
+#define BLE_GAP_REPEAT_PAIRING_RETRY 1
+
+struct ble_gap_sec_state {
+  unsigned encrypted : 1;
+  unsigned authenticated : 1;
+  unsigned bonded : 1;
+  unsigned key_size : 5;
+};
+
+struct ble_gap_conn_desc {
+  struct ble_gap_sec_state sec_state;
+  ble_addr_t our_id_addr;
+  ble_addr_t peer_id_addr;
+  ble_addr_t our_ota_addr;
+  ble_addr_t peer_ota_addr;
+  uint16_t conn_handle;
+  uint16_t conn_itvl;
+  uint16_t conn_latency;
+  uint16_t supervision_timeout;
+  uint8_t role;
+  uint8_t master_clock_accuracy;
+};
+
+struct ble_gap_upd_params {
+  uint16_t itvl_min;
+  uint16_t itvl_max;
+  uint16_t latency;
+  uint16_t supervision_timeout;
+  uint16_t min_ce_len;
+  uint16_t max_ce_len;
+};
+
+struct ble_gap_adv_params {
+  uint8_t conn_mode;
+  uint8_t disc_mode;
+  uint16_t itvl_min;
+  uint16_t itvl_max;
+  uint8_t channel_map;
+  uint8_t filter_policy;
+  uint8_t high_duty_cycle : 1;
+};
+
+struct ble_gap_event {
+  uint8_t type;
+  union {
+    struct {
+      int status;
+      uint16_t conn_handle;
+    } connect;
+    struct {
+      int reason;
+      struct ble_gap_conn_desc conn;
+    } disconnect;
+    struct {
+      int status;
+      uint16_t conn_handle;
+    } conn_update;
+    struct {
+      struct ble_gap_upd_params* self_params;
+      const struct ble_gap_upd_params* peer_params;
+      uint16_t conn_handle;
+    } conn_update_req;
+    struct {
+      int reason;
+    } adv_complete;
+    struct {
+      int status;
+      uint16_t conn_handle;
+    } enc_change;
+    struct {
+      int status;
+      uint16_t conn_handle;
+      uint16_t attr_handle;
+      uint8_t indication : 1;
+    } notify_tx;
+    struct {
+      uint16_t conn_handle;
+      uint16_t attr_handle;
+      uint8_t reason;
+      uint8_t prev_notify : 1;
+      uint8_t cur_notify : 1;
+      uint8_t prev_indicate : 1;
+      uint8_t cur_indicate : 1;
+    } subscribe;
+    struct {
+      uint16_t conn_handle;
+      uint16_t channel_id;
+      uint16_t value;
+    } mtu;
+    struct {
+      uint16_t conn_handle;
+      uint8_t cur_key_size;
+      uint8_t cur_authenticated : 1;
+      uint8_t cur_sc : 1;
+      uint8_t new_key_size;
+      uint8_t new_authenticated : 1;
+      uint8_t new_sc : 1;
+      uint8_t new_bonding : 1;
+    } repeat_pairing;
+  };
+};
+
+typedef int ble_gap_event_fn(struct ble_gap_event* event, void* arg);
+
+int ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc* out_desc);
+int ble_gap_terminate(uint16_t conn_handle, uint8_t hci_reason);
+int ble_gap_security_initiate(uint16_t conn_handle);
+int ble_gap_update_params(uint16_t conn_handle,
+                          const struct ble_gap_upd_params* params);
+int ble_gap_adv_start(uint8_t own_addr_type, const ble_addr_t* direct_addr,
+                      int32_t duration_ms,
+                      const struct ble_gap_adv_params* adv_params,
+                      ble_gap_event_fn* cb, void* cb_arg);
+int ble_gap_adv_stop(void);
+int ble_gap_adv_active(void);
+int ble_gap_adv_set_data(const uint8_t* data, int data_len);
+int ble_gap_adv_rsp_set_data(const uint8_t* data, int data_len);
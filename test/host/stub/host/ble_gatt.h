@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "os/os_mbuf.h"
+
+#define BLE_GATTS_CLT_CFG_F_NOTIFY 0x0001
+#define BLE_GATTS_CLT_CFG_F_INDICATE 0x0002
+
+#define BLE_GATT_ACCESS_OP_READ_CHR 0
+#define BLE_GATT_ACCESS_OP_WRITE_CHR 1
+#define BLE_GATT_ACCESS_OP_READ_DSC 2
+#define BLE_GATT_ACCESS_OP_WRITE_DSC 3
+
+// Only the fields firmware access callbacks read.
+struct ble_gatt_access_ctxt {
+  uint8_t op;
+  uint16_t offset;
+  struct os_mbuf* om;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+// Host-test stand-in for the NimBLE host headers: the types, constants and
+// status codes firmware modules use, with NimBLE's values. Functions are
+// only declared; each test defines the ones its sources call.
+#include <stdint.h>
+
+#include "esp_log.h"
+#include "host/ble_att.h"
+#include "host/ble_gap.h"
+#include "host/ble_gatt.h"
+#include "host/ble_hs_adv.h"
+#include "host/ble_store.h"
+#include "host/ble_uuid.h"
+#include "nimble/ble.h"
+#include "syscfg/syscfg.h"
+
+#define BLE_HS_EAGAIN 1
+#define BLE_HS_EALREADY 2
+#define BLE_HS_EINVAL 3
+#define BLE_HS_EMSGSIZE 4
+#define BLE_HS_ENOENT 5
+#define BLE_HS_ENOMEM 6
+#define BLE_HS_ENOTCONN 7
+#define BLE_HS_ENOTSUP 8
+#define BLE_HS_ETIMEOUT 13
+#define BLE_HS_EBUSY 15
+#define BLE_HS_ESTORE_CAP 27
+
+#define BLE_HS_CONN_HANDLE_NONE 0xffff
+#define BLE_HS_FOREVER INT32_MAX
+
+#define BLE_OWN_ADDR_PUBLIC 0x00
+#define BLE_OWN_ADDR_RANDOM 0x01
+#define BLE_OWN_ADDR_RPA_PUBLIC_DEFAULT 0x02
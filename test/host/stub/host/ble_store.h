@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "nimble/ble.h"
+
+#define BLE_STORE_OBJ_TYPE_OUR_SEC 1
+#define BLE_STORE_OBJ_TYPE_PEER_SEC 2
+#define BLE_STORE_OBJ_TYPE_CCCD 3
+
+#define BLE_STORE_EVENT_OVERFLOW 1
+#define BLE_STORE_EVENT_FULL 2
+
+struct ble_store_key_cccd {
+  ble_addr_t peer_addr;
+  uint16_t chr_val_handle;
+  uint8_t idx;
+};
+
+struct ble_store_value_cccd {
+  ble_addr_t peer_addr;
+  uint16_t chr_val_handle;
+  uint16_t flags;
+  unsigned value_changed : 1;
+};
+
+struct ble_store_status_event {
+  int event_code;
+  union {
+    struct {
+      int obj_type;
+      const void* value;
+    } overflow;
+    struct {
+      int obj_type;
+      uint16_t conn_handle;
+    } full;
+  };
+};
+
+int ble_store_read_cccd(const struct ble_store_key_cccd* key,
+                        struct ble_store_value_cccd* out_value);
+int ble_store_util_bonded_peers(ble_addr_t* out_peer_id_addrs,
+                                int* out_num_peers, int max_peers);
+int ble_store_util_delete_peer(const ble_addr_t* peer_id_addr);
+int ble_store_util_status_rr(struct ble_store_status_event* event, void* arg);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+  uint8_t type;
+} ble_uuid_t;
+
+typedef struct {
+  ble_uuid_t u;
+  uint8_t value[16];
+} ble_uuid128_t;
+
+#define BLE_UUID_TYPE_128 128
+#define BLE_UUID128_INIT(uuid128...) \
+  {                                  \
+      .u = {.type = BLE_UUID_TYPE_128}, .value = {uuid128},    \
+  }
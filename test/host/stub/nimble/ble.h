@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+
+#define BLE_ADDR_PUBLIC 0x00
+#define BLE_ADDR_RANDOM 0x01
+
+#define BLE_ERR_REM_USER_CONN_TERM 0x13
+
+typedef struct {
+  uint8_t type;
+  uint8_t val[6];
+} ble_addr_t;
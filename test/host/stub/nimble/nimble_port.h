@@ -0,0 +1,18 @@
+#pragma once
+
+// Events run whenever the test drains its queue; see the test's
+// ble_npl_eventq_put.
+struct ble_npl_event;
+typedef void ble_npl_event_fn(struct ble_npl_event* ev);
+
+struct ble_npl_event {
+  ble_npl_event_fn* fn;
+  void* arg;
+};
+
+struct ble_npl_eventq;
+
+void ble_npl_event_init(struct ble_npl_event* ev, ble_npl_event_fn* fn,
+                        void* arg);
+struct ble_npl_eventq* nimble_port_get_dflt_eventq(void);
+void ble_npl_eventq_put(struct ble_npl_eventq* evq, struct ble_npl_event* ev);
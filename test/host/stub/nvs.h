@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+  NVS_READONLY,
+  NVS_READWRITE,
+} nvs_open_mode_t;
+
+#define ESP_ERR_NVS_NOT_FOUND 0x1102
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode,
+                   nvs_handle_t* out_handle);
+void nvs_close(nvs_handle_t handle);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value,
+                       size_t* length);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value,
+                       size_t length);
+esp_err_t nvs_commit(nvs_handle_t handle);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+// NimBLE's mbuf layout, down to the packet header that os_mbuf_concat
+// clears. Chains link through om_next as SLIST_NEXT does.
+
+struct os_mempool;
+
+struct os_mbuf_pool {
+  uint16_t omp_databuf_len;
+  struct os_mempool* omp_pool;
+};
+
+struct os_mbuf_pkthdr {
+  uint16_t omp_len;
+  uint16_t omp_flags;
+};
+
+struct os_mbuf {
+  uint8_t* om_data;
+  uint8_t om_flags;
+  uint8_t om_pkthdr_len;
+  uint16_t om_len;
+  struct os_mbuf_pool* om_omp;
+  struct os_mbuf* om_next;
+  uint8_t om_databuf[];
+};
+
+#define OS_MBUF_IS_PKTHDR(om) \
+  ((om)->om_pkthdr_len >= sizeof(struct os_mbuf_pkthdr))
+#define OS_MBUF_PKTHDR(om) ((struct os_mbuf_pkthdr*)(om)->om_databuf)
+#define OS_MBUF_USRHDR(om) ((void*)(OS_MBUF_PKTHDR(om) + 1))
+#define OS_MBUF_PKTLEN(om) (OS_MBUF_PKTHDR(om)->omp_len)
+
+// Provided by the test.
+int os_mbuf_append(struct os_mbuf* om, const void* data, uint16_t len);
+int os_mbuf_pool_init(struct os_mbuf_pool* omp, struct os_mempool* mp,
+                      uint16_t buf_len, uint16_t nbufs);
+struct os_mbuf* os_mbuf_get(struct os_mbuf_pool* omp, uint16_t leadingspace);
+struct os_mbuf* os_mbuf_get_pkthdr(struct os_mbuf_pool* omp,
+                                   uint8_t pkthdr_len);
+void os_mbuf_concat(struct os_mbuf* first, struct os_mbuf* second);
+int os_mbuf_free(struct os_mbuf* om);
+int os_mbuf_free_chain(struct os_mbuf* om);
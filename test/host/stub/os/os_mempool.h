@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "os/os_mbuf.h"
+
+typedef int os_error_t;
+typedef uint32_t os_membuf_t;
+
+#define OS_OK 0
+#define OS_ENOMEM 1
+#define OS_INVALID_PARM 2
+
+#define OS_ALIGNMENT 4
+#define OS_ALIGN(n, a) (((n) + (a) - 1) / (a) * (a))
+#define OS_MEM_TRUE_BLOCK_SIZE(bsize) OS_ALIGN(bsize, OS_ALIGNMENT)
+// In os_membuf_t words.
+#define OS_MEMPOOL_SIZE(n, blksize) \
+  ((((blksize) + (OS_ALIGNMENT - 1)) / OS_ALIGNMENT) * (n))
+
+#define OS_MEMPOOL_F_EXT 0x01
+
+struct os_memblock {
+  struct os_memblock* mb_next;
+};
+
+struct os_mempool {
+  uint32_t mp_block_size;
+  uint16_t mp_num_blocks;
+  uint16_t mp_num_free;
+  uint8_t mp_flags;
+  uintptr_t mp_membuf_addr;
+  struct os_memblock* mp_head;
+};
+
+struct os_mempool_ext;
+typedef os_error_t os_mempool_put_fn(struct os_mempool_ext* mpe, void* data,
+                                     void* arg);
+
+// An extended pool hands released blocks to mpe_put_cb, which must return
+// them with os_memblock_put_from_cb.
+struct os_mempool_ext {
+  struct os_mempool mpe_mp;
+  os_mempool_put_fn* mpe_put_cb;
+  void* mpe_put_arg;
+};
+
+// Provided by the test.
+os_error_t os_mempool_init(struct os_mempool* mp, uint16_t blocks,
+                           uint32_t block_size, void* membuf,
+                           const char* name);
+os_error_t os_mempool_ext_init(struct os_mempool_ext* mpe, uint16_t blocks,
+                               uint32_t block_size, void* membuf,
+                               const char* name);
+void* os_memblock_get(struct os_mempool* mp);
+os_error_t os_memblock_put(struct os_mempool* mp, void* block_addr);
+os_error_t os_memblock_put_from_cb(struct os_mempool* mp, void* block_addr);
@@ -0,0 +1,6 @@
+#pragma once
+
+// The values from sdkconfig that firmware sources read.
+#define CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU 256
+#define CONFIG_BT_NIMBLE_MAX_BONDS 3
+#define CONFIG_BT_NIMBLE_MAX_CONNECTIONS 3
@@ -0,0 +1,4 @@
+#pragma once
+
+#define MYNEWT_VAL(name) MYNEWT_VAL_##name
+#define MYNEWT_VAL_BLE_GATT_BLOB_TRANSFER 1
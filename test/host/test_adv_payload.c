@@ -0,0 +1,137 @@
+#include <string.h>
+
+#include "adv_payload.h"
+#include "host/ble_hs.h"
+#include "test_util.h"
+
+// Golden payloads are what ble_hs_adv_set_fields emits for the same fields:
+// one length byte, one type byte, then the value, in the order NimBLE walks
+// struct ble_hs_adv_fields (flags, UUIDs, name, TX power, ..., appearance).
+
+static void check_bytes(const adv_payload_t* payload, const uint8_t* golden,
+                        size_t golden_len) {
+  CHECK_EQ(payload->len, golden_len);
+  CHECK(memcmp(payload->data, golden, golden_len) == 0);
+}
+
+// Flags 0x06, HID service UUID, TX power level, keyboard appearance: the
+// advertising data gap.c pushes.
+static void test_keyboard_adv_data(void) {
+  static const uint8_t golden[] = {
+      0x02, 0x01, 0x06,        // flags: general discoverable, no BR/EDR
+      0x03, 0x03, 0x12, 0x18,  // complete 16-bit UUIDs: 0x1812
+      0x02, 0x0a, 0x00,        // TX power level: 0 dBm
+      0x03, 0x19, 0xc1, 0x03,  // appearance: 0x03C1, keyboard
+  };
+  static const uint8_t flags = 0x06;
+  static const uint8_t uuids16[] = {0x12, 0x18};
+  static const uint8_t tx_pwr = 0;
+  static const uint8_t appearance[] = {0xc1, 0x03};
+
+  adv_payload_t payload;
+  adv_payload_init(&payload);
+  CHECK_EQ(adv_payload_add(&payload, BLE_HS_ADV_TYPE_FLAGS, &flags, 1), 0);
+  CHECK_EQ(adv_payload_add(&payload, BLE_HS_ADV_TYPE_COMP_UUIDS16, uuids16,
+                           sizeof(uuids16)),
+           0);
+  CHECK_EQ(adv_payload_add(&payload, BLE_HS_ADV_TYPE_TX_PWR_LVL, &tx_pwr, 1),
+           0);
+  CHECK_EQ(adv_payload_add(&payload, BLE_HS_ADV_TYPE_APPEARANCE, appearance,
+                           sizeof(appearance)),
+           0);
+  check_bytes(&payload, golden, sizeof(golden));
+
+  // The TX power value is found where the golden bytes put it, and patching
+  // it touches nothing else.
+  uint8_t* tx = adv_payload_find(&payload, BLE_HS_ADV_TYPE_TX_PWR_LVL);
+  CHECK(tx == &payload.data[9]);
+  *tx = (uint8_t)-3;
+  CHECK_EQ(payload.data[9], 0xfd);
+  CHECK(memcmp(payload.data, golden, 9) == 0);
+  CHECK(memcmp(&payload.data[10], &golden[10], sizeof(golden) - 10) == 0);
+}
+
+static void test_complete_name(void) {
+  static const uint8_t golden[] = {
+      0x0e, 0x09, 'T', 'e', 's', 't', ' ', 'K', 'e', 'y', 'b', 'o', 'a', 'r',
+      'd',
+  };
+  adv_payload_t payload;
+  adv_payload_init(&payload);
+  CHECK_EQ(adv_payload_add_name(&payload, "Test Keyboard"), 0);
+  check_bytes(&payload, golden, sizeof(golden));
+}
+
+// A name filling the PDU exactly stays complete; one byte longer and it's
+// cut to the 29 bytes that fit, marked shortened.
+static void test_shortened_name(void) {
+  char name[40];
+  memset(name, 'k', sizeof(name));
+
+  adv_payload_t payload;
+  name[29] = '\0';
+  adv_payload_init(&payload);
+  CHECK_EQ(adv_payload_add_name(&payload, name), 0);
+  CHECK_EQ(payload.len, ADV_PAYLOAD_MAX_LEN);
+  CHECK_EQ(payload.data[0], 30);
+  CHECK_EQ(payload.data[1], BLE_HS_ADV_TYPE_COMP_NAME);
+
+  name[29] = 'k';
+  name[39] = '\0';
+  adv_payload_init(&payload);
+  CHECK_EQ(adv_payload_add_name(&payload, name), 0);
+  CHECK_EQ(payload.len, ADV_PAYLOAD_MAX_LEN);
+  CHECK_EQ(payload.data[0], 30);
+  CHECK_EQ(payload.data[1], BLE_HS_ADV_TYPE_INCOMP_NAME);
+  CHECK(memcmp(&payload.data[2], name, 29) == 0);
+
+  // Behind other fields, the name gets whatever room is left.
+  static const uint8_t flags = 0x06;
+  adv_payload_init(&payload);
+  CHECK_EQ(adv_payload_add(&payload, BLE_HS_ADV_TYPE_FLAGS, &flags, 1), 0);
+  CHECK_EQ(adv_payload_add_name(&payload, name), 0);
+  CHECK_EQ(payload.len, ADV_PAYLOAD_MAX_LEN);
+  CHECK_EQ(payload.data[3], 27);
+  CHECK_EQ(payload.data[4], BLE_HS_ADV_TYPE_INCOMP_NAME);
+}
+
+static void test_overflow(void) {
+  uint8_t value[ADV_PAYLOAD_MAX_LEN] = {0};
+  adv_payload_t payload;
+  adv_payload_init(&payload);
+  CHECK_EQ(adv_payload_add(&payload, 0xff, value, ADV_PAYLOAD_MAX_LEN - 1),
+           BLE_HS_EMSGSIZE);
+  CHECK_EQ(payload.len, 0);
+  CHECK_EQ(adv_payload_add(&payload, 0xff, value, ADV_PAYLOAD_MAX_LEN - 3),
+           0);
+  // One byte left: too little for even an empty structure or a name.
+  CHECK_EQ(adv_payload_add(&payload, 0xff, value, 0), BLE_HS_EMSGSIZE);
+  CHECK_EQ(adv_payload_add_name(&payload, "K"), BLE_HS_EMSGSIZE);
+  CHECK_EQ(payload.len, ADV_PAYLOAD_MAX_LEN - 1);
+}
+
+static void test_find(void) {
+  static const uint8_t flags = 0x06;
+  adv_payload_t payload;
+  adv_payload_init(&payload);
+  CHECK(adv_payload_find(&payload, BLE_HS_ADV_TYPE_FLAGS) == NULL);
+  CHECK_EQ(adv_payload_add(&payload, BLE_HS_ADV_TYPE_FLAGS, &flags, 1), 0);
+  CHECK_EQ(adv_payload_add_name(&payload, "Kbd"), 0);
+  CHECK(adv_payload_find(&payload, BLE_HS_ADV_TYPE_FLAGS) == &payload.data[2]);
+  CHECK(adv_payload_find(&payload, BLE_HS_ADV_TYPE_COMP_NAME) ==
+        &payload.data[5]);
+  CHECK(adv_payload_find(&payload, BLE_HS_ADV_TYPE_TX_PWR_LVL) == NULL);
+
+  // A corrupt length never walks past the payload.
+  payload.data[3] = 20;
+  CHECK(adv_payload_find(&payload, BLE_HS_ADV_TYPE_COMP_NAME) == NULL);
+}
+
+int main(void) {
+  RUN(test_keyboard_adv_data);
+  RUN(test_complete_name);
+  RUN(test_shortened_name);
+  RUN(test_overflow);
+  RUN(test_find);
+  return 0;
+}
@@ -0,0 +1,63 @@
+#include "adv_sched.h"
+#include "test_util.h"
+
+// Longest gap between two advertising packets of a step, in microseconds:
+// the interval plus the spec's up-to-10 ms random advDelay, or 3.75 ms for
+// high duty cycle directed advertising.
+static uint32_t max_packet_gap_us(const adv_sched_step_t* step) {
+  if (step->phase == ADV_SCHED_DIRECTED) {
+    return 3750;
+  }
+  return step->itvl_max * 625u + 10000;
+}
+
+// A host scanning continuously connects on the first packet it sees, so a
+// reconnect takes at most one packet gap from the moment the host wakes.
+static void test_reconnect_phases(void) {
+  adv_sched_t sched;
+  const adv_sched_step_t* step = adv_sched_begin(&sched, true);
+  CHECK_EQ(step->phase, ADV_SCHED_DIRECTED);
+  // The spec caps high duty cycle directed advertising at 1.28 s.
+  CHECK(step->duration_ms > 0 && step->duration_ms <= 1280);
+  CHECK(max_packet_gap_us(step) < 200000);
+  uint32_t elapsed_ms = step->duration_ms;
+
+  step = adv_sched_advance(&sched);
+  CHECK_EQ(step->phase, ADV_SCHED_FAST);
+  CHECK(step->itvl_min <= step->itvl_max);
+  CHECK_EQ(step->itvl_max * 625, 20000);
+  CHECK(max_packet_gap_us(step) < 200000);
+  CHECK(step->duration_ms >= 30000);
+  elapsed_ms += step->duration_ms;
+  // Sub-200 ms reconnects hold for the first 30 s after a drop.
+  CHECK(elapsed_ms >= 31000);
+
+  step = adv_sched_advance(&sched);
+  CHECK_EQ(step->phase, ADV_SCHED_SLOW);
+  CHECK_EQ(step->duration_ms, ADV_SCHED_FOREVER);
+  CHECK(step->itvl_max * 625 >= 1000000);
+
+  // The slow phase never times out, but if it did it would run again.
+  CHECK_EQ(adv_sched_advance(&sched)->phase, ADV_SCHED_SLOW);
+  const adv_sched_step_t* directed = adv_sched_begin(&sched, true);
+  const adv_sched_step_t* fast = adv_sched_advance(&sched);
+  printf("reconnect: <%.2f ms gaps for %d ms, then <%.1f ms until %u ms\n",
+         max_packet_gap_us(directed) / 1e3, (int)directed->duration_ms,
+         max_packet_gap_us(fast) / 1e3, elapsed_ms);
+}
+
+static void test_no_bonded_peer(void) {
+  adv_sched_t sched;
+  const adv_sched_step_t* step = adv_sched_begin(&sched, false);
+  CHECK_EQ(step->phase, ADV_SCHED_FAST);
+  CHECK_EQ(adv_sched_advance(&sched)->phase, ADV_SCHED_SLOW);
+
+  // A new drop restarts from the top.
+  CHECK_EQ(adv_sched_begin(&sched, true)->phase, ADV_SCHED_DIRECTED);
+}
+
+int main(void) {
+  RUN(test_reconnect_phases);
+  RUN(test_no_bonded_peer);
+  return 0;
+}
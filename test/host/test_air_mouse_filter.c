@@ -0,0 +1,293 @@
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "air_mouse_filter.h"
+#include "test_util.h"
+
+// Gyro traces are synthesized at the firmware's rate and scale: 500 Hz,
+// 16.4 LSB per °/s (±2000 °/s range), with a per-axis bias and uniform noise
+// of the size an MPU6886 shows lying on a desk.
+#define SAMPLE_HZ 500
+#define LSB_PER_DPS_X10 164
+#define COUNTS_PER_DEG 20
+#define GAIN_Q16 (COUNTS_PER_DEG * 65536 * 10 / (LSB_PER_DPS_X10 * SAMPLE_HZ))
+#define NOISE_LSB 12
+
+// One connection event every 7.5 ms: 3.75 samples per report.
+#define EVENT_US 7500
+
+static uint32_t rng_state;
+
+static int32_t noise(void) {
+  rng_state = rng_state * 1664525u + 1013904223u;
+  return (int32_t)(rng_state >> 16) % (2 * NOISE_LSB + 1) - NOISE_LSB;
+}
+
+typedef struct trace_sim {
+  air_mouse_filter_t filter;
+  air_mouse_accum_t accum;
+  uint64_t now_us;
+  uint64_t next_event_us;
+  int64_t added_q16[AIR_MOUSE_AXIS_COUNT];
+  int64_t reported[AIR_MOUSE_AXIS_COUNT];
+  int reports;
+} trace_sim_t;
+
+static void sim_init(trace_sim_t* sim) {
+  air_mouse_filter_init(&sim->filter, GAIN_Q16);
+  air_mouse_accum_init(&sim->accum);
+  *sim = (trace_sim_t){.filter = sim->filter, .accum = sim->accum,
+                       .next_event_us = EVENT_US};
+  rng_state = 1;
+}
+
+// The connection event takes one report, as the HID interval clock does.
+static void sim_event(trace_sim_t* sim) {
+  int8_t delta[AIR_MOUSE_AXIS_COUNT];
+  if (air_mouse_accum_peek(&sim->accum, delta)) {
+    air_mouse_accum_commit(&sim->accum, delta);
+    for (int axis = 0; axis < AIR_MOUSE_AXIS_COUNT; axis++) {
+      sim->reported[axis] += delta[axis];
+    }
+    sim->reports++;
+  }
+}
+
+// Feeds one sample of true rate `dps_x10` plus `bias` and noise per axis,
+// flushing any connection events that fall before it.
+static void sim_sample(trace_sim_t* sim,
+                       const int32_t dps_x10[AIR_MOUSE_AXIS_COUNT],
+                       const int32_t bias[AIR_MOUSE_AXIS_COUNT]) {
+  int16_t rate[AIR_MOUSE_AXIS_COUNT];
+  for (int axis = 0; axis < AIR_MOUSE_AXIS_COUNT; axis++) {
+    rate[axis] =
+        (int16_t)(dps_x10[axis] * LSB_PER_DPS_X10 / 100 + bias[axis] +
+                  noise());
+  }
+  int32_t motion_q16[AIR_MOUSE_AXIS_COUNT];
+  air_mouse_filter_step(&sim->filter, rate, motion_q16);
+  air_mouse_accum_add(&sim->accum, motion_q16);
+  for (int axis = 0; axis < AIR_MOUSE_AXIS_COUNT; axis++) {
+    sim->added_q16[axis] += motion_q16[axis];
+  }
+
+  sim->now_us += 1000000 / SAMPLE_HZ;
+  while (sim->next_event_us <= sim->now_us) {
+    sim_event(sim);
+    sim->next_event_us += EVENT_US;
+  }
+}
+
+static void sim_rest(trace_sim_t* sim, int samples,
+                     const int32_t bias[AIR_MOUSE_AXIS_COUNT]) {
+  static const int32_t still[AIR_MOUSE_AXIS_COUNT] = {0};
+  for (int i = 0; i < samples; i++) {
+    sim_sample(sim, still, bias);
+  }
+}
+
+// Reported counts plus what's still carried equal everything added: no
+// motion lost or sent twice.
+static void check_conserved(trace_sim_t* sim) {
+  for (int axis = 0; axis < AIR_MOUSE_AXIS_COUNT; axis++) {
+    int64_t carried = atomic_load(&sim->accum.q16[axis]);
+    CHECK(carried > -65536 && carried < 65536);
+    CHECK_EQ(sim->reported[axis] * 65536 + carried, sim->added_q16[axis]);
+  }
+}
+
+// Lying still with a large bias: the pointer must not creep.
+static void test_rest_no_drift(void) {
+  static const int32_t bias[AIR_MOUSE_AXIS_COUNT] = {41, -27};
+  trace_sim_t sim;
+  sim_init(&sim);
+  sim_rest(&sim, 60 * SAMPLE_HZ, bias);
+  CHECK_EQ(sim.reported[AIR_MOUSE_AXIS_X], 0);
+  CHECK_EQ(sim.reported[AIR_MOUSE_AXIS_Y], 0);
+  check_conserved(&sim);
+}
+
+// Bias wandering with temperature while at rest is tracked, not reported.
+static void test_bias_ramp(void) {
+  trace_sim_t sim;
+  sim_init(&sim);
+  int32_t bias[AIR_MOUSE_AXIS_COUNT] = {0, 0};
+  for (int s = 0; s < 120; s++) {
+    bias[AIR_MOUSE_AXIS_X] = s / 4;   // +30 LSB over two minutes
+    bias[AIR_MOUSE_AXIS_Y] = -s / 6;  // -20 LSB
+    sim_rest(&sim, SAMPLE_HZ, bias);
+  }
+  CHECK(sim.reported[AIR_MOUSE_AXIS_X] >= -2 &&
+        sim.reported[AIR_MOUSE_AXIS_X] <= 2);
+  CHECK(sim.reported[AIR_MOUSE_AXIS_Y] >= -2 &&
+        sim.reported[AIR_MOUSE_AXIS_Y] <= 2);
+  check_conserved(&sim);
+}
+
+// A 90° turn in half a second moves COUNTS_PER_DEG * 90 counts, and a slow
+// steady turn isn't mistaken for bias.
+static void test_turns(void) {
+  static const int32_t bias[AIR_MOUSE_AXIS_COUNT] = {41, -27};
+  trace_sim_t sim;
+  sim_init(&sim);
+  sim_rest(&sim, SAMPLE_HZ, bias);
+
+  const int32_t fast[AIR_MOUSE_AXIS_COUNT] = {1800, 0};  // 180 °/s
+  for (int i = 0; i < SAMPLE_HZ / 2; i++) {
+    sim_sample(&sim, fast, bias);
+  }
+  sim_rest(&sim, SAMPLE_HZ, bias);
+  int64_t expected = 90 * COUNTS_PER_DEG;
+  int64_t x = sim.reported[AIR_MOUSE_AXIS_X];
+  CHECK(x > expected * 97 / 100 && x < expected * 103 / 100);
+  CHECK(sim.reported[AIR_MOUSE_AXIS_Y] >= -2 &&
+        sim.reported[AIR_MOUSE_AXIS_Y] <= 2);
+
+  // 6 °/s downwards for 5 s: 30°. Steady, so it passes the stillness test,
+  // but too far from the bias to be taken for drift.
+  const int32_t slow[AIR_MOUSE_AXIS_COUNT] = {0, 60};
+  for (int i = 0; i < 5 * SAMPLE_HZ; i++) {
+    sim_sample(&sim, slow, bias);
+  }
+  sim_rest(&sim, SAMPLE_HZ, bias);
+  expected = 30 * COUNTS_PER_DEG;
+  int64_t y = sim.reported[AIR_MOUSE_AXIS_Y];
+  CHECK(y > expected * 90 / 100 && y < expected * 110 / 100);
+  check_conserved(&sim);
+}
+
+// A flick faster than one report can carry spreads over the following
+// connection events instead of being clipped.
+static void test_clamped_reports(void) {
+  static const int32_t bias[AIR_MOUSE_AXIS_COUNT] = {0, 0};
+  trace_sim_t sim;
+  sim_init(&sim);
+  sim_rest(&sim, SAMPLE_HZ / 2, bias);
+
+  const int32_t flick[AIR_MOUSE_AXIS_COUNT] = {-19000, 19000};  // 1900 °/s
+  for (int i = 0; i < SAMPLE_HZ / 20; i++) {
+    sim_sample(&sim, flick, bias);
+  }
+  sim_rest(&sim, SAMPLE_HZ, bias);
+  // 95° at 20 counts per degree is far more than 127 per report.
+  CHECK(sim.reported[AIR_MOUSE_AXIS_X] < -1500);
+  CHECK(sim.reported[AIR_MOUSE_AXIS_Y] > 1500);
+  check_conserved(&sim);
+}
+
+// peek reports whole counts only, truncated toward zero, and commit removes
+// exactly what was reported.
+static void test_accum_rounding(void) {
+  air_mouse_accum_t accum;
+  air_mouse_accum_init(&accum);
+  int8_t delta[AIR_MOUSE_AXIS_COUNT];
+  CHECK(!air_mouse_accum_peek(&accum, delta));
+
+  const int32_t part[AIR_MOUSE_AXIS_COUNT] = {65536 * 3 / 4, -65536 * 3 / 4};
+  air_mouse_accum_add(&accum, part);
+  CHECK(!air_mouse_accum_peek(&accum, delta));
+  air_mouse_accum_add(&accum, part);
+  CHECK(air_mouse_accum_peek(&accum, delta));
+  CHECK_EQ(delta[AIR_MOUSE_AXIS_X], 1);
+  CHECK_EQ(delta[AIR_MOUSE_AXIS_Y], -1);
+  air_mouse_accum_commit(&accum, delta);
+  CHECK_EQ(atomic_load(&accum.q16[AIR_MOUSE_AXIS_X]), 65536 / 2);
+  CHECK_EQ(atomic_load(&accum.q16[AIR_MOUSE_AXIS_Y]), -65536 / 2);
+}
+
+#define STRESS_SAMPLES 2000000
+
+static air_mouse_accum_t shared;
+static atomic_bool producing;
+
+// Small enough that the whole run fits the accumulator even if the consumer
+// never gets a turn.
+#define STRESS_X_Q16 300
+#define STRESS_Y_Q16 -171
+
+static void* sampler(void* arg) {
+  const int32_t motion[AIR_MOUSE_AXIS_COUNT] = {STRESS_X_Q16, STRESS_Y_Q16};
+  for (int i = 0; i < STRESS_SAMPLES; i++) {
+    air_mouse_accum_add(&shared, motion);
+  }
+  atomic_store(&producing, false);
+  return NULL;
+}
+
+// The sampler task adds while the host task peeks and commits; nothing
+// added in between a peek and its commit gets lost.
+static void test_accum_concurrent(void) {
+  air_mouse_accum_init(&shared);
+  atomic_store(&producing, true);
+  pthread_t thread;
+  CHECK(pthread_create(&thread, NULL, sampler, NULL) == 0);
+
+  int64_t reported[AIR_MOUSE_AXIS_COUNT] = {0};
+  int8_t delta[AIR_MOUSE_AXIS_COUNT];
+  for (;;) {
+    bool last = !atomic_load(&producing);
+    while (air_mouse_accum_peek(&shared, delta)) {
+      air_mouse_accum_commit(&shared, delta);
+      reported[AIR_MOUSE_AXIS_X] += delta[AIR_MOUSE_AXIS_X];
+      reported[AIR_MOUSE_AXIS_Y] += delta[AIR_MOUSE_AXIS_Y];
+    }
+    if (last) {
+      break;
+    }
+  }
+  pthread_join(thread, NULL);
+
+  CHECK_EQ(reported[AIR_MOUSE_AXIS_X] * 65536 +
+               atomic_load(&shared.q16[AIR_MOUSE_AXIS_X]),
+           (int64_t)STRESS_X_Q16 * STRESS_SAMPLES);
+  CHECK_EQ(reported[AIR_MOUSE_AXIS_Y] * 65536 +
+               atomic_load(&shared.q16[AIR_MOUSE_AXIS_Y]),
+           (int64_t)STRESS_Y_Q16 * STRESS_SAMPLES);
+}
+
+// Per-sample cost on the sampler task and per-report cost on the host task.
+static void bench_filter(void) {
+  const int rounds = 10000000;
+  air_mouse_filter_t filter;
+  air_mouse_filter_init(&filter, GAIN_Q16);
+  int32_t motion_q16[AIR_MOUSE_AXIS_COUNT];
+  int64_t sink = 0;
+  rng_state = 1;
+  double start = test_now_s();
+  for (int i = 0; i < rounds; i++) {
+    // Alternating still and turning stretches, so both paths run.
+    const int16_t rate[AIR_MOUSE_AXIS_COUNT] = {
+        (int16_t)(41 + noise() + ((i >> 13) & 1) * 500),
+        (int16_t)(-27 + noise())};
+    air_mouse_filter_step(&filter, rate, motion_q16);
+    sink += motion_q16[AIR_MOUSE_AXIS_X];
+  }
+  double elapsed = test_now_s() - start;
+  CHECK(sink != 0);
+  printf("bench filter step: %.1f ns\n", elapsed / rounds * 1e9);
+
+  air_mouse_accum_t accum;
+  air_mouse_accum_init(&accum);
+  const int32_t motion[AIR_MOUSE_AXIS_COUNT] = {70000, -70000};
+  int8_t delta[AIR_MOUSE_AXIS_COUNT];
+  start = test_now_s();
+  for (int i = 0; i < rounds; i++) {
+    air_mouse_accum_add(&accum, motion);
+    if (air_mouse_accum_peek(&accum, delta)) {
+      air_mouse_accum_commit(&accum, delta);
+    }
+  }
+  elapsed = test_now_s() - start;
+  printf("bench accum add+peek+commit: %.1f ns\n", elapsed / rounds * 1e9);
+}
+
+int main(void) {
+  RUN(test_rest_no_drift);
+  RUN(test_bias_ramp);
+  RUN(test_turns);
+  RUN(test_clamped_reports);
+  RUN(test_accum_rounding);
+  RUN(test_accum_concurrent);
+  bench_filter();
+  return 0;
+}
@@ -0,0 +1,186 @@
+#include "battery_gauge.h"
+#include "test_util.h"
+
+// Discharge traces are synthesized at the monitor's 10 s period: a LiPo
+// voltage falling along a curve, ADC noise, and single-sample dips while the
+// radio or backlight draws a burst.
+#define PERIOD_S 10
+
+static uint32_t rng_state;
+
+static int32_t noise(int32_t amplitude) {
+  rng_state = rng_state * 1664525u + 1013904223u;
+  return (int32_t)(rng_state >> 16) % (2 * amplitude + 1) - amplitude;
+}
+
+static void test_curve(void) {
+  CHECK_EQ(battery_gauge_percent(4200), 100);
+  CHECK_EQ(battery_gauge_percent(4150), 100);
+  CHECK_EQ(battery_gauge_percent(3800), 50);
+  CHECK_EQ(battery_gauge_percent(3780), 45);
+  CHECK_EQ(battery_gauge_percent(3300), 0);
+  CHECK_EQ(battery_gauge_percent(3000), 0);
+  CHECK_EQ(battery_gauge_percent(0), 0);
+
+  uint8_t prev = 100;
+  for (uint32_t mv = 4300; mv >= 3000; mv--) {
+    uint8_t percent = battery_gauge_percent((uint16_t)mv);
+    CHECK(percent <= prev);
+    prev = percent;
+  }
+}
+
+// Nothing is reported until the median window fills; then the first level
+// always is, even if it's the initial 100.
+static void test_first_window(void) {
+  battery_gauge_t gauge;
+  battery_gauge_init(&gauge);
+  CHECK_EQ(battery_gauge_level(&gauge), 100);
+  CHECK(!battery_gauge_update(&gauge, 3800));
+  CHECK(!battery_gauge_update(&gauge, 3800));
+  CHECK(battery_gauge_update(&gauge, 3800));
+  CHECK_EQ(battery_gauge_level(&gauge), 50);
+
+  battery_gauge_init(&gauge);
+  CHECK(!battery_gauge_update(&gauge, 4200));
+  CHECK(!battery_gauge_update(&gauge, 4200));
+  CHECK(battery_gauge_update(&gauge, 4200));
+  CHECK_EQ(battery_gauge_level(&gauge), 100);
+}
+
+// A lone dip under load never reaches the level.
+static void test_dip_rejected(void) {
+  battery_gauge_t gauge;
+  battery_gauge_init(&gauge);
+  for (int i = 0; i < 3; i++) {
+    battery_gauge_update(&gauge, 3900);
+  }
+  CHECK_EQ(battery_gauge_level(&gauge), 70);
+  for (int i = 0; i < 20; i++) {
+    CHECK(!battery_gauge_update(&gauge, i % 5 == 0 ? 3500 : 3900));
+  }
+  CHECK_EQ(battery_gauge_level(&gauge), 70);
+}
+
+// Noise straddling a boundary doesn't toggle the level.
+static void test_hysteresis(void) {
+  battery_gauge_t gauge;
+  battery_gauge_init(&gauge);
+  rng_state = 7;
+  // 3787 mV is 46.75%: noise alone moves it across 46 and 47. Once the
+  // smoothing has settled, the level never bounces back up and stays close.
+  for (int i = 0; i < 50; i++) {
+    battery_gauge_update(&gauge, (uint16_t)(3787 + noise(12)));
+  }
+  uint8_t prev = battery_gauge_level(&gauge);
+  int changes = 0;
+  for (int i = 0; i < 1000; i++) {
+    if (battery_gauge_update(&gauge, (uint16_t)(3787 + noise(12)))) {
+      CHECK(battery_gauge_level(&gauge) < prev);
+      prev = battery_gauge_level(&gauge);
+      changes++;
+    }
+  }
+  CHECK(changes <= 1);
+  CHECK(prev >= 43 && prev <= 47);
+}
+
+typedef struct trace_stats {
+  int samples;
+  int changes;
+  uint8_t first_level;
+  uint8_t last_level;
+  int max_error_pct;
+} trace_stats_t;
+
+// Runs a discharge from `start_mv` to `end_mv` over `hours`, with noise and
+// a 200 mV dip on one sample in `dip_every`.
+static trace_stats_t run_discharge(uint16_t start_mv, uint16_t end_mv,
+                                   int hours, int dip_every) {
+  battery_gauge_t gauge;
+  battery_gauge_init(&gauge);
+  rng_state = 1;
+  trace_stats_t stats = {.first_level = 0};
+  int samples = hours * 3600 / PERIOD_S;
+  uint8_t prev = 100;
+  for (int i = 0; i < samples; i++) {
+    uint16_t true_mv =
+        (uint16_t)(start_mv - (int32_t)(start_mv - end_mv) * i / samples);
+    int32_t mv = true_mv + noise(15);
+    if (dip_every != 0 && i % dip_every == dip_every - 1) {
+      mv -= 200;
+    }
+
+    if (battery_gauge_update(&gauge, (uint16_t)mv)) {
+      uint8_t level = battery_gauge_level(&gauge);
+      if (stats.changes == 0) {
+        stats.first_level = level;
+      } else {
+        // Discharging: the level only ever steps down.
+        CHECK(level < prev);
+      }
+      prev = level;
+      stats.changes++;
+    }
+
+    // Settled, the level tracks the true voltage within a few percent.
+    if (i > 60) {
+      int error = (int)battery_gauge_level(&gauge) -
+                  (int)battery_gauge_percent(true_mv);
+      if (error < 0) {
+        error = -error;
+      }
+      if (error > stats.max_error_pct) {
+        stats.max_error_pct = error;
+      }
+    }
+  }
+  stats.samples = samples;
+  stats.last_level = battery_gauge_level(&gauge);
+  return stats;
+}
+
+// A full discharge over eight hours notifies a few dozen times, always
+// downwards, against thousands of samples.
+static void test_full_discharge(void) {
+  trace_stats_t stats = run_discharge(4180, 3300, 8, 7);
+  CHECK_EQ(stats.first_level, 100);
+  CHECK(stats.last_level <= 2);
+  CHECK(stats.changes <= 60);
+  CHECK(stats.max_error_pct <= 4);
+  printf("full discharge: %d samples, %d notifications, max error %d%%\n",
+         stats.samples, stats.changes, stats.max_error_pct);
+}
+
+// Idle on the plateau for a day: almost no notifications.
+static void test_plateau(void) {
+  trace_stats_t stats = run_discharge(3820, 3790, 24, 5);
+  CHECK(stats.changes <= 5);
+  CHECK(stats.max_error_pct <= 3);
+}
+
+static void bench_update(void) {
+  const int rounds = 10000000;
+  battery_gauge_t gauge;
+  battery_gauge_init(&gauge);
+  rng_state = 1;
+  int changes = 0;
+  double start = test_now_s();
+  for (int i = 0; i < rounds; i++) {
+    changes += battery_gauge_update(&gauge, (uint16_t)(3800 + noise(40)));
+  }
+  double elapsed = test_now_s() - start;
+  CHECK(changes > 0);
+  printf("bench update: %.1f ns\n", elapsed / rounds * 1e9);
+}
+
+int main(void) {
+  RUN(test_curve);
+  RUN(test_first_window);
+  RUN(test_dip_rejected);
+  RUN(test_hysteresis);
+  RUN(test_full_discharge);
+  RUN(test_plateau);
+  bench_update();
+  return 0;
+}
@@ -0,0 +1,295 @@
+#include <string.h>
+
+#include "ble_hid.h"
+#include "ble_hid_state.h"
+#include "ble_keyboard.h"
+#include "host/ble_hs.h"
+#include "test_util.h"
+
+// Fakes for what ble_keyboard_type reaches in ble_hid: every report is
+// recorded, and the queue reports full every few sends so the
+// wait-for-space path runs too.
+#define MAX_REPORTS 4096
+
+static ble_keyboard_report_t sent[MAX_REPORTS];
+static size_t sent_count;
+static size_t send_calls;
+static size_t waits;
+static uint32_t host_state;
+
+bool ble_hid_nkro_enabled(void) { return false; }
+
+int ble_hid_send_report(uint8_t report_id, const uint8_t* data, size_t length) {
+  CHECK_EQ(report_id, BLE_HID_DEFAULT_REPORT_ID);
+  CHECK_EQ(length, sizeof(ble_keyboard_report_t));
+  if (++send_calls % 7 == 0) {
+    return BLE_HS_EAGAIN;
+  }
+  CHECK(sent_count < MAX_REPORTS);
+  memcpy(&sent[sent_count++], data, length);
+  return 0;
+}
+
+void ble_hid_wait_for_space(void) { waits++; }
+
+uint32_t ble_hid_state_get(void) { return host_state; }
+
+static void reset_reports(void) {
+  sent_count = 0;
+  send_calls = 0;
+  waits = 0;
+}
+
+static void check_key(ble_keyboard_layout_t layout, uint32_t codepoint,
+                      uint8_t keycode, uint8_t modifier) {
+  ble_keyboard_key_t key;
+  CHECK(ble_keyboard_lookup(layout, codepoint, &key));
+  CHECK_EQ(key.keycode, keycode);
+  CHECK_EQ(key.modifier, modifier);
+}
+
+static void test_lookup(void) {
+  ble_keyboard_key_t key;
+  check_key(BLE_KEYBOARD_LAYOUT_US, 'a', 0x04, 0);
+  check_key(BLE_KEYBOARD_LAYOUT_US, '@', 0x1F, BLE_KEYBOARD_MOD_LSHIFT);
+  CHECK(!ble_keyboard_lookup(BLE_KEYBOARD_LAYOUT_US, 0x00A3, &key));
+  CHECK(!ble_keyboard_lookup(BLE_KEYBOARD_LAYOUT_US, 0x01, &key));
+
+  check_key(BLE_KEYBOARD_LAYOUT_UK, '@', 0x34, BLE_KEYBOARD_MOD_LSHIFT);
+  check_key(BLE_KEYBOARD_LAYOUT_UK, 0x00A3, 0x20, BLE_KEYBOARD_MOD_LSHIFT);
+  check_key(BLE_KEYBOARD_LAYOUT_UK, 0x20AC, 0x21, BLE_KEYBOARD_MOD_RALT);
+
+  check_key(BLE_KEYBOARD_LAYOUT_DE, 'z', 0x1C, 0);
+  check_key(BLE_KEYBOARD_LAYOUT_DE, 0x00DF, 0x2D, 0);
+  check_key(BLE_KEYBOARD_LAYOUT_DE, 0x00A7, 0x20, BLE_KEYBOARD_MOD_LSHIFT);
+  check_key(BLE_KEYBOARD_LAYOUT_DE, 0x20AC, 0x08, BLE_KEYBOARD_MOD_RALT);
+  CHECK(!ble_keyboard_lookup(BLE_KEYBOARD_LAYOUT_DE, 0x00E9, &key));
+
+  check_key(BLE_KEYBOARD_LAYOUT_FR, 'a', 0x14, 0);
+  check_key(BLE_KEYBOARD_LAYOUT_FR, '1', 0x1E, BLE_KEYBOARD_MOD_LSHIFT);
+  check_key(BLE_KEYBOARD_LAYOUT_FR, 0x00E9, 0x1F, 0);
+  check_key(BLE_KEYBOARD_LAYOUT_FR, 0x00A3, 0x30, BLE_KEYBOARD_MOD_LSHIFT);
+  CHECK(!ble_keyboard_lookup(BLE_KEYBOARD_LAYOUT_FR, 0x00DF, &key));
+
+  CHECK(!ble_keyboard_lookup(BLE_KEYBOARD_LAYOUT_COUNT, 'a', &key));
+}
+
+// The binary search must find both ends of every extension table.
+static void test_ext_table_edges(void) {
+  check_key(BLE_KEYBOARD_LAYOUT_UK, 0x00A3, 0x20, BLE_KEYBOARD_MOD_LSHIFT);
+  check_key(BLE_KEYBOARD_LAYOUT_UK, 0x20AC, 0x21, BLE_KEYBOARD_MOD_RALT);
+  check_key(BLE_KEYBOARD_LAYOUT_DE, 0x00A7, 0x20, BLE_KEYBOARD_MOD_LSHIFT);
+  check_key(BLE_KEYBOARD_LAYOUT_DE, 0x20AC, 0x08, BLE_KEYBOARD_MOD_RALT);
+  check_key(BLE_KEYBOARD_LAYOUT_FR, 0x00A3, 0x30, BLE_KEYBOARD_MOD_LSHIFT);
+  check_key(BLE_KEYBOARD_LAYOUT_FR, 0x20AC, 0x08, BLE_KEYBOARD_MOD_RALT);
+
+  ble_keyboard_key_t key;
+  CHECK(!ble_keyboard_lookup(BLE_KEYBOARD_LAYOUT_DE, 0x00A6, &key));
+  CHECK(!ble_keyboard_lookup(BLE_KEYBOARD_LAYOUT_DE, 0x20AD, &key));
+  CHECK(!ble_keyboard_lookup(BLE_KEYBOARD_LAYOUT_FR, 0x0080, &key));
+}
+
+// Collects the reports for `text` without the send path.
+static size_t type_reports(ble_keyboard_layout_t layout, bool caps_lock,
+                           const char* text, ble_keyboard_report_t* out,
+                           size_t max, size_t* skipped) {
+  ble_keyboard_typer_t typer;
+  ble_keyboard_typer_init(&typer, layout, text, strlen(text));
+  ble_keyboard_typer_set_caps_lock(&typer, caps_lock);
+  size_t count = 0;
+  while (count < max && ble_keyboard_typer_next(&typer, &out[count])) {
+    count++;
+  }
+  *skipped = typer.skipped;
+  return count;
+}
+
+static void test_utf8_decoding(void) {
+  ble_keyboard_report_t reports[32];
+  size_t skipped;
+
+  // Two-, three- and four-byte sequences; the emoji isn't on any layout.
+  size_t count = type_reports(BLE_KEYBOARD_LAYOUT_FR, false,
+                              "\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80", reports,
+                              32, &skipped);
+  CHECK_EQ(skipped, 1);
+  CHECK_EQ(count, 4);
+  CHECK_EQ(reports[0].keycode[0], 0x1F);  // é
+  CHECK_EQ(reports[1].keycode[0], 0);     // modifier change needs a release
+  CHECK_EQ(reports[2].keycode[0], 0x08);  // €
+  CHECK_EQ(reports[2].modifier, BLE_KEYBOARD_MOD_RALT);
+  CHECK_EQ(reports[3].keycode[0], 0);
+
+  // A stray continuation byte, an invalid lead byte and a truncated sequence
+  // are each skipped a byte at a time, and decoding resynchronizes.
+  count = type_reports(BLE_KEYBOARD_LAYOUT_US, false,
+                       "\x80" "a\xFF" "b\xE2\x82", reports, 32, &skipped);
+  CHECK_EQ(skipped, 4);
+  CHECK_EQ(count, 3);
+  CHECK_EQ(reports[0].keycode[0], 0x04);
+  CHECK_EQ(reports[1].keycode[0], 0x05);
+  CHECK_EQ(reports[2].keycode[0], 0);
+
+  // A continuation byte that isn't one.
+  count = type_reports(BLE_KEYBOARD_LAYOUT_DE, false, "\xC3z", reports, 32,
+                       &skipped);
+  CHECK_EQ(skipped, 1);
+  CHECK_EQ(reports[0].keycode[0], 0x1C);
+}
+
+static void test_caps_lock(void) {
+  ble_keyboard_report_t reports[32];
+  size_t skipped;
+
+  // Letters flip Shift; digits don't, so "A1" needs no release in between.
+  size_t count = type_reports(BLE_KEYBOARD_LAYOUT_US, true, "A1b", reports, 32,
+                              &skipped);
+  CHECK_EQ(count, 5);
+  CHECK_EQ(reports[0].keycode[0], 0x04);
+  CHECK_EQ(reports[0].modifier, 0);
+  CHECK_EQ(reports[1].keycode[0], 0x1E);
+  CHECK_EQ(reports[1].modifier, 0);
+  CHECK_EQ(reports[2].keycode[0], 0);
+  CHECK_EQ(reports[3].keycode[0], 0x05);
+  CHECK_EQ(reports[3].modifier, BLE_KEYBOARD_MOD_LSHIFT);
+
+  // Layout letters outside ASCII follow Caps Lock as well.
+  count = type_reports(BLE_KEYBOARD_LAYOUT_DE, true, "\xC3\x84", reports, 32,
+                       &skipped);
+  CHECK_EQ(reports[0].keycode[0], 0x34);
+  CHECK_EQ(reports[0].modifier, 0);
+
+  // é has no uppercase key on AZERTY, so Caps Lock leaves it alone.
+  count = type_reports(BLE_KEYBOARD_LAYOUT_FR, true, "\xC3\xA9", reports, 32,
+                       &skipped);
+  CHECK_EQ(reports[0].keycode[0], 0x1F);
+  CHECK_EQ(reports[0].modifier, 0);
+
+  // AltGr symbols don't pair with anything.
+  count = type_reports(BLE_KEYBOARD_LAYOUT_DE, true, "\xE2\x82\xAC", reports,
+                       32, &skipped);
+  CHECK_EQ(reports[0].modifier, BLE_KEYBOARD_MOD_RALT);
+}
+
+// Replays reports the way a host sees them: each newly pressed key emits
+// the character its key and modifiers map to on `layout`.
+static size_t host_decode(ble_keyboard_layout_t layout, bool caps_lock,
+                          const ble_keyboard_report_t* reports, size_t count,
+                          uint32_t* out, size_t max) {
+  size_t chars = 0;
+  uint8_t held = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint8_t key = reports[i].keycode[0];
+    for (size_t slot = 1; slot < sizeof(reports[i].keycode); slot++) {
+      CHECK_EQ(reports[i].keycode[slot], 0);
+    }
+    if (key != 0 && key != held) {
+      uint8_t modifier = reports[i].modifier;
+      uint32_t found = 0;
+      for (uint32_t cp = 1; cp < 0x10000 && found == 0; cp++) {
+        ble_keyboard_key_t candidate;
+        if (!ble_keyboard_lookup(layout, cp, &candidate) ||
+            candidate.keycode != key) {
+          continue;
+        }
+        uint8_t effective = modifier;
+        bool letter = (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z') ||
+                      (cp >= 0xC0 && cp <= 0xFE && cp != 0xD7 && cp != 0xF7);
+        if (caps_lock && letter && (modifier & ~BLE_KEYBOARD_MOD_LSHIFT) == 0) {
+          effective ^= BLE_KEYBOARD_MOD_LSHIFT;
+        }
+        if (candidate.modifier == effective) {
+          found = cp;
+        }
+      }
+      CHECK(found != 0);
+      CHECK(chars < max);
+      out[chars++] = found;
+    }
+    held = key;
+  }
+  CHECK_EQ(held, 0);
+  return chars;
+}
+
+static size_t utf8_codepoints(const char* text, uint32_t* out) {
+  const uint8_t* p = (const uint8_t*)text;
+  size_t count = 0;
+  while (*p != 0) {
+    uint32_t cp = *p;
+    size_t extra = cp >= 0xF0 ? 3 : cp >= 0xE0 ? 2 : cp >= 0xC0 ? 1 : 0;
+    if (extra > 0) {
+      cp &= 0x3F >> extra;
+    }
+    for (size_t i = 1; i <= extra; i++) {
+      cp = (cp << 6) | (p[i] & 0x3F);
+    }
+    p += extra + 1;
+    out[count++] = cp;
+  }
+  return count;
+}
+
+static void check_round_trip(ble_keyboard_layout_t layout, bool caps_lock,
+                             const char* text) {
+  static uint32_t expected[256];
+  static uint32_t decoded[256];
+  host_state = caps_lock ? BLE_HID_STATE_CAPS_LOCK : 0;
+  reset_reports();
+  CHECK_EQ(ble_keyboard_type(layout, text), 0);
+  CHECK(waits > 0);
+
+  size_t count = utf8_codepoints(text, expected);
+  CHECK_EQ(host_decode(layout, caps_lock, sent, sent_count, decoded, 256),
+           count);
+  CHECK(memcmp(expected, decoded, count * sizeof(expected[0])) == 0);
+}
+
+static void test_round_trip(void) {
+  check_round_trip(BLE_KEYBOARD_LAYOUT_US, false,
+                   "Hello, World! aa bB {x} ~`1@#$%^&*()_+\n");
+  check_round_trip(BLE_KEYBOARD_LAYOUT_US, true, "CAPS 123 mixed Case");
+  check_round_trip(BLE_KEYBOARD_LAYOUT_UK, false,
+                   "\xC2\xA3" "5 @home \"q\" #1");
+  check_round_trip(BLE_KEYBOARD_LAYOUT_DE, false,
+                   "Gr\xC3\xBC\xC3\x9F" "e aus K\xC3\xB6ln: 5\xE2\x82\xAC {z}");
+  check_round_trip(BLE_KEYBOARD_LAYOUT_DE, true, "\xC3\x84RGER yz");
+  check_round_trip(BLE_KEYBOARD_LAYOUT_FR, false,
+                   "\xC3\xA9t\xC3\xA9 \xC3\xA0 l'\xC3\xA9" "cole, "
+                   "10\xE2\x82\xAC!");
+}
+
+static const char bench_text[] =
+    "The quick brown fox jumps over the lazy dog. Pack my box with five "
+    "dozen liquor jugs! How vexingly quick daft zebras jump; 1234567890.\n";
+
+static void bench_reports_per_char(void) {
+  ble_keyboard_typer_t typer;
+  ble_keyboard_report_t report;
+  const size_t length = sizeof(bench_text) - 1;
+  const int rounds = 20000;
+
+  size_t reports = 0;
+  double start = test_now_s();
+  for (int i = 0; i < rounds; i++) {
+    ble_keyboard_typer_init(&typer, BLE_KEYBOARD_LAYOUT_US, bench_text, length);
+    while (ble_keyboard_typer_next(&typer, &report)) {
+      reports++;
+    }
+  }
+  double elapsed = test_now_s() - start;
+
+  printf("bench typer: %.2f reports/char, %.1f ns/char, %.1f M chars/s\n",
+         (double)reports / rounds / length, elapsed / rounds / length * 1e9,
+         rounds * length / elapsed / 1e6);
+}
+
+int main(void) {
+  RUN(test_lookup);
+  RUN(test_ext_table_edges);
+  RUN(test_utf8_decoding);
+  RUN(test_caps_lock);
+  RUN(test_round_trip);
+  bench_reports_per_char();
+  return 0;
+}
@@ -0,0 +1,157 @@
+#include "conn_policy.h"
+#include "test_util.h"
+
+// Simulated link: conn_params evaluates the policy once a second and on the
+// first report after an idle period, and the host answers every request
+// `answer_ms` later.
+typedef struct sim {
+  conn_policy_t policy;
+  uint32_t now_ms;
+  uint32_t last_activity_ms;
+  conn_policy_mode_t pending;
+  uint32_t answer_at_ms;
+  bool accept;
+  int requests;
+  int active_requests;
+  int idle_requests;
+  uint32_t last_request_ms;
+} sim_t;
+
+#define ANSWER_MS 50
+
+static void sim_init(sim_t* sim, uint32_t start_ms) {
+  *sim = (sim_t){.now_ms = start_ms, .last_activity_ms = start_ms,
+                 .accept = true};
+  conn_policy_init(&sim->policy, start_ms);
+}
+
+static void sim_evaluate(sim_t* sim) {
+  conn_policy_mode_t mode =
+      conn_policy_evaluate(&sim->policy, sim->now_ms, sim->last_activity_ms);
+  if (mode == CONN_POLICY_MODE_NONE) {
+    return;
+  }
+  // One outstanding request at a time, and never two within the dwell.
+  CHECK_EQ(sim->pending, CONN_POLICY_MODE_NONE);
+  if (sim->requests > 0) {
+    CHECK(sim->now_ms - sim->last_request_ms >= CONN_POLICY_DWELL_MS);
+  }
+  sim->pending = mode;
+  sim->answer_at_ms = sim->now_ms + ANSWER_MS;
+  sim->last_request_ms = sim->now_ms;
+  sim->requests++;
+  if (mode == CONN_POLICY_MODE_ACTIVE) {
+    sim->active_requests++;
+  } else {
+    sim->idle_requests++;
+  }
+}
+
+// Advances `ms` milliseconds, typing every `type_every_ms` (0: idle).
+static void sim_run(sim_t* sim, uint32_t ms, uint32_t type_every_ms) {
+  for (uint32_t t = 0; t < ms; t++) {
+    sim->now_ms++;
+    if (sim->pending != CONN_POLICY_MODE_NONE &&
+        sim->now_ms == sim->answer_at_ms) {
+      conn_policy_on_result(&sim->policy, sim->now_ms, sim->accept);
+      sim->pending = CONN_POLICY_MODE_NONE;
+    }
+    bool typed = type_every_ms != 0 && t % type_every_ms == 0;
+    bool was_idle = sim->now_ms - sim->last_activity_ms >= CONN_POLICY_IDLE_MS;
+    if (typed) {
+      sim->last_activity_ms = sim->now_ms;
+    }
+    if ((typed && was_idle) || sim->now_ms % 1000 == 0) {
+      sim_evaluate(sim);
+    }
+  }
+}
+
+static void test_active_then_idle(void) {
+  sim_t sim;
+  sim_init(&sim, 0);
+  // Typing right after connecting waits out the initial dwell.
+  sim_run(&sim, 999, 100);
+  CHECK_EQ(sim.requests, 0);
+  sim_run(&sim, 100, 100);
+  CHECK_EQ(sim.policy.mode, CONN_POLICY_MODE_ACTIVE);
+
+  // Ten seconds of typing: no further requests.
+  sim_run(&sim, 10000, 100);
+  CHECK_EQ(sim.requests, 1);
+
+  // Idle drops to the low-power parameters once, about 5 s after the last
+  // key.
+  sim_run(&sim, CONN_POLICY_IDLE_MS + 1000, 0);
+  CHECK_EQ(sim.policy.mode, CONN_POLICY_MODE_IDLE);
+  CHECK_EQ(sim.idle_requests, 1);
+  sim_run(&sim, 60000, 0);
+  CHECK_EQ(sim.requests, 2);
+
+  // The first key after idling asks for the fast interval immediately.
+  uint32_t before = sim.now_ms;
+  sim_run(&sim, 1, 1);
+  CHECK_EQ(sim.active_requests, 2);
+  CHECK_EQ(sim.last_request_ms, before + 1);
+}
+
+// Keys every 4 s never let the link idle, so nothing toggles.
+static void test_no_thrash(void) {
+  sim_t sim;
+  sim_init(&sim, 0);
+  sim_run(&sim, 120000, 4000);
+  CHECK_EQ(sim.requests, 1);
+  CHECK_EQ(sim.policy.mode, CONN_POLICY_MODE_ACTIVE);
+
+  // Alternating bursts and pauses just past the idle time: at most one
+  // request per dwell, and each mode change is a real one.
+  sim_init(&sim, 0);
+  for (int i = 0; i < 20; i++) {
+    sim_run(&sim, 2000, 50);
+    sim_run(&sim, CONN_POLICY_IDLE_MS + 1500, 0);
+  }
+  CHECK_EQ(sim.active_requests, 20);
+  CHECK_EQ(sim.idle_requests, 20);
+}
+
+static void test_rejection_backs_off(void) {
+  sim_t sim;
+  sim_init(&sim, 0);
+  sim.accept = false;
+  sim_run(&sim, 2000, 100);
+  CHECK_EQ(sim.requests, 1);
+  CHECK_EQ(sim.policy.mode, CONN_POLICY_MODE_NONE);
+
+  sim_run(&sim, CONN_POLICY_BACKOFF_MS - 1000, 100);
+  CHECK_EQ(sim.requests, 1);
+  sim.accept = true;
+  sim_run(&sim, 2000, 100);
+  CHECK_EQ(sim.requests, 2);
+  CHECK_EQ(sim.policy.mode, CONN_POLICY_MODE_ACTIVE);
+
+  // A host-initiated update is respected for the back-off period too.
+  conn_policy_on_peer_update(&sim.policy, sim.now_ms);
+  sim_run(&sim, CONN_POLICY_BACKOFF_MS - 1000, 100);
+  CHECK_EQ(sim.requests, 2);
+  sim_run(&sim, 2000, 100);
+  CHECK_EQ(sim.requests, 3);
+}
+
+// Millisecond timestamps wrap after 49 days.
+static void test_time_wrap(void) {
+  sim_t sim;
+  sim_init(&sim, UINT32_MAX - 3000);
+  sim_run(&sim, 2000, 100);
+  CHECK_EQ(sim.policy.mode, CONN_POLICY_MODE_ACTIVE);
+  sim_run(&sim, CONN_POLICY_IDLE_MS + 2000, 0);
+  CHECK_EQ(sim.policy.mode, CONN_POLICY_MODE_IDLE);
+  CHECK_EQ(sim.requests, 2);
+}
+
+int main(void) {
+  RUN(test_active_then_idle);
+  RUN(test_no_thrash);
+  RUN(test_rejection_backs_off);
+  RUN(test_time_wrap);
+  return 0;
+}
@@ -0,0 +1,567 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ble_battery.h"
+#include "ble_diag.h"
+#include "ble_gatt_registry.h"
+#include "ble_hid.h"
+#include "ble_ota.h"
+#include "ble_trace.h"
+#include "ble_upload.h"
+#include "conn_params.h"
+#include "esp_bt.h"
+#include "gap.h"
+#include "gap_conn.h"
+#include "host/ble_hs.h"
+#include "host/util/util.h"
+#include "host_slots.h"
+#include "nimble/nimble_port.h"
+#include "nvs.h"
+#include "services/gap/ble_svc_gap.h"
+#include "services/gatt/ble_svc_gatt.h"
+#include "test_util.h"
+
+// Replays GAP event sequences through gap_event_handler against a fake
+// NimBLE host: links the test "connects" live in `links`, and every call
+// the handler makes into the stack or the services is counted.
+int gap_event_handler(struct ble_gap_event* event, void* arg);
+
+#define MAX_LINKS 8
+
+static struct ble_gap_conn_desc links[MAX_LINKS];
+static size_t num_links;
+static ble_addr_t bonds[CONFIG_BT_NIMBLE_MAX_BONDS];
+static int num_bonds;
+
+static struct {
+  int security_initiated;
+  int terminated;
+  uint16_t terminated_handle;
+  int adv_started;
+  int adv_active;
+  uint8_t adv_conn_mode;
+  ble_addr_t adv_peer;
+  bool adv_directed;
+  int hid_connect;
+  int hid_disconnect;
+  int hid_enc_change;
+  int output_changes;
+  int deleted_peers;
+  int status_rr;
+} calls;
+
+// Payloads last pushed to the controller.
+static uint8_t adv_data[BLE_HS_ADV_MAX_SZ];
+static int adv_data_len;
+static uint8_t rsp_data[BLE_HS_ADV_MAX_SZ];
+static int rsp_data_len;
+static esp_power_level_t adv_power = ESP_PWR_LVL_P3;
+
+static struct ble_npl_event* pending_events[8];
+static size_t num_pending;
+
+static void reset(void) {
+  memset(&calls, 0, sizeof(calls));
+  memset(links, 0, sizeof(links));
+  num_links = 0;
+  num_bonds = 0;
+  num_pending = 0;
+}
+
+static struct ble_gap_conn_desc* link_add(uint16_t conn_handle,
+                                          uint8_t addr_byte) {
+  CHECK(num_links < MAX_LINKS);
+  struct ble_gap_conn_desc* desc = &links[num_links++];
+  memset(desc, 0, sizeof(*desc));
+  desc->conn_handle = conn_handle;
+  desc->conn_itvl = 24;
+  desc->supervision_timeout = 400;
+  desc->peer_id_addr.type = BLE_ADDR_PUBLIC;
+  memset(desc->peer_id_addr.val, addr_byte, sizeof(desc->peer_id_addr.val));
+  return desc;
+}
+
+static struct ble_gap_conn_desc* link_find(uint16_t conn_handle) {
+  for (size_t i = 0; i < num_links; i++) {
+    if (links[i].conn_handle == conn_handle) {
+      return &links[i];
+    }
+  }
+  return NULL;
+}
+
+static void link_remove(uint16_t conn_handle) {
+  struct ble_gap_conn_desc* desc = link_find(conn_handle);
+  CHECK(desc != NULL);
+  *desc = links[--num_links];
+}
+
+// NimBLE host.
+int ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc* out_desc) {
+  struct ble_gap_conn_desc* desc = link_find(handle);
+  if (desc == NULL) {
+    return BLE_HS_ENOTCONN;
+  }
+  *out_desc = *desc;
+  return 0;
+}
+int ble_gap_terminate(uint16_t conn_handle, uint8_t hci_reason) {
+  calls.terminated++;
+  calls.terminated_handle = conn_handle;
+  return 0;
+}
+int ble_gap_security_initiate(uint16_t conn_handle) {
+  calls.security_initiated++;
+  return 0;
+}
+int ble_gap_adv_start(uint8_t own_addr_type, const ble_addr_t* direct_addr,
+                      int32_t duration_ms,
+                      const struct ble_gap_adv_params* adv_params,
+                      ble_gap_event_fn* cb, void* cb_arg) {
+  calls.adv_started++;
+  calls.adv_active = 1;
+  calls.adv_conn_mode = adv_params->conn_mode;
+  calls.adv_directed = direct_addr != NULL;
+  if (direct_addr != NULL) {
+    calls.adv_peer = *direct_addr;
+  }
+  return 0;
+}
+int ble_gap_adv_stop(void) {
+  calls.adv_active = 0;
+  return 0;
+}
+int ble_gap_adv_active(void) { return calls.adv_active; }
+int ble_gap_adv_set_data(const uint8_t* data, int data_len) {
+  CHECK(data_len <= BLE_HS_ADV_MAX_SZ);
+  memcpy(adv_data, data, data_len);
+  adv_data_len = data_len;
+  return 0;
+}
+int ble_gap_adv_rsp_set_data(const uint8_t* data, int data_len) {
+  CHECK(data_len <= BLE_HS_ADV_MAX_SZ);
+  memcpy(rsp_data, data, data_len);
+  rsp_data_len = data_len;
+  return 0;
+}
+int ble_hs_util_ensure_addr(int prefer_random) { return 0; }
+int ble_store_util_bonded_peers(ble_addr_t* out_peer_id_addrs,
+                                int* out_num_peers, int max_peers) {
+  memcpy(out_peer_id_addrs, bonds, num_bonds * sizeof(bonds[0]));
+  *out_num_peers = num_bonds;
+  return 0;
+}
+int ble_store_util_delete_peer(const ble_addr_t* peer_id_addr) {
+  calls.deleted_peers++;
+  return 0;
+}
+int ble_store_util_status_rr(struct ble_store_status_event* event, void* arg) {
+  calls.status_rr++;
+  return 0;
+}
+int ble_store_read_cccd(const struct ble_store_key_cccd* key,
+                        struct ble_store_value_cccd* out_value) {
+  return BLE_HS_ENOENT;
+}
+void ble_svc_gap_init(void) {}
+int ble_svc_gap_device_name_set(const char* name) { return 0; }
+void ble_svc_gatt_init(void) {}
+esp_power_level_t esp_ble_tx_power_get(esp_ble_power_type_t power_type) {
+  return adv_power;
+}
+
+static struct ble_npl_eventq* const dflt_eventq =
+    (struct ble_npl_eventq*)&pending_events;
+struct ble_npl_eventq* nimble_port_get_dflt_eventq(void) { return dflt_eventq; }
+void ble_npl_event_init(struct ble_npl_event* ev, ble_npl_event_fn* fn,
+                        void* arg) {
+  ev->fn = fn;
+  ev->arg = arg;
+}
+void ble_npl_eventq_put(struct ble_npl_eventq* evq, struct ble_npl_event* ev) {
+  CHECK(num_pending < sizeof(pending_events) / sizeof(pending_events[0]));
+  pending_events[num_pending++] = ev;
+}
+static void run_events(void) {
+  for (size_t i = 0; i < num_pending; i++) {
+    pending_events[i]->fn(pending_events[i]);
+  }
+  num_pending = 0;
+}
+
+// NVS: a single record, enough for the host slots.
+static uint8_t nvs_blob[64];
+static size_t nvs_blob_len;
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode,
+                   nvs_handle_t* out_handle) {
+  *out_handle = 1;
+  return ESP_OK;
+}
+void nvs_close(nvs_handle_t handle) {}
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value,
+                       size_t* length) {
+  if (nvs_blob_len == 0) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+  if (*length < nvs_blob_len) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(out_value, nvs_blob, nvs_blob_len);
+  *length = nvs_blob_len;
+  return ESP_OK;
+}
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value,
+                       size_t length) {
+  CHECK(length <= sizeof(nvs_blob));
+  memcpy(nvs_blob, value, length);
+  nvs_blob_len = length;
+  return ESP_OK;
+}
+esp_err_t nvs_commit(nvs_handle_t handle) { return ESP_OK; }
+const char* esp_err_to_name(esp_err_t code) { return "error"; }
+
+// Services the handler fans events out to.
+int ble_hid_init(void) { return 0; }
+void ble_hid_on_connect(uint16_t conn_handle) { calls.hid_connect++; }
+void ble_hid_on_disconnect(uint16_t conn_handle) { calls.hid_disconnect++; }
+void ble_hid_on_enc_change(const struct ble_gap_conn_desc* desc) {
+  calls.hid_enc_change++;
+}
+void ble_hid_on_subscribe(const struct ble_gap_event* event) {}
+void ble_hid_on_output_change(uint16_t old_conn_handle) {
+  calls.output_changes++;
+}
+int ble_diag_init(void) { return 0; }
+int ble_ota_init(void) { return 0; }
+int ble_gatt_registry_init(void) { return 0; }
+void ble_battery_init(void) {}
+void ble_battery_on_subscribe(const struct ble_gap_event* event) {}
+void ble_battery_on_enc_change(const struct ble_gap_conn_desc* desc) {}
+void ble_upload_init(void) {}
+void ble_upload_on_subscribe(const struct ble_gap_event* event) {}
+void ble_upload_on_disconnect(uint16_t conn_handle) {}
+void conn_params_init(void) {}
+void conn_params_on_connect(gap_conn_t* conn) {}
+void conn_params_on_enc_change(void) {}
+void conn_params_on_update(gap_conn_t* conn, int status) {}
+void conn_params_on_update_req(gap_conn_t* conn,
+                               struct ble_gap_upd_params* self_params) {}
+void ble_trace_record(ble_trace_event_t event, uint32_t a0, uint32_t a1,
+                      uint32_t a2) {}
+
+static void send_connect(uint16_t conn_handle, int status) {
+  // The advertising instance ends with the connection it produced, or with
+  // the failed attempt.
+  calls.adv_active = 0;
+  struct ble_gap_event event = {.type = BLE_GAP_EVENT_CONNECT};
+  event.connect.status = status;
+  event.connect.conn_handle = conn_handle;
+  CHECK_EQ(gap_event_handler(&event, NULL), 0);
+}
+
+static void send_disconnect(uint16_t conn_handle) {
+  struct ble_gap_event event = {.type = BLE_GAP_EVENT_DISCONNECT};
+  event.disconnect.reason = 0x213;
+  event.disconnect.conn = *link_find(conn_handle);
+  link_remove(conn_handle);
+  CHECK_EQ(gap_event_handler(&event, NULL), 0);
+}
+
+static void send_enc_change(uint16_t conn_handle, int status) {
+  struct ble_gap_event event = {.type = BLE_GAP_EVENT_ENC_CHANGE};
+  event.enc_change.status = status;
+  event.enc_change.conn_handle = conn_handle;
+  CHECK_EQ(gap_event_handler(&event, NULL), 0);
+}
+
+static void send_mtu(uint16_t conn_handle, uint16_t mtu) {
+  struct ble_gap_event event = {.type = BLE_GAP_EVENT_MTU};
+  event.mtu.conn_handle = conn_handle;
+  event.mtu.value = mtu;
+  CHECK_EQ(gap_event_handler(&event, NULL), 0);
+}
+
+static void send_conn_update(uint16_t conn_handle, int status) {
+  struct ble_gap_event event = {.type = BLE_GAP_EVENT_CONN_UPDATE};
+  event.conn_update.status = status;
+  event.conn_update.conn_handle = conn_handle;
+  CHECK_EQ(gap_event_handler(&event, NULL), 0);
+}
+
+// Brings up a bonded, encrypted link to the host with `addr_byte`.
+static void connect_bonded(uint16_t conn_handle, uint8_t addr_byte) {
+  link_add(conn_handle, addr_byte);
+  send_connect(conn_handle, 0);
+  struct ble_gap_conn_desc* desc = link_find(conn_handle);
+  desc->sec_state.encrypted = 1;
+  desc->sec_state.bonded = 1;
+  send_enc_change(conn_handle, 0);
+}
+
+static void disconnect_all(void) {
+  while (num_links > 0) {
+    send_disconnect(links[0].conn_handle);
+  }
+  CHECK_EQ(gap_conn_count(), 0);
+}
+
+static void test_failed_connect(void) {
+  reset();
+  send_connect(0, 0x3E);
+  CHECK_EQ(gap_conn_count(), 0);
+  CHECK_EQ(calls.security_initiated, 0);
+  CHECK_EQ(calls.hid_connect, 0);
+  // Advertising resumes for the next attempt.
+  CHECK_EQ(calls.adv_started, 1);
+}
+
+// Advertising data matches what ble_hs_adv_set_fields would emit, with the
+// current TX power patched in on every start.
+static void test_adv_payloads(void) {
+  static const uint8_t golden[] = {
+      0x02, 0x01, 0x06,        // flags
+      0x03, 0x03, 0x12, 0x18,  // HID service
+      0x02, 0x0a, 0x03,        // TX power: +3 dBm
+      0x03, 0x19, 0xc1, 0x03,  // appearance: keyboard
+  };
+  static const uint8_t rsp_golden[] = {
+      0x0e, 0x09, 'T', 'e', 's', 't', ' ', 'K', 'e', 'y', 'b', 'o', 'a', 'r',
+      'd',
+  };
+
+  reset();
+  send_connect(0, 0x3E);
+  CHECK_EQ(adv_data_len, sizeof(golden));
+  CHECK(memcmp(adv_data, golden, sizeof(golden)) == 0);
+  CHECK_EQ(rsp_data_len, sizeof(rsp_golden));
+  CHECK(memcmp(rsp_data, rsp_golden, sizeof(rsp_golden)) == 0);
+
+  adv_power = ESP_PWR_LVL_N12;
+  send_connect(0, 0x3E);
+  CHECK_EQ(adv_data[9], (uint8_t)-12);
+  CHECK(memcmp(adv_data, golden, 9) == 0);
+  CHECK(memcmp(&adv_data[10], &golden[10], sizeof(golden) - 10) == 0);
+  adv_power = ESP_PWR_LVL_P3;
+}
+
+static void test_connect_tracks_link(void) {
+  reset();
+  struct ble_gap_conn_desc* desc = link_add(1, 0xA1);
+  desc->conn_itvl = 6;
+  send_connect(1, 0);
+
+  gap_conn_t* conn = gap_conn_find(1);
+  CHECK(conn != NULL);
+  CHECK_EQ(gap_conn_count(), 1);
+  CHECK_EQ(conn->mtu, BLE_ATT_MTU_DFLT);
+  CHECK_EQ(conn->itvl, 6);
+  CHECK(!conn->encrypted);
+  CHECK_EQ(calls.security_initiated, 1);
+  CHECK_EQ(calls.hid_connect, 1);
+  // Still room for more hosts.
+  CHECK_EQ(calls.adv_started, 1);
+
+  send_mtu(1, 185);
+  send_mtu(7, 100);  // unknown handle
+  CHECK_EQ(conn->mtu, 185);
+
+  desc->conn_itvl = 12;
+  send_conn_update(1, 0);
+  CHECK_EQ(conn->itvl, 12);
+  desc->conn_itvl = 40;
+  send_conn_update(1, BLE_HS_ETIMEOUT);  // rejected: nothing changes
+  CHECK_EQ(conn->itvl, 12);
+
+  // A failed encryption leaves the link as it was.
+  send_enc_change(1, 0x206);
+  CHECK(!conn->encrypted);
+  CHECK_EQ(calls.hid_enc_change, 0);
+
+  desc->sec_state.encrypted = 1;
+  desc->sec_state.bonded = 1;
+  send_enc_change(1, 0);
+  CHECK(conn->encrypted);
+  CHECK(conn->bonded);
+  CHECK_EQ(conn->peer_addr[0], 0xA1);
+  CHECK_EQ(calls.hid_enc_change, 1);
+  CHECK_EQ(gap_output_conn(), 1);
+
+  send_disconnect(1);
+  CHECK(gap_conn_find(1) == NULL);
+  CHECK_EQ(gap_conn_count(), 0);
+  CHECK_EQ(calls.hid_disconnect, 1);
+  CHECK_EQ(gap_output_conn(), BLE_HS_CONN_HANDLE_NONE);
+}
+
+// Three hosts whose handles all hash to the same slot, dropping in an order
+// that exercises the table's backward-shift deletion.
+static void test_multiple_links(void) {
+  reset();
+  const uint16_t handles[] = {1, 5, 9};
+  for (size_t i = 0; i < 3; i++) {
+    connect_bonded(handles[i], (uint8_t)(0xB0 + i));
+  }
+  CHECK_EQ(gap_conn_count(), 3);
+  // The last free connection stops the extra advertising.
+  CHECK_EQ(calls.adv_started, 2);
+  for (size_t i = 0; i < 3; i++) {
+    gap_conn_t* conn = gap_conn_find(handles[i]);
+    CHECK(conn != NULL && conn->encrypted);
+    CHECK_EQ(conn->peer_addr[0], 0xB0 + i);
+  }
+
+  send_disconnect(5);
+  CHECK(gap_conn_find(5) == NULL);
+  CHECK(gap_conn_find(1) != NULL);
+  CHECK_EQ(gap_conn_find(9)->peer_addr[0], 0xB2);
+  CHECK_EQ(calls.adv_started, 3);
+
+  send_disconnect(1);
+  CHECK_EQ(gap_conn_find(9)->conn_handle, 9);
+  CHECK_EQ(gap_conn_count(), 1);
+  disconnect_all();
+}
+
+// A bonded host that drops gets directed advertising even though the
+// advertising restarted on CONNECT is still running.
+static void test_reconnect_directed(void) {
+  reset();
+  connect_bonded(1, 0xE1);
+  CHECK(calls.adv_active);
+
+  // 31 s later the schedule has stepped down to its slow phase.
+  struct ble_gap_event timeout = {.type = BLE_GAP_EVENT_ADV_COMPLETE};
+  timeout.adv_complete.reason = BLE_HS_ETIMEOUT;
+  for (int i = 0; i < 2; i++) {
+    calls.adv_active = 0;
+    CHECK_EQ(gap_event_handler(&timeout, NULL), 0);
+  }
+  CHECK(calls.adv_active);
+  CHECK(!calls.adv_directed);
+
+  int started = calls.adv_started;
+  send_disconnect(1);
+  CHECK_EQ(calls.adv_started, started + 1);
+  CHECK(calls.adv_directed);
+  CHECK_EQ(calls.adv_conn_mode, BLE_GAP_CONN_MODE_DIR);
+  CHECK_EQ(calls.adv_peer.val[0], 0xE1);
+}
+
+// A full bond store frees the bond of the slot the new host will get, and
+// that slot with it; the rest is left to the stack's round-robin handler.
+static void test_store_status(void) {
+  reset();
+  // Every slot was taken, so this already replaced the selected host.
+  connect_bonded(1, 0xC1);
+  calls.deleted_peers = 0;
+  struct ble_store_status_event event = {.event_code = BLE_STORE_EVENT_FULL};
+  event.full.obj_type = BLE_STORE_OBJ_TYPE_PEER_SEC;
+  event.full.conn_handle = 2;
+
+  // The selected host is connected: an away host's bond goes instead, and
+  // the next host pairs into its emptied slot without evicting anyone.
+  CHECK_EQ(gap_store_status_cb(&event, NULL), 0);
+  CHECK_EQ(calls.deleted_peers, 1);
+  CHECK_EQ(calls.status_rr, 0);
+  connect_bonded(2, 0xC2);
+  CHECK_EQ(calls.deleted_peers, 1);
+  CHECK_EQ(calls.terminated, 0);
+
+  // Every slot's host connected: the pairing fails and no bond goes.
+  connect_bonded(3, 0xC3);
+  CHECK_EQ(calls.deleted_peers, 2);
+  event.full.conn_handle = 4;
+  CHECK_EQ(gap_store_status_cb(&event, NULL), BLE_HS_ESTORE_CAP);
+  CHECK_EQ(calls.deleted_peers, 2);
+  CHECK_EQ(calls.status_rr, 0);
+
+  // The selected host away: its own bond goes.
+  send_disconnect(1);
+  event.full.obj_type = BLE_STORE_OBJ_TYPE_OUR_SEC;
+  CHECK_EQ(gap_store_status_cb(&event, NULL), 0);
+  CHECK_EQ(calls.deleted_peers, 3);
+  connect_bonded(5, 0xC5);
+  CHECK_EQ(calls.deleted_peers, 3);
+  CHECK_EQ(gap_output_conn(), 5);
+
+  // A full CCCD table would otherwise cost a host its bond.
+  event.full.obj_type = BLE_STORE_OBJ_TYPE_CCCD;
+  CHECK_EQ(gap_store_status_cb(&event, NULL), 0);
+  CHECK_EQ(calls.deleted_peers, 3);
+  CHECK_EQ(calls.status_rr, 1);
+
+  event.event_code = BLE_STORE_EVENT_OVERFLOW;
+  event.overflow.obj_type = BLE_STORE_OBJ_TYPE_PEER_SEC;
+  event.overflow.value = NULL;
+  CHECK_EQ(gap_store_status_cb(&event, NULL), 0);
+  CHECK_EQ(calls.deleted_peers, 3);
+  CHECK_EQ(calls.status_rr, 2);
+  disconnect_all();
+}
+
+// With every slot's host connected, a new host is turned away instead of
+// cutting one of them off.
+static void test_no_free_slot(void) {
+  reset();
+  for (uint16_t i = 1; i <= HOST_SLOT_COUNT; i++) {
+    connect_bonded(i, (uint8_t)(0xD0 + i));
+  }
+  uint16_t output = gap_output_conn();
+  calls.deleted_peers = 0;
+  calls.terminated = 0;
+
+  connect_bonded(4, 0xD4);
+  CHECK_EQ(calls.terminated, 1);
+  CHECK_EQ(calls.terminated_handle, 4);
+  CHECK_EQ(calls.deleted_peers, 1);
+  CHECK_EQ(gap_output_conn(), output);
+  disconnect_all();
+}
+
+// The table against a reference model under random churn.
+static void test_table_churn(void) {
+  bool live[32] = {0};
+  srand(7);
+  for (int step = 0; step < 100000; step++) {
+    uint16_t handle = (uint16_t)(rand() % 32);
+    if (live[handle]) {
+      gap_conn_remove(handle);
+      live[handle] = false;
+    } else if (gap_conn_count() < GAP_CONN_TABLE_SIZE) {
+      gap_conn_t* conn = gap_conn_add(handle);
+      CHECK(conn != NULL);
+      conn->mtu = handle;
+      live[handle] = true;
+    }
+
+    size_t count = 0;
+    for (uint16_t h = 0; h < 32; h++) {
+      gap_conn_t* conn = gap_conn_find(h);
+      CHECK_EQ(conn != NULL, live[h]);
+      if (conn != NULL) {
+        CHECK_EQ(conn->mtu, h);
+        count++;
+      }
+    }
+    CHECK_EQ(gap_conn_count(), count);
+  }
+  for (uint16_t h = 0; h < 32; h++) {
+    gap_conn_remove(h);
+  }
+  CHECK_EQ(gap_conn_count(), 0);
+}
+
+int main(void) {
+  CHECK_EQ(gap_init("Test Keyboard"), 0);
+  gap_slots_init();
+  run_events();
+  RUN(test_failed_connect);
+  RUN(test_adv_payloads);
+  RUN(test_connect_tracks_link);
+  RUN(test_multiple_links);
+  RUN(test_reconnect_directed);
+  RUN(test_store_status);
+  RUN(test_no_free_slot);
+  RUN(test_table_churn);
+  return 0;
+}
@@ -0,0 +1,164 @@
+#include <string.h>
+
+#include "ble_gatt_span.h"
+#include "host/ble_att.h"
+#include "host/ble_hs.h"
+#include "test_util.h"
+
+// A GATT client reading a long attribute: Read Request at offset 0, then Read
+// Blob Requests at the running offset until a response comes back shorter
+// than ATT_MTU - 1. Every byte the server copies into a response buffer is
+// counted.
+
+#define MAP_LEN 512
+
+static uint8_t report_map[MAP_LEN];
+static uint16_t mtu;
+static uint8_t om_buf[MAP_LEN];
+static uint64_t copied;
+
+uint16_t ble_att_mtu(uint16_t conn_handle) { return mtu; }
+
+int os_mbuf_append(struct os_mbuf* om, const void* data, uint16_t len) {
+  if (om->om_len + len > sizeof(om_buf)) {
+    return BLE_HS_ENOMEM;
+  }
+  memcpy(om->om_data + om->om_len, data, len);
+  om->om_len += len;
+  copied += len;
+  return 0;
+}
+
+typedef int (*read_fn)(uint16_t conn_handle, struct ble_gatt_access_ctxt* ctxt,
+                       const void* data, size_t len);
+
+// What serving the value looked like before spans: the whole thing on every
+// call, left for the stack to slice.
+static int append_whole(uint16_t conn_handle,
+                        struct ble_gatt_access_ctxt* ctxt, const void* data,
+                        size_t len) {
+  return os_mbuf_append(ctxt->om, data, len) == 0
+             ? 0
+             : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+// Runs one long read. Returns the number of requests it took.
+static int long_read(read_fn read, uint8_t* out, size_t* out_len) {
+  size_t offset = 0;
+  int requests = 0;
+  for (;;) {
+    struct os_mbuf om = {.om_data = om_buf};
+    struct ble_gatt_access_ctxt ctxt = {.op = BLE_GATT_ACCESS_OP_READ_CHR,
+                                        .offset = (uint16_t)offset,
+                                        .om = &om};
+    CHECK_EQ(read(0, &ctxt, report_map, sizeof(report_map)), 0);
+    requests++;
+
+    // The stack never sends more than ATT_MTU - 1 bytes in a response.
+    size_t rsp_len = om.om_len;
+    const uint8_t* rsp = om.om_data;
+    if (read == append_whole) {
+      rsp += offset;
+      rsp_len -= offset;
+    }
+    if (rsp_len > (size_t)mtu - 1) {
+      rsp_len = mtu - 1;
+    }
+    memcpy(out + offset, rsp, rsp_len);
+    offset += rsp_len;
+    if (rsp_len < (size_t)mtu - 1) {
+      break;
+    }
+  }
+  *out_len = offset;
+  return requests;
+}
+
+static void test_long_read(uint16_t att_mtu) {
+  mtu = att_mtu;
+  copied = 0;
+  uint8_t out[MAP_LEN];
+  size_t out_len;
+  int requests = long_read(ble_gatt_span_append, out, &out_len);
+
+  CHECK_EQ(out_len, MAP_LEN);
+  CHECK(memcmp(out, report_map, MAP_LEN) == 0);
+  CHECK_EQ(requests, MAP_LEN / (att_mtu - 1) + 1);
+  // Each byte is copied exactly once across the whole read.
+  CHECK_EQ(copied, MAP_LEN);
+}
+
+static void test_long_read_mtu23(void) { test_long_read(23); }
+static void test_long_read_mtu256(void) { test_long_read(256); }
+
+// A short value fits in one response, whatever the MTU.
+static void test_short_value(void) {
+  static const uint8_t pnp_id[7] = {0x02, 0xe5, 0x02, 0x01, 0x00, 0x10, 0x01};
+  mtu = 23;
+  struct os_mbuf om = {.om_data = om_buf};
+  struct ble_gatt_access_ctxt ctxt = {.op = BLE_GATT_ACCESS_OP_READ_CHR,
+                                      .om = &om};
+  CHECK_EQ(ble_gatt_span_append(0, &ctxt, pnp_id, sizeof(pnp_id)), 0);
+  CHECK_EQ(om.om_len, sizeof(pnp_id));
+  CHECK(memcmp(om_buf, pnp_id, sizeof(pnp_id)) == 0);
+}
+
+// Reading at the very end gets an empty response; past it is an error.
+static void test_offsets(void) {
+  mtu = 23;
+  struct os_mbuf om = {.om_data = om_buf};
+  struct ble_gatt_access_ctxt ctxt = {.op = BLE_GATT_ACCESS_OP_READ_CHR,
+                                      .offset = MAP_LEN,
+                                      .om = &om};
+  CHECK_EQ(ble_gatt_span_append(0, &ctxt, report_map, MAP_LEN), 0);
+  CHECK_EQ(om.om_len, 0);
+
+  ctxt.offset = MAP_LEN + 1;
+  CHECK_EQ(ble_gatt_span_append(0, &ctxt, report_map, MAP_LEN),
+           BLE_ATT_ERR_INVALID_OFFSET);
+  CHECK_EQ(om.om_len, 0);
+
+  // An MTU not yet exchanged reads as the default.
+  mtu = 0;
+  ctxt.offset = 0;
+  CHECK_EQ(ble_gatt_span_append(0, &ctxt, report_map, MAP_LEN), 0);
+  CHECK_EQ(om.om_len, BLE_ATT_MTU_DFLT - 1);
+}
+
+// Bytes copied and time per full read, spans against whole-value appends.
+static void bench_long_read(uint16_t att_mtu) {
+  const int rounds = 20000;
+  uint8_t out[MAP_LEN];
+  size_t out_len;
+  mtu = att_mtu;
+
+  const struct {
+    const char* name;
+    read_fn read;
+  } servers[] = {{"span", ble_gatt_span_append}, {"whole", append_whole}};
+  for (size_t s = 0; s < 2; s++) {
+    copied = 0;
+    double start = test_now_s();
+    for (int i = 0; i < rounds; i++) {
+      long_read(servers[s].read, out, &out_len);
+    }
+    double elapsed = test_now_s() - start;
+    CHECK_EQ(out_len, MAP_LEN);
+    printf("bench %d-byte read at MTU %u, %s: %llu bytes copied, %.2f us\n",
+           MAP_LEN, att_mtu, servers[s].name,
+           (unsigned long long)(copied / rounds), elapsed / rounds * 1e6);
+  }
+}
+
+int main(void) {
+  for (size_t i = 0; i < MAP_LEN; i++) {
+    report_map[i] = (uint8_t)(i * 7 + 1);
+  }
+  RUN(test_long_read_mtu23);
+  RUN(test_long_read_mtu256);
+  RUN(test_short_value);
+  RUN(test_offsets);
+  bench_long_read(23);
+  bench_long_read(256);
+  return 0;
+}
@@ -0,0 +1,259 @@
+#include <string.h>
+
+#include "ble_hid_mbuf.h"
+#include "os/os_mempool.h"
+#include "test_util.h"
+
+// The report pool against the path a notification takes through NimBLE:
+// ble_att_clt_tx_notify chains the report behind a new msys mbuf holding the
+// ATT header, and the transport frees the whole chain once the controller
+// has the packet. The pool and mbuf calls below follow NimBLE's
+// os_mempool.c and os_mbuf.c.
+
+// NimBLE memory pools.
+os_error_t os_mempool_init(struct os_mempool* mp, uint16_t blocks,
+                           uint32_t block_size, void* membuf,
+                           const char* name) {
+  uint32_t true_size = OS_MEM_TRUE_BLOCK_SIZE(block_size);
+  *mp = (struct os_mempool){
+      .mp_block_size = block_size,
+      .mp_num_blocks = blocks,
+      .mp_num_free = blocks,
+      .mp_membuf_addr = (uintptr_t)membuf,
+  };
+  struct os_memblock** tail = &mp->mp_head;
+  for (uint16_t i = 0; i < blocks; i++) {
+    struct os_memblock* block =
+        (struct os_memblock*)((uint8_t*)membuf + i * true_size);
+    *tail = block;
+    tail = &block->mb_next;
+  }
+  *tail = NULL;
+  return OS_OK;
+}
+os_error_t os_mempool_ext_init(struct os_mempool_ext* mpe, uint16_t blocks,
+                               uint32_t block_size, void* membuf,
+                               const char* name) {
+  os_error_t rc =
+      os_mempool_init(&mpe->mpe_mp, blocks, block_size, membuf, name);
+  mpe->mpe_mp.mp_flags = OS_MEMPOOL_F_EXT;
+  mpe->mpe_put_cb = NULL;
+  mpe->mpe_put_arg = NULL;
+  return rc;
+}
+void* os_memblock_get(struct os_mempool* mp) {
+  struct os_memblock* block = mp->mp_head;
+  if (block != NULL) {
+    mp->mp_head = block->mb_next;
+    mp->mp_num_free--;
+  }
+  return block;
+}
+os_error_t os_memblock_put_from_cb(struct os_mempool* mp, void* block_addr) {
+  uintptr_t addr = (uintptr_t)block_addr;
+  uint32_t true_size = OS_MEM_TRUE_BLOCK_SIZE(mp->mp_block_size);
+  CHECK(addr >= mp->mp_membuf_addr &&
+        addr < mp->mp_membuf_addr + mp->mp_num_blocks * true_size);
+  CHECK_EQ((addr - mp->mp_membuf_addr) % true_size, 0);
+  CHECK(mp->mp_num_free < mp->mp_num_blocks);
+
+  struct os_memblock* block = block_addr;
+  block->mb_next = mp->mp_head;
+  mp->mp_head = block;
+  mp->mp_num_free++;
+  return OS_OK;
+}
+os_error_t os_memblock_put(struct os_mempool* mp, void* block_addr) {
+  if (mp->mp_flags & OS_MEMPOOL_F_EXT) {
+    struct os_mempool_ext* mpe = (struct os_mempool_ext*)mp;
+    if (mpe->mpe_put_cb != NULL) {
+      return mpe->mpe_put_cb(mpe, block_addr, mpe->mpe_put_arg);
+    }
+  }
+  return os_memblock_put_from_cb(mp, block_addr);
+}
+
+// NimBLE mbufs.
+int os_mbuf_pool_init(struct os_mbuf_pool* omp, struct os_mempool* mp,
+                      uint16_t buf_len, uint16_t nbufs) {
+  omp->omp_databuf_len = buf_len - sizeof(struct os_mbuf);
+  omp->omp_pool = mp;
+  return 0;
+}
+struct os_mbuf* os_mbuf_get(struct os_mbuf_pool* omp, uint16_t leadingspace) {
+  if (leadingspace > omp->omp_databuf_len) {
+    return NULL;
+  }
+  struct os_mbuf* om = os_memblock_get(omp->omp_pool);
+  if (om != NULL) {
+    om->om_next = NULL;
+    om->om_flags = 0;
+    om->om_pkthdr_len = 0;
+    om->om_len = 0;
+    om->om_data = &om->om_databuf[leadingspace];
+    om->om_omp = omp;
+  }
+  return om;
+}
+struct os_mbuf* os_mbuf_get_pkthdr(struct os_mbuf_pool* omp,
+                                   uint8_t pkthdr_len) {
+  uint16_t total = pkthdr_len + sizeof(struct os_mbuf_pkthdr);
+  if (total > UINT8_MAX) {
+    return NULL;
+  }
+  struct os_mbuf* om = os_mbuf_get(omp, 0);
+  if (om != NULL) {
+    om->om_pkthdr_len = (uint8_t)total;
+    om->om_data += total;
+    OS_MBUF_PKTHDR(om)->omp_len = 0;
+    OS_MBUF_PKTHDR(om)->omp_flags = 0;
+  }
+  return om;
+}
+void os_mbuf_concat(struct os_mbuf* first, struct os_mbuf* second) {
+  struct os_mbuf* cur = first;
+  while (cur->om_next != NULL) {
+    cur = cur->om_next;
+  }
+  cur->om_next = second;
+
+  if (OS_MBUF_IS_PKTHDR(first)) {
+    if (OS_MBUF_IS_PKTHDR(second)) {
+      OS_MBUF_PKTLEN(first) += OS_MBUF_PKTLEN(second);
+    } else {
+      for (cur = second; cur != NULL; cur = cur->om_next) {
+        OS_MBUF_PKTLEN(first) += cur->om_len;
+      }
+    }
+  }
+  second->om_pkthdr_len = 0;
+}
+int os_mbuf_free(struct os_mbuf* om) {
+  if (om->om_omp != NULL) {
+    return os_memblock_put(om->om_omp->omp_pool, om);
+  }
+  return 0;
+}
+int os_mbuf_free_chain(struct os_mbuf* om) {
+  while (om != NULL) {
+    struct os_mbuf* next = om->om_next;
+    int rc = os_mbuf_free(om);
+    if (rc != 0) {
+      return rc;
+    }
+    om = next;
+  }
+  return 0;
+}
+
+// The msys pool the ATT header comes from.
+#define MSYS_COUNT 12
+#define MSYS_BLOCK_SIZE 292
+
+static os_membuf_t msys_mem[OS_MEMPOOL_SIZE(MSYS_COUNT, MSYS_BLOCK_SIZE)];
+static struct os_mempool msys_mempool;
+static struct os_mbuf_pool msys_pool;
+
+#define BLE_ATT_OP_NOTIFY_REQ 0x1b
+
+// As ble_att_clt_tx_notify: a new msys packet holds the opcode and handle,
+// and the report is concatenated behind it.
+static struct os_mbuf* att_tx_notify(uint16_t handle, struct os_mbuf* txom) {
+  struct os_mbuf* om = os_mbuf_get_pkthdr(&msys_pool, 0);
+  CHECK(om != NULL);
+  om->om_data[0] = BLE_ATT_OP_NOTIFY_REQ;
+  om->om_data[1] = (uint8_t)handle;
+  om->om_data[2] = (uint8_t)(handle >> 8);
+  om->om_len = 3;
+  OS_MBUF_PKTLEN(om) = 3;
+  os_mbuf_concat(om, txom);
+  return om;
+}
+
+static ble_hid_mbuf_stamp_t freed[BLE_HID_MBUF_COUNT * 4];
+static size_t num_freed;
+
+static void on_free(const ble_hid_mbuf_stamp_t* stamp) {
+  CHECK(stamp != NULL);
+  CHECK(num_freed < sizeof(freed) / sizeof(freed[0]));
+  freed[num_freed++] = *stamp;
+}
+
+static void setup(void) {
+  CHECK_EQ(os_mempool_init(&msys_mempool, MSYS_COUNT, MSYS_BLOCK_SIZE,
+                           msys_mem, "msys"),
+           0);
+  CHECK_EQ(os_mbuf_pool_init(&msys_pool, &msys_mempool, MSYS_BLOCK_SIZE,
+                             MSYS_COUNT),
+           0);
+  CHECK_EQ(ble_hid_mbuf_init(on_free), 0);
+}
+
+// Every report sent through the notify path comes back with its own stamp,
+// whatever order the transport frees the chains in.
+static void test_stamps_survive_concat(void) {
+  static const uint8_t report[] = {0x01, 0x00, 0x04, 0x00, 0x00,
+                                   0x00, 0x00, 0x00, 0x00};
+  struct os_mbuf* chains[BLE_HID_MBUF_COUNT];
+  num_freed = 0;
+  for (uint32_t i = 0; i < BLE_HID_MBUF_COUNT; i++) {
+    ble_hid_mbuf_stamp_t stamp = {1000 + i, 2000 + i};
+    struct os_mbuf* om = ble_hid_mbuf_get(report, sizeof(report), &stamp);
+    CHECK(om != NULL);
+    CHECK_EQ(OS_MBUF_PKTLEN(om), sizeof(report));
+    CHECK(memcmp(om->om_data, report, sizeof(report)) == 0);
+    chains[i] = att_tx_notify(0x0010 + i, om);
+    CHECK_EQ(OS_MBUF_PKTLEN(chains[i]), 3 + sizeof(report));
+    // The concat clears the report's packet header.
+    CHECK_EQ(om->om_pkthdr_len, 0);
+  }
+
+  // The pool bounds what's in flight.
+  ble_hid_mbuf_stamp_t none = {0, 0};
+  CHECK(ble_hid_mbuf_get(report, sizeof(report), &none) == NULL);
+
+  // Odd chains first, then even ones; each frees its msys block too.
+  for (uint32_t pass = 0; pass < 2; pass++) {
+    for (uint32_t i = 1 - pass; i < BLE_HID_MBUF_COUNT; i += 2) {
+      uint16_t msys_free = msys_mempool.mp_num_free;
+      size_t before = num_freed;
+      CHECK_EQ(os_mbuf_free_chain(chains[i]), 0);
+      CHECK_EQ(msys_mempool.mp_num_free, msys_free + 1);
+      CHECK_EQ(num_freed, before + 1);
+      CHECK_EQ(freed[before].enqueued_us, 1000 + i);
+      CHECK_EQ(freed[before].handoff_us, 2000 + i);
+    }
+  }
+  CHECK_EQ(msys_mempool.mp_num_free, MSYS_COUNT);
+
+  // Every block is back.
+  for (uint32_t i = 0; i < BLE_HID_MBUF_COUNT; i++) {
+    chains[i] = ble_hid_mbuf_get(report, sizeof(report), &none);
+    CHECK(chains[i] != NULL);
+  }
+  for (uint32_t i = 0; i < BLE_HID_MBUF_COUNT; i++) {
+    CHECK_EQ(os_mbuf_free_chain(chains[i]), 0);
+  }
+}
+
+// A recycled block carries the stamp it was last handed out with.
+static void test_reuse_restamps(void) {
+  static const uint8_t report[] = {0x03, 0xE9, 0x00};
+  num_freed = 0;
+  for (uint32_t i = 0; i < 3 * BLE_HID_MBUF_COUNT; i++) {
+    ble_hid_mbuf_stamp_t stamp = {i, ~i};
+    struct os_mbuf* om = ble_hid_mbuf_get(report, sizeof(report), &stamp);
+    CHECK(om != NULL);
+    CHECK_EQ(os_mbuf_free_chain(att_tx_notify(0x0020, om)), 0);
+    CHECK_EQ(num_freed, i + 1);
+    CHECK_EQ(freed[i].enqueued_us, i);
+    CHECK_EQ(freed[i].handoff_us, ~i);
+  }
+}
+
+int main(void) {
+  setup();
+  RUN(test_stamps_survive_concat);
+  RUN(test_reuse_restamps);
+  return 0;
+}
@@ -0,0 +1,319 @@
+#include <string.h>
+
+#include "ble_hid.h"
+#include "ble_hid_report_queue.h"
+#include "ble_hid_sched.h"
+#include "ble_hid_state.h"
+#include "ble_keyboard.h"
+#include "host/ble_hs.h"
+#include "test_util.h"
+
+// Runs ble_keyboard_type against the firmware's queue and scheduler on a
+// simulated connection-event clock. Every event refills the budget and
+// drains the queue the way the host task does; reports that go out are
+// applied to a model of the host, which turns key-down edges back into text.
+
+#define EVENT_US 7500
+
+static ble_hid_report_queue_t queue;
+static ble_hid_sched_t sched;
+static bool nkro;
+static uint64_t now_us;
+static int events;
+static int sent;
+static int collapsed;
+
+static uint8_t route_flags(uint8_t report_id) {
+  switch (report_id) {
+    case BLE_HID_DEFAULT_REPORT_ID:
+    case BLE_HID_NKRO_REPORT_ID:
+      return BLE_HID_SCHED_STATE | BLE_HID_SCHED_KEYS;
+    case BLE_HID_CONSUMER_REPORT_ID:
+    case BLE_HID_SYSTEM_REPORT_ID:
+      return BLE_HID_SCHED_STATE;
+    default:
+      return 0;
+  }
+}
+
+// Host model: the keys it holds, and the text their key-down edges type.
+static ble_keyboard_state_t host_keys;
+static char typed[4096];
+static size_t typed_len;
+
+// Reverse of the US layout for printable ASCII.
+static char keymap[BLE_KEYBOARD_NKRO_KEYS][2];
+
+static void keymap_init(void) {
+  memset(keymap, 0, sizeof(keymap));
+  for (uint32_t c = 0x20; c < 0x7f; c++) {
+    ble_keyboard_key_t key;
+    CHECK(ble_keyboard_lookup(BLE_KEYBOARD_LAYOUT_US, c, &key));
+    bool shift = (key.modifier & BLE_KEYBOARD_MOD_LSHIFT) != 0;
+    keymap[key.keycode][shift] = (char)c;
+  }
+}
+
+static void host_receive(const ble_hid_queued_report_t* report) {
+  ble_keyboard_state_t next = {0};
+  if (report->report_id == BLE_HID_NKRO_REPORT_ID) {
+    const ble_keyboard_nkro_report_t* r = (const void*)report->data;
+    memcpy(next.keys, r->keys, sizeof(r->keys));
+    next.modifier = r->modifier;
+  } else {
+    CHECK_EQ(report->report_id, BLE_HID_DEFAULT_REPORT_ID);
+    const ble_keyboard_report_t* r = (const void*)report->data;
+    for (size_t i = 0; i < sizeof(r->keycode); i++) {
+      CHECK(r->keycode[i] != BLE_KEYBOARD_KEY_ERROR_ROLLOVER);
+      if (r->keycode[i] != 0) {
+        ble_keyboard_state_press(&next, r->keycode[i]);
+      }
+    }
+    next.modifier = r->modifier;
+  }
+
+  // Hosts apply a report's modifiers before its keys.
+  bool shift = (next.modifier & (BLE_KEYBOARD_MOD_LSHIFT |
+                                 BLE_KEYBOARD_MOD_RSHIFT)) != 0;
+  for (uint32_t key = 0; key < BLE_KEYBOARD_NKRO_KEYS; key++) {
+    uint32_t bit = 1u << (key % 32);
+    if ((next.keys[key / 32] & bit) && !(host_keys.keys[key / 32] & bit)) {
+      char c = keymap[key][shift];
+      CHECK(c != 0);
+      CHECK(typed_len < sizeof(typed));
+      typed[typed_len++] = c;
+    }
+  }
+  host_keys = next;
+}
+
+static int sim_sink(const ble_hid_queued_report_t* report, void* arg) {
+  uint8_t flags = route_flags(report->report_id);
+  if (ble_hid_sched_redundant(&sched, &queue, report, flags)) {
+    collapsed++;
+    return 0;
+  }
+  if (ble_hid_sched_exhausted(&sched)) {
+    return BLE_HS_EAGAIN;
+  }
+  ble_hid_sched_sent(&sched, report, flags);
+  host_receive(report);
+  sent++;
+  return 0;
+}
+
+// One connection event: the interval clock ticks and the queue drains.
+static void sim_event(void) {
+  now_us += EVENT_US;
+  events++;
+  ble_hid_sched_refill(&sched);
+  ble_hid_report_queue_drain(&queue, BLE_HID_REPORT_QUEUE_LEN, sim_sink,
+                             NULL);
+}
+
+static void sim_reset(bool use_nkro) {
+  ble_hid_report_queue_init(&queue);
+  ble_hid_sched_init(&sched);
+  memset(&host_keys, 0, sizeof(host_keys));
+  typed_len = 0;
+  nkro = use_nkro;
+  now_us = 0;
+  events = 0;
+  sent = 0;
+  collapsed = 0;
+}
+
+// What ble_keyboard_type reaches in ble_hid.
+bool ble_hid_nkro_enabled(void) { return nkro; }
+
+int ble_hid_send_report(uint8_t report_id, const uint8_t* data, size_t length) {
+  return ble_hid_report_queue_push(&queue, report_id, data, length,
+                                   (uint32_t)now_us)
+             ? 0
+             : BLE_HS_EAGAIN;
+}
+
+// The producer blocks until a drain made room: the next connection event.
+void ble_hid_wait_for_space(void) { sim_event(); }
+
+uint32_t ble_hid_state_get(void) { return 0; }
+
+static const char text[] =
+    "The quick brown fox jumps over the lazy dog. Pack my box with five "
+    "dozen liquor jugs! Sphinx of black quartz, judge my vow? 1234567890 "
+    "-=[]\\;',./ ~!@#$%^&*()_+{}|:\"<>? Aardvarks eat 33 ooze-filled "
+    "apples in Mississippi; bookkeeper committee, HELLO world, MiXeD CaSe.";
+
+static void type_and_flush(bool use_nkro) {
+  sim_reset(use_nkro);
+  keymap_init();
+  CHECK_EQ(ble_keyboard_type(BLE_KEYBOARD_LAYOUT_US, text), 0);
+  while (ble_hid_report_queue_count(&queue) > 0) {
+    sim_event();
+  }
+
+  // Exactly the text, nothing dropped or repeated, and nothing left held.
+  CHECK_EQ(typed_len, strlen(text));
+  CHECK(memcmp(typed, text, typed_len) == 0);
+  ble_keyboard_state_t released = {0};
+  CHECK(ble_keyboard_state_equal(&host_keys, &released));
+  CHECK(ble_hid_sched_released(&sched, use_nkro ? BLE_HID_NKRO_REPORT_ID
+                                                : BLE_HID_DEFAULT_REPORT_ID,
+                               use_nkro ? sizeof(ble_keyboard_nkro_report_t)
+                                        : sizeof(ble_keyboard_report_t)));
+
+  // Never more than the budget per connection event.
+  CHECK(sent <= events * BLE_HID_SCHED_TX_PER_EVENT);
+  double seconds = events * EVENT_US / 1e6;
+  double cps = typed_len / seconds;
+  printf("%s at 7.5 ms: %zu chars, %d events, %d reports sent, %d "
+         "collapsed, %.0f chars/s, %.2f reports/char\n",
+         use_nkro ? "nkro" : "6kro", typed_len, events, sent, collapsed, cps,
+         (double)sent / typed_len);
+  CHECK(cps >= 100);
+}
+
+static void test_typing_boot(void) { type_and_flush(false); }
+static void test_typing_nkro(void) { type_and_flush(true); }
+
+static void push_keys(uint8_t modifier, uint8_t key) {
+  ble_keyboard_report_t report = {.modifier = modifier};
+  report.keycode[0] = key;
+  CHECK(ble_hid_report_queue_push(&queue, BLE_HID_DEFAULT_REPORT_ID,
+                                  (const uint8_t*)&report, sizeof(report),
+                                  0));
+}
+
+// Drains without a budget limit and returns how many reports went out.
+static int drain_all(void) {
+  int before = sent;
+  ble_hid_sched_refill(&sched);
+  sched.tx_budget = BLE_HID_REPORT_QUEUE_LEN;
+  ble_hid_report_queue_drain(&queue, BLE_HID_REPORT_QUEUE_LEN, sim_sink,
+                             NULL);
+  return sent - before;
+}
+
+// Which intermediate states may go: a release between two different keys,
+// never one between two presses of the same key, and never a press whose
+// order against the next one matters.
+static void test_collapse_rules(void) {
+  sim_reset(false);
+  keymap_init();
+  push_keys(0, 0x04);  // a
+  push_keys(0, 0);
+  push_keys(0, 0x05);  // b: the release in between is dropped
+  push_keys(0, 0);
+  push_keys(0, 0x05);  // b again: the release stays
+  push_keys(0, 0);
+  CHECK_EQ(drain_all(), 5);
+  CHECK_EQ(collapsed, 1);
+  CHECK_EQ(typed_len, 3);
+  CHECK(memcmp(typed, "abb", 3) == 0);
+
+  // A report equal to what the host holds is a no-op.
+  push_keys(0, 0);
+  CHECK_EQ(drain_all(), 0);
+
+  // Shift going up and down again between presses is kept.
+  push_keys(BLE_KEYBOARD_MOD_LSHIFT, 0x04);  // A
+  push_keys(0, 0);
+  push_keys(BLE_KEYBOARD_MOD_LSHIFT, 0x05);  // B
+  push_keys(0, 0);
+  CHECK_EQ(drain_all(), 4);
+  CHECK_EQ(collapsed, 2);
+  CHECK(memcmp(typed, "abbAB", 5) == 0);
+
+  // A press followed by a second key on top: dropping the first would make
+  // the host see both go down at once, in its own order.
+  push_keys(0, 0x06);  // c
+  ble_keyboard_report_t both = {0};
+  both.keycode[0] = 0x06;
+  both.keycode[1] = 0x07;  // d
+  CHECK(ble_hid_report_queue_push(&queue, BLE_HID_DEFAULT_REPORT_ID,
+                                  (const uint8_t*)&both, sizeof(both), 0));
+  CHECK_EQ(drain_all(), 2);
+  CHECK_EQ(typed_len, 7);
+  CHECK(memcmp(typed, "abbABcd", 7) == 0);
+}
+
+// Mouse motion is relative: identical reports are all sent.
+static void test_relative_never_collapsed(void) {
+  sim_reset(false);
+  const uint8_t motion[sizeof(ble_mouse_report_t)] = {0, 1, 1};
+  for (int i = 0; i < 3; i++) {
+    CHECK(ble_hid_report_queue_push(&queue, BLE_HID_MOUSE_REPORT_ID, motion,
+                                    sizeof(motion), 0));
+  }
+  int taken = 0;
+  const ble_hid_queued_report_t* report;
+  while ((report = ble_hid_report_queue_peek(&queue)) != NULL) {
+    CHECK(!ble_hid_sched_redundant(&sched, &queue, report,
+                                   route_flags(report->report_id)));
+    ble_hid_sched_sent(&sched, report, route_flags(report->report_id));
+    ble_hid_report_queue_pop(&queue);
+    taken++;
+  }
+  CHECK_EQ(taken, 3);
+}
+
+// The budget runs out after BLE_HID_SCHED_TX_PER_EVENT sends and comes back
+// with the next interval; forgetting resets the host state, not the budget.
+static void test_budget(void) {
+  sim_reset(false);
+  const ble_hid_queued_report_t report = {
+      .report_id = BLE_HID_MOUSE_REPORT_ID,
+      .length = sizeof(ble_mouse_report_t)};
+  for (int i = 0; i < BLE_HID_SCHED_TX_PER_EVENT; i++) {
+    CHECK(!ble_hid_sched_exhausted(&sched));
+    ble_hid_sched_sent(&sched, &report, 0);
+  }
+  CHECK(ble_hid_sched_exhausted(&sched));
+  ble_hid_sched_forget(&sched);
+  CHECK(ble_hid_sched_exhausted(&sched));
+  ble_hid_sched_refill(&sched);
+  CHECK(!ble_hid_sched_exhausted(&sched));
+
+  const uint8_t volume_up[sizeof(ble_consumer_report_t)] = {0xe9, 0x00};
+  ble_hid_sched_set_state(&sched, BLE_HID_CONSUMER_REPORT_ID, volume_up,
+                          sizeof(volume_up));
+  CHECK(!ble_hid_sched_released(&sched, BLE_HID_CONSUMER_REPORT_ID,
+                                sizeof(volume_up)));
+  ble_hid_sched_forget(&sched);
+  CHECK(ble_hid_sched_released(&sched, BLE_HID_CONSUMER_REPORT_ID,
+                               sizeof(volume_up)));
+}
+
+// Cost of the collapse check on the host task, per queued report.
+static void bench_redundant(void) {
+  const int rounds = 5000000;
+  sim_reset(true);
+  ble_keyboard_nkro_report_t a = {.modifier = BLE_KEYBOARD_MOD_LSHIFT};
+  ble_keyboard_nkro_report_t b = {0};
+  a.keys[0] = 0x10;
+  b.keys[1] = 0x20;
+  CHECK(ble_hid_report_queue_push(&queue, BLE_HID_NKRO_REPORT_ID,
+                                  (const uint8_t*)&a, sizeof(a), 0));
+  CHECK(ble_hid_report_queue_push(&queue, BLE_HID_NKRO_REPORT_ID,
+                                  (const uint8_t*)&b, sizeof(b), 0));
+  const ble_hid_queued_report_t* front = ble_hid_report_queue_peek(&queue);
+  uint8_t flags = route_flags(BLE_HID_NKRO_REPORT_ID);
+  int redundant = 0;
+  double start = test_now_s();
+  for (int i = 0; i < rounds; i++) {
+    redundant += ble_hid_sched_redundant(&sched, &queue, front, flags);
+  }
+  double elapsed = test_now_s() - start;
+  CHECK_EQ(redundant, 0);
+  printf("bench redundant (nkro): %.1f ns\n", elapsed / rounds * 1e9);
+}
+
+int main(void) {
+  RUN(test_typing_boot);
+  RUN(test_typing_nkro);
+  RUN(test_collapse_rules);
+  RUN(test_relative_never_collapsed);
+  RUN(test_budget);
+  bench_redundant();
+  return 0;
+}
@@ -0,0 +1,196 @@
+#include <string.h>
+
+#include "host_slots.h"
+#include "test_util.h"
+
+static host_addr_t host(uint8_t n) {
+  host_addr_t addr = {.type = 1, .val = {n, 0x11, 0x22, 0x33, 0x44, 0xC0}};
+  return addr;
+}
+
+static bool addr_equal(const host_addr_t* a, const host_addr_t* b) {
+  return a->type == b->type && memcmp(a->val, b->val, sizeof(a->val)) == 0;
+}
+
+// Pairs `n` on `conn` into whatever slot the bookkeeping picks and expects
+// nobody to be evicted.
+static uint8_t pair(host_slots_t* slots, uint8_t n, uint16_t conn) {
+  host_addr_t addr = host(n);
+  host_slot_t evicted;
+  uint8_t slot = host_slots_on_encrypted(slots, &addr, conn, &evicted);
+  CHECK(!evicted.bonded);
+  return slot;
+}
+
+static void test_init(void) {
+  host_slots_t slots;
+  memset(&slots, 0xA5, sizeof(slots));
+  host_slots_init(&slots);
+  CHECK_EQ(slots.active, 0);
+  for (uint8_t i = 0; i < HOST_SLOT_COUNT; i++) {
+    CHECK(!slots.slots[i].bonded);
+    CHECK_EQ(slots.slots[i].conn_handle, HOST_SLOT_CONN_NONE);
+  }
+  CHECK(host_slots_pairing(&slots));
+  CHECK_EQ(host_slots_output(&slots), HOST_SLOT_CONN_NONE);
+  host_addr_t addr;
+  CHECK(!host_slots_reconnect_target(&slots, &addr));
+}
+
+static void test_select(void) {
+  host_slots_t slots;
+  host_slots_init(&slots);
+  CHECK_EQ(pair(&slots, 1, 10), 0);
+  CHECK_EQ(host_slots_select(&slots, 0), HOST_SLOTS_STAY);
+  CHECK_EQ(host_slots_select(&slots, HOST_SLOT_COUNT), HOST_SLOTS_STAY);
+  CHECK_EQ(slots.active, 0);
+
+  CHECK_EQ(host_slots_select(&slots, 1), HOST_SLOTS_PAIR);
+  CHECK_EQ(slots.active, 1);
+  CHECK(host_slots_pairing(&slots));
+  CHECK_EQ(pair(&slots, 2, 11), 1);
+
+  // Connected: input moves over at once.
+  CHECK_EQ(host_slots_select(&slots, 0), HOST_SLOTS_SWITCHED);
+  CHECK_EQ(host_slots_output(&slots), 10);
+
+  // Bonded but away: reconnect to it.
+  host_slots_on_disconnect(&slots, 11);
+  CHECK_EQ(host_slots_select(&slots, 1), HOST_SLOTS_RECONNECT);
+  CHECK_EQ(host_slots_output(&slots), HOST_SLOT_CONN_NONE);
+  CHECK(!host_slots_pairing(&slots));
+  host_addr_t addr;
+  host_addr_t expected = host(2);
+  CHECK(host_slots_reconnect_target(&slots, &addr));
+  CHECK(addr_equal(&addr, &expected));
+}
+
+static void test_place_into_empty(void) {
+  host_slots_t slots;
+  host_slots_init(&slots);
+
+  // The selected slot first, when it is empty.
+  CHECK_EQ(host_slots_select(&slots, 2), HOST_SLOTS_PAIR);
+  CHECK_EQ(pair(&slots, 1, 10), 2);
+
+  // Then the first empty one, leaving the selected host in place.
+  CHECK_EQ(pair(&slots, 2, 11), 0);
+  CHECK_EQ(pair(&slots, 3, 12), 1);
+  CHECK_EQ(slots.active, 2);
+  CHECK_EQ(host_slots_output(&slots), 10);
+
+  // A known host comes back to its own slot, even on a new link.
+  host_slots_on_disconnect(&slots, 11);
+  CHECK_EQ(slots.slots[0].conn_handle, HOST_SLOT_CONN_NONE);
+  CHECK(slots.slots[0].bonded);
+  CHECK_EQ(pair(&slots, 2, 21), 0);
+  CHECK_EQ(slots.slots[0].conn_handle, 21);
+  CHECK_EQ(host_slots_output(&slots), 10);
+}
+
+static void test_evict_when_full(void) {
+  host_slots_t slots;
+  host_slots_init(&slots);
+  for (uint8_t i = 0; i < HOST_SLOT_COUNT; i++) {
+    CHECK_EQ(pair(&slots, i + 1, 10 + i), i);
+  }
+
+  // Every slot taken: the selected slot's host makes way.
+  CHECK_EQ(host_slots_select(&slots, 1), HOST_SLOTS_SWITCHED);
+  host_slots_on_disconnect(&slots, 11);
+  host_addr_t addr = host(9);
+  host_slot_t evicted;
+  CHECK_EQ(host_slots_on_encrypted(&slots, &addr, 19, &evicted), 1);
+  host_addr_t old = host(2);
+  CHECK(evicted.bonded);
+  CHECK(addr_equal(&evicted.addr, &old));
+  CHECK(addr_equal(&slots.slots[1].addr, &addr));
+  CHECK_EQ(host_slots_output(&slots), 19);
+
+  // The other slots keep their hosts and links.
+  CHECK_EQ(slots.slots[0].conn_handle, 10);
+  CHECK_EQ(slots.slots[2].conn_handle, 12);
+
+  // The newcomer re-encrypting is not an eviction.
+  CHECK_EQ(pair(&slots, 9, 29), 1);
+}
+
+static void test_evict_away_host(void) {
+  host_slots_t slots;
+  host_slots_init(&slots);
+  for (uint8_t i = 0; i < HOST_SLOT_COUNT; i++) {
+    CHECK_EQ(pair(&slots, i + 1, 10 + i), i);
+  }
+
+  // The selected host is connected: an away one makes way instead.
+  host_slots_on_disconnect(&slots, 12);
+  host_addr_t addr = host(9);
+  host_slot_t evicted;
+  CHECK_EQ(host_slots_on_encrypted(&slots, &addr, 19, &evicted), 2);
+  host_addr_t old = host(3);
+  CHECK(evicted.bonded);
+  CHECK(addr_equal(&evicted.addr, &old));
+  CHECK_EQ(slots.active, 0);
+  CHECK_EQ(host_slots_output(&slots), 10);
+  CHECK_EQ(slots.slots[1].conn_handle, 11);
+}
+
+static void test_refuse_when_all_connected(void) {
+  host_slots_t slots;
+  host_slots_init(&slots);
+  for (uint8_t i = 0; i < HOST_SLOT_COUNT; i++) {
+    CHECK_EQ(pair(&slots, i + 1, 10 + i), i);
+  }
+
+  // No slot to give: the newcomer is turned away and nothing moves.
+  host_addr_t addr = host(9);
+  host_slot_t evicted;
+  CHECK_EQ(host_slots_on_encrypted(&slots, &addr, 19, &evicted),
+           HOST_SLOT_NONE);
+  CHECK(!evicted.bonded);
+  for (uint8_t i = 0; i < HOST_SLOT_COUNT; i++) {
+    host_addr_t kept = host(i + 1);
+    CHECK(slots.slots[i].bonded);
+    CHECK(addr_equal(&slots.slots[i].addr, &kept));
+    CHECK_EQ(slots.slots[i].conn_handle, 10 + i);
+  }
+  CHECK_EQ(host_slots_output(&slots), 10);
+
+  // A known host on a new link still gets its slot.
+  CHECK_EQ(pair(&slots, 2, 21), 1);
+}
+
+static void test_output(void) {
+  host_slots_t slots;
+  host_slots_init(&slots);
+  CHECK_EQ(pair(&slots, 1, 10), 0);
+  CHECK_EQ(pair(&slots, 2, 11), 1);
+
+  // Only the selected slot's link gets input.
+  CHECK_EQ(host_slots_output(&slots), 10);
+  host_slots_on_disconnect(&slots, 11);
+  CHECK_EQ(host_slots_output(&slots), 10);
+  host_slots_on_disconnect(&slots, 10);
+  CHECK_EQ(host_slots_output(&slots), HOST_SLOT_CONN_NONE);
+  host_addr_t addr;
+  host_addr_t expected = host(1);
+  CHECK(host_slots_reconnect_target(&slots, &addr));
+  CHECK(addr_equal(&addr, &expected));
+
+  // An unknown handle changes nothing.
+  CHECK_EQ(pair(&slots, 1, 20), 0);
+  host_slots_on_disconnect(&slots, 99);
+  CHECK_EQ(host_slots_output(&slots), 20);
+  CHECK(!host_slots_reconnect_target(&slots, &addr));
+}
+
+int main(void) {
+  RUN(test_init);
+  RUN(test_select);
+  RUN(test_place_into_empty);
+  RUN(test_evict_when_full);
+  RUN(test_evict_away_host);
+  RUN(test_refuse_when_all_connected);
+  RUN(test_output);
+  return 0;
+}
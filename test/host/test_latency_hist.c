@@ -0,0 +1,154 @@
+#include <pthread.h>
+
+#include "latency_hist.h"
+#include "test_util.h"
+
+static latency_hist_t hist;
+
+// Every value maps to a bucket whose upper bound covers it, at most 1/8 above
+// it, and buckets never go backwards as values grow.
+static void test_bucket_bounds(void) {
+  size_t prev = 0;
+  for (uint64_t v = 0; v < (1u << LATENCY_HIST_MAX_BITS);
+       v += v < 4096 ? 1 : v / 97) {
+    uint32_t value = (uint32_t)v;
+    size_t bucket = latency_hist_bucket(value);
+    CHECK(bucket < LATENCY_HIST_BUCKETS - 1);
+    CHECK(bucket >= prev);
+    prev = bucket;
+
+    uint32_t upper = latency_hist_bucket_upper(bucket);
+    CHECK(upper >= value);
+    CHECK((uint64_t)(upper - value) * 8 <= value);
+  }
+
+  // The last in-range value fills the top regular bucket.
+  uint32_t top = (1u << LATENCY_HIST_MAX_BITS) - 1;
+  CHECK_EQ(latency_hist_bucket(top), LATENCY_HIST_BUCKETS - 2);
+  CHECK_EQ(latency_hist_bucket_upper(LATENCY_HIST_BUCKETS - 2), top);
+}
+
+// Out-of-range values get the overflow bucket to themselves instead of
+// sharing the top sub-bucket.
+static void test_overflow_bucket(void) {
+  uint32_t top = (1u << LATENCY_HIST_MAX_BITS) - 1;
+  CHECK(latency_hist_bucket(top) != latency_hist_bucket(top + 1));
+  CHECK_EQ(latency_hist_bucket(top + 1), LATENCY_HIST_BUCKETS - 1);
+  CHECK_EQ(latency_hist_bucket(UINT32_MAX), LATENCY_HIST_BUCKETS - 1);
+  CHECK_EQ(latency_hist_bucket_upper(LATENCY_HIST_BUCKETS - 1), UINT32_MAX);
+
+  latency_hist_reset(&hist);
+  latency_hist_record(&hist, top);
+  latency_hist_record(&hist, 40000000);
+  CHECK_EQ(atomic_load(&hist.buckets[LATENCY_HIST_BUCKETS - 2]), 1);
+  CHECK_EQ(atomic_load(&hist.buckets[LATENCY_HIST_BUCKETS - 1]), 1);
+  // Percentiles in the overflow bucket report the largest value seen.
+  CHECK_EQ(latency_hist_percentile(&hist, 1000), 40000000);
+}
+
+static void test_percentiles(void) {
+  latency_hist_reset(&hist);
+  CHECK_EQ(latency_hist_percentile(&hist, 500), 0);
+
+  for (uint32_t v = 1; v <= 1000; v++) {
+    latency_hist_record(&hist, v);
+  }
+
+  latency_hist_summary_t summary;
+  latency_hist_summarize(&hist, &summary);
+  CHECK_EQ(summary.count, 1000);
+  CHECK_EQ(summary.max, 1000);
+  // Reported as the bucket's upper bound: never below the true value, at most
+  // 1/8 above it.
+  CHECK(summary.p50 >= 500 && summary.p50 <= 500 + 500 / 8);
+  CHECK(summary.p90 >= 900 && summary.p90 <= 900 + 900 / 8);
+  CHECK(summary.p99 >= 990 && summary.p99 <= 1000);
+  CHECK_EQ(latency_hist_percentile(&hist, 0), 1);
+}
+
+// A bucket's upper bound is clamped to the largest value actually recorded.
+static void test_max_clamp(void) {
+  latency_hist_reset(&hist);
+  latency_hist_record(&hist, 7500);
+  CHECK(latency_hist_bucket_upper(latency_hist_bucket(7500)) > 7500);
+  CHECK_EQ(latency_hist_percentile(&hist, 500), 7500);
+  CHECK_EQ(latency_hist_percentile(&hist, 1000), 7500);
+}
+
+static void test_reset(void) {
+  latency_hist_reset(&hist);
+  latency_hist_record(&hist, 3);
+  latency_hist_record(&hist, 300000000);
+  latency_hist_reset(&hist);
+
+  latency_hist_summary_t summary;
+  latency_hist_summarize(&hist, &summary);
+  CHECK_EQ(summary.count, 0);
+  CHECK_EQ(summary.max, 0);
+  CHECK_EQ(summary.p99, 0);
+}
+
+#define RECORDERS 4
+#define RECORDS_PER_THREAD 200000
+
+static void* recorder(void* arg) {
+  uint32_t base = (uint32_t)(uintptr_t)arg;
+  for (uint32_t i = 0; i < RECORDS_PER_THREAD; i++) {
+    latency_hist_record(&hist, base + i % 1000);
+  }
+  return NULL;
+}
+
+// Concurrent recorders lose no counts and agree on the max.
+static void test_concurrent_record(void) {
+  latency_hist_reset(&hist);
+  pthread_t threads[RECORDERS];
+  for (uintptr_t t = 0; t < RECORDERS; t++) {
+    CHECK(pthread_create(&threads[t], NULL, recorder,
+                         (void*)(t * 1000)) == 0);
+  }
+  for (int t = 0; t < RECORDERS; t++) {
+    pthread_join(threads[t], NULL);
+  }
+
+  uint64_t total = 0;
+  for (size_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+    total += atomic_load(&hist.buckets[i]);
+  }
+  CHECK_EQ(total, RECORDERS * RECORDS_PER_THREAD);
+  CHECK_EQ(atomic_load(&hist.count), RECORDERS * RECORDS_PER_THREAD);
+  CHECK_EQ(atomic_load(&hist.max), (RECORDERS - 1) * 1000 + 999);
+}
+
+// Cost of one record on the hot path, over a spread of latencies.
+static void bench_record(void) {
+  const uint32_t rounds = 20000000;
+  latency_hist_reset(&hist);
+  double start = test_now_s();
+  for (uint32_t i = 0; i < rounds; i++) {
+    latency_hist_record(&hist, (i * 2654435761u) >> 12);
+  }
+  double elapsed = test_now_s() - start;
+  CHECK_EQ(atomic_load(&hist.count), rounds);
+  printf("bench record: %.1f ns\n", elapsed / rounds * 1e9);
+
+  start = test_now_s();
+  uint32_t sink = 0;
+  for (uint32_t i = 0; i < 10000; i++) {
+    sink += latency_hist_percentile(&hist, 990);
+  }
+  elapsed = test_now_s() - start;
+  CHECK(sink > 0);
+  printf("bench percentile: %.1f ns\n", elapsed / 10000 * 1e9);
+}
+
+int main(void) {
+  RUN(test_bucket_bounds);
+  RUN(test_overflow_bucket);
+  RUN(test_percentiles);
+  RUN(test_max_clamp);
+  RUN(test_reset);
+  RUN(test_concurrent_record);
+  bench_record();
+  return 0;
+}
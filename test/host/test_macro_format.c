@@ -0,0 +1,303 @@
+#include <string.h>
+
+#include "ble_keyboard.h"
+#include "macro_format.h"
+#include "test_util.h"
+
+// macro_format only needs ble_keyboard's state helpers; the send path is
+// never reached.
+bool ble_hid_nkro_enabled(void) { return false; }
+int ble_hid_send_report(uint8_t report_id, const uint8_t* data,
+                        size_t length) {
+  CHECK(false);
+  return 0;
+}
+void ble_hid_wait_for_space(void) {}
+uint32_t ble_hid_state_get(void) { return 0; }
+
+#define KEY_A 0x04
+#define KEY_B 0x05
+#define KEY_C 0x06
+
+static bool key_down(const ble_keyboard_state_t* state, uint8_t usage) {
+  return (state->keys[usage / 32] >> (usage % 32)) & 1;
+}
+
+static void expect_report(macro_player_t* player, uint8_t modifier,
+                          const uint8_t* down, size_t count) {
+  CHECK_EQ(macro_player_next(player), MACRO_STEP_REPORT);
+  CHECK_EQ(player->state.modifier, modifier);
+  ble_keyboard_state_t expected;
+  ble_keyboard_state_clear(&expected);
+  expected.modifier = modifier;
+  for (size_t i = 0; i < count; i++) {
+    ble_keyboard_state_press(&expected, down[i]);
+  }
+  CHECK(ble_keyboard_state_equal(&player->state, &expected));
+}
+
+static void expect_delay(macro_player_t* player, uint32_t ms) {
+  CHECK_EQ(macro_player_next(player), MACRO_STEP_DELAY);
+  CHECK_EQ(player->delay_ms, ms);
+}
+
+// Everything the encoder writes comes back out of the player, byte for byte
+// in the expected opcodes.
+static void test_round_trip(void) {
+  uint8_t buf[64];
+  macro_encoder_t enc;
+  macro_encoder_init(&enc, buf, sizeof(buf));
+  const uint8_t chord[] = {KEY_B, KEY_C};
+  CHECK(macro_encode_toggle(&enc, KEY_A));
+  CHECK(macro_encode_toggle(&enc, KEY_A));
+  CHECK(macro_encode_mods(&enc, BLE_KEYBOARD_MOD_LSHIFT, false));
+  CHECK(macro_encode_chord(&enc, chord, 2));
+  CHECK(macro_encode_mods(&enc, 0, true));
+  CHECK(macro_encode_chord(&enc, chord, 2));
+  CHECK(macro_encode_delay(&enc, 50));
+  CHECK(macro_encode_delay(&enc, 310));
+  CHECK(macro_encode_delay(&enc, 320));
+  CHECK(macro_encode_delay(&enc, 70000));
+  CHECK(macro_encode_end(&enc));
+  CHECK(!enc.overflow);
+
+  const uint8_t golden[] = {
+      KEY_A, KEY_A,  // press, release
+      MACRO_OP_MODS, BLE_KEYBOARD_MOD_LSHIFT,
+      MACRO_OP_CHORD | 1, KEY_B, KEY_C,
+      MACRO_OP_MODS_SEND, 0,
+      MACRO_OP_CHORD | 1, KEY_B, KEY_C,
+      MACRO_OP_SHORT_DELAY | 5,
+      MACRO_OP_SHORT_DELAY | 31,
+      MACRO_OP_DELAY, 0x40, 0x01,  // 320 ms is past the short form
+      MACRO_OP_DELAY, 0xFF, 0xFF,  // 70000 ms takes two
+      MACRO_OP_DELAY, 0x71, 0x11,
+      MACRO_OP_END,
+  };
+  CHECK_EQ(enc.len, sizeof(golden));
+  CHECK(memcmp(buf, golden, sizeof(golden)) == 0);
+
+  macro_player_t player;
+  macro_player_init(&player, buf, enc.len);
+  const uint8_t a[] = {KEY_A};
+  expect_report(&player, 0, a, 1);
+  expect_report(&player, 0, NULL, 0);
+  expect_report(&player, BLE_KEYBOARD_MOD_LSHIFT, chord, 2);
+  expect_report(&player, 0, chord, 2);
+  expect_report(&player, 0, NULL, 0);
+  expect_delay(&player, 50);
+  expect_delay(&player, 310);
+  expect_delay(&player, 320);
+  expect_delay(&player, 65535);
+  expect_delay(&player, 70000 - 65535);
+  CHECK_EQ(macro_player_next(&player), MACRO_STEP_END);
+  CHECK(player.pos == buf + enc.len);
+}
+
+// The largest chord toggles every key it names in one report.
+static void test_full_chord(void) {
+  uint8_t usages[MACRO_OP_CHORD_MAX_KEYS];
+  for (size_t i = 0; i < sizeof(usages); i++) {
+    usages[i] = (uint8_t)(KEY_A + i);
+  }
+  uint8_t buf[40];
+  macro_encoder_t enc;
+  macro_encoder_init(&enc, buf, sizeof(buf));
+  CHECK(macro_encode_chord(&enc, usages, sizeof(usages)));
+  CHECK(macro_encode_end(&enc));
+  CHECK_EQ(buf[0], 0x9F);
+
+  macro_player_t player;
+  macro_player_init(&player, buf, enc.len);
+  expect_report(&player, 0, usages, sizeof(usages));
+  CHECK(key_down(&player.state, KEY_A + MACRO_OP_CHORD_MAX_KEYS - 1));
+  CHECK(!key_down(&player.state, KEY_A + MACRO_OP_CHORD_MAX_KEYS));
+  CHECK_EQ(macro_player_next(&player), MACRO_STEP_END);
+}
+
+// Bad arguments are refused without writing; a full buffer sticks.
+static void test_encoder_limits(void) {
+  uint8_t buf[4];
+  macro_encoder_t enc;
+  macro_encoder_init(&enc, buf, sizeof(buf));
+  const uint8_t bad_chord[] = {KEY_A, 0};
+  uint8_t too_many[MACRO_OP_CHORD_MAX_KEYS + 1] = {KEY_A};
+  CHECK(!macro_encode_toggle(&enc, 0));
+  CHECK(!macro_encode_toggle(&enc, MACRO_OP_TOGGLE_MAX + 1));
+  CHECK(!macro_encode_chord(&enc, bad_chord, 0));
+  CHECK(!macro_encode_chord(&enc, bad_chord, 2));
+  CHECK(!macro_encode_chord(&enc, too_many, sizeof(too_many)));
+  CHECK_EQ(enc.len, 0);
+  CHECK(!enc.overflow);
+
+  const uint8_t chord[] = {KEY_A, KEY_B, KEY_C};
+  CHECK(macro_encode_toggle(&enc, KEY_A));
+  CHECK(!macro_encode_chord(&enc, chord, 3));
+  CHECK(enc.overflow);
+  // Room is left for a toggle, but the stream is already incomplete.
+  CHECK(!macro_encode_toggle(&enc, KEY_B));
+  CHECK(!macro_encode_end(&enc));
+  // The chord's opcode went out before its usages overflowed.
+  CHECK(enc.len <= sizeof(buf));
+}
+
+typedef struct test_image {
+  macro_table_header_t header;
+  macro_table_entry_t entries[2];
+  uint8_t streams[8];
+} __attribute__((packed)) test_image_t;
+
+static void make_image(test_image_t* image) {
+  memset(image, 0, sizeof(*image));
+  image->header.magic = MACRO_TABLE_MAGIC;
+  image->header.version = MACRO_TABLE_VERSION;
+  image->header.count = 2;
+  uint32_t base = (uint32_t)offsetof(test_image_t, streams);
+  image->entries[0] = (macro_table_entry_t){.offset = base, .length = 3};
+  image->entries[1] = (macro_table_entry_t){.offset = base + 3, .length = 5};
+  const uint8_t streams[] = {KEY_A, KEY_A, MACRO_OP_END,
+                             KEY_B, KEY_B, KEY_C, KEY_C, MACRO_OP_END};
+  memcpy(image->streams, streams, sizeof(streams));
+}
+
+static bool table_get(const test_image_t* image, size_t size, uint16_t index,
+                      size_t* offset, size_t* length) {
+  const uint8_t* macro;
+  if (!macro_table_get((const uint8_t*)image, size, index, &macro, length)) {
+    return false;
+  }
+  *offset = (size_t)(macro - (const uint8_t*)image);
+  return true;
+}
+
+static void test_table(void) {
+  test_image_t image;
+  make_image(&image);
+  size_t offset, length;
+  CHECK(table_get(&image, sizeof(image), 0, &offset, &length));
+  CHECK_EQ(offset, offsetof(test_image_t, streams));
+  CHECK_EQ(length, 3);
+  CHECK(table_get(&image, sizeof(image), 1, &offset, &length));
+  CHECK_EQ(offset, offsetof(test_image_t, streams) + 3);
+  CHECK_EQ(length, 5);
+  CHECK(!table_get(&image, sizeof(image), 2, &offset, &length));
+
+  // An erased partition reads as all ones.
+  test_image_t erased;
+  memset(&erased, 0xFF, sizeof(erased));
+  CHECK(!table_get(&erased, sizeof(erased), 0, &offset, &length));
+
+  image.header.version = MACRO_TABLE_VERSION + 1;
+  CHECK(!table_get(&image, sizeof(image), 0, &offset, &length));
+  make_image(&image);
+  CHECK(!table_get(&image, sizeof(image.header) - 1, 0, &offset, &length));
+  // The entry table itself runs off the end.
+  CHECK(!table_get(&image, sizeof(image.header) + sizeof(image.entries) - 1,
+                   0, &offset, &length));
+  // A stream running off the end, with and without wrapping.
+  CHECK(!table_get(&image, sizeof(image) - 1, 1, &offset, &length));
+  image.entries[1].length = UINT32_MAX;
+  CHECK(!table_get(&image, sizeof(image), 1, &offset, &length));
+  image.entries[1].offset = UINT32_MAX;
+  image.entries[1].length = 2;
+  CHECK(!table_get(&image, sizeof(image), 1, &offset, &length));
+  // Entry 0 stays readable.
+  CHECK(table_get(&image, sizeof(image), 0, &offset, &length));
+}
+
+static macro_step_t play_to_end(const uint8_t* macro, size_t length,
+                                size_t* steps) {
+  macro_player_t player;
+  macro_player_init(&player, macro, length);
+  *steps = 0;
+  for (;;) {
+    macro_step_t step = macro_player_next(&player);
+    CHECK(player.pos >= macro && player.pos <= macro + length);
+    if (step == MACRO_STEP_END || step == MACRO_STEP_ERROR) {
+      return step;
+    }
+    // Every step consumes at least one byte.
+    CHECK(++*steps <= length);
+  }
+}
+
+#define CHECK_CORRUPT(...)                                               \
+  do {                                                                   \
+    const uint8_t stream[] = {__VA_ARGS__};                              \
+    size_t steps;                                                        \
+    CHECK_EQ(play_to_end(stream, sizeof(stream), &steps),                \
+             MACRO_STEP_ERROR);                                          \
+  } while (0)
+
+static void test_corrupt_streams(void) {
+  size_t steps;
+  CHECK_EQ(play_to_end(NULL, 0, &steps), MACRO_STEP_ERROR);
+  CHECK_CORRUPT(KEY_A);  // no END
+  CHECK_CORRUPT(0x00);
+  CHECK_CORRUPT(MACRO_OP_CHORD | 2, KEY_A, KEY_B);
+  CHECK_CORRUPT(MACRO_OP_CHORD | 1, KEY_A, 0, MACRO_OP_END);
+  CHECK_CORRUPT(MACRO_OP_CHORD, 0x80, MACRO_OP_END);
+  CHECK_CORRUPT(MACRO_OP_MODS);
+  CHECK_CORRUPT(MACRO_OP_MODS_SEND);
+  CHECK_CORRUPT(MACRO_OP_MODS_SEND + 1, MACRO_OP_END);
+  CHECK_CORRUPT(MACRO_OP_SHORT_DELAY, MACRO_OP_END);
+  CHECK_CORRUPT(MACRO_OP_DELAY, 0x10);
+  CHECK_CORRUPT(MACRO_OP_DELAY + 1, MACRO_OP_END);
+  CHECK_CORRUPT(MACRO_OP_END - 1, MACRO_OP_END);
+}
+
+// Random bytes never make the player read outside the stream or loop.
+static void test_random_streams(void) {
+  uint32_t rng = 1;
+  uint8_t stream[64];
+  int ends = 0;
+  for (int round = 0; round < 200000; round++) {
+    size_t length = round % (sizeof(stream) + 1);
+    for (size_t i = 0; i < length; i++) {
+      rng = rng * 1664525u + 1013904223u;
+      stream[i] = (uint8_t)(rng >> 24);
+    }
+    size_t steps;
+    ends += play_to_end(stream, length, &steps) == MACRO_STEP_END;
+  }
+  CHECK(ends > 0);
+}
+
+static void bench_player(void) {
+  // Two bytes per typed character plus a short delay every word.
+  static uint8_t buf[16384];
+  macro_encoder_t enc;
+  macro_encoder_init(&enc, buf, sizeof(buf));
+  uint8_t key = KEY_A;
+  while (enc.len + 4 < sizeof(buf)) {
+    macro_encode_toggle(&enc, key);
+    macro_encode_toggle(&enc, key);
+    if (++key == KEY_A + 6) {
+      key = KEY_A;
+      macro_encode_delay(&enc, 20);
+    }
+  }
+  CHECK(macro_encode_end(&enc));
+
+  const int rounds = 500;
+  size_t steps = 0;
+  double start = test_now_s();
+  for (int i = 0; i < rounds; i++) {
+    size_t round_steps;
+    CHECK_EQ(play_to_end(buf, enc.len, &round_steps), MACRO_STEP_END);
+    steps += round_steps;
+  }
+  double elapsed = test_now_s() - start;
+  printf("bench player step: %.1f ns\n", elapsed / (double)steps * 1e9);
+}
+
+int main(void) {
+  RUN(test_round_trip);
+  RUN(test_full_chord);
+  RUN(test_encoder_limits);
+  RUN(test_table);
+  RUN(test_corrupt_streams);
+  RUN(test_random_streams);
+  bench_player();
+  return 0;
+}
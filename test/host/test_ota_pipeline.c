@@ -0,0 +1,364 @@
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include "file_flash.h"
+#include "ota_pipeline.h"
+#include "test_util.h"
+
+#define FLASH_SIZE (1024 * 1024)
+
+static ota_pipeline_t pipeline;
+static file_flash_t flash;
+static uint8_t image[FLASH_SIZE];
+static uint8_t readback[FLASH_SIZE];
+static uint32_t rng_state;
+
+static uint32_t rng(void) {
+  rng_state = rng_state * 1664525u + 1013904223u;
+  return rng_state >> 8;
+}
+
+static void make_image(uint32_t length, uint32_t seed) {
+  rng_state = seed;
+  for (uint32_t i = 0; i < length; i++) {
+    image[i] = (uint8_t)rng();
+  }
+}
+
+static void sha256(const uint8_t* data, size_t len, uint8_t digest[32]) {
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  CHECK_EQ(mbedtls_sha256_starts(&ctx, 0), 0);
+  mbedtls_sha256_update(&ctx, data, len);
+  mbedtls_sha256_finish(&ctx, digest);
+  mbedtls_sha256_free(&ctx);
+}
+
+static void check_hex(const uint8_t digest[32], const char* hex) {
+  char out[65];
+  for (int i = 0; i < 32; i++) {
+    snprintf(&out[2 * i], 3, "%02x", digest[i]);
+  }
+  if (strcmp(out, hex) != 0) {
+    fprintf(stderr, "digest %s, expected %s\n", out, hex);
+  }
+  CHECK(strcmp(out, hex) == 0);
+}
+
+// The stub stands in for mbedtls, so it has to get the FIPS 180-4 vectors
+// right before the pipeline's digests mean anything.
+static void test_sha256(void) {
+  uint8_t digest[32];
+  sha256((const uint8_t*)"", 0, digest);
+  check_hex(digest,
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  sha256((const uint8_t*)"abc", 3, digest);
+  check_hex(digest,
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  const char* two_blocks =
+      "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  sha256((const uint8_t*)two_blocks, strlen(two_blocks), digest);
+  check_hex(digest,
+            "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+  // A million 'a's, fed in uneven pieces.
+  memset(image, 'a', 1000000);
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts(&ctx, 0);
+  for (size_t done = 0, n = 1; done < 1000000; done += n, n = n * 3 % 997) {
+    if (n > 1000000 - done) {
+      n = 1000000 - done;
+    }
+    mbedtls_sha256_update(&ctx, &image[done], n);
+  }
+  mbedtls_sha256_finish(&ctx, digest);
+  check_hex(digest,
+            "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+// Producer and consumer taking turns on one thread, in an order picked by
+// `seed`: chunks of any size up to the room left, and the consumer running
+// whenever the producer is out of room or by chance.
+static void push_interleaved(uint32_t length, uint32_t seed) {
+  rng_state = seed;
+  uint32_t pushed = 0;
+  while (pushed < length) {
+    size_t room = ota_pipeline_room(&pipeline);
+    if (room == 0 || (ota_pipeline_pending(&pipeline) && rng() % 4 == 0)) {
+      CHECK(ota_pipeline_pending(&pipeline));
+      ota_pipeline_process(&pipeline);
+      continue;
+    }
+
+    size_t n = 1 + rng() % 600;
+    if (n > room) {
+      n = room;
+    }
+    if (n > length - pushed) {
+      n = length - pushed;
+    }
+    CHECK(ota_pipeline_write(&pipeline, &image[pushed], n) >= 0);
+    pushed += n;
+  }
+
+  while (ota_pipeline_flush(&pipeline) < 0) {
+    ota_pipeline_process(&pipeline);
+  }
+  while (ota_pipeline_pending(&pipeline)) {
+    ota_pipeline_process(&pipeline);
+  }
+}
+
+static void check_flash(uint32_t length) {
+  file_flash_read(&flash, 0, readback, length);
+  CHECK(memcmp(readback, image, length) == 0);
+  CHECK_EQ(ota_pipeline_written(&pipeline), length);
+  CHECK_EQ(flash.written_end, length);
+}
+
+static void check_digest(uint32_t length) {
+  uint8_t expected[32];
+  uint8_t digest[32];
+  sha256(image, length, expected);
+  ota_pipeline_finish(&pipeline, digest);
+  CHECK(memcmp(digest, expected, sizeof(digest)) == 0);
+}
+
+// Whatever the interleaving, flash ends up holding the image, written in
+// order onto freshly erased sectors, and the digest covers exactly it.
+static void test_ordered_writes(void) {
+  const uint32_t lengths[] = {
+      1,
+      OTA_PIPELINE_BLOCK_SIZE - 1,
+      OTA_PIPELINE_BLOCK_SIZE,
+      OTA_PIPELINE_BLOCK_SIZE + 1,
+      7 * OTA_PIPELINE_BLOCK_SIZE / 2 + 13,
+      64 * OTA_PIPELINE_BLOCK_SIZE,
+  };
+  file_flash_open(&flash, FLASH_SIZE);
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    for (uint32_t seed = 1; seed <= 5; seed++) {
+      uint32_t length = lengths[i];
+      make_image(length, seed * 100 + (uint32_t)i);
+      file_flash_restart(&flash);
+      flash.erases = flash.writes = 0;
+      ota_pipeline_init(&pipeline, &file_flash_ops, &flash);
+      push_interleaved(length, seed);
+
+      uint32_t blocks =
+          (length + OTA_PIPELINE_BLOCK_SIZE - 1) / OTA_PIPELINE_BLOCK_SIZE;
+      CHECK_EQ(flash.erases, blocks);
+      CHECK_EQ(flash.writes, blocks);
+      CHECK(!ota_pipeline_failed(&pipeline));
+      check_flash(length);
+      check_digest(length);
+    }
+  }
+  file_flash_close(&flash);
+}
+
+// The producer gets room a block at a time, and never more than the free
+// blocks hold.
+static void test_room(void) {
+  file_flash_open(&flash, FLASH_SIZE);
+  make_image(4 * OTA_PIPELINE_BLOCK_SIZE, 1);
+  ota_pipeline_init(&pipeline, &file_flash_ops, &flash);
+
+  CHECK_EQ(ota_pipeline_room(&pipeline),
+           OTA_PIPELINE_BLOCKS * OTA_PIPELINE_BLOCK_SIZE);
+  CHECK_EQ(ota_pipeline_flush(&pipeline), 0);
+  CHECK_EQ(ota_pipeline_write(&pipeline, image, 100), 0);
+  CHECK_EQ(ota_pipeline_write(&pipeline, image + 100,
+                              2 * OTA_PIPELINE_BLOCK_SIZE - 100),
+           2);
+  CHECK_EQ(ota_pipeline_room(&pipeline), 0);
+  CHECK_EQ(ota_pipeline_write(&pipeline, image, 1), -1);
+  CHECK_EQ(ota_pipeline_flush(&pipeline), 0);
+
+  CHECK_EQ(ota_pipeline_process(&pipeline), 0);
+  CHECK_EQ(ota_pipeline_room(&pipeline), OTA_PIPELINE_BLOCK_SIZE);
+  CHECK_EQ(ota_pipeline_write(&pipeline,
+                              image + 2 * OTA_PIPELINE_BLOCK_SIZE, 10),
+           0);
+  // With one block in flight the tail has a buffer to go to.
+  CHECK_EQ(ota_pipeline_flush(&pipeline), 1);
+  CHECK_EQ(ota_pipeline_room(&pipeline), 0);
+  CHECK_EQ(ota_pipeline_write(&pipeline, image, 1), -1);
+  while (ota_pipeline_pending(&pipeline)) {
+    CHECK_EQ(ota_pipeline_process(&pipeline), 0);
+  }
+  check_flash(2 * OTA_PIPELINE_BLOCK_SIZE + 10);
+  check_digest(2 * OTA_PIPELINE_BLOCK_SIZE + 10);
+  file_flash_close(&flash);
+}
+
+static void run_failure(uint32_t fail_erase_at, uint32_t fail_write_at) {
+  const uint32_t length = 6 * OTA_PIPELINE_BLOCK_SIZE;
+  file_flash_open(&flash, FLASH_SIZE);
+  flash.fail_erase_at = fail_erase_at;
+  flash.fail_write_at = fail_write_at;
+  make_image(length, 3);
+  ota_pipeline_init(&pipeline, &file_flash_ops, &flash);
+
+  uint32_t pushed = 0;
+  int failures = 0;
+  while (pushed < length) {
+    if (ota_pipeline_room(&pipeline) == 0) {
+      failures += ota_pipeline_process(&pipeline) != 0;
+      continue;
+    }
+    if (ota_pipeline_write(&pipeline, &image[pushed],
+                           OTA_PIPELINE_BLOCK_SIZE / 2) < 0) {
+      break;
+    }
+    pushed += OTA_PIPELINE_BLOCK_SIZE / 2;
+  }
+  while (ota_pipeline_pending(&pipeline)) {
+    failures += ota_pipeline_process(&pipeline) != 0;
+  }
+
+  // The producer is turned away once it learns of the failure, every block
+  // handed over since fails without touching flash, and nothing past the
+  // failed sector was erased or written.
+  uint32_t failed_at = fail_erase_at < fail_write_at ? fail_erase_at
+                                                      : fail_write_at;
+  CHECK(ota_pipeline_failed(&pipeline));
+  CHECK(pushed < length);
+  CHECK(failures >= 1);
+  CHECK_EQ(ota_pipeline_write(&pipeline, image, 1), -1);
+  CHECK_EQ(ota_pipeline_written(&pipeline), failed_at);
+  CHECK_EQ(flash.written_end, failed_at);
+  CHECK(flash.erased_end <= failed_at + OTA_PIPELINE_BLOCK_SIZE);
+  uint8_t digest[32];
+  ota_pipeline_finish(&pipeline, digest);
+  file_flash_close(&flash);
+}
+
+static void test_flash_failures(void) {
+  run_failure(2 * OTA_PIPELINE_BLOCK_SIZE, UINT32_MAX);
+  run_failure(UINT32_MAX, 3 * OTA_PIPELINE_BLOCK_SIZE);
+  run_failure(0, UINT32_MAX);
+}
+
+// An image abandoned halfway, with blocks in flight and a failure behind
+// it, leaves nothing for the next one: once the consumer has drained, init
+// starts clean and the next digest covers only the new image.
+static void test_abort_restart(void) {
+  file_flash_open(&flash, FLASH_SIZE);
+  make_image(5 * OTA_PIPELINE_BLOCK_SIZE, 4);
+  flash.fail_write_at = OTA_PIPELINE_BLOCK_SIZE;
+  ota_pipeline_init(&pipeline, &file_flash_ops, &flash);
+  CHECK_EQ(ota_pipeline_write(&pipeline, image,
+                              3 * OTA_PIPELINE_BLOCK_SIZE / 2),
+           1);
+  CHECK_EQ(ota_pipeline_process(&pipeline), 0);
+  CHECK_EQ(ota_pipeline_write(&pipeline,
+                              image + 3 * OTA_PIPELINE_BLOCK_SIZE / 2,
+                              OTA_PIPELINE_BLOCK_SIZE),
+           1);
+  // Abandoned: the writer finishes what it was given, then the next BEGIN
+  // starts over.
+  while (ota_pipeline_pending(&pipeline)) {
+    CHECK_EQ(ota_pipeline_process(&pipeline), -1);
+  }
+  CHECK(ota_pipeline_failed(&pipeline));
+
+  const uint32_t length = 3 * OTA_PIPELINE_BLOCK_SIZE + 77;
+  make_image(length, 5);
+  flash.fail_write_at = UINT32_MAX;
+  file_flash_restart(&flash);
+  ota_pipeline_init(&pipeline, &file_flash_ops, &flash);
+  CHECK(!ota_pipeline_failed(&pipeline));
+  CHECK_EQ(ota_pipeline_written(&pipeline), 0);
+  CHECK_EQ(ota_pipeline_room(&pipeline),
+           OTA_PIPELINE_BLOCKS * OTA_PIPELINE_BLOCK_SIZE);
+  push_interleaved(length, 6);
+  check_flash(length);
+  check_digest(length);
+  file_flash_close(&flash);
+}
+
+// The consumer on a thread of its own, as the OTA writer task runs it.
+static atomic_bool consumer_stop;
+
+static void* consumer_main(void* arg) {
+  while (!atomic_load(&consumer_stop) || ota_pipeline_pending(&pipeline)) {
+    if (ota_pipeline_pending(&pipeline)) {
+      CHECK_EQ(ota_pipeline_process(&pipeline), 0);
+    } else {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static double push_threaded(uint32_t length, uint32_t seed) {
+  file_flash_restart(&flash);
+  ota_pipeline_init(&pipeline, &file_flash_ops, &flash);
+  atomic_store(&consumer_stop, false);
+  pthread_t consumer;
+  CHECK_EQ(pthread_create(&consumer, NULL, consumer_main, NULL), 0);
+
+  rng_state = seed;
+  double start = test_now_s();
+  uint32_t pushed = 0;
+  while (pushed < length) {
+    size_t n = 1 + rng() % 512;
+    if (n > length - pushed) {
+      n = length - pushed;
+    }
+    if (ota_pipeline_room(&pipeline) < n) {
+      sched_yield();
+      continue;
+    }
+    CHECK(ota_pipeline_write(&pipeline, &image[pushed], n) >= 0);
+    pushed += n;
+  }
+  while (ota_pipeline_flush(&pipeline) < 0) {
+    sched_yield();
+  }
+  atomic_store(&consumer_stop, true);
+  CHECK_EQ(pthread_join(consumer, NULL), 0);
+  return test_now_s() - start;
+}
+
+static void test_threaded(void) {
+  const uint32_t length = FLASH_SIZE - 1234;
+  file_flash_open(&flash, FLASH_SIZE);
+  for (uint32_t seed = 1; seed <= 3; seed++) {
+    make_image(length, seed);
+    push_threaded(length, seed);
+    check_flash(length);
+    check_digest(length);
+  }
+  file_flash_close(&flash);
+}
+
+static void bench_pipeline(void) {
+  const uint32_t length = FLASH_SIZE;
+  const int rounds = 10;
+  file_flash_open(&flash, FLASH_SIZE);
+  make_image(length, 7);
+  double elapsed = 0;
+  for (int i = 0; i < rounds; i++) {
+    elapsed += push_threaded(length, (uint32_t)i);
+    uint8_t digest[32];
+    ota_pipeline_finish(&pipeline, digest);
+  }
+  file_flash_close(&flash);
+  printf("bench pipeline: %.1f MB/s\n",
+         (double)length * rounds / elapsed / 1e6);
+}
+
+int main(void) {
+  RUN(test_sha256);
+  RUN(test_ordered_writes);
+  RUN(test_room);
+  RUN(test_flash_failures);
+  RUN(test_abort_restart);
+  RUN(test_threaded);
+  bench_pipeline();
+  return 0;
+}
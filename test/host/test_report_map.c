@@ -0,0 +1,157 @@
+#include <string.h>
+
+#include "ble_hid.h"
+#include "ble_hid_data.h"
+#include "ble_hid_report_map.h"
+#include "test_util.h"
+
+// Parses the generated descriptor back with an independent short-item
+// decoder and checks every report against its packed struct.
+#define MAX_REPORTS 16
+
+typedef struct parsed_report {
+  uint8_t id;
+  uint8_t type;
+  uint32_t bits;
+} parsed_report_t;
+
+typedef struct parsed_map {
+  parsed_report_t reports[MAX_REPORTS];
+  size_t num_reports;
+  size_t top_collections;
+} parsed_map_t;
+
+static void add_bits(parsed_map_t* map, uint8_t id, uint8_t type,
+                     uint32_t bits) {
+  for (size_t i = 0; i < map->num_reports; i++) {
+    if (map->reports[i].id == id && map->reports[i].type == type) {
+      map->reports[i].bits += bits;
+      return;
+    }
+  }
+  CHECK(map->num_reports < MAX_REPORTS);
+  map->reports[map->num_reports++] = (parsed_report_t){id, type, bits};
+}
+
+static uint32_t report_bits(const parsed_map_t* map, uint8_t id,
+                            uint8_t type) {
+  for (size_t i = 0; i < map->num_reports; i++) {
+    if (map->reports[i].id == id && map->reports[i].type == type) {
+      return map->reports[i].bits;
+    }
+  }
+  return 0;
+}
+
+static int32_t sign_extend(uint32_t value, size_t length) {
+  if (length == 1) {
+    return (int8_t)value;
+  }
+  if (length == 2) {
+    return (int16_t)value;
+  }
+  return (int32_t)value;
+}
+
+static void parse(const uint8_t* bytes, size_t len, parsed_map_t* map) {
+  memset(map, 0, sizeof(*map));
+  uint32_t report_size = 0;
+  uint32_t report_count = 0;
+  uint8_t report_id = 0;
+  int32_t logical_min = 0;
+  size_t depth = 0;
+
+  size_t pos = 0;
+  while (pos < len) {
+    uint8_t prefix = bytes[pos++];
+    CHECK(prefix != 0xFE);  // long items aren't used
+    size_t length = (size_t[]){0, 1, 2, 4}[prefix & 0x03];
+    CHECK(pos + length <= len);
+    uint32_t data = 0;
+    for (size_t i = 0; i < length; i++) {
+      data |= (uint32_t)bytes[pos + i] << (8 * i);
+    }
+    pos += length;
+
+    uint8_t item = prefix & 0xFC;
+    switch (item) {
+      case 0x74:  // Report Size
+        report_size = data;
+        break;
+      case 0x94:  // Report Count
+        report_count = data;
+        break;
+      case 0x84:  // Report ID
+        CHECK(depth > 0);
+        CHECK(data != 0 && data < BLE_HID_REPORT_ID_COUNT);
+        report_id = (uint8_t)data;
+        break;
+      case 0x14:  // Logical Minimum
+        logical_min = sign_extend(data, length);
+        break;
+      case 0x24:  // Logical Maximum
+        CHECK(sign_extend(data, length) >= logical_min);
+        break;
+      case 0xA0:  // Collection
+        if (depth == 0) {
+          CHECK_EQ(data, 0x01);  // Application
+          map->top_collections++;
+          report_id = 0;
+        }
+        depth++;
+        break;
+      case 0xC0:  // End Collection
+        CHECK(depth > 0);
+        depth--;
+        break;
+      case 0x80:  // Input
+      case 0x90:  // Output
+      case 0xB0:  // Feature
+        // With report IDs in use, every main item must belong to one.
+        CHECK(report_id != 0);
+        add_bits(map, report_id,
+                 item == 0x80 ? BLE_HID_REPORT_TYPE_INPUT
+                 : item == 0x90 ? BLE_HID_REPORT_TYPE_OUTPUT
+                                : BLE_HID_REPORT_TYPE_FEATURE,
+                 report_size * report_count);
+        break;
+      default:
+        break;
+    }
+  }
+  CHECK_EQ(pos, len);
+  CHECK_EQ(depth, 0);
+}
+
+static void test_report_sizes(void) {
+  const ble_gatt_span_t* span = &ble_hid_report_map_attr.span;
+  CHECK(span->len > 0);
+  parsed_map_t map;
+  parse(span->data, span->len, &map);
+
+  CHECK_EQ(map.top_collections, 5);
+  CHECK_EQ(map.num_reports, 6);
+  CHECK_EQ(report_bits(&map, BLE_HID_DEFAULT_REPORT_ID,
+                       BLE_HID_REPORT_TYPE_INPUT),
+           sizeof(ble_keyboard_report_t) * 8);
+  CHECK_EQ(report_bits(&map, BLE_HID_DEFAULT_REPORT_ID,
+                       BLE_HID_REPORT_TYPE_OUTPUT),
+           8);
+  CHECK_EQ(report_bits(&map, BLE_HID_NKRO_REPORT_ID, BLE_HID_REPORT_TYPE_INPUT),
+           sizeof(ble_keyboard_nkro_report_t) * 8);
+  CHECK_EQ(report_bits(&map, BLE_HID_MOUSE_REPORT_ID,
+                       BLE_HID_REPORT_TYPE_INPUT),
+           sizeof(ble_mouse_report_t) * 8);
+  CHECK_EQ(report_bits(&map, BLE_HID_CONSUMER_REPORT_ID,
+                       BLE_HID_REPORT_TYPE_INPUT),
+           sizeof(ble_consumer_report_t) * 8);
+  CHECK_EQ(report_bits(&map, BLE_HID_SYSTEM_REPORT_ID,
+                       BLE_HID_REPORT_TYPE_INPUT),
+           sizeof(ble_system_report_t) * 8);
+  printf("report map: %zu bytes, %zu reports\n", span->len, map.num_reports);
+}
+
+int main(void) {
+  RUN(test_report_sizes);
+  return 0;
+}
@@ -0,0 +1,171 @@
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include "ble_hid_report_queue.h"
+#include "test_util.h"
+
+#define STRESS_REPORTS 2000000u
+
+static ble_hid_report_queue_t queue;
+
+static bool push_seq(uint32_t seq) {
+  uint8_t data[8];
+  memset(data, (uint8_t)seq, sizeof(data));
+  memcpy(data, &seq, sizeof(seq));
+  return ble_hid_report_queue_push(&queue, (uint8_t)(seq % 5 + 1), data,
+                                   sizeof(data), seq);
+}
+
+static void check_seq(const ble_hid_queued_report_t* report, uint32_t seq) {
+  uint32_t got;
+  memcpy(&got, report->data, sizeof(got));
+  CHECK_EQ(got, seq);
+  CHECK_EQ(report->report_id, seq % 5 + 1);
+  CHECK_EQ(report->length, 8);
+  CHECK_EQ(report->enqueued_us, seq);
+  for (size_t i = sizeof(got); i < report->length; i++) {
+    CHECK_EQ(report->data[i], (uint8_t)seq);
+  }
+}
+
+static void test_empty(void) {
+  ble_hid_report_queue_init(&queue);
+  CHECK(ble_hid_report_queue_peek(&queue) == NULL);
+  CHECK(ble_hid_report_queue_peek_next(&queue) == NULL);
+  CHECK_EQ(ble_hid_report_queue_count(&queue), 0);
+}
+
+static void test_fifo_and_full(void) {
+  ble_hid_report_queue_init(&queue);
+  for (uint32_t i = 0; i < BLE_HID_REPORT_QUEUE_LEN; i++) {
+    CHECK(push_seq(i));
+  }
+  CHECK(!push_seq(BLE_HID_REPORT_QUEUE_LEN));
+  CHECK_EQ(ble_hid_report_queue_count(&queue), BLE_HID_REPORT_QUEUE_LEN);
+
+  check_seq(ble_hid_report_queue_peek_next(&queue), 1);
+  for (uint32_t i = 0; i < BLE_HID_REPORT_QUEUE_LEN; i++) {
+    check_seq(ble_hid_report_queue_peek(&queue), i);
+    ble_hid_report_queue_pop(&queue);
+  }
+  CHECK(ble_hid_report_queue_peek(&queue) == NULL);
+}
+
+static void test_rejects_oversized(void) {
+  uint8_t data[BLE_HID_REPORT_MAX_LEN + 1] = {0};
+  ble_hid_report_queue_init(&queue);
+  CHECK(!ble_hid_report_queue_push(&queue, 1, data, sizeof(data), 0));
+  CHECK(ble_hid_report_queue_push(&queue, 1, data, BLE_HID_REPORT_MAX_LEN, 0));
+}
+
+typedef struct sink_state {
+  uint32_t next;
+  uint32_t refuse_at;
+} sink_state_t;
+
+static int counting_sink(const ble_hid_queued_report_t* report, void* arg) {
+  sink_state_t* state = arg;
+  if (state->next == state->refuse_at) {
+    return 1;
+  }
+  check_seq(report, state->next++);
+  return 0;
+}
+
+static void test_drain_budget_and_refusal(void) {
+  ble_hid_report_queue_init(&queue);
+  for (uint32_t i = 0; i < 10; i++) {
+    CHECK(push_seq(i));
+  }
+
+  sink_state_t state = {.next = 0, .refuse_at = UINT32_MAX};
+  CHECK_EQ(ble_hid_report_queue_drain(&queue, 3, counting_sink, &state), 3);
+  CHECK_EQ(ble_hid_report_queue_count(&queue), 7);
+
+  // A refused report stays at the front for the next drain.
+  state.refuse_at = 5;
+  CHECK_EQ(ble_hid_report_queue_drain(&queue, 100, counting_sink, &state), 2);
+  check_seq(ble_hid_report_queue_peek(&queue), 5);
+
+  state.refuse_at = UINT32_MAX;
+  CHECK_EQ(ble_hid_report_queue_drain(&queue, 100, counting_sink, &state), 5);
+  CHECK_EQ(state.next, 10);
+}
+
+static void test_index_wrap(void) {
+  // Start the free-running indices just below the 32-bit wrap.
+  ble_hid_report_queue_init(&queue);
+  atomic_store(&queue.head, UINT32_MAX - 10);
+  atomic_store(&queue.tail, UINT32_MAX - 10);
+  for (uint32_t i = 0; i < 40; i++) {
+    CHECK(push_seq(i));
+  }
+  CHECK_EQ(ble_hid_report_queue_count(&queue), 40);
+  for (uint32_t i = 0; i < 40; i++) {
+    check_seq(ble_hid_report_queue_peek(&queue), i);
+    ble_hid_report_queue_pop(&queue);
+  }
+  CHECK_EQ(ble_hid_report_queue_count(&queue), 0);
+}
+
+static void* producer(void* arg) {
+  for (uint32_t seq = 0; seq < STRESS_REPORTS; seq++) {
+    while (!push_seq(seq)) {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static int stress_sink(const ble_hid_queued_report_t* report, void* arg) {
+  check_seq(report, (*(uint32_t*)arg)++);
+  return 0;
+}
+
+// One producer and one consumer thread, as with the typing task and the
+// host task: every report must arrive once, in order and intact.
+static void test_spsc_stress(void) {
+  ble_hid_report_queue_init(&queue);
+  pthread_t thread;
+  double start = test_now_s();
+  CHECK(pthread_create(&thread, NULL, producer, NULL) == 0);
+
+  uint32_t next = 0;
+  while (next < STRESS_REPORTS) {
+    if (ble_hid_report_queue_drain(&queue, BLE_HID_REPORT_QUEUE_LEN,
+                                   stress_sink, &next) == 0) {
+      sched_yield();
+    }
+  }
+  pthread_join(thread, NULL);
+  double elapsed = test_now_s() - start;
+
+  CHECK_EQ(ble_hid_report_queue_count(&queue), 0);
+  printf("bench spsc: %u reports in %.3f s, %.1f M reports/s\n",
+         STRESS_REPORTS, elapsed, STRESS_REPORTS / elapsed / 1e6);
+}
+
+// Uncontended cost of one push and one pop on the same thread.
+static void bench_push_pop(void) {
+  const uint32_t rounds = 10000000;
+  ble_hid_report_queue_init(&queue);
+  double start = test_now_s();
+  for (uint32_t i = 0; i < rounds; i++) {
+    push_seq(i);
+    ble_hid_report_queue_pop(&queue);
+  }
+  double elapsed = test_now_s() - start;
+  printf("bench push+pop: %.1f ns\n", elapsed / rounds * 1e9);
+}
+
+int main(void) {
+  RUN(test_empty);
+  RUN(test_fifo_and_full);
+  RUN(test_rejects_oversized);
+  RUN(test_drain_budget_and_refusal);
+  RUN(test_index_wrap);
+  RUN(test_spsc_stress);
+  bench_push_pop();
+  return 0;
+}
@@ -0,0 +1,485 @@
+#include <string.h>
+
+#include "sdkconfig.h"
+#include "test_util.h"
+#include "upload_rx.h"
+
+// Chunk payload at the preferred MTU, as BLE_UPLOAD_CHUNK_MAX.
+#define CHUNK (CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU - 3 - 2)
+#define IMAGE_MAX (96 * 1024)
+
+static uint8_t image[IMAGE_MAX];
+
+// Memory sink: writes must arrive in order, and the window opens only while
+// `ready` is set.
+typedef struct mem_sink {
+  uint8_t data[IMAGE_MAX];
+  uint32_t len;
+  uint32_t fail_at;  // offset whose write fails, UINT32_MAX for none
+  bool ready;
+  int window_checks;
+} mem_sink_t;
+
+static mem_sink_t mem;
+
+static int mem_write(uint32_t offset, const uint8_t* data, size_t len,
+                     void* arg) {
+  mem_sink_t* sink = arg;
+  CHECK_EQ(offset, sink->len);
+  CHECK(offset + len <= sizeof(sink->data));
+  if (offset == sink->fail_at) {
+    return -1;
+  }
+  memcpy(&sink->data[offset], data, len);
+  sink->len += len;
+  return 0;
+}
+
+static bool mem_window_ready(void* arg) {
+  mem_sink_t* sink = arg;
+  sink->window_checks++;
+  return sink->ready;
+}
+
+static const upload_sink_t sink = {
+    .write = mem_write,
+    .window_ready = mem_window_ready,
+    .arg = &mem,
+};
+
+static uint32_t rng_state;
+
+static uint32_t rng(void) {
+  rng_state = rng_state * 1664525u + 1013904223u;
+  return rng_state >> 8;
+}
+
+static void reset(uint32_t length, uint32_t seed) {
+  memset(&mem, 0, sizeof(mem));
+  mem.fail_at = UINT32_MAX;
+  mem.ready = true;
+  rng_state = seed;
+  for (uint32_t i = 0; i < length; i++) {
+    image[i] = (uint8_t)rng();
+  }
+}
+
+static size_t chunk_len(uint32_t length, uint32_t index) {
+  uint32_t offset = index * CHUNK;
+  return length - offset < CHUNK ? length - offset : CHUNK;
+}
+
+static bool send(upload_rx_t* rx, uint32_t length, uint32_t index,
+                 upload_reply_t* reply) {
+  return upload_rx_chunk(rx, (uint16_t)index, &image[index * CHUNK],
+                         chunk_len(length, index), &sink, reply);
+}
+
+static void check_reply(const upload_reply_t* reply, upload_status_t status,
+                        uint16_t next_seq, uint32_t received) {
+  CHECK_EQ(reply->status, status);
+  CHECK_EQ(reply->next_seq, next_seq);
+  CHECK_EQ(reply->received, received);
+}
+
+static void test_crc32(void) {
+  const uint8_t check[] = "123456789";
+  CHECK_EQ(upload_crc32(0, check, 9), 0xCBF43926);
+  CHECK_EQ(upload_crc32(0, NULL, 0), 0);
+
+  reset(4096, 3);
+  uint32_t whole = upload_crc32(0, image, 4096);
+  uint32_t split = upload_crc32(upload_crc32(0, image, 1000), image + 1000,
+                                4096 - 1000);
+  CHECK_EQ(whole, split);
+}
+
+// Clean link: an ACK every window, DONE with the last byte, and the bytes
+// land in the sink unchanged.
+static void test_in_order(void) {
+  const uint32_t length = 40 * CHUNK + 17;
+  reset(length, 1);
+  upload_rx_t rx;
+  upload_rx_begin(&rx, length, upload_crc32(0, image, length));
+
+  upload_reply_t reply;
+  for (uint32_t i = 0; i < 40; i++) {
+    bool replied = send(&rx, length, i, &reply);
+    CHECK_EQ(replied, (i + 1) % UPLOAD_RX_WINDOW == 0);
+    if (replied) {
+      check_reply(&reply, UPLOAD_STATUS_ACK, i + 1, (i + 1) * CHUNK);
+    }
+  }
+  CHECK(send(&rx, length, 40, &reply));
+  check_reply(&reply, UPLOAD_STATUS_DONE, 41, length);
+  CHECK(!rx.active);
+  CHECK_EQ(mem.len, length);
+  CHECK(memcmp(mem.data, image, length) == 0);
+
+  // Late chunks after the end get nothing.
+  CHECK(!send(&rx, length, 40, &reply));
+}
+
+// A lost chunk draws one NACK however much of the window follows it, and
+// the resend picks up where the gap was.
+static void test_gap(void) {
+  const uint32_t length = 32 * CHUNK;
+  reset(length, 2);
+  upload_rx_t rx;
+  upload_rx_begin(&rx, length, upload_crc32(0, image, length));
+
+  upload_reply_t reply;
+  for (uint32_t i = 0; i < 3; i++) {
+    CHECK(!send(&rx, length, i, &reply));
+  }
+  CHECK(send(&rx, length, 4, &reply));
+  check_reply(&reply, UPLOAD_STATUS_NACK, 3, 3 * CHUNK);
+  for (uint32_t i = 5; i < 16; i++) {
+    CHECK(!send(&rx, length, i, &reply));
+  }
+
+  // The window counts from the resync.
+  for (uint32_t i = 3; i < 3 + UPLOAD_RX_WINDOW - 1; i++) {
+    CHECK(!send(&rx, length, i, &reply));
+  }
+  CHECK(send(&rx, length, 3 + UPLOAD_RX_WINDOW - 1, &reply));
+  check_reply(&reply, UPLOAD_STATUS_ACK, 3 + UPLOAD_RX_WINDOW,
+              (3 + UPLOAD_RX_WINDOW) * CHUNK);
+  CHECK_EQ(mem.len, (3 + UPLOAD_RX_WINDOW) * CHUNK);
+}
+
+// Resent chunks that already arrived (a lost ACK) get one ACK telling the
+// sender where the receiver is.
+static void test_duplicates(void) {
+  const uint32_t length = 32 * CHUNK;
+  reset(length, 4);
+  upload_rx_t rx;
+  upload_rx_begin(&rx, length, upload_crc32(0, image, length));
+
+  upload_reply_t reply;
+  for (uint32_t i = 0; i < 10; i++) {
+    CHECK(!send(&rx, length, i, &reply));
+  }
+  CHECK(send(&rx, length, 4, &reply));
+  check_reply(&reply, UPLOAD_STATUS_ACK, 10, 10 * CHUNK);
+  for (uint32_t i = 5; i < 10; i++) {
+    CHECK(!send(&rx, length, i, &reply));
+  }
+  CHECK(!send(&rx, length, 10, &reply));
+  CHECK_EQ(mem.len, 11 * CHUNK);
+  CHECK(memcmp(mem.data, image, mem.len) == 0);
+}
+
+// Each resync reply can be lost as well: a sender that starts over from its
+// last ACK gets answered again rather than resending into silence.
+static void test_lost_resync(void) {
+  const uint32_t length = 64 * CHUNK;
+  reset(length, 8);
+  upload_rx_t rx;
+  upload_rx_begin(&rx, length, upload_crc32(0, image, length));
+
+  upload_reply_t reply;
+  for (uint32_t i = 0; i < 20; i++) {
+    send(&rx, length, i, &reply);
+  }
+  // The sender lost the ACK at 16 and times out, twice.
+  for (int round = 0; round < 2; round++) {
+    CHECK(send(&rx, length, 0, &reply));
+    check_reply(&reply, UPLOAD_STATUS_ACK, 20, 20 * CHUNK);
+    for (uint32_t i = 1; i < UPLOAD_RX_WINDOW; i++) {
+      CHECK(!send(&rx, length, i, &reply));
+    }
+  }
+
+  // Same for a gap: chunk 20 is lost, then the NACK.
+  for (uint32_t i = 21; i < 24; i++) {
+    CHECK_EQ(send(&rx, length, i, &reply), i == 21);
+  }
+  CHECK(send(&rx, length, 21, &reply));
+  check_reply(&reply, UPLOAD_STATUS_NACK, 20, 20 * CHUNK);
+  CHECK(!send(&rx, length, 20, &reply));
+  CHECK_EQ(rx.next_seq, 21);
+}
+
+// Sequence numbers wrap; only the distance to the next one expected counts.
+static void test_seq_wrap(void) {
+  const uint32_t length = 70000;
+  reset(length, 5);
+  upload_rx_t rx;
+  upload_rx_begin(&rx, length, upload_crc32(0, image, length));
+
+  upload_reply_t reply;
+  bool done = false;
+  for (uint32_t i = 0; i < length; i++) {
+    if (upload_rx_chunk(&rx, (uint16_t)i, &image[i], 1, &sink, &reply)) {
+      CHECK_EQ(reply.next_seq, (uint16_t)(i + 1));
+      done = reply.status == UPLOAD_STATUS_DONE;
+      CHECK(done || reply.status == UPLOAD_STATUS_ACK);
+    }
+  }
+  CHECK(done);
+  CHECK_EQ(rx.next_seq, (uint16_t)length);
+  CHECK(memcmp(mem.data, image, length) == 0);
+}
+
+static void test_errors(void) {
+  const uint32_t length = 3 * CHUNK;
+  upload_rx_t rx;
+  upload_reply_t reply;
+
+  reset(length, 6);
+  upload_rx_begin(&rx, length, upload_crc32(0, image, length));
+  CHECK(upload_rx_chunk(&rx, 0, image, 0, &sink, &reply));
+  check_reply(&reply, UPLOAD_STATUS_LENGTH_MISMATCH, 0, 0);
+  CHECK(!rx.active);
+
+  // Past the announced length.
+  reset(length, 6);
+  upload_rx_begin(&rx, length - 1, upload_crc32(0, image, length - 1));
+  CHECK(!send(&rx, length, 0, &reply));
+  CHECK(!send(&rx, length, 1, &reply));
+  CHECK(send(&rx, length, 2, &reply));
+  check_reply(&reply, UPLOAD_STATUS_LENGTH_MISMATCH, 2, 2 * CHUNK);
+  CHECK_EQ(mem.len, 2 * CHUNK);
+
+  reset(length, 6);
+  upload_rx_begin(&rx, length, upload_crc32(0, image, length) ^ 1);
+  CHECK(!send(&rx, length, 0, &reply));
+  CHECK(!send(&rx, length, 1, &reply));
+  CHECK(send(&rx, length, 2, &reply));
+  check_reply(&reply, UPLOAD_STATUS_CRC_MISMATCH, 3, length);
+
+  reset(length, 6);
+  mem.fail_at = CHUNK;
+  upload_rx_begin(&rx, length, upload_crc32(0, image, length));
+  CHECK(!send(&rx, length, 0, &reply));
+  CHECK(send(&rx, length, 1, &reply));
+  check_reply(&reply, UPLOAD_STATUS_WRITE_FAILED, 1, CHUNK);
+  CHECK(!rx.active);
+
+  reset(length, 6);
+  upload_rx_begin(&rx, length, upload_crc32(0, image, length));
+  CHECK(!send(&rx, length, 0, &reply));
+  CHECK(upload_rx_abort(&rx, &reply));
+  check_reply(&reply, UPLOAD_STATUS_ABORTED, 1, CHUNK);
+  CHECK(!upload_rx_abort(&rx, &reply));
+  CHECK(!send(&rx, length, 1, &reply));
+  CHECK(!upload_rx_poll(&rx, &sink, &reply));
+}
+
+// A sink without room holds the ACK back, and the sender with it, until a
+// poll finds the window open.
+static void test_held_reply(void) {
+  const uint32_t length = 64 * CHUNK;
+  reset(length, 7);
+  upload_rx_t rx;
+  upload_rx_begin(&rx, length, upload_crc32(0, image, length));
+
+  upload_reply_t reply;
+  CHECK(!upload_rx_poll(&rx, &sink, &reply));
+  mem.ready = false;
+  for (uint32_t i = 0; i < UPLOAD_RX_WINDOW; i++) {
+    CHECK(!send(&rx, length, i, &reply));
+  }
+  CHECK_EQ(mem.window_checks, 1);
+  CHECK(!upload_rx_poll(&rx, &sink, &reply));
+  mem.ready = true;
+  CHECK(upload_rx_poll(&rx, &sink, &reply));
+  check_reply(&reply, UPLOAD_STATUS_ACK, UPLOAD_RX_WINDOW,
+              UPLOAD_RX_WINDOW * CHUNK);
+  CHECK(!upload_rx_poll(&rx, &sink, &reply));
+
+  // A NACK waits for room the same way.
+  mem.ready = false;
+  CHECK(!send(&rx, length, UPLOAD_RX_WINDOW + 1, &reply));
+  mem.ready = true;
+  CHECK(upload_rx_poll(&rx, &sink, &reply));
+  check_reply(&reply, UPLOAD_STATUS_NACK, UPLOAD_RX_WINDOW,
+              UPLOAD_RX_WINDOW * CHUNK);
+}
+
+// Go-back-N sender against a link that drops chunks and replies. Time runs
+// in chunk slots; replies take `latency` slots to come back, and a sender
+// that hears nothing for `timeout` slots resends from its last ACK. Once
+// everything is sent, a timeout reads the progress characteristic, which
+// tells a lost DONE from a stalled session.
+typedef struct link_sim {
+  uint32_t chunk_loss_pm;  // per mille
+  uint32_t reply_loss_pm;
+  uint32_t latency;
+  uint32_t timeout;
+} link_sim_t;
+
+typedef struct link_stats {
+  uint32_t slots;
+  uint32_t chunks_sent;
+  uint32_t replies;
+  uint32_t timeouts;
+} link_stats_t;
+
+#define SIM_REPLIES_MAX 64
+
+static link_stats_t run_link(const link_sim_t* link, uint32_t length,
+                             uint32_t seed) {
+  reset(length, seed);
+  upload_rx_t rx;
+  upload_rx_begin(&rx, length, upload_crc32(0, image, length));
+
+  const uint32_t chunks = (length + CHUNK - 1) / CHUNK;
+  struct {
+    upload_reply_t reply;
+    uint32_t due;
+  } in_flight[SIM_REPLIES_MAX];
+  size_t in_flight_count = 0;
+
+  link_stats_t stats = {0};
+  uint32_t base = 0;  // first chunk not acknowledged
+  uint32_t next = 0;  // next chunk to send
+  uint32_t heard = 0;
+  bool done = false;
+  for (uint32_t now = 0; !done; now++) {
+    CHECK(now < 100 * chunks + 10000);
+
+    for (size_t i = 0; i < in_flight_count;) {
+      if (in_flight[i].due != now) {
+        i++;
+        continue;
+      }
+      upload_reply_t reply = in_flight[i].reply;
+      in_flight[i] = in_flight[--in_flight_count];
+      heard = now;
+
+      CHECK_EQ(reply.received % CHUNK == 0 || reply.received == length, 1);
+      uint32_t acked = (reply.received + CHUNK - 1) / CHUNK;
+      CHECK_EQ(reply.next_seq, (uint16_t)acked);
+      if (reply.status == UPLOAD_STATUS_DONE) {
+        done = true;
+      } else if (reply.status == UPLOAD_STATUS_NACK) {
+        base = next = acked;
+      } else {
+        CHECK_EQ(reply.status, UPLOAD_STATUS_ACK);
+        // A resync ACK can arrive after a newer one.
+        if (acked > base) {
+          base = acked;
+        }
+        if (next < base) {
+          next = base;
+        }
+      }
+    }
+    if (done) {
+      stats.slots = now;
+      break;
+    }
+
+    if (next < chunks && next - base < UPLOAD_RX_WINDOW) {
+      stats.chunks_sent++;
+      upload_reply_t reply;
+      if (rng() % 1000 >= link->chunk_loss_pm &&
+          send(&rx, length, next, &reply)) {
+        stats.replies++;
+        CHECK(reply.status == UPLOAD_STATUS_ACK ||
+              reply.status == UPLOAD_STATUS_NACK ||
+              reply.status == UPLOAD_STATUS_DONE);
+        if (rng() % 1000 >= link->reply_loss_pm) {
+          CHECK(in_flight_count < SIM_REPLIES_MAX);
+          in_flight[in_flight_count].reply = reply;
+          in_flight[in_flight_count].due = now + link->latency;
+          in_flight_count++;
+        }
+      }
+      next++;
+    } else if (now - heard >= link->timeout) {
+      stats.timeouts++;
+      heard = now;
+      if (!rx.active) {
+        // Progress says the session ended: only a lost DONE gets here.
+        CHECK_EQ(rx.received, length);
+        stats.slots = now;
+        done = true;
+      }
+      next = base;
+    }
+  }
+
+  CHECK(!rx.active);
+  CHECK_EQ(mem.len, length);
+  CHECK(memcmp(mem.data, image, length) == 0);
+  return stats;
+}
+
+static void test_lossy_link(void) {
+  const uint32_t length = IMAGE_MAX;
+  const uint32_t chunks = (length + CHUNK - 1) / CHUNK;
+
+  // Lossless: every chunk once, one reply per window.
+  link_sim_t clean = {.latency = 4, .timeout = 40};
+  link_stats_t stats = run_link(&clean, length, 11);
+  CHECK_EQ(stats.chunks_sent, chunks);
+  CHECK_EQ(stats.replies, (chunks + UPLOAD_RX_WINDOW - 1) / UPLOAD_RX_WINDOW);
+  CHECK_EQ(stats.timeouts, 0);
+
+  const uint32_t loss_pm[] = {10, 50, 200};
+  for (size_t i = 0; i < sizeof(loss_pm) / sizeof(loss_pm[0]); i++) {
+    link_sim_t link = {
+        .chunk_loss_pm = loss_pm[i],
+        .reply_loss_pm = loss_pm[i],
+        .latency = 4,
+        .timeout = 40,
+    };
+    const uint32_t runs = 20;
+    link_stats_t total = {0};
+    for (uint32_t seed = 1; seed <= runs; seed++) {
+      stats = run_link(&link, length, seed);
+      total.slots += stats.slots;
+      total.chunks_sent += stats.chunks_sent;
+      total.timeouts += stats.timeouts;
+    }
+    printf("lossy link %u/1000: %.0f chunks sent for %u, %.0f slots, "
+           "%.1f timeouts\n",
+           (unsigned)loss_pm[i], (double)total.chunks_sent / runs,
+           (unsigned)chunks, (double)total.slots / runs,
+           (double)total.timeouts / runs);
+    // Go-back-N resends up to a window per lost chunk or reply.
+    uint32_t losses = chunks * 2 * loss_pm[i] / 1000;
+    CHECK(total.chunks_sent / runs < chunks + UPLOAD_RX_WINDOW * losses);
+  }
+}
+
+static void bench_throughput(void) {
+  const uint32_t length = IMAGE_MAX;
+  const int rounds = 200;
+  reset(length, 9);
+  uint32_t crc = upload_crc32(0, image, length);
+  const uint32_t chunks = (length + CHUNK - 1) / CHUNK;
+
+  double start = test_now_s();
+  for (int r = 0; r < rounds; r++) {
+    mem.len = 0;
+    upload_rx_t rx;
+    upload_rx_begin(&rx, length, crc);
+    upload_reply_t reply = {0};
+    for (uint32_t i = 0; i < chunks; i++) {
+      send(&rx, length, i, &reply);
+    }
+    CHECK_EQ(reply.status, UPLOAD_STATUS_DONE);
+  }
+  double elapsed = test_now_s() - start;
+  printf("bench chunk: %.1f ns\n", elapsed / (rounds * chunks) * 1e9);
+  printf("bench throughput: %.1f MB/s\n",
+         (double)length * rounds / elapsed / 1e6);
+}
+
+int main(void) {
+  RUN(test_crc32);
+  RUN(test_in_order);
+  RUN(test_gap);
+  RUN(test_duplicates);
+  RUN(test_lost_resync);
+  RUN(test_seq_wrap);
+  RUN(test_errors);
+  RUN(test_held_reply);
+  RUN(test_lossy_link);
+  bench_throughput();
+  return 0;
+}
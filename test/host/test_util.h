@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Minimal assertions: the first failure prints its location and aborts the
+// test binary, which CTest reports as failed.
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, \
+              #cond);                                                 \
+      abort();                                                        \
+    }                                                                 \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                     \
+  do {                                                                     \
+    long long check_a = (long long)(a);                                    \
+    long long check_b = (long long)(b);                                    \
+    if (check_a != check_b) {                                              \
+      fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n",    \
+              __FILE__, __LINE__, #a, #b, check_a, check_b);               \
+      abort();                                                             \
+    }                                                                      \
+  } while (0)
+
+#define RUN(test)            \
+  do {                       \
+    test();                  \
+    printf("ok %s\n", #test); \
+  } while (0)
+
+static inline double test_now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
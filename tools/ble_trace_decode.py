@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""Decodes BLE_TRACE lines from a serial log into readable text.
+
+Usage: ble_trace_decode.py [log file]   (reads stdin when no file is given)
+
+Event names and formats come from main/ble_trace_events.h, so the decoder
+must be run against the same tree as the firmware that produced the dump.
+"""
+
+import argparse
+import pathlib
+import re
+import struct
+import sys
+
+EVENTS_HEADER = (pathlib.Path(__file__).resolve().parent.parent / "main" /
+                 "ble_trace_events.h")
+
+# Matches ble_trace_record_t: timestamp_us, event, seq, args[3].
+RECORD = struct.Struct("<IHH3I")
+
+EVENT_RE = re.compile(r'^BLE_TRACE_EVENT\((\w+),\s*"([^"]*)"\)', re.M)
+LINE_RE = re.compile(r"BLE_TRACE (\d+) ([0-9a-f]{%d})" % (RECORD.size * 2))
+SPEC_RE = re.compile(r"%[-0-9]*[a-z]")
+
+
+def load_events(path):
+    return EVENT_RE.findall(path.read_text())
+
+
+def format_args(fmt, args):
+    values = []
+    for spec, arg in zip(SPEC_RE.findall(fmt), args):
+        if spec.endswith("d") and arg >= 1 << 31:
+            arg -= 1 << 32
+        values.append(arg)
+    return fmt % tuple(values)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", nargs="?", type=argparse.FileType("r"),
+                        default=sys.stdin)
+    parser.add_argument("--events", type=pathlib.Path, default=EVENTS_HEADER)
+    args = parser.parse_args()
+
+    events = load_events(args.events)
+    records = []
+    for line in args.log:
+        match = LINE_RE.search(line)
+        if match is None:
+            continue
+        core = int(match.group(1))
+        timestamp, event, seq, *values = RECORD.unpack(
+            bytes.fromhex(match.group(2)))
+        records.append((timestamp, core, seq, event, values))
+
+    records.sort()
+    for timestamp, core, seq, event, values in records:
+        if event < len(events):
+            name, fmt = events[event]
+            text = format_args(fmt, values)
+        else:
+            name, text = "UNKNOWN_%d" % event, " ".join(map(str, values))
+        print("%10.6f core%d #%-5d %-24s %s" %
+              (timestamp / 1e6, core, seq, name, text))
+
+
+if __name__ == "__main__":
+    main()